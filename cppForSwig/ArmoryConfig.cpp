@@ -90,6 +90,10 @@ void Armory::Config::printHelp(void)
 --zcthread-count           defines the maximum number on threads the zc parser
                            can create for processing incoming transcations from
                            the network node
+--blkfile-window           stream block files during scans with explicit
+                           readahead, keeping at most this many files resident
+                           in RAM. Defaults to 0 (map whole files, rely on the
+                           page cache). Can be changed in between processes
 --db-type                  sets the db type:
                            DB_BARE:  tracks wallet history only. Smallest DB.
                            DB_FULL:  tracks wallet history and resolves all
@@ -102,6 +106,19 @@ void Armory::Config::printHelp(void)
                            always function according to that type.
                            Specifying another type will do nothing. Build a new
                            db to change type.
+--db-shards                DB_SUPER only: splits the ssh, subssh and spentness
+                           dbs across this many files, each with its own writer.
+                           Defaults to 1 (single file). Only applies to new
+                           dbs, existing dbs keep the count they were built with
+--replica                  DB_SUPER only: opens the dbs in --dbdir read only and
+                           follows the top block scanned by the db process that
+                           builds them. Does not parse block files, scan or
+                           track zero conf
+--build-budget             DB_SUPER only: runs the initial build for at most this
+                           many minutes then exits, like --checkchain, instead of
+                           serving. The build stops at its next checkpoint and
+                           the next run resumes from there. Exits with 75 while
+                           the build isn't done, 0 once it is
 --cookie                   create a cookie file holding a random authentication
                            key to allow local clients to make use of elevated
                            commands, like shutdown. Client and server will make
@@ -508,10 +525,14 @@ SOCKET_SERVICE DBSettings::service_ = SERVICE_WEBSOCKET;
 unsigned DBSettings::ramUsage_ = 4;
 unsigned DBSettings::threadCount_ = thread::hardware_concurrency();
 unsigned DBSettings::zcThreadCount_ = DEFAULT_ZCTHREAD_COUNT;
+unsigned DBSettings::blkFileWindow_ = 0;
+unsigned DBSettings::dbShardCount_ = 1;
+unsigned DBSettings::buildBudget_ = 0;
 
 bool DBSettings::reportProgress_ = true;
 bool DBSettings::checkChain_ = false;
 bool DBSettings::clearMempool_ = false;
+bool DBSettings::replica_ = false;
 
 ////////////////////////////////////////////////////////////////////////////////
 void DBSettings::processArgs(const map<string, string>& args)
@@ -537,6 +558,10 @@ void DBSettings::processArgs(const map<string, string>& args)
    if (iter != args.end())
       clearMempool_ = true;
 
+   iter = args.find("replica");
+   if (iter != args.end())
+      replica_ = true;
+
    //db type
    iter = args.find("db-type");
    if (iter != args.end())
@@ -610,6 +635,61 @@ void DBSettings::processArgs(const map<string, string>& args)
       if (val > 0)
          zcThreadCount_ = val;
    }
+
+   iter = args.find("blkfile-window");
+   if (iter != args.end())
+   {
+      int val = 0;
+      try
+      {
+         val = stoi(iter->second);
+      }
+      catch (...)
+      {
+      }
+
+      if (val >= 0)
+         blkFileWindow_ = val;
+   }
+
+   iter = args.find("db-shards");
+   if (iter != args.end())
+   {
+      int val = 0;
+      try
+      {
+         val = stoi(iter->second);
+      }
+      catch (...)
+      {
+      }
+
+      if (val > 0)
+         dbShardCount_ = val;
+   }
+
+   iter = args.find("build-budget");
+   if (iter != args.end())
+   {
+      int val = 0;
+      try
+      {
+         val = stoi(iter->second);
+      }
+      catch (...)
+      {
+      }
+
+      if (val > 0)
+         buildBudget_ = val;
+   }
+
+   //fullnode registers new addresses by scanning, replicas can't write
+   if (replica_ && armoryDbType_ != ARMORY_DB_SUPER)
+      throw runtime_error("--replica requires --db-type=DB_SUPER");
+
+   if (buildBudget_ > 0 && (armoryDbType_ != ARMORY_DB_SUPER || replica_))
+      throw runtime_error("--build-budget requires --db-type=DB_SUPER");
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -653,10 +733,14 @@ void DBSettings::reset()
    ramUsage_ = 4;
    threadCount_ = thread::hardware_concurrency();
    zcThreadCount_ = DEFAULT_ZCTHREAD_COUNT;
+   blkFileWindow_ = 0;
+   dbShardCount_ = 1;
+   buildBudget_ = 0;
 
    reportProgress_ = true;  
    checkChain_ = false;
    clearMempool_ = false;
+   replica_ = false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
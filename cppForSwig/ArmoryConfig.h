@@ -122,10 +122,14 @@ namespace Armory
          static unsigned ramUsage_;
          static unsigned threadCount_;
          static unsigned zcThreadCount_;
+         static unsigned blkFileWindow_;
+         static unsigned dbShardCount_;
+         static unsigned buildBudget_;
 
          static bool reportProgress_;
          static bool checkChain_;
          static bool clearMempool_;
+         static bool replica_;
 
       private:
          static void processArgs(const std::map<std::string, std::string>&);
@@ -153,10 +157,14 @@ namespace Armory
          static unsigned threadCount(void) { return threadCount_; }
          static unsigned ramUsage(void) { return ramUsage_; }
          static unsigned zcThreadCount(void) { return zcThreadCount_; }
+         static unsigned blkFileWindow(void) { return blkFileWindow_; }
+         static unsigned dbShardCount(void) { return dbShardCount_; }
+         static unsigned buildBudget(void) { return buildBudget_; }
 
          static bool checkChain(void) { return checkChain_; }
          static BDM_INIT_MODE initMode(void) { return initMode_; }
          static bool clearMempool(void) { return clearMempool_; }
+         static bool isReplica(void) { return replica_; }
          static bool reportProgress(void) { return reportProgress_; }
       };
 
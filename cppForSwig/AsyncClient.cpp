@@ -729,12 +729,14 @@ AsyncClient::BtcWallet::BtcWallet(const BlockDataViewer& bdv, const string& id)
 
 ///////////////////////////////////////////////////////////////////////////////
 string AsyncClient::BtcWallet::registerAddresses(
-   const vector<BinaryData>& addrVec, bool isNew)
+   const vector<BinaryData>& addrVec, bool isNew, unsigned scanFrom)
 {
    auto payload = BlockDataViewer::make_payload(Methods::registerWallet);
    auto command = dynamic_cast<BDVCommand*>(payload->message_.get());
    command->set_flag(isNew);
    command->set_walletid(walletID_);
+   if (scanFrom > 0)
+      command->set_height(scanFrom);
 
    auto&& registrationId = 
       BtcUtils::fortuna_.generateRandom(REGISTER_ID_LENGH).toHexStr();
@@ -956,12 +958,14 @@ void Lockbox::getBalancesAndCountFromDB(uint32_t topBlockHeight)
 
 ///////////////////////////////////////////////////////////////////////////////
 string AsyncClient::Lockbox::registerAddresses(
-   const vector<BinaryData>& addrVec, bool isNew)
+   const vector<BinaryData>& addrVec, bool isNew, unsigned scanFrom)
 {
    auto payload = BlockDataViewer::make_payload(Methods::registerLockbox);
    auto command = dynamic_cast<BDVCommand*>(payload->message_.get());
    command->set_flag(isNew);
    command->set_walletid(walletID_);
+   if (scanFrom > 0)
+      command->set_height(scanFrom);
    
    auto&& registrationId = 
       BtcUtils::fortuna_.generateRandom(REGISTER_ID_LENGH).toHexStr();
@@ -316,7 +316,8 @@ namespace AsyncClient
          uint64_t, uint64_t, uint64_t, uint32_t);
 
       virtual std::string registerAddresses(
-         const std::vector<BinaryData>& addrVec, bool isNew);
+         const std::vector<BinaryData>& addrVec, bool isNew,
+         unsigned scanFrom = 0);
       std::string unregisterAddresses(const std::set<BinaryData>&);
       std::string unregister(void);
 
@@ -351,7 +352,8 @@ namespace AsyncClient
       uint64_t getWltTotalTxnCount(void) const { return txnCount_; }
  
       std::string registerAddresses(
-         const std::vector<BinaryData>& addrVec, bool isNew);
+         const std::vector<BinaryData>& addrVec, bool isNew,
+         unsigned scanFrom = 0);
    };
 
    /////////////////////////////////////////////////////////////////////////////
@@ -1494,9 +1494,9 @@ BDVCommandProcessingResultType BDV_Server_Object::processCommand(
 
       map<BinaryDataRef, map<unsigned, SpentnessResult>> spenderMap;
       {
-         //grab all spentness data for these outputs
-         auto&& spentness_tx = db_->beginTransaction(SPENTNESS, LMDB::ReadOnly);
-
+         //parse the requested outputs
+         vector<BinaryDataRef> txHashes;
+         vector<vector<unsigned>> txOutIndices;
          for (int i = 0; i < command->bindata_size(); i++)
          {
             auto& rawOutputs = command->bindata(i);
@@ -1504,11 +1504,24 @@ BDVCommandProcessingResultType BDV_Server_Object::processCommand(
                throw runtime_error("malformed output data");
 
             BinaryRefReader brr((const uint8_t*)rawOutputs.c_str(), rawOutputs.size());
-            auto txHashRef = brr.get_BinaryDataRef(32);
-            auto& opMap = spenderMap[txHashRef];
+            txHashes.push_back(brr.get_BinaryDataRef(32));
 
-            //get dbkey for this txhash
-            auto&& dbkey = db_->getDBKeyForHash(txHashRef);
+            vector<unsigned> indices;
+            auto outputCount = brr.get_var_int();
+            for (unsigned y = 0; y < outputCount; y++)
+               indices.push_back((uint32_t)brr.get_var_int());
+            txOutIndices.emplace_back(move(indices));
+         }
+
+         //get dbkeys for all txhashes
+         auto&& dbkeys = db_->getDBKeysForHashes(txHashes);
+
+         vector<BinaryData> spentnessKeys;
+         vector<SpentnessResult*> spentnessResults;
+         for (unsigned i = 0; i < txHashes.size(); i++)
+         {
+            auto& opMap = spenderMap[txHashes[i]];
+            auto& dbkey = dbkeys[i];
 
             //convert id to block height and setup stxo
             StoredTxOut stxo;
@@ -1526,35 +1539,40 @@ BDVCommandProcessingResultType BDV_Server_Object::processCommand(
             }
             
             //run through txout indices
-            auto outputCount = brr.get_var_int();
-            for (unsigned y = 0; y < outputCount; y++)
+            for (auto& txOutIndex : txOutIndices[i])
             {
-               const unsigned txOutIndex = (uint32_t)brr.get_var_int();
                auto opInsertIter = opMap.insert(make_pair(
                   txOutIndex, SpentnessResult()));
                if (dbkey.getSize() == 0 || !opInsertIter.second)
                   continue;
 
+               if (db_->getDbType() != ARMORY_DB_SUPER)
+                  throw runtime_error("need to implement this for full node");
+
                //set txout index
                stxo.txOutIndex_ = txOutIndex;
-             
-               //get spentness for index
-               db_->getSpentness(stxo);
+               spentnessKeys.emplace_back(stxo.getSpentnessKey());
+               spentnessResults.push_back(&opInsertIter.first->second);
+            }
+         }
 
-               //add to the result vector
-               if (stxo.isSpent())
-               {
-                  opInsertIter.first->second.state_ = 
-                     OutputSpentnessState::Spent;
-                  
-                  opInsertIter.first->second.spender_ = 
-                     stxo.spentByTxInKey_;
-               }
-               else
-               {
-                  opInsertIter.first->second.state_ = 
-                     OutputSpentnessState::Unspent;
-               }
+         //grab all spentness data for these outputs in one go
+         vector<BinaryDataRef> spentnessRefs(
+            spentnessKeys.begin(), spentnessKeys.end());
+         auto&& spentness_tx = db_->beginTransaction(SPENTNESS, LMDB::ReadOnly);
+         auto&& spentnessVals = db_->multiGet(SPENTNESS, spentnessRefs);
+
+         for (unsigned i = 0; i < spentnessVals.size(); i++)
+         {
+            auto result = spentnessResults[i];
+            if (spentnessVals[i].getSize() != 0)
+            {
+               result->state_ = OutputSpentnessState::Spent;
+               result->spender_ = spentnessVals[i];
+            }
+            else
+            {
+               result->state_ = OutputSpentnessState::Unspent;
             }
          }
       }
@@ -1914,10 +1932,18 @@ void BDV_Server_Object::init()
       //create address batch
       auto batch = make_shared<RegistrationBatch>();
       batch->isNew_ = false;
+      batch->scanFrom_ = UINT32_MAX;
 
       //fill with addresses from protobuf payloads
       for (auto& wlt : wltMap)
       {
+         //the batch is scanned from the lowest height any wallet asks for
+         unsigned wltScanFrom = 0;
+         if (wlt.second.command_->has_height())
+            wltScanFrom = wlt.second.command_->height();
+         if (wltScanFrom < batch->scanFrom_)
+            batch->scanFrom_ = wltScanFrom;
+
          for (int i = 0; i < wlt.second.command_->bindata_size(); i++)
          {
             auto& addrStr = wlt.second.command_->bindata(i);
@@ -54,6 +54,7 @@ namespace DBTestUtils
 {
    std::tuple<std::shared_ptr<::Codec_BDVCommand::BDVCallback>, unsigned> waitOnSignal(
       Clients*, const std::string&, ::Codec_BDVCommand::NotificationType);
+   void holdNotifications(Clients*, const std::string&, bool);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -140,6 +141,8 @@ class BDV_Server_Object : public BlockDataViewer
    friend std::tuple<std::shared_ptr<::Codec_BDVCommand::BDVCallback>, unsigned>
       DBTestUtils::waitOnSignal(
       Clients*, const std::string&, ::Codec_BDVCommand::NotificationType);
+   friend void DBTestUtils::holdNotifications(
+      Clients*, const std::string&, bool);
 
 private: 
    std::atomic<unsigned> started_;
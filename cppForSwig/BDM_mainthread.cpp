@@ -13,6 +13,7 @@
 
 #include "BDM_mainthread.h"
 #include "BlockUtils.h"
+#include "DatabaseBuilder.h"
 #include "BlockDataViewer.h"
 
 #include "nodeRPC.h"
@@ -115,6 +116,65 @@ try
       }
    };
 
+   tuple<BDMPhase, double, unsigned, unsigned> lastvalues;
+
+   const auto loadProgress
+      = [&](BDMPhase phase, double prog, unsigned time, unsigned numericProgress)
+   {
+      //pass empty walletID for main build&scan calls
+      auto&& notifPtr = make_unique<BDV_Notification_Progress>(
+         phase, prog, time, numericProgress, vector<string>());
+
+      bdm->notificationStack_.push_back(move(notifPtr));
+   };
+
+   if (DBSettings::isReplica())
+   {
+      //replicas never touch the node nor the db, they follow the
+      //primary's scanned top
+      bdm->doInitialSyncOnLoad_Replica(loadProgress);
+      isReadyPromise.set_value(true);
+
+      while (pimpl->run)
+      {
+         for (unsigned i = 0; i < REPLICA_POLL_INTERVAL_MS / 100; i++)
+         {
+            if (!pimpl->run)
+               return;
+            this_thread::sleep_for(chrono::milliseconds(100));
+         }
+
+         Blockchain::ReorganizationState reorgState;
+         try
+         {
+            reorgState = bdm->readReplicaUpdate();
+         }
+         catch (exception& e)
+         {
+            LOGWARN << "replica update failed with error: " << e.what();
+            continue;
+         }
+
+         if (!reorgState.hasNewTop_)
+            continue;
+
+         stringstream ss;
+         ss << "replica found new top!" << endl;
+         ss << "  hash: " << reorgState.newTop_->getThisHash().toHexStr() << endl;
+         ss << "  height: " << reorgState.newTop_->getBlockHeight();
+         LOGINFO << ss.str();
+
+         //no zc on replicas, nothing to purge
+         auto&& notifPtr =
+            make_unique<BDV_Notification_NewBlock>(
+               move(reorgState), nullptr);
+         bdm->triggerOneTimeHooks(notifPtr.get());
+         bdm->notificationStack_.push_back(move(notifPtr));
+      }
+
+      return;
+   }
+
    //connect to node as async, no need to wait for a succesful connection
    //to init the DB
    bdm->processNode_->connectToNode(true);
@@ -131,55 +191,63 @@ try
       LOGINFO << "Message: " << e.what();
    }
 
-   tuple<BDMPhase, double, unsigned, unsigned> lastvalues;
-
-   const auto loadProgress
-      = [&](BDMPhase phase, double prog, unsigned time, unsigned numericProgress)
-   {
-      //pass empty walletID for main build&scan calls
-      auto&& notifPtr = make_unique<BDV_Notification_Progress>(
-         phase, prog, time, numericProgress, vector<string>());
-
-      bdm->notificationStack_.push_back(move(notifPtr));
-   };
-
    unsigned mode = pimpl->mode & 0x00000003;
    bool clearZc = DBSettings::clearMempool();
 
-   switch (mode)
+   try
    {
-   case 0:
-      bdm->doInitialSyncOnLoad(loadProgress);
-      break;
+      //the initial scan is a single write section
+      DbWriteGate::Section writeSection(bdm->getIFace()->writeGate());
+      switch (mode)
+      {
+      case 0:
+         bdm->doInitialSyncOnLoad(loadProgress);
+         break;
 
-   case 1:
-      bdm->doInitialSyncOnLoad_Rescan(loadProgress);
-      break;
+      case 1:
+         bdm->doInitialSyncOnLoad_Rescan(loadProgress);
+         break;
 
-   case 2:
-      bdm->doInitialSyncOnLoad_Rebuild(loadProgress);
-      break;
+      case 2:
+         bdm->doInitialSyncOnLoad_Rebuild(loadProgress);
+         break;
 
-   case 3:
-      bdm->doInitialSyncOnLoad_RescanBalance(loadProgress);
-      break;
+      case 3:
+         bdm->doInitialSyncOnLoad_RescanBalance(loadProgress);
+         break;
 
-   default:
-      throw runtime_error("invalid bdm init mode");
+      default:
+         throw runtime_error("invalid bdm init mode");
+      }
+   }
+   catch (BuildPausedException&)
+   {
+      LOGINFO << "build budget spent, run again to resume the build";
+      pimpl->buildPaused = true;
+      return;
    }
 
-   if (!DBSettings::checkChain())
+   //budgeted builds exit once done, like chain checks
+   bool buildOnly = 
+      DBSettings::checkChain() || DBSettings::buildBudget() > 0;
+
+   if (!buildOnly)
       bdm->enableZeroConf(clearZc);
 
    isReadyPromise.set_value(true);
 
-   if (DBSettings::checkChain())
+   if (buildOnly)
       return;
 
    auto updateChainLambda = [bdm, this]()->void
    {
       LOGINFO << "readBlkFileUpdate";
-      auto reorgState = bdm->readBlkFileUpdate();
+      Blockchain::ReorganizationState reorgState;
+      {
+         //snapshots wait for the update to land
+         DbWriteGate::Section writeSection(bdm->getIFace()->writeGate());
+         reorgState = bdm->readBlkFileUpdate();
+      }
       if (reorgState.hasNewTop_)
       {            
          //purge zc container
@@ -41,6 +41,10 @@ public:
 
 // let an outsider call functions from the BDM thread
 
+// exit status of a process that spent its --build-budget before the
+// initial build was done (EX_TEMPFAIL), a finished build exits with 0
+#define BUILD_PAUSED_EXIT_CODE 75
+
 class BDMFailure : public std::exception
 {
 public:
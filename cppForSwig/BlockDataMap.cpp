@@ -8,10 +8,15 @@
 
 #include "BlockDataMap.h"
 #include "BtcUtils.h"
+#include "Hash256Batch.h"
 #include "TxHashFilters.h"
 
+#include <algorithm>
+
 #ifndef _WIN32
 #include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 using namespace std;
@@ -21,11 +26,239 @@ BlockData::BlockData(uint32_t blockid)
    : uniqueID_(blockid)
 {}
 
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// OffsetArena
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+OffsetAndSize* OffsetArena::allocate(size_t count)
+{
+   if (count == 0)
+      return nullptr;
+
+   unique_lock<mutex> lock(mu_);
+
+   //oversized requests get a chunk of their own
+   if (count > chunkSize_)
+   {
+      chunks_.emplace_back(new OffsetAndSize[count]);
+      return chunks_.back().get();
+   }
+
+   if (chunkUsed_ + count > chunkSize_)
+   {
+      chunks_.emplace_back(new OffsetAndSize[chunkSize_]);
+      current_ = chunks_.back().get();
+      chunkUsed_ = 0;
+   }
+
+   auto ptr = current_ + chunkUsed_;
+   chunkUsed_ += count;
+   return ptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// BCTX
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+BCTX::BCTX(const BCTX& rhs) :
+   txHash_(rhs.txHash_), ownedOffsets_(rhs.ownedOffsets_),
+   ownsOffsets_(rhs.ownsOffsets_), offsetsStart_(rhs.offsetsStart_),
+   witnessOffset_(rhs.witnessOffset_),
+   data_(rhs.data_), size_(rhs.size_),
+   version_(rhs.version_), lockTime_(rhs.lockTime_),
+   usesWitness_(rhs.usesWitness_),
+   txins_(rhs.txins_), txouts_(rhs.txouts_),
+   isCoinbase_(rhs.isCoinbase_)
+{
+   //copied offsets need the ranges pointed at the new buffer
+   if (ownsOffsets_)
+      bindOffsets(ownedOffsets_.data());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BCTX::BCTX(BCTX&& rhs) noexcept :
+   txHash_(move(rhs.txHash_)), ownedOffsets_(move(rhs.ownedOffsets_)),
+   ownsOffsets_(rhs.ownsOffsets_), offsetsStart_(rhs.offsetsStart_),
+   witnessOffset_(rhs.witnessOffset_),
+   data_(rhs.data_), size_(rhs.size_),
+   version_(rhs.version_), lockTime_(rhs.lockTime_),
+   usesWitness_(rhs.usesWitness_),
+   txins_(rhs.txins_), txouts_(rhs.txouts_),
+   isCoinbase_(rhs.isCoinbase_)
+{
+   if (ownsOffsets_)
+      bindOffsets(ownedOffsets_.data());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BCTX BCTX::parseUnbound(const uint8_t* data, size_t len,
+   vector<OffsetAndSize>& offsets, unsigned id)
+{
+   BinaryRefReader brr(data, len);
+   if (brr.getSizeRemaining() < 4)
+      throw BlockDeserializingException();
+   brr.advance(4);
+
+   // Get marker and flag if transaction uses segwit
+   auto usesWitness = BtcUtils::checkSwMarker(brr.getCurrPtr());
+   if (usesWitness)
+      brr.advance(2);
+
+   auto offsetsStart = offsets.size();
+
+   auto nIn = (size_t)brr.get_var_int();
+   for (size_t i = 0; i < nIn; i++)
+   {
+      auto txinLen = BtcUtils::TxInCalcLength(
+         brr.getCurrPtr(), brr.getSizeRemaining());
+      offsets.emplace_back(brr.getPosition(), txinLen);
+      brr.advance(txinLen);
+   }
+
+   auto nOut = (size_t)brr.get_var_int();
+   for (size_t i = 0; i < nOut; i++)
+   {
+      auto txoutLen = BtcUtils::TxOutCalcLength(
+         brr.getCurrPtr(), brr.getSizeRemaining());
+      offsets.emplace_back(brr.getPosition(), txoutLen);
+      brr.advance(txoutLen);
+   }
+
+   //skip the witness data, consumers that need it walk it again
+   auto witnessOffset = brr.getPosition();
+   if (usesWitness)
+   {
+      for (size_t i = 0; i < nIn; i++)
+      {
+         brr.advance(BtcUtils::TxWitnessCalcLength(
+            brr.getCurrPtr(), brr.getSizeRemaining()));
+      }
+   }
+
+   auto lockTime = brr.get_uint32_t();
+
+   BCTX tx(data, brr.getPosition());
+   tx.version_ = READ_UINT32_LE(data);
+   tx.lockTime_ = lockTime;
+   tx.usesWitness_ = usesWitness;
+   tx.witnessOffset_ = witnessOffset;
+   tx.offsetsStart_ = offsetsStart;
+   tx.txins_.size_ = nIn;
+   tx.txouts_.size_ = nOut;
+
+   if (id != UINT32_MAX)
+   {
+      tx.isCoinbase_ = (id == 0);
+   }
+   else if (nIn == 1)
+   {
+      BinaryDataRef bdr(data + offsets[offsetsStart].first, 32);
+      if (bdr == BtcUtils::EmptyHash_)
+         tx.isCoinbase_ = true;
+   }
+
+   return tx;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BCTX::bindOffsets(const OffsetAndSize* base)
+{
+   txins_.ptr_ = base + offsetsStart_;
+   txouts_.ptr_ = txins_.ptr_ + txins_.size_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<BCTX> BCTX::parse(const uint8_t* data, size_t len, unsigned id)
+{
+   vector<OffsetAndSize> offsets;
+   auto txPtr = make_shared<BCTX>(parseUnbound(data, len, offsets, id));
+
+   txPtr->ownedOffsets_ = move(offsets);
+   txPtr->ownsOffsets_ = true;
+   txPtr->bindOffsets(txPtr->ownedOffsets_.data());
+
+   return txPtr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<OffsetAndSize> BCTX::getWitnessOffsets() const
+{
+   vector<OffsetAndSize> result;
+   if (!usesWitness_)
+      return result;
+
+   BinaryRefReader brr(data_, size_);
+   brr.advance(witnessOffset_);
+
+   result.reserve(txins_.size());
+   for (size_t i = 0; i < txins_.size(); i++)
+   {
+      auto witnessLen = BtcUtils::TxWitnessCalcLength(
+         brr.getCurrPtr(), brr.getSizeRemaining());
+      result.emplace_back(brr.getPosition(), witnessLen);
+      brr.advance(witnessLen);
+   }
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BCTX::computeHashes(const vector<BCTX*>& txns)
+{
+   vector<BinaryDataRef> preimages;
+   preimages.reserve(txns.size());
+
+   //witness stripped copies, only needs to outlive the hashing call
+   deque<BinaryData> noWitData;
+
+   vector<unsigned> txIds;
+   txIds.reserve(txns.size());
+
+   for (unsigned i = 0; i < txns.size(); i++)
+   {
+      auto& txn = txns[i];
+      if (txn->txHash_.getSize() != 0)
+         continue;
+
+      if (txn->usesWitness_)
+      {
+         noWitData.emplace_back();
+         preimages.push_back(txn->getHashPreimage(noWitData.back()));
+      }
+      else
+      {
+         preimages.emplace_back(txn->data_, txn->size_);
+      }
+
+      txIds.push_back(i);
+   }
+
+   if (preimages.size() == 0)
+      return;
+
+   BinaryData digests(preimages.size() * 32);
+   Hash256Batch::getHash256(
+      preimages.data(), preimages.size(), digests.getPtr());
+
+   for (unsigned i = 0; i < txIds.size(); i++)
+   {
+      txns[txIds[i]]->txHash_ = BinaryData(
+         digests.getPtr() + i * 32, 32);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// BlockData
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 shared_ptr<BlockData> BlockData::deserialize(const uint8_t* data, size_t size,
    const shared_ptr<BlockHeader> blockHeader,
    function<unsigned int(const BinaryData&)> getID, 
-   bool checkMerkle, bool keepHashes)
+   bool checkMerkle, bool keepHashes, shared_ptr<OffsetArena> arena)
 {
    //deser header from raw block and run a quick sanity check
    if (size < HEADER_SIZE)
@@ -59,15 +292,43 @@ shared_ptr<BlockData> BlockData::deserialize(const uint8_t* data, size_t size,
          "tx count mismatch in deser header");
    }
 
+   //offsets are parsed into a per thread buffer first, then moved to their
+   //final location in one go once the block's total count is known
+   thread_local vector<OffsetAndSize> offsetBuffer;
+   offsetBuffer.clear();
+
+   //numTx comes from the raw data, don't trust it for the reservation
+   result->txStorage_.reserve(min<size_t>(numTx, size / 60));
+
    for (unsigned i = 0; i < numTx; i++)
    {
       //light tx deserialization, just figure out the offset and size of
       //txins and txouts
-      auto tx = BCTX::parse(brr);
-      brr.advance(tx->size_);
+      result->txStorage_.emplace_back(BCTX::parseUnbound(
+         brr.getCurrPtr(), brr.getSizeRemaining(), offsetBuffer));
+      brr.advance(result->txStorage_.back().size_);
+   }
 
-      //move it to BlockData object vector
-      result->txns_.push_back(move(tx));
+   const OffsetAndSize* offsetsPtr = nullptr;
+   if (arena != nullptr)
+   {
+      auto arenaPtr = arena->allocate(offsetBuffer.size());
+      copy(offsetBuffer.begin(), offsetBuffer.end(), arenaPtr);
+
+      offsetsPtr = arenaPtr;
+      result->arena_ = arena;
+   }
+   else
+   {
+      result->offsets_ = offsetBuffer;
+      offsetsPtr = result->offsets_.data();
+   }
+
+   result->txns_.reserve(result->txStorage_.size());
+   for (auto& tx : result->txStorage_)
+   {
+      tx.bindOffsets(offsetsPtr);
+      result->txns_.push_back(&tx);
    }
 
    result->data_ = data;
@@ -77,6 +338,8 @@ shared_ptr<BlockData> BlockData::deserialize(const uint8_t* data, size_t size,
       return result;
 
    //let's check the merkle root
+   BCTX::computeHashes(result->txns_);
+
    vector<BinaryData> allhashes;
    for (auto& txn : result->txns_)
    {
@@ -186,9 +449,12 @@ const string& BlockFiles::getLastFileName(void) const
 }
 
 /////////////////////////////////////////////////////////////////////////////
-BlockDataLoader::BlockDataLoader(const string& path) :
+BlockDataLoader::BlockDataLoader(const string& path, unsigned streamWindow) :
    path_(path), prefix_("blk")
-{}
+{
+   if (streamWindow > 0)
+      streamWindow_ = make_shared<BlockDataStreamWindow>(streamWindow);
+}
 
 /////////////////////////////////////////////////////////////////////////////
 shared_ptr<BlockDataFileMap> BlockDataLoader::get(const string& filename)
@@ -201,12 +467,45 @@ shared_ptr<BlockDataFileMap> BlockDataLoader::get(const string& filename)
 }
 
 /////////////////////////////////////////////////////////////////////////////
-shared_ptr<BlockDataFileMap> BlockDataLoader::get(uint32_t fileid)
+shared_ptr<BlockDataFileMap> BlockDataLoader::get(
+   uint32_t fileid, unsigned held)
 {
-   //don't have this fileid yet, create it
+   if (streamWindow_ != nullptr)
+      streamWindow_->acquire(1, held);
+
    return getNewBlockDataMap(fileid);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+map<unsigned, shared_ptr<BlockDataFileMap>> BlockDataLoader::get(
+   const set<unsigned>& fileids, unsigned held)
+{
+   //the whole group is reserved at once, a partial group would hold slots
+   //while waiting on the rest
+   if (streamWindow_ != nullptr)
+      streamWindow_->acquire((unsigned)fileids.size(), held);
+
+   map<unsigned, shared_ptr<BlockDataFileMap>> result;
+   for (auto& id : fileids)
+      result.emplace(id, getNewBlockDataMap(id));
+
+   return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool BlockDataLoader::tryGet(const set<unsigned>& fileids,
+   map<unsigned, shared_ptr<BlockDataFileMap>>& result, unsigned held)
+{
+   if (streamWindow_ != nullptr &&
+      !streamWindow_->tryAcquire((unsigned)fileids.size(), held))
+      return false;
+
+   for (auto& id : fileids)
+      result.emplace(id, getNewBlockDataMap(id));
+
+   return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 uint32_t BlockDataLoader::nameToIntID(const string& filename)
 {
@@ -236,11 +535,13 @@ shared_ptr<BlockDataFileMap>
 {
    string filename = move(intIDToName(fileid));
 
-   return make_shared<BlockDataFileMap>(filename);
+   return make_shared<BlockDataFileMap>(filename, streamWindow_);
 }
 
 /////////////////////////////////////////////////////////////////////////////
-BlockDataFileMap::BlockDataFileMap(const string& filename)
+BlockDataFileMap::BlockDataFileMap(const string& filename,
+   shared_ptr<BlockDataStreamWindow> streamWindow) :
+   filename_(filename), streamWindow_(streamWindow)
 {
    //relaxed memory order for loads and stores, we only care about 
    //atomicity in these operations
@@ -256,6 +557,21 @@ BlockDataFileMap::BlockDataFileMap(const string& filename)
    {
       //LOGERR << "Failed to create BlockDataMap with error: " << e.what();
    }
+
+   if (fileMap_ == nullptr || streamWindow_ == nullptr)
+      return;
+
+   //scans read block files front to back: prefetch the head of the file,
+   //sequential advice has the kernel read ahead of the parser from there
+   auto readahead = min(size_, (size_t)(BLKFILE_READAHEAD_SIZE));
+#ifndef _WIN32
+   madvise(fileMap_, size_, MADV_SEQUENTIAL);
+   madvise(fileMap_, readahead, MADV_WILLNEED);
+#endif
+#if defined(POSIX_FADV_SEQUENTIAL) && defined(POSIX_FADV_WILLNEED)
+   adviseFile(POSIX_FADV_SEQUENTIAL, 0);
+   adviseFile(POSIX_FADV_WILLNEED, readahead);
+#endif
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -270,5 +586,102 @@ BlockDataFileMap::~BlockDataFileMap()
       munmap(fileMap_, size_);
 #endif
       fileMap_ = nullptr;
+
+      //no batch reads this file anymore, don't let it linger in the cache
+#if defined(POSIX_FADV_DONTNEED)
+      if (streamWindow_ != nullptr)
+         adviseFile(POSIX_FADV_DONTNEED, 0);
+#endif
+   }
+
+   if (streamWindow_ != nullptr)
+      streamWindow_->release();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void BlockDataFileMap::adviseFile(int advice, size_t length) const
+{
+#if defined(POSIX_FADV_NORMAL)
+   int fd = open(filename_.c_str(), O_RDONLY);
+   if (fd == -1)
+      return;
+
+   posix_fadvise(fd, 0, length, advice);
+   close(fd);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void BlockDataStreamWindow::reserve(unsigned count)
+{
+   residentCount_ += count;
+   peakCount_ = max(peakCount_, residentCount_);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void BlockDataStreamWindow::acquire(unsigned count, unsigned held)
+{
+   unique_lock<mutex> lock(mu_);
+   if (!fits(count, held))
+   {
+      ++waitCount_;
+      cv_.wait(lock, [this, count, held]()->bool
+      {
+         return fits(count, held);
+      });
    }
+
+   reserve(count);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool BlockDataStreamWindow::tryAcquire(unsigned count, unsigned held)
+{
+   unique_lock<mutex> lock(mu_);
+   if (!fits(count, held))
+      return false;
+
+   reserve(count);
+   return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void BlockDataStreamWindow::release()
+{
+   {
+      unique_lock<mutex> lock(mu_);
+      if (residentCount_ > 0)
+         --residentCount_;
+      ++evictionCount_;
+   }
+
+   cv_.notify_all();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned BlockDataStreamWindow::residentCount()
+{
+   unique_lock<mutex> lock(mu_);
+   return residentCount_;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned BlockDataStreamWindow::peakCount()
+{
+   unique_lock<mutex> lock(mu_);
+   return peakCount_;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned BlockDataStreamWindow::evictionCount()
+{
+   unique_lock<mutex> lock(mu_);
+   return evictionCount_;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned BlockDataStreamWindow::waitCount()
+{
+   unique_lock<mutex> lock(mu_);
+   return waitCount_;
 }
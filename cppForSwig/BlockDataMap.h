@@ -24,19 +24,77 @@
 #include <iomanip>
 
 #include <map>
+#include <set>
+#include <vector>
 
 #include "BlockObj.h"
 #include "BinaryData.h"
 
 #define OffsetAndSize std::pair<size_t, size_t>
+#define OFFSET_ARENA_CHUNK_SIZE 65536
 struct BlockHashVector;
 
+////////////////////////////////////////////////////////////////////////////////
+class OffsetArena
+{
+   /***
+   Bump allocator for tx offsets. A scanner batch shares one arena across
+   all the blocks it deserializes so that parsing costs one allocation per
+   chunk instead of several per tx. Memory is released with the arena.
+   ***/
+
+private:
+   std::mutex mu_;
+   std::vector<std::unique_ptr<OffsetAndSize[]>> chunks_;
+   OffsetAndSize* current_ = nullptr;
+   const size_t chunkSize_;
+   size_t chunkUsed_;
+
+public:
+   OffsetArena(size_t chunkSize = OFFSET_ARENA_CHUNK_SIZE) :
+      chunkSize_(chunkSize), chunkUsed_(chunkSize)
+   {}
+
+   //thread safe
+   OffsetAndSize* allocate(size_t count);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct OffsetAndSizeRange
+{
+   //non owning view over contiguous offsets
+   const OffsetAndSize* ptr_ = nullptr;
+   size_t size_ = 0;
+
+   size_t size(void) const { return size_; }
+   bool empty(void) const { return size_ == 0; }
+
+   const OffsetAndSize& operator[](size_t i) const { return ptr_[i]; }
+   const OffsetAndSize& back(void) const { return ptr_[size_ - 1]; }
+
+   const OffsetAndSize* begin(void) const { return ptr_; }
+   const OffsetAndSize* end(void) const { return ptr_ + size_; }
+   const OffsetAndSize* cbegin(void) const { return ptr_; }
+   const OffsetAndSize* cend(void) const { return ptr_ + size_; }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 struct BCTX
 {
 private:
    mutable BinaryData txHash_;
 
+   //txin then txout offsets, only set for txs parsed on their own, block
+   //txns point into their BlockData or batch arena instead
+   std::vector<OffsetAndSize> ownedOffsets_;
+   bool ownsOffsets_ = false;
+
+   //position of the txin offsets in the parsing buffer, until bound
+   size_t offsetsStart_ = 0;
+
+   //start of the witness data, witness offsets are computed on demand
+   size_t witnessOffset_ = SIZE_MAX;
+
 public:
    const uint8_t* data_;
    const size_t size_;
@@ -46,9 +104,8 @@ public:
 
    bool usesWitness_ = false;
 
-   std::vector<OffsetAndSize> txins_;
-   std::vector<OffsetAndSize> txouts_;
-   std::vector<OffsetAndSize> witnesses_;
+   OffsetAndSizeRange txins_;
+   OffsetAndSizeRange txouts_;
 
    bool isCoinbase_ = false;
 
@@ -60,36 +117,46 @@ public:
       data_(bdr.getPtr()), size_(bdr.getSize())
    {}
 
+   BCTX(const BCTX&);
+   BCTX(BCTX&&) noexcept;
+
+   //witness txs are hashed without their witness data, which has to be
+   //copied out to noWitData. Returns a ref to the bytes to hash.
+   BinaryDataRef getHashPreimage(BinaryData& noWitData) const
+   {
+      if (!usesWitness_)
+         return BinaryDataRef(data_, size_);
+
+      BinaryDataRef version(data_, 4);
+
+      auto& lastTxOut = txouts_.back();
+      auto witnessOffset = lastTxOut.first + lastTxOut.second;
+      BinaryDataRef txinout(data_ + 6, witnessOffset - 6);
+      BinaryDataRef locktime(data_ + size_ - 4, 4);
+
+      noWitData.clear();
+      noWitData.append(version);
+      noWitData.append(txinout);
+      noWitData.append(locktime);
+
+      return noWitData.getRef();
+   }
+
    const BinaryData& getHash(void) const
    {
       if(txHash_.getSize() == 0)
       {
-         if (usesWitness_)
-         {
-            BinaryData noWitData;
-            BinaryDataRef version(data_, 4);
-           
-            auto& lastTxOut = txouts_.back();
-            auto witnessOffset = lastTxOut.first + lastTxOut.second;
-            BinaryDataRef txinout(data_ + 6, witnessOffset - 6);
-            BinaryDataRef locktime(data_ + size_ - 4, 4);
-           
-            noWitData.append(version);
-            noWitData.append(txinout);
-            noWitData.append(locktime);
-            
-            BtcUtils::getHash256(noWitData, txHash_);
-         }
-         else
-         {
-            BinaryDataRef hashdata(data_, size_);
-            BtcUtils::getHash256(hashdata, txHash_);
-         }
+         BinaryData noWitData;
+         auto hashdata = getHashPreimage(noWitData);
+         BtcUtils::getHash256(hashdata, txHash_);
       }
 
       return txHash_;
    }
 
+   //computes the hashes of all txns with a single batched hashing call
+   static void computeHashes(const std::vector<BCTX*>&);
+
    BinaryData&& moveHash(void)
    {
       getHash();
@@ -119,6 +186,16 @@ public:
          (*txoutIter).second);
    }
 
+   //walks the witness data, empty for non witness txs
+   std::vector<OffsetAndSize> getWitnessOffsets(void) const;
+
+   //parses a tx for block deserialization: txin and txout offsets are
+   //appended to offsets and the result isn't usable until bindOffsets
+   //is called with the final location of the buffer
+   static BCTX parseUnbound(const uint8_t*, size_t,
+      std::vector<OffsetAndSize>& offsets, unsigned id = UINT32_MAX);
+   void bindOffsets(const OffsetAndSize* base);
+
    static std::shared_ptr<BCTX> parse(
       BinaryRefReader brr, unsigned id = UINT32_MAX)
    {
@@ -126,59 +203,7 @@ public:
    }
 
    static std::shared_ptr<BCTX> parse(
-      const uint8_t* data, size_t len, unsigned id=UINT32_MAX)
-   {
-      std::vector<size_t> offsetIns, offsetOuts, offsetsWitness;
-      auto txlen = BtcUtils::TxCalcLength(
-         data, len,
-         &offsetIns, &offsetOuts, &offsetsWitness);
-
-      auto txPtr = std::make_shared<BCTX>(data, txlen);
-
-      //create BCTX object and fill it up
-      txPtr->version_ = READ_UINT32_LE(data);
-
-      // Check the marker and flag for witness transaction
-      txPtr->usesWitness_ = BtcUtils::checkSwMarker(data + 4);
-
-      //convert offsets to offset + size pairs
-      for (unsigned int y = 0; y < offsetIns.size() - 1; y++)
-         txPtr->txins_.push_back(
-            std::make_pair(
-         offsetIns[y],
-         offsetIns[y + 1] - offsetIns[y]));
-
-      for (unsigned int y = 0; y < offsetOuts.size() - 1; y++)
-         txPtr->txouts_.push_back(
-            std::make_pair(
-         offsetOuts[y],
-         offsetOuts[y + 1] - offsetOuts[y]));
-
-      if (txPtr->usesWitness_)
-      {
-         for (unsigned int y = 0; y < offsetsWitness.size() - 1; y++)
-            txPtr->witnesses_.push_back(
-               std::make_pair(
-            offsetsWitness[y],
-            offsetsWitness[y + 1] - offsetsWitness[y]));
-      }
-
-      txPtr->lockTime_ = READ_UINT32_LE(data + offsetsWitness.back());
-
-      if (id != UINT32_MAX)
-      {
-         txPtr->isCoinbase_ = (id == 0);
-      }
-      else if (txPtr->txins_.size() == 1)
-      {
-         auto txinref = txPtr->getTxInRef(0);
-         auto bdr = txinref.getSliceRef(0, 32);
-         if (bdr == BtcUtils::EmptyHash_)
-            txPtr->isCoinbase_ = true;
-      }
-
-      return txPtr;
-   }
+      const uint8_t* data, size_t len, unsigned id=UINT32_MAX);
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -192,7 +217,12 @@ private:
    const uint8_t* data_ = nullptr;
    size_t size_ = SIZE_MAX;
 
-   std::vector<std::shared_ptr<BCTX>> txns_;
+   //txns are views into txStorage_, their offsets live in offsets_ or in
+   //the arena of the batch that deserialized this block
+   std::vector<BCTX> txStorage_;
+   std::vector<BCTX*> txns_;
+   std::vector<OffsetAndSize> offsets_;
+   std::shared_ptr<OffsetArena> arena_;
 
    unsigned fileID_ = UINT32_MAX;
    size_t offset_ = SIZE_MAX;
@@ -206,14 +236,15 @@ public:
       const uint8_t*, size_t,
       const std::shared_ptr<BlockHeader>,
       std::function<unsigned int(const BinaryData&)> getID,
-      bool checkMerkle, bool keepHashes);
+      bool checkMerkle, bool keepHashes,
+      std::shared_ptr<OffsetArena> arena = nullptr);
 
    bool isInitialized(void) const
    {
       return (data_ != nullptr);
    }
 
-   const std::vector<std::shared_ptr<BCTX>>& getTxns(void) const
+   const std::vector<BCTX*>& getTxns(void) const
    {
       return txns_;
    }
@@ -293,6 +324,66 @@ public:
    const std::string& getLastFileName(void) const;
 };
 
+/////////////////////////////////////////////////////////////////////////////
+class BlockDataFileMap;
+
+//readahead issued when a streamed block file is mapped, the kernel's 
+//sequential readahead takes over from there
+#define BLKFILE_READAHEAD_SIZE 1024 * 1024 * 16ULL
+
+class BlockDataStreamWindow
+{
+   /***
+   Bounds the count of streamed block files mapped at once. The loader
+   reserves a slot per file before mapping it and blocks while the window
+   is full. A map gives its slot back, and drops its pages from the page
+   cache, once the last batch holding it lets go.
+
+   Callers that keep live maps while they acquire more pass their count as
+   held. Once the window has drained down to those, a group is let in even
+   if it overshoots the window, so a batch spanning more files than the 
+   window goes through on its own rather than waiting on itself.
+   ***/
+
+private:
+   std::mutex mu_;
+   std::condition_variable cv_;
+   const unsigned windowSize_;
+
+   unsigned residentCount_ = 0;
+   unsigned peakCount_ = 0;
+   unsigned evictionCount_ = 0;
+   unsigned waitCount_ = 0;
+
+private:
+   bool fits(unsigned count, unsigned held) const
+   {
+      return residentCount_ + count <= windowSize_ || residentCount_ <= held;
+   }
+
+   void reserve(unsigned count);
+
+public:
+   BlockDataStreamWindow(unsigned windowSize) :
+      windowSize_(windowSize)
+   {}
+
+   //blocks until count more files fit
+   void acquire(unsigned count, unsigned held = 0);
+
+   //false rather than blocking if the files don't fit
+   bool tryAcquire(unsigned count, unsigned held = 0);
+
+   //one map left the window
+   void release(void);
+
+   unsigned windowSize(void) const { return windowSize_; }
+   unsigned residentCount(void);
+   unsigned peakCount(void);
+   unsigned evictionCount(void);
+   unsigned waitCount(void);
+};
+
 /////////////////////////////////////////////////////////////////////////////
 class BlockDataFileMap
 {
@@ -305,8 +396,17 @@ private:
 
    std::atomic<int> useCounter_;
 
+   const std::string filename_;
+
+   //holds a slot in this window, given back on destruction
+   std::shared_ptr<BlockDataStreamWindow> streamWindow_;
+
+private:
+   void adviseFile(int, size_t length) const;
+
 public:
-   BlockDataFileMap(const std::string& filename);
+   BlockDataFileMap(const std::string& filename,
+      std::shared_ptr<BlockDataStreamWindow> streamWindow = nullptr);
    ~BlockDataFileMap(void);
 
    const uint8_t* getPtr() const
@@ -324,6 +424,9 @@ private:
    const std::string path_;
    const std::string prefix_;
 
+   //null when mapping whole files
+   std::shared_ptr<BlockDataStreamWindow> streamWindow_;
+
 private:   
 
    BlockDataLoader(const BlockDataLoader&) = delete; //no copies
@@ -335,13 +438,31 @@ private:
       getNewBlockDataMap(uint32_t fileid);
 
 public:
-   BlockDataLoader(const std::string& path);
+   //streamWindow is the max count of mapped files, 0 maps files whole
+   BlockDataLoader(const std::string& path, unsigned streamWindow = 0);
 
    ~BlockDataLoader(void)
    {}
 
+   /*
+   When streaming, these block until the files fit the window. held is the
+   count of maps from this loader the caller keeps alive meanwhile.
+   */
    std::shared_ptr<BlockDataFileMap> get(const std::string& filename);
-   std::shared_ptr<BlockDataFileMap> get(uint32_t fileid);
+   std::shared_ptr<BlockDataFileMap> get(uint32_t fileid, unsigned held = 0);
+   std::map<unsigned, std::shared_ptr<BlockDataFileMap>> get(
+      const std::set<unsigned>& fileids, unsigned held = 0);
+
+   //false and no maps if the files don't fit the window right now
+   bool tryGet(const std::set<unsigned>& fileids,
+      std::map<unsigned, std::shared_ptr<BlockDataFileMap>>&,
+      unsigned held = 0);
+
+   bool isStreaming(void) const { return streamWindow_ != nullptr; }
+   std::shared_ptr<BlockDataStreamWindow> streamWindow(void) const
+   {
+      return streamWindow_;
+   }
 };
 
 #endif
@@ -102,6 +102,7 @@ void BlockDataViewer::scanWallets(shared_ptr<BDV_Notification> action)
       }
          
       endBlock = reorgState.newTop_->getBlockHeight();
+      scanData.touchedScrAddrs_ = reorgState.touchedScrAddrs_;
 
       //set invalidated keys
       if (reorgNotif->zcPurgePacket_ != nullptr)
@@ -1092,10 +1093,20 @@ vector<pair<StoredTxOut, BinaryDataRef>> BlockDataViewer::getOutputsForOutpoints
    
    auto&& stxo_tx = db_->beginTransaction(STXO, LMDB::ReadOnly);
 
+   //resolve all hashes and outputs in batches rather than one key at a time
+   vector<BinaryDataRef> hashes;
+   hashes.reserve(outpoints.size());
+   for (auto& opSet : outpoints)
+      hashes.push_back(opSet.first);
+   auto&& dbkeys = db_->getDBKeysForHashes(hashes);
+
+   vector<BinaryData> stxoKeys;
+   vector<size_t> stxoIds;
+   unsigned hashId = 0;
    for (auto& opSet : outpoints)
    {
       //get dbkey for this txhash
-      auto&& dbkey = db_->getDBKeyForHash(opSet.first);
+      auto& dbkey = dbkeys[hashId++];
       if (dbkey.getSize() == 6)
       {
          for (auto& op : opSet.second)
@@ -1103,14 +1114,12 @@ vector<pair<StoredTxOut, BinaryDataRef>> BlockDataViewer::getOutputsForOutpoints
             //set txout index
             pair<StoredTxOut, BinaryDataRef> stxoPair;
             stxoPair.second = opSet.first;
-            
-            auto& stxo = stxoPair.first;
-            stxo.txOutIndex_ = op;
+            stxoPair.first.txOutIndex_ = op;
+
             auto stxoKey = dbkey;
             stxoKey.append(WRITE_UINT16_BE(op));
-
-            if (!db_->getStoredTxOut(stxo, stxoKey))
-               throw runtime_error("invalid outpoint");
+            stxoKeys.emplace_back(move(stxoKey));
+            stxoIds.push_back(result.size());
                
             result.emplace_back(stxoPair);
          }
@@ -1149,6 +1158,13 @@ vector<pair<StoredTxOut, BinaryDataRef>> BlockDataViewer::getOutputsForOutpoints
       }
    }
 
+   vector<StoredTxOut> stxos;
+   if (!db_->getStoredTxOuts(stxos, stxoKeys))
+      throw runtime_error("invalid outpoint");
+
+   for (unsigned i = 0; i < stxos.size(); i++)
+      result[stxoIds[i]].first = move(stxos[i]);
+
    return result;
 }
 
@@ -1295,6 +1311,8 @@ void WalletGroup::registerAddresses(
    batch->msg_ = msg;
    batch->isNew_ = msg->flag();
    batch->callback_ = callback;
+   if (msg->has_height())
+      batch->scanFrom_ = msg->height();
 
    saf_->pushAddressBatch(batch);
    theWallet->resetCounters();
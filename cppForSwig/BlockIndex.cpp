@@ -0,0 +1,315 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+#include "BlockIndex.h"
+#include "log.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// BlockIndexRecord
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+bool BlockIndexRecord::operator==(const BlockIndexRecord& rhs) const
+{
+   //padding is zeroed on creation, compare the whole record
+   return memcmp(this, &rhs, sizeof(BlockIndexRecord)) == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// BlockIndex
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+BlockIndex::~BlockIndex()
+{
+   try
+   {
+      unmap();
+   }
+   catch (exception&)
+   {}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BlockIndexFileHeader* BlockIndex::header() const
+{
+   if (fileMap_.filePtr_ == nullptr)
+      throw BlockIndexException("block index is not mapped");
+
+   return (BlockIndexFileHeader*)fileMap_.filePtr_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockIndex::map()
+{
+   unmap();
+   fileMap_ = DBUtils::getMmapOfFile(path_, true);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockIndex::unmap()
+{
+   fileMap_.unmap();
+   fileMap_.size_ = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockIndex::flush()
+{
+   if (fileMap_.filePtr_ == nullptr)
+      return;
+
+#ifdef _WIN32
+   FlushViewOfFile(fileMap_.filePtr_, fileMap_.size_);
+#else
+   msync(fileMap_.filePtr_, fileMap_.size_, MS_SYNC);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool BlockIndex::open()
+{
+   if (!DBUtils::fileExists(path_, 2))
+      return false;
+
+   try
+   {
+      map();
+   }
+   catch (...)
+   {
+      LOGWARN << "failed to map block index file";
+      unmap();
+      return false;
+   }
+
+   if (fileMap_.size_ < sizeof(BlockIndexFileHeader))
+   {
+      LOGWARN << "block index file is too short";
+      unmap();
+      return false;
+   }
+
+   auto headerPtr = header();
+   if (headerPtr->magic_ != BLOCKINDEX_MAGIC ||
+      headerPtr->version_ != BLOCKINDEX_VERSION ||
+      headerPtr->recordSize_ != sizeof(BlockIndexRecord))
+   {
+      LOGWARN << "block index version mismatch";
+      unmap();
+      return false;
+   }
+
+   auto expectedSize = sizeof(BlockIndexFileHeader) +
+      headerPtr->recordCount_ * sizeof(BlockIndexRecord);
+   if (fileMap_.size_ < expectedSize)
+   {
+      LOGWARN << "block index file is truncated";
+      unmap();
+      return false;
+   }
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool BlockIndex::isValid(const BinaryData& topHash,
+   uint32_t topHeight, uint32_t topId) const
+{
+   if (!isOpen())
+      return false;
+
+   auto headerPtr = header();
+   if (headerPtr->isClean_ != 1)
+      return false;
+
+   if (headerPtr->recordCount_ == 0)
+      return false;
+
+   if (topHash.getSize() != 32 ||
+      memcmp(headerPtr->topHash_, topHash.getPtr(), 32) != 0)
+      return false;
+
+   return headerPtr->topHeight_ == topHeight && headerPtr->topId_ == topId;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData BlockIndex::topHash() const
+{
+   if (!isOpen())
+      return BinaryData();
+
+   return BinaryData(header()->topHash_, 32);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t BlockIndex::recordCount() const
+{
+   if (!isOpen())
+      return 0;
+
+   return header()->recordCount_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const BlockIndexRecord* BlockIndex::records() const
+{
+   if (!isOpen())
+      return nullptr;
+
+   return (const BlockIndexRecord*)
+      (fileMap_.filePtr_ + sizeof(BlockIndexFileHeader));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BlockIndexRecord* BlockIndex::getRecordById(uint32_t id)
+{
+   auto begin = (BlockIndexRecord*)records();
+   if (begin == nullptr)
+      return nullptr;
+   auto end = begin + recordCount();
+
+   auto iter = lower_bound(begin, end, id,
+      [](const BlockIndexRecord& rec, uint32_t val)->bool
+   {
+      return rec.uniqueID_ < val;
+   });
+
+   if (iter == end || iter->uniqueID_ != id)
+      return nullptr;
+
+   return iter;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockIndex::writeFile(const string& path,
+   const vector<BlockIndexRecord>& recVec) const
+{
+   BlockIndexFileHeader fileHeader;
+   memset(&fileHeader, 0, sizeof(BlockIndexFileHeader));
+   fileHeader.magic_ = BLOCKINDEX_MAGIC;
+   fileHeader.version_ = BLOCKINDEX_VERSION;
+   fileHeader.recordSize_ = sizeof(BlockIndexRecord);
+   fileHeader.recordCount_ = recVec.size();
+
+   ofstream fs(path, ios::binary | ios::trunc);
+   if (!fs.is_open())
+      throw BlockIndexException("failed to open block index file for writing");
+
+   fs.write((const char*)&fileHeader, sizeof(BlockIndexFileHeader));
+   if (recVec.size() > 0)
+   {
+      fs.write((const char*)recVec.data(),
+         recVec.size() * sizeof(BlockIndexRecord));
+   }
+
+   if (!fs.good())
+      throw BlockIndexException("failed to write block index file");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockIndex::beginUpdate()
+{
+   if (!isOpen())
+      return;
+
+   header()->isClean_ = 0;
+   flush();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockIndex::append(const vector<BlockIndexRecord>& recVec)
+{
+   if (recVec.size() == 0)
+      return;
+
+   if (!isOpen())
+   {
+      reset(recVec);
+      return;
+   }
+
+   //an empty index takes the records as is, otherwise they have to extend it
+   auto count = recordCount();
+   if (count > 0 &&
+      recVec.front().uniqueID_ <= records()[count - 1].uniqueID_)
+      throw BlockIndexException("block index records out of order");
+
+   //file size only grows from appends, drop the view to extend it
+   beginUpdate();
+   unmap();
+
+   {
+      ofstream fs(path_, ios::binary | ios::in | ios::out);
+      fs.seekp(sizeof(BlockIndexFileHeader) +
+         count * sizeof(BlockIndexRecord));
+      fs.write((const char*)recVec.data(),
+         recVec.size() * sizeof(BlockIndexRecord));
+
+      if (!fs.good())
+         throw BlockIndexException("failed to append to block index file");
+   }
+
+   map();
+   header()->recordCount_ = count + recVec.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockIndex::reset(const vector<BlockIndexRecord>& recVec)
+{
+   //write to a swap file first, a partial write would otherwise leave a
+   //seemingly valid index behind
+   auto swapPath = path_;
+   swapPath.append(".tmp");
+   writeFile(swapPath, recVec);
+
+   unmap();
+   remove(path_.c_str());
+   if (rename(swapPath.c_str(), path_.c_str()) != 0)
+      throw BlockIndexException("failed to replace block index file");
+
+   map();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockIndex::commit(
+   const BinaryData& topHash, uint32_t topHeight, uint32_t topId)
+{
+   if (topHash.getSize() != 32)
+      throw BlockIndexException("invalid top hash");
+
+   //records have to hit the disk before the header claims they are valid
+   flush();
+
+   auto headerPtr = header();
+   memcpy(headerPtr->topHash_, topHash.getPtr(), 32);
+   headerPtr->topHeight_ = topHeight;
+   headerPtr->topId_ = topId;
+   headerPtr->isClean_ = 1;
+
+   flush();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockIndex::erase()
+{
+   unmap();
+   remove(path_.c_str());
+}
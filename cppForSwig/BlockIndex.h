@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _BLOCKINDEX_H
+#define _BLOCKINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "BinaryData.h"
+#include "DBUtils.h"
+
+#define BLOCKINDEX_MAGIC      0x58444942 //"BIDX"
+#define BLOCKINDEX_VERSION    1
+#define BLOCKINDEX_FILENAME   "blockindex"
+
+#define BLOCKINDEX_FLAG_MAIN     0x01
+#define BLOCKINDEX_FLAG_ORPHAN   0x02
+
+////////////////////////////////////////////////////////////////////////////////
+struct BlockIndexException : public std::runtime_error
+{
+   BlockIndexException(const std::string& err) : std::runtime_error(err)
+   {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/***
+On disk layout, host endianness:
+   BlockIndexFileHeader
+   BlockIndexRecord * recordCount_, sorted by uniqueID_
+
+The header carries the HEADERS db state (top hash, height and top block id)
+the index was last synced against. A mismatch with the db on load means the
+index is stale and has to be rebuilt from the HEADERS db.
+***/
+struct BlockIndexFileHeader
+{
+   uint32_t magic_;
+   uint32_t version_;
+   uint32_t recordSize_;
+   uint32_t isClean_;
+
+   uint64_t recordCount_;
+
+   uint32_t topHeight_;
+   uint32_t topId_;
+   uint8_t topHash_[32];
+};
+
+////
+struct BlockIndexRecord
+{
+   uint8_t rawHeader_[80];
+   uint8_t hash_[32];
+
+   double difficultySum_;
+   uint64_t fileOffset_;
+
+   uint32_t fileNum_;
+   uint32_t uniqueID_;
+   uint32_t height_;
+   uint32_t blockSize_;
+   uint32_t numTx_;
+
+   uint8_t dupID_;
+   uint8_t flags_;
+   uint16_t padding_;
+
+   bool operator==(const BlockIndexRecord&) const;
+   bool operator!=(const BlockIndexRecord& rhs) const
+   {
+      return !(*this == rhs);
+   }
+};
+
+static_assert(sizeof(BlockIndexFileHeader) == 64,
+   "unexpected block index header size");
+static_assert(sizeof(BlockIndexRecord) == 152,
+   "unexpected block index record size");
+
+////////////////////////////////////////////////////////////////////////////////
+class BlockIndex
+{
+private:
+   const std::string path_;
+   FileMap fileMap_;
+
+private:
+   BlockIndexFileHeader* header(void) const;
+   void map(void);
+   void unmap(void);
+   void flush(void);
+   void writeFile(const std::string&,
+      const std::vector<BlockIndexRecord>&) const;
+
+public:
+   BlockIndex(const std::string& path) :
+      path_(path)
+   {}
+
+   ~BlockIndex(void);
+
+   //open existing index file, returns false if missing or unusable
+   bool open(void);
+   bool isOpen(void) const { return fileMap_.filePtr_ != nullptr; }
+   bool isValid(const BinaryData& topHash,
+      uint32_t topHeight, uint32_t topId) const;
+   BinaryData topHash(void) const;
+
+   size_t recordCount(void) const;
+   const BlockIndexRecord* records(void) const;
+   BlockIndexRecord* getRecordById(uint32_t id);
+
+   //mark index as dirty before modifying records in place
+   void beginUpdate(void);
+   void append(const std::vector<BlockIndexRecord>&);
+   void reset(const std::vector<BlockIndexRecord>&);
+   void commit(const BinaryData& topHash, uint32_t topHeight, uint32_t topId);
+
+   void erase(void);
+   const std::string& path(void) const { return path_; }
+};
+
+#endif
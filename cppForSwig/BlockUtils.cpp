@@ -338,6 +338,7 @@ void BlockDataManager::loadDiskState(const ProgressCallback &progress,
    dbBuilder_ = make_shared<DatabaseBuilder>(
       *blockFiles_, *this, progress, forceRescanSSH);
    dbBuilder_->init();
+   headersFromIndex_ = dbBuilder_->loadedHeadersFromIndex();
 
    if (DBSettings::checkChain())
       checkTransactionCount_ = dbBuilder_->getCheckedTxCount();
@@ -352,6 +353,93 @@ Blockchain::ReorganizationState BlockDataManager::readBlkFileUpdate()
    return dbBuilder_->update();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void BlockDataManager::doInitialSyncOnLoad_Replica(
+   const ProgressCallback &progress)
+{
+   LOGINFO << "Executing: doInitialSyncOnLoad_Replica";
+   BDMstate_ = BDM_initializing;
+
+   if (DBSettings::reportProgress())
+      progress(BDMPhase_OrganizingChain, 0, UINT32_MAX, 0);
+
+   auto&& reorgState = readReplicaUpdate();
+   if (!reorgState.hasNewTop_)
+   {
+      throw runtime_error(
+         "replica db has no scanned top, is the primary done building?");
+   }
+
+   BDMstate_ = BDM_ready;
+   LOGINFO << "replica is ready at height " <<
+      blockchain_->top()->getBlockHeight();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+Blockchain::ReorganizationState BlockDataManager::readReplicaUpdate()
+{
+   /***
+   The primary publishes its progress through the SSH sdbi once a scan
+   batch is committed. Follow that hash rather than the HEADERS db top,
+   which can run ahead of the scanned history. Walk back from it until we
+   hit a header the chain already carries, then organize on the new
+   branch.
+   ***/
+
+   Blockchain::ReorganizationState reorgState;
+
+   auto&& sdbi = iface_->getStoredDBInfo(SSH, 0);
+   auto& topHash = sdbi.topScannedBlkHash_;
+   if (topHash.getSize() != 32 || topHash == BtcUtils::EmptyHash_ ||
+      topHash == replicaTopHash_)
+   {
+      return reorgState;
+   }
+
+   auto isKnown = [this](const BinaryData& hash)->bool
+   {
+      if (!blockchain_->hasHeaderWithHash(hash))
+         return false;
+      return blockchain_->getHeaderByHash(hash)->isInitialized();
+   };
+
+   map<BinaryData, shared_ptr<BlockHeader>> headerMap;
+   BinaryData hash = topHash;
+   while (hash != BtcUtils::EmptyHash_ && !isKnown(hash))
+   {
+      auto header = iface_->readHeader(hash);
+      if (header == nullptr)
+      {
+         LOGWARN << "replica is missing header " <<
+            hash.toHexStr(true) << ", retrying on next poll";
+         return reorgState;
+      }
+
+      hash = header->getPrevHash();
+      headerMap.insert(make_pair(header->getThisHash(), move(header)));
+   }
+
+   blockchain_->addBlocksInBulk(headerMap, false);
+   if (replicaTopHash_.empty())
+      reorgState = blockchain_->forceOrganize();
+   else
+      reorgState = blockchain_->organize(false);
+
+   blockchain_->updateBranchingMaps(iface_, reorgState);
+   if (DBSettings::getDbType() == ARMORY_DB_SUPER)
+      iface_->loadHeightToIdMap();
+
+   if (blockchain_->top()->getThisHash() != topHash)
+   {
+      LOGWARN << "replica top " <<
+         blockchain_->top()->getThisHash().toHexStr(true) <<
+         " differs from primary's scanned top " << topHash.toHexStr(true);
+   }
+
+   replicaTopHash_ = topHash;
+   return reorgState;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 StoredHeader BlockDataManager::getBlockFromDB(uint32_t hgt, uint8_t dup) const
 {
@@ -56,6 +56,8 @@
 
 #define NUM_BLKS_IS_DIRTY 2016
 
+#define REPLICA_POLL_INTERVAL_MS 1000
+
 class BlockDataManager;
 class LSM;
 
@@ -133,6 +135,10 @@ private:
    std::exception_ptr exceptPtr_ = nullptr;
 
    unsigned checkTransactionCount_ = 0;
+   bool headersFromIndex_ = false;
+
+   //last scanned top picked up from the primary, replica mode only
+   BinaryData replicaTopHash_;
    
    mutable std::shared_ptr<std::mutex> nodeStatusPollMutex_;
 
@@ -165,6 +171,7 @@ public:
    void doInitialSyncOnLoad_Rebuild(const ProgressCallback &progress);
    void doInitialSyncOnLoad_RescanBalance(
       const ProgressCallback &progress);
+   void doInitialSyncOnLoad_Replica(const ProgressCallback &progress);
 
    // for testing only
    struct BlkFileUpdateCallbacks
@@ -182,6 +189,7 @@ private:
    
 public:
    Blockchain::ReorganizationState readBlkFileUpdate(void);
+   Blockchain::ReorganizationState readReplicaUpdate(void);
 
    BinaryData applyBlockRangeToDB(ProgressCallback, 
                             uint32_t blk0,
@@ -220,6 +228,7 @@ public:
    void resetDatabases(ResetDBMode mode);
    
    unsigned getCheckedTxCount(void) const { return checkTransactionCount_; }
+   bool loadedHeadersFromIndex(void) const { return headersFromIndex_; }
    CoreRPC::NodeStatus getNodeStatus(void) const;
    void registerZcCallbacks(std::unique_ptr<ZeroConfCallbacks> ptr)
    {
@@ -239,6 +248,7 @@ class BlockDataManagerThread
       int mode = 0;
       volatile bool run = false;
       bool failure = false;
+      bool buildPaused = false;
       std::thread tID;
 
       ~BlockDataManagerThreadImpl()
@@ -262,6 +272,10 @@ public:
    bool shutdown();
    void join();
 
+   // true if the thread returned with the initial build cut short by
+   // --build-budget
+   bool buildPaused(void) const { return pimpl->buildPaused; }
+
 private:
    static void* thrun(void *);
    void run();
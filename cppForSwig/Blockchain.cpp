@@ -51,6 +51,10 @@ void Blockchain::clear()
    topBlockId_ = 0;
 
    topID_.store(0, memory_order_relaxed);
+
+   //the chain is rebuilt from scratch, so is the index on its next update
+   unique_lock<mutex> indexLock(indexMutex_);
+   blockIndexSynced_ = false;
 }
 
 Blockchain::ReorganizationState Blockchain::organize(bool verbose)
@@ -505,7 +509,7 @@ void Blockchain::putNewBareHeaders(LMDBBlockDatabase *db)
    //create transaction here to batch the write
    auto&& tx = db->beginTransaction(HEADERS, LMDB::ReadWrite);
 
-   vector<shared_ptr<BlockHeader>> unputHeaders;
+   vector<shared_ptr<BlockHeader>> putHeaders, unputHeaders;
    for (auto& block : newlyParsedBlocks_)
    {
       if (block->blockHeight_ != UINT32_MAX)
@@ -521,6 +525,7 @@ void Blockchain::putNewBareHeaders(LMDBBlockDatabase *db)
 
          blockIdMap.insert(
             make_pair(block->getThisID(), block->isMainBranch()));
+         putHeaders.push_back(block);
       }
       else
       {
@@ -560,6 +565,9 @@ void Blockchain::putNewBareHeaders(LMDBBlockDatabase *db)
 
    db->setValidDupIDForHeight(dupIdMap);
    db->setBlockIDBranch(blockIdMap);
+
+   //keep the block index in sync with what was just written
+   updateBlockIndex(db, putHeaders);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -744,3 +752,321 @@ map<unsigned, HeightAndDup> Blockchain::getHeightAndDupMap(void) const
 
    return hd_map;
 }
+
+/////////////////////////////////////////////////////////////////////////////
+bool Blockchain::isIndexable(const BlockHeader& header)
+{
+   //mirror the headers putNewBareHeaders commits to the HEADERS db
+   return header.isInitialized_ &&
+      header.blockHeight_ != UINT32_MAX &&
+      header.dataCopy_.getSize() == HEADER_SIZE &&
+      header.thisHash_.getSize() == 32;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+BlockIndexRecord Blockchain::getIndexRecord(const BlockHeader& header)
+{
+   BlockIndexRecord rec;
+   memset(&rec, 0, sizeof(BlockIndexRecord));
+
+   memcpy(rec.rawHeader_, header.dataCopy_.getPtr(), HEADER_SIZE);
+   memcpy(rec.hash_, header.thisHash_.getPtr(), 32);
+
+   rec.difficultySum_ = header.difficultySum_;
+   rec.fileOffset_ = header.blkFileOffset_;
+   rec.fileNum_ = header.blkFileNum_;
+   rec.uniqueID_ = header.uniqueID_;
+   rec.height_ = header.blockHeight_;
+   rec.blockSize_ = header.numBlockBytes_;
+   rec.numTx_ = header.numTx_;
+   rec.dupID_ = header.duplicateID_;
+
+   if (header.isMainBranch_)
+      rec.flags_ |= BLOCKINDEX_FLAG_MAIN;
+   if (header.isOrphan_)
+      rec.flags_ |= BLOCKINDEX_FLAG_ORPHAN;
+
+   return rec;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+shared_ptr<BlockHeader> Blockchain::getHeaderFromIndex(
+   const BlockIndexRecord& rec)
+{
+   //the hash is trusted from the index, no need to hash the header again
+   auto header = make_shared<BlockHeader>();
+   header->dataCopy_.copyFrom(rec.rawHeader_, HEADER_SIZE);
+   header->thisHash_.copyFrom(rec.hash_, 32);
+   header->difficultyDbl_ = BtcUtils::convertDiffBitsToDouble(
+      BinaryDataRef(rec.rawHeader_ + 72, 4));
+   header->isInitialized_ = true;
+
+   header->difficultySum_ = rec.difficultySum_;
+   header->blkFileOffset_ = rec.fileOffset_;
+   header->blkFileNum_ = rec.fileNum_;
+   header->uniqueID_ = rec.uniqueID_;
+   header->blockHeight_ = rec.height_;
+   header->numBlockBytes_ = rec.blockSize_;
+   header->numTx_ = rec.numTx_;
+   header->duplicateID_ = rec.dupID_;
+
+   header->isMainBranch_ = (rec.flags_ & BLOCKINDEX_FLAG_MAIN) != 0;
+   header->isOrphan_ = (rec.flags_ & BLOCKINDEX_FLAG_ORPHAN) != 0;
+   header->isFinishedCalc_ = header->isMainBranch_;
+   header->nextHash_ = BtcUtils::EmptyHash();
+
+   return header;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Blockchain::openBlockIndex()
+{
+   if (blockIndex_ != nullptr)
+      return;
+
+   blockIndex_ = make_unique<BlockIndex>(
+      DatabaseContainer::getDbPath(BLOCKINDEX_FILENAME));
+   blockIndex_->open();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool Blockchain::loadBlockIndex(
+   LMDBBlockDatabase* db, ReorganizationState& reorgState)
+{
+   unique_lock<mutex> indexLock(indexMutex_);
+   openBlockIndex();
+
+   //the index is only usable if it was synced against the current db state
+   auto&& sdbi = db->getStoredDBInfo(HEADERS, 0);
+   if (!blockIndex_->isValid(
+      sdbi.topScannedBlkHash_, sdbi.topBlkHgt_, getTopIdFromDb(db)))
+   {
+      LOGINFO << "block index is missing or stale";
+      return false;
+   }
+
+   auto recPtr = blockIndex_->records();
+   auto count = blockIndex_->recordCount();
+
+   map<BinaryData, shared_ptr<BlockHeader>> hashMap;
+   map<unsigned, shared_ptr<BlockHeader>> idMap;
+   map<unsigned, shared_ptr<BlockHeader>> heightMap;
+   uint32_t topId = 0;
+
+   for (size_t i = 0; i < count; i++)
+   {
+      auto header = getHeaderFromIndex(recPtr[i]);
+      if (header->isMainBranch_)
+      {
+         if (!heightMap.emplace(header->blockHeight_, header).second)
+         {
+            LOGWARN << "block index has duplicate main branch heights";
+            return false;
+         }
+      }
+
+      if (header->uniqueID_ > topId)
+         topId = header->uniqueID_;
+
+      idMap.emplace(header->uniqueID_, header);
+      hashMap.emplace(header->thisHash_, move(header));
+   }
+
+   if (heightMap.size() == 0 ||
+      heightMap.begin()->second->thisHash_ != genesisHash_ ||
+      heightMap.rbegin()->first + 1 != heightMap.size())
+   {
+      LOGWARN << "block index main branch is not contiguous";
+      return false;
+   }
+
+   //link the main branch, check it against the db top along the way
+   shared_ptr<BlockHeader> prevHeader;
+   for (auto& heightPair : heightMap)
+   {
+      if (prevHeader != nullptr)
+      {
+         if (heightPair.second->getPrevHashRef() != prevHeader->thisHash_)
+         {
+            LOGWARN << "block index main branch is broken at height #" <<
+               heightPair.first;
+            return false;
+         }
+
+         prevHeader->nextHash_ = heightPair.second->thisHash_;
+      }
+
+      prevHeader = heightPair.second;
+   }
+
+   if (prevHeader->thisHash_ != sdbi.topScannedBlkHash_)
+   {
+      LOGWARN << "block index top does not match HEADERS db";
+      return false;
+   }
+
+   {
+      unique_lock<mutex> lock(mu_);
+
+      reorgState.prevTop_ = top();
+      reorgState.prevTopStillValid_ = true;
+      reorgState.reorgBranchPoint_ = nullptr;
+
+      headerMap_.update(move(hashMap));
+      headersById_.update(move(idMap));
+      headersByHeight_.update(move(heightMap));
+
+      topBlockId_ = prevHeader->getThisID();
+      atomic_store(&topBlockPtr_, prevHeader);
+
+      if (topID_.load(memory_order_relaxed) < topId)
+         topID_.store(topId, memory_order_relaxed);
+
+      reorgState.newTop_ = prevHeader;
+      reorgState.hasNewTop_ = (reorgState.prevTop_ != prevHeader);
+   }
+
+   blockIndexSynced_ = true;
+   LOGINFO << "loaded " << count << " headers from block index";
+   return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Blockchain::updateBlockIndex(LMDBBlockDatabase* db,
+   const vector<shared_ptr<BlockHeader>>& newHeaders)
+{
+   unique_lock<mutex> indexLock(indexMutex_);
+
+   try
+   {
+      openBlockIndex();
+
+      auto&& sdbi = db->getStoredDBInfo(HEADERS, 0);
+      auto dbTopId = getTopIdFromDb(db);
+      if (blockIndexSynced_ && blockIndex_->isValid(
+         sdbi.topScannedBlkHash_, sdbi.topBlkHgt_, dbTopId))
+         return;
+
+      auto headermap = headersById_.get();
+      vector<BlockIndexRecord> newRecords;
+
+      //only an index this instance loaded or wrote can be patched
+      bool needsReset = !blockIndexSynced_ || blockIndex_->recordCount() == 0;
+
+      if (!needsReset)
+      {
+         /*
+         Only the tip of the chain moves between commits. Headers past the
+         last indexed id are appended, records of freshly committed headers
+         and of headers that switched branch in a reorg are rewritten in
+         place. Reorged headers are found by walking down from the previous
+         and the current top until the branches meet, so this costs the depth
+         of the reorg rather than the length of the chain.
+         */
+
+         auto count = blockIndex_->recordCount();
+         auto lastId = blockIndex_->records()[count - 1].uniqueID_;
+         bool hasChanges = false;
+
+         //returns true if the header's record was already up to date
+         auto syncRecord = [&](const BlockHeader& header)->bool
+         {
+            if (header.uniqueID_ > lastId)
+               return false;
+
+            auto recPtr = blockIndex_->getRecordById(header.uniqueID_);
+            if (recPtr == nullptr || !isIndexable(header))
+            {
+               //can't insert below the last id, rebuild instead
+               if (recPtr != nullptr || isIndexable(header))
+                  needsReset = true;
+               return false;
+            }
+
+            auto&& rec = getIndexRecord(header);
+            if (*recPtr == rec)
+               return true;
+
+            if (!hasChanges)
+               blockIndex_->beginUpdate();
+
+            *recPtr = rec;
+            hasChanges = true;
+            return false;
+         };
+
+         auto hashmap = headerMap_.get();
+         auto getParent = [&hashmap](const shared_ptr<BlockHeader>& header)
+            ->shared_ptr<BlockHeader>
+         {
+            auto iter = hashmap->find(header->getPrevHash());
+            if (iter == hashmap->end())
+               return nullptr;
+            return iter->second;
+         };
+
+         for (auto& header : newHeaders)
+            syncRecord(*header);
+
+         //previous top down to the branch point, these left the main branch
+         auto iter = hashmap->find(blockIndex_->topHash());
+         if (iter == hashmap->end())
+         {
+            needsReset = true;
+         }
+         else
+         {
+            auto header = iter->second;
+            while (header != nullptr && !header->isMainBranch())
+            {
+               syncRecord(*header);
+               header = getParent(header);
+            }
+         }
+
+         //current top down to the first record that is in sync
+         auto header = atomic_load(&topBlockPtr_);
+         while (!needsReset && header != nullptr && !syncRecord(*header))
+            header = getParent(header);
+
+         for (auto idIter = headermap->upper_bound(lastId);
+            idIter != headermap->end(); ++idIter)
+         {
+            if (!isIndexable(*idIter->second))
+               continue;
+
+            newRecords.emplace_back(getIndexRecord(*idIter->second));
+         }
+      }
+
+      if (needsReset)
+      {
+         newRecords.clear();
+         for (auto& headerPair : *headermap)
+         {
+            if (!isIndexable(*headerPair.second))
+               continue;
+
+            newRecords.emplace_back(getIndexRecord(*headerPair.second));
+         }
+
+         blockIndex_->reset(newRecords);
+      }
+      else
+      {
+         blockIndex_->append(newRecords);
+      }
+
+      blockIndex_->commit(sdbi.topScannedBlkHash_, sdbi.topBlkHgt_, dbTopId);
+      blockIndexSynced_ = true;
+   }
+   catch (exception& e)
+   {
+      //the index is an optimization, drop it rather than fail
+      LOGWARN << "failed to update block index: " << e.what();
+      if (blockIndex_ != nullptr)
+         blockIndex_->erase();
+      blockIndex_.reset();
+      blockIndexSynced_ = false;
+   }
+}
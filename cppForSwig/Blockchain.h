@@ -17,6 +17,7 @@
 #include "ThreadSafeClasses.h"
 #include "BlockObj.h"
 #include "lmdb_wrapper.h"
+#include "BlockIndex.h"
 
 #include <memory>
 #include <deque>
@@ -52,6 +53,10 @@ public:
       std::shared_ptr<BlockHeader> prevTop_;
       std::shared_ptr<BlockHeader> newTop_;
       std::shared_ptr<BlockHeader> reorgBranchPoint_;
+
+      //scrAddrs whose ssh summary changed with this update, null if
+      //not tracked
+      std::shared_ptr<const std::set<BinaryData>> touchedScrAddrs_;
    };
    
    /**
@@ -96,7 +101,21 @@ public:
    std::map<unsigned, std::set<unsigned>> mapIDsPerBlockFile(void) const;
    std::map<unsigned, HeightAndDup> getHeightAndDupMap(void) const;
 
+   /***
+   Persistent block index, mirrors the HEADERS db with the chain already
+   organized. Loading it skips readAllHeaders and forceOrganize on boot.
+   ***/
+   bool loadBlockIndex(LMDBBlockDatabase*, ReorganizationState&);
+   void updateBlockIndex(LMDBBlockDatabase*,
+      const std::vector<std::shared_ptr<BlockHeader>>& newHeaders = {});
+
 private:
+   static bool isIndexable(const BlockHeader&);
+   static BlockIndexRecord getIndexRecord(const BlockHeader&);
+   static std::shared_ptr<BlockHeader> getHeaderFromIndex(
+      const BlockIndexRecord&);
+   void openBlockIndex(void);
+
    std::shared_ptr<BlockHeader> organizeChain(bool forceRebuild = false, bool verbose = false);
    /////////////////////////////////////////////////////////////////////////////
    // Update/organize the headers map (figure out longest chain, mark orphans)
@@ -125,6 +144,10 @@ private:
    static const BinaryData topIdKey_;
 
    mutable std::mutex mu_;
+
+   std::unique_ptr<BlockIndex> blockIndex_;
+   bool blockIndexSynced_ = false;
+   std::mutex indexMutex_;
 };
 
 #endif
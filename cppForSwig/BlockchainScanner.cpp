@@ -74,7 +74,7 @@ void BlockchainScanner::scan_nocheck(int32_t scanFrom)
    startAt_ = scanFrom;
    auto topBlock = blockchain_->top();
 
-   preloadUtxos();
+   preloadUtxos(scanFrom);
 
    auto scrRefMap = scrAddrFilter_->getOutScrRefMap();
 
@@ -225,6 +225,17 @@ void BlockchainScanner::scan_nocheck(int32_t scanFrom)
    auto timeSpent = TIMER_READ_SEC("throttling");
    if (timeSpent > 5)
       LOGINFO << "throttling for " << timeSpent << "s";
+
+   if (blockDataLoader_.isStreaming())
+   {
+      auto streamWindow = blockDataLoader_.streamWindow();
+      LOGINFO << "block file window: " << streamWindow->windowSize() <<
+         " files, peaked at " << streamWindow->peakCount() << ", " <<
+         streamWindow->waitCount() << " waits, " << 
+         streamWindow->evictionCount() << " evictions";
+   }
+   LOGINFO << "task pool: " << taskPool_->threadCount() << " workers, " <<
+      taskPool_->stealCount() << " steals";
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -234,43 +245,59 @@ void BlockchainScanner::processOutputs()
    TIMER_RESET("preload");
    TIMER_RESET("outputs");
 
-   auto process_thread = [this](ParserBatch* batch)->void
-   {
-      this->processOutputsThread(batch);
-   };
-
    map<unsigned, shared_ptr<BlockDataFileMap>> localFileMap;
 
-   auto preloadBlockDataFiles = [&](ParserBatch* batch)->void
+   /*
+   Maps shared with the previous batch are reused, the others are mapped
+   as one group. Without wait, gives up rather than block if they don't 
+   fit the streaming window.
+   */
+   auto preloadBlockDataFiles = [&](ParserBatch* batch, bool wait)->bool
    {
       if (batch == nullptr)
-         return;
+         return true;
 
       TIMER_START("preload");
 
+      map<unsigned, shared_ptr<BlockDataFileMap>> fileMaps;
+      set<unsigned> missingIDs;
+
       auto file_id = batch->startBlockFileID_;
       while (file_id <= batch->targetBlockFileID_)
       {
          auto local_iter = localFileMap.find(file_id);
          if (local_iter != localFileMap.end())
-         {
-            batch->fileMaps_.insert(
-               make_pair(file_id, local_iter->second));
-         }
+            fileMaps.insert(*local_iter);
          else
-         {
-            batch->fileMaps_.insert(
-               make_pair(file_id, blockDataLoader_.get(file_id)));
-         }
+            missingIDs.insert(file_id);
 
          ++file_id;
       }
 
-      localFileMap = batch->fileMaps_;
+      //waiting on the window, only hold on to the maps this batch reuses
+      if (wait)
+         localFileMap = fileMaps;
+
+      auto held = (unsigned)localFileMap.size();
+      if (wait)
+      {
+         auto&& newMaps = blockDataLoader_.get(missingIDs, held);
+         fileMaps.insert(newMaps.begin(), newMaps.end());
+      }
+      else if (!blockDataLoader_.tryGet(missingIDs, fileMaps, held))
+      {
+         TIMER_STOP("preload");
+         return false;
+      }
+
+      batch->fileMaps_.insert(fileMaps.begin(), fileMaps.end());
+      localFileMap = move(fileMaps);
 
       TIMER_STOP("preload");
+      return true;
    };
 
+
    //init batch
    unique_ptr<ParserBatch> batch;
    while (1)
@@ -284,14 +311,21 @@ void BlockchainScanner::processOutputs()
       {}
    }
 
-   preloadBlockDataFiles(batch.get());
+   preloadBlockDataFiles(batch.get(), true);
 
    while (1)
    {
-      //start processing threads
-      vector<thread> thr_vec;
-      for (unsigned i = 0; i < totalThreadCount_; i++)
-         thr_vec.push_back(thread(process_thread, batch.get()));
+      //queue output parsing tasks, each task pulls blocks off the batch
+      //counter until it runs dry
+      TaskGroup outputTasks(taskPool_.get());
+      auto batchPtr = batch.get();
+      for (unsigned i = 0; i < taskPool_->threadCount(); i++)
+      {
+         outputTasks.run([this, batchPtr](void)->void
+         {
+            this->processOutputsThread(batchPtr);
+         });
+      }
 
       unique_ptr<ParserBatch> nextBatch;
 
@@ -308,18 +342,18 @@ void BlockchainScanner::processOutputs()
 
       //populate the next batch's file map while the first
       //batch is being processed
-      preloadBlockDataFiles(nextBatch.get());
+      auto preloaded = preloadBlockDataFiles(nextBatch.get(), false);
 
-      //wait on threads
-      for (auto& thr : thr_vec)
-      {
-         if (thr.joinable())
-            thr.join();
-      }
+      //wait on tasks
+      outputTasks.wait();
       
       //push first batch for input processing
       inputQueue_.push_back(move(batch));
 
+      //the window had no room for both batches, wait on the ones ahead
+      if (!preloaded)
+         preloadBlockDataFiles(nextBatch.get(), true);
+
       //exit loop condition
       if (nextBatch == nullptr)
       {
@@ -343,11 +377,6 @@ void BlockchainScanner::processInputs()
 {
    TIMER_RESET("inputs");
 
-   auto process_thread = [this](ParserBatch* batch)->void
-   {
-      this->processInputsThread(batch);
-   };
-
    while (1)
    {
       unique_ptr<ParserBatch> batch;
@@ -368,52 +397,44 @@ void BlockchainScanner::processInputs()
 
       //merge utxo map from batch with global one
       //this data needs copied because we still have use for the original map
-      for (auto& hash_map : batch->outputMap_)
+      for (auto& utxo : batch->outputMap_)
+         utxoMap_.insert(utxo);
+
+      //queue input parsing tasks, this thread helps out until they're done
       {
-         auto hash_iter = utxoMap_.find(hash_map.first);
-         if (hash_iter == utxoMap_.end())
+         TaskGroup inputTasks(taskPool_.get());
+         auto batchPtr = batch.get();
+         for (unsigned i = 0; i < taskPool_->threadCount(); i++)
          {
-            utxoMap_.insert(hash_map);
-            continue;
+            inputTasks.run([this, batchPtr](void)->void
+            {
+               this->processInputsThread(batchPtr);
+            });
          }
 
-         hash_iter->second.insert(
-            hash_map.second.begin(), hash_map.second.end());
-      }
-
-      //start processing threads
-      vector<thread> thr_vec;
-      for (unsigned i = 1; i < totalThreadCount_; i++)
-         thr_vec.push_back(thread(process_thread, batch.get()));
-      process_thread(batch.get());
-
-      //wait on threads
-      for (auto& thr : thr_vec)
-      {
-         if (thr.joinable())
-            thr.join();
+         inputTasks.wait();
       }
 
       //purge spent outputs from global map
       for (auto& spent_txout : batch->spentOutputs_)
       {
-         auto hash_iter = utxoMap_.find(spent_txout.parentHash_);
-         if (hash_iter == utxoMap_.end())
+         auto utxo_iter = utxoMap_.find(getOutpointKey(
+            spent_txout.parentHash_, spent_txout.txOutIndex_));
+         if (utxo_iter == utxoMap_.end())
          {
             LOGERR << "missing utxo";
             continue;
          }
 
-         auto utxo_iter = hash_iter->second.find(spent_txout.txOutIndex_);
-         if (utxo_iter == hash_iter->second.end())
-         {
-            LOGERR << "missing utxo";
-            continue;
-         }
+         utxoMap_.erase(utxo_iter);
+      }
 
-         hash_iter->second.erase(utxo_iter);
-         if (hash_iter->second.size() == 0)
-            utxoMap_.erase(hash_iter);
+      //checkpoint the utxo set, the commit thread writes it with the batch
+      if (batch->end_ >= nextSnapshotHeight_)
+      {
+         batch->utxoSnapshot_ = takeUtxoSnapshot(batch.get());
+         nextSnapshotHeight_ = (batch->end_ / UTXO_SNAPSHOT_INTERVAL + 1) *
+            UTXO_SNAPSHOT_INTERVAL;
       }
 
       //push for commit
@@ -460,7 +481,7 @@ shared_ptr<BlockData> BlockchainScanner::getBlockData(
    auto bdata = BlockData::deserialize(
       filemap->getPtr() + blockheader->getOffset(),
       blockheader->getBlockSize(),
-      blockheader, getID, false, false);
+      blockheader, getID, false, false, batch->offsetArena_);
    return bdata;
 }
 
@@ -468,9 +489,13 @@ shared_ptr<BlockData> BlockchainScanner::getBlockData(
 void BlockchainScanner::processOutputsThread(ParserBatch* batch)
 {
    map<unsigned, shared_ptr<BlockData>> blockMap;
-   map<BinaryData, map<unsigned, StoredTxOut>> outputMap;
+   FlatHashMap<OutpointKey, StoredTxOut> outputMap;
    map<BinaryData, map<BinaryData, StoredSubHistory>> sshMap;
 
+   vector<TxOutScriptKey> scriptKeys;
+   vector<pair<unsigned, unsigned>> outputIds;
+   vector<uint8_t> filterHits;
+
    while (1)
    {
       auto currentBlock =
@@ -492,9 +517,14 @@ void BlockchainScanner::processOutputsThread(ParserBatch* batch)
       const auto header = blockdata->header();
 
       auto& txns = blockdata->getTxns();
+
+      //run the script keys of all the block's txouts through the 
+      //prefilter first, only hits get the exact lookup
+      scriptKeys.clear();
+      outputIds.clear();
       for (unsigned i = 0; i < txns.size(); i++)
       {
-         const BCTX& txn = *(txns[i].get());
+         const BCTX& txn = *txns[i];
          for (unsigned y = 0; y < txn.txouts_.size(); y++)
          {
             auto& txout = txn.txouts_[y];
@@ -506,56 +536,80 @@ void BlockchainScanner::processOutputsThread(ParserBatch* batch)
             auto&& scrRef = BtcUtils::getTxOutScrAddrNoCopy(
                brr.get_BinaryDataRef(scriptSize));
 
-            auto saIter = batch->scriptRefMap_->find(scrRef);
-            if (saIter == batch->scriptRefMap_->end())
-               continue;
-
-            if (saIter->second >= (int)blockdata->header()->getBlockHeight())
-               continue;
-
-            //if we got this far, this txout is ours
-            //get tx hash
-            auto& txHash = txn.getHash();
-
-            auto&& scrAddr = scrRef.getScrAddr();
-
-            //construct StoredTxOut
-            StoredTxOut stxo;
-            stxo.dataCopy_ = BinaryData(
-               txn.data_ + txout.first, txout.second);
-            stxo.parentHash_ = txHash;
-            stxo.blockHeight_ = header->getBlockHeight();
-            stxo.duplicateID_ = header->getDuplicateID();
-            stxo.txIndex_ = i;
-            stxo.txOutIndex_ = y;
-            stxo.scrAddr_ = scrAddr;
-            stxo.spentness_ = TXOUT_UNSPENT;
-            stxo.parentTxOutCount_ = (unsigned)txn.txouts_.size();
-            stxo.isCoinbase_ = txn.isCoinbase_;
-            auto value = stxo.getValue();
+            scriptKeys.push_back(scrRef.getKey());
+            outputIds.push_back(make_pair(i, y));
+         }
+      }
 
-            auto&& hgtx = DBUtils::heightAndDupToHgtx(
-               stxo.blockHeight_, stxo.duplicateID_);
+      filterHits.resize(scriptKeys.size());
+      batch->scriptRefMap_->filter_.mayContain(
+         scriptKeys.data(), scriptKeys.size(), filterHits.data());
 
-            auto&& txioKey = DBUtils::getBlkDataKeyNoPrefix(
-               stxo.blockHeight_, stxo.duplicateID_,
-               i, y);
+      for (unsigned k = 0; k < scriptKeys.size(); k++)
+      {
+         if (filterHits[k] == 0)
+            continue;
 
-            //update utxos_
-            auto& stxoHashMap = outputMap[txHash];
-            stxoHashMap.insert(make_pair(y, move(stxo)));
+         auto saIter = batch->scriptRefMap_->map_.find(scriptKeys[k]);
+         if (saIter == batch->scriptRefMap_->map_.end())
+            continue;
 
-            //update ssh_
-            auto& ssh = sshMap[scrAddr];
-            auto& subssh = ssh[hgtx];
+         if (saIter->second >= (int)blockdata->header()->getBlockHeight())
+            continue;
 
-            //deal with txio count in subssh at serialization
-            TxIOPair txio;
-            txio.setValue(value);
-            txio.setTxOut(txioKey);
-            txio.setFromCoinbase(txn.isCoinbase_);
-            subssh.txioMap_.insert(make_pair(txioKey, move(txio)));
-         }
+         auto i = outputIds[k].first;
+         auto y = outputIds[k].second;
+         const BCTX& txn = *txns[i];
+         auto& txout = txn.txouts_[y];
+
+         BinaryRefReader brr(
+            txn.data_ + txout.first, txout.second);
+         brr.advance(8);
+         unsigned scriptSize = (unsigned)brr.get_var_int();
+         auto&& scrRef = BtcUtils::getTxOutScrAddrNoCopy(
+            brr.get_BinaryDataRef(scriptSize));
+
+         //if we got this far, this txout is ours
+         //get tx hash
+         auto& txHash = txn.getHash();
+
+         auto&& scrAddr = scrRef.getScrAddr();
+
+         //construct StoredTxOut
+         StoredTxOut stxo;
+         stxo.dataCopy_ = BinaryData(
+            txn.data_ + txout.first, txout.second);
+         stxo.parentHash_ = txHash;
+         stxo.blockHeight_ = header->getBlockHeight();
+         stxo.duplicateID_ = header->getDuplicateID();
+         stxo.txIndex_ = i;
+         stxo.txOutIndex_ = y;
+         stxo.scrAddr_ = scrAddr;
+         stxo.spentness_ = TXOUT_UNSPENT;
+         stxo.parentTxOutCount_ = (unsigned)txn.txouts_.size();
+         stxo.isCoinbase_ = txn.isCoinbase_;
+         auto value = stxo.getValue();
+
+         auto&& hgtx = DBUtils::heightAndDupToHgtx(
+            stxo.blockHeight_, stxo.duplicateID_);
+
+         auto&& txioKey = DBUtils::getBlkDataKeyNoPrefix(
+            stxo.blockHeight_, stxo.duplicateID_,
+            i, y);
+
+         //update utxos_
+         outputMap.emplace(getOutpointKey(txHash, y), move(stxo));
+
+         //update ssh_
+         auto& ssh = sshMap[scrAddr];
+         auto& subssh = ssh[hgtx];
+
+         //deal with txio count in subssh at serialization
+         TxIOPair txio;
+         txio.setValue(value);
+         txio.setTxOut(txioKey);
+         txio.setFromCoinbase(txn.isCoinbase_);
+         subssh.txioMap_.insert(make_pair(txioKey, move(txio)));
       }
    }
 
@@ -563,7 +617,8 @@ void BlockchainScanner::processOutputsThread(ParserBatch* batch)
    unique_lock<mutex> lock(batch->mergeMutex_);
 
    batch->blockMap_.insert(blockMap.begin(), blockMap.end());
-   batch->outputMap_.insert(outputMap.begin(), outputMap.end());
+   for (auto& utxo : outputMap)
+      batch->outputMap_.insert(move(utxo));
 
    for (auto& ssh_pair : sshMap)
    {
@@ -607,25 +662,18 @@ void BlockchainScanner::processInputsThread(ParserBatch* batch)
 
       for (unsigned i = 0; i < txns.size(); i++)
       {
-         const BCTX& txn = *(txns[i].get());
+         const BCTX& txn = *txns[i];
 
          for (unsigned y = 0; y < txn.txins_.size(); y++)
          {
+            //the txin starts with the outpoint, hash then LE txout id
             auto& txin = txn.txins_[y];
-            BinaryDataRef outHash(
-               txn.data_ + txin.first, 32);
+            OutpointKey outpoint(txn.data_ + txin.first);
 
-            auto utxoIter = utxoMap_.find(outHash);
+            auto utxoIter = utxoMap_.find(outpoint);
             if (utxoIter == utxoMap_.end())
                continue;
 
-            unsigned txOutId = READ_UINT32_LE(
-               txn.data_ + txin.first + 32);
-
-            auto idIter = utxoIter->second.find(txOutId);
-            if (idIter == utxoIter->second.end())
-               continue;
-
             //if we got this far, this txins consumes one of our utxos
 
             //create spent txout
@@ -636,7 +684,7 @@ void BlockchainScanner::processInputsThread(ParserBatch* batch)
                header->getBlockHeight(), header->getDuplicateID(),
                i, y);
 
-            StoredTxOut stxo = idIter->second;
+            StoredTxOut stxo = utxoIter->second;
             stxo.spentness_ = TXOUT_SPENT;
             stxo.spentByTxInKey_ = txinkey;
 
@@ -773,13 +821,10 @@ void BlockchainScanner::writeBlockData()
             }
          }
 
-         for (auto& utxomap : batch->outputMap_)
+         for (auto& utxo : batch->outputMap_)
          {
-            for (auto& utxo : utxomap.second)
-            {
-               auto& bw = serializedStxo[utxo.second.getDBKey()];
-               utxo.second.serializeDBValue(bw);
-            }
+            auto& bw = serializedStxo[utxo.second.getDBKey()];
+            utxo.second.serializeDBValue(bw);
          }
       }
 
@@ -794,43 +839,60 @@ void BlockchainScanner::writeBlockData()
          stxo.serializeDBValue(bw);
       }
 
-      //write data
-      {
-         //txouts
-         auto&& tx = db_->beginTransaction(STXO, LMDB::ReadWrite);
+      //write data. The commit stage writes txouts and subssh on their own
+      //threads, this thread moves on to serializing the next batch
+      auto& commitStage = db_->commitStage();
 
-         for (auto& stxo : serializedStxo)
-         { 
-            //TODO: dont rewrite utxos, check if they are already in DB first
-            db_->putValue(STXO,
-               stxo.first.getRef(),
-               stxo.second.getDataRef());
-         }
-      }
+      //TODO: dont rewrite utxos, check if they are already in DB first
+      auto stxoFut = commitStage.push(
+         DBWriteBatch::fromMap(STXO, move(serializedStxo)));
 
-      {
-         //subssh
-         auto&& tx = db_->beginTransaction(SUBSSH, LMDB::ReadWrite);
+      auto subsshBatch = 
+         DBWriteBatch::fromMap(SUBSSH, move(serializedSubSSH));
 
-         for (auto& subssh : serializedSubSSH)
-         {
-            db_->putValue(
-               SUBSSH,
-               subssh.first.getRef(),
-               subssh.second.getDataRef());
-         }
+      //the SUBSSH sdbi marks the batch as scanned, it can't land ahead 
+      //of the txouts
+      subsshBatch->after_.push_back(stxoFut);
 
+      auto topHeight = topheader->getBlockHeight();
+      auto topHash = topheader->getThisHash();
+      subsshBatch->inTx_ = [this, topHeight, topHash](void)->void
+      {
          //update SUBSSH sdbi
          auto&& sdbi = scrAddrFilter_->getSubSshSDBI();
-         sdbi.topBlkHgt_ = topheader->getBlockHeight();
-         sdbi.topScannedBlkHash_ = topheader->getThisHash();
+         sdbi.topBlkHgt_ = topHeight;
+         sdbi.topScannedBlkHash_ = topHash;
          scrAddrFilter_->putSubSshSDBI(sdbi);
-      }
+      };
+      commitStage.push(move(subsshBatch));
 
       //wait on writeHintsThreadId
       if (writeHintsThreadId.joinable())
          writeHintsThreadId.join();
 
+      //utxo checkpoint goes last so that it never gets ahead of the
+      //stxo data it refers to
+      if (batch->utxoSnapshot_ != nullptr)
+      {
+         commitStage.flush(STXO);
+         commitStage.flush(SUBSSH);
+
+         auto& snapshot = *batch->utxoSnapshot_;
+         auto&& tx = db_->beginTransaction(UTXOSNAP, LMDB::ReadWrite);
+         db_->putUtxoSnapshot(snapshot);
+
+         //only keep the most recent checkpoints
+         auto&& heights = db_->getUtxoSnapshotHeights(snapshot.filterKey_);
+         for (unsigned i = UTXO_SNAPSHOT_DEPTH; i < heights.size(); i++)
+         {
+            db_->deleteValue(UTXOSNAP, StoredUtxoSnapshot::getDBKey(
+               snapshot.filterKey_, heights[heights.size() - i - 1]));
+         }
+
+         LOGINFO << "utxo checkpoint at block #" << snapshot.height_ <<
+            " (" << snapshot.utxos_.size() << " utxos)";
+      }
+
       if (batch->start_ != batch->end_)
       {
          LOGINFO << "scanned from block #" << batch->start_
@@ -855,6 +917,11 @@ void BlockchainScanner::writeBlockData()
 
       TIMER_STOP("write");
    }
+
+   //the scan is done once its last batch is on disk
+   db_->commitStage().flush(STXO);
+   db_->commitStage().flush(SUBSSH);
+   db_->commitStage().logStats();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -878,10 +945,10 @@ void BlockchainScanner::processAndCommitTxHints(ParserBatch* batch)
       stxh.dbKeyList_.push_back(move(utxokey));
    };
 
-   auto addTxHintMap = 
-      [&](const pair<BinaryData, map<unsigned, StoredTxOut>>& utxomap)->void
+   auto addTxHintMap = [&](const BinaryDataRef& txHash,
+      const vector<const StoredTxOut*>& stxos)->void
    {
-      auto&& txHashPrefix = utxomap.first.getSliceCopy(0, 4);
+      auto&& txHashPrefix = txHash.getSliceCopy(0, 4);
       StoredTxHints& stxh = txHints[txHashPrefix];
 
       //pull txHint from DB first, don't want to override 
@@ -889,31 +956,37 @@ void BlockchainScanner::processAndCommitTxHints(ParserBatch* batch)
       if (stxh.isNull())
          db_->getStoredTxHints(stxh, txHashPrefix);
 
-      for (auto& utxo : utxomap.second)
+      for (auto& utxo : stxos)
       {
-         addTxHint(stxh, utxo.second);
+         addTxHint(stxh, *utxo);
       }
 
       stxh.preferredDBKey_ = stxh.dbKeyList_.front();
 
       //count and hash
-      auto& stxo = utxomap.second.begin()->second;
+      auto& stxo = *stxos.front();
       auto& bw = countAndHash[stxo.getDBKeyOfParentTx(true)];
       if (bw.getSize() != 0)
          return;
 
       bw.put_uint32_t(stxo.parentTxOutCount_);
-      bw.put_BinaryData(utxomap.first);
+      bw.put_BinaryDataRef(txHash);
    };
 
    {
       auto&& hintdbtx = db_->beginTransaction(TXHINTS, LMDB::ReadOnly);
 
-      for (auto& utxomap : batch->outputMap_)
+      //group outputs by parent tx
+      map<BinaryDataRef, vector<const StoredTxOut*>> outputsByTx;
+      for (auto& utxo : batch->outputMap_)
       {
-         addTxHintMap(utxomap);
+         outputsByTx[utxo.second.parentHash_.getRef()].push_back(
+            &utxo.second);
       }
 
+      for (auto& txOutputs : outputsByTx)
+         addTxHintMap(txOutputs.first, txOutputs.second);
+
       map<BinaryData, map<unsigned, StoredTxOut>> spentTxOutMap;
       for (auto& stxo : batch->spentOutputs_)
       {
@@ -937,36 +1010,27 @@ void BlockchainScanner::processAndCommitTxHints(ParserBatch* batch)
       }
 
       for (auto& stxomap : spentTxOutMap)
-         addTxHintMap(stxomap);
-   }
+      {
+         vector<const StoredTxOut*> stxos;
+         for (auto& stxo : stxomap.second)
+            stxos.push_back(&stxo.second);
 
-   map<BinaryData, BinaryWriter> serializedHints;
+         addTxHintMap(stxomap.first.getRef(), stxos);
+      }
+   }
 
-   //serialize
+   //serialize, count and hash entries are keyed apart from the hints
+   auto& serializedHints = countAndHash;
    for (auto& txhint : txHints)
    {
       auto& bw = serializedHints[txhint.second.getDBKey()];
       txhint.second.serializeDBValue(bw);
    }
 
-   //write
-   {
-      auto&& hintdbtx = db_->beginTransaction(TXHINTS, LMDB::ReadWrite);
-
-      for (auto& txhint : serializedHints)
-      {
-         db_->putValue(TXHINTS,
-            txhint.first.getRef(),
-            txhint.second.getDataRef());
-      }
-
-      for (auto& cah : countAndHash)
-      {
-         db_->putValue(TXHINTS,
-            cah.first.getRef(),
-            cah.second.getDataRef());
-      }
-   }
+   //write. The next batch reads these hints back, commit on this thread
+   auto hintBatch = 
+      DBWriteBatch::fromMap(TXHINTS, move(serializedHints));
+   db_->commitStage().commit(*hintBatch);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1046,20 +1110,14 @@ void BlockchainScanner::updateSSH(bool force, int32_t startHeight)
       auto historyTx = db_->beginTransaction(SSH, LMDB::ReadOnly);
       for (auto& ssh : subsshparser_result.second)
       {
+         touchedScrAddrs_->insert(ssh.first);
+
          auto& db_ssh = sshMap[ssh.first];
          db_->getStoredScriptHistorySummary(db_ssh, ssh.first);
          if (db_ssh.isInitialized())
-         {
-            db_ssh.totalUnspent_ += ssh.second.totalUnspent_;
-            db_ssh.totalTxioCount_ += ssh.second.totalTxioCount_;
-            db_ssh.subsshSummary_.insert(
-               ssh.second.subsshSummary_.begin(),
-               ssh.second.subsshSummary_.end());
-         }
+            db_ssh.addSummary(ssh.second);
          else
-         {
             db_ssh = move(ssh.second);
-         }
       }
 
       txnsToResolve = move(subsshparser_result.first);
@@ -1154,14 +1212,43 @@ void BlockchainScanner::updateSSH(bool force, int32_t startHeight)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void BlockchainScanner::preloadUtxos()
+void BlockchainScanner::preloadUtxos(unsigned scanFrom)
 {
-   //TODO: check utxos pulled vs scraddrfilter (to reduce dataset for side scans)
+   //side scans are one-off passes over a temporary filter, 
+   //do not checkpoint those
+   snapshotMerkle_.clear();
+   nextSnapshotHeight_ = UINT32_MAX;
+   if (scrAddrFilter_->sdbiKey() != SIDESCAN_ID)
+   {
+      snapshotMerkle_ = scrAddrFilter_->getAddressMapMerkle();
+      nextSnapshotHeight_ = (scanFrom / UTXO_SNAPSHOT_INTERVAL + 1) *
+         UTXO_SNAPSHOT_INTERVAL;
+   }
+
+   //side scans only need the utxos of their own addresses
+   shared_ptr<const map<BinaryDataRef, shared_ptr<AddrAndHash>>> addrMap;
+   if (scrAddrFilter_->sdbiKey() == SIDESCAN_ID)
+      addrMap = scrAddrFilter_->getScanFilterAddrMap();
+
    auto&& tx = db_->beginTransaction(STXO, LMDB::ReadOnly);
+
+   //start from the nearest checkpoint if there is one, in which case only
+   //the txouts created past it are left to pull
+   auto walkFrom = loadUtxoSnapshot(scanFrom);
+
    auto dbIter = db_->getIterator(STXO);
-   dbIter->seekToFirst();
+   if (walkFrom == 0)
+   {
+      dbIter->seekToFirst();
+      if (!dbIter->advanceAndRead())
+         return;
+   }
+   else if (!dbIter->seekTo(DBUtils::getBlkDataKey(walkFrom, 0)))
+   {
+      return;
+   }
 
-   while (dbIter->advanceAndRead())
+   do
    {
       StoredTxOut stxo;
       stxo.unserializeDBKey(dbIter->getKeyRef());
@@ -1170,11 +1257,112 @@ void BlockchainScanner::preloadUtxos()
       if (stxo.spentness_ == TXOUT_SPENT)
          continue;
 
+      if (addrMap != nullptr &&
+         addrMap->find(stxo.getScrAddress().getRef()) == addrMap->end())
+         continue;
+
       stxo.parentHash_ = move(db_->getTxHashForLdbKey(
          stxo.getDBKeyOfParentTx(false)));
-      auto& idMap = utxoMap_[stxo.parentHash_];
-      idMap.insert(make_pair(stxo.txOutIndex_, move(stxo)));
+      if (stxo.parentHash_.getSize() != 32)
+      {
+         LOGWARN << "missing hash for utxo parent tx";
+         continue;
+      }
+
+      auto&& outpoint = getOutpointKey(stxo.parentHash_, stxo.txOutIndex_);
+      utxoMap_.emplace(outpoint, move(stxo));
+   } while (dbIter->advanceAndRead());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned BlockchainScanner::loadUtxoSnapshot(unsigned scanFrom)
+{
+   /***
+   Loads the most recent checkpoint below scanFrom that matches the current
+   address set and main branch. Returns the height to resume pulling txouts 
+   from, 0 if no checkpoint was loaded.
+   ***/
+
+   if (scanFrom == 0 || snapshotMerkle_.getSize() == 0)
+      return 0;
+
+   auto filterKey = scrAddrFilter_->sdbiKey();
+   auto&& tx = db_->beginTransaction(UTXOSNAP, LMDB::ReadOnly);
+   auto&& heights = db_->getUtxoSnapshotHeights(filterKey);
+
+   for (auto iter = heights.rbegin(); iter != heights.rend(); ++iter)
+   {
+      if (*iter >= scanFrom)
+         continue;
+
+      StoredUtxoSnapshot snapshot;
+      if (!db_->getUtxoSnapshot(snapshot, filterKey, *iter))
+         continue;
+
+      if (snapshot.addrMerkle_ != snapshotMerkle_)
+         continue;
+
+      try
+      {
+         auto header = blockchain_->getHeaderByHeight(snapshot.height_, 0xFF);
+         if (header->getThisHash() != snapshot.blockHash_)
+            continue;
+      }
+      catch (exception&)
+      {
+         continue;
+      }
+
+      for (auto& utxo : snapshot.utxos_)
+      {
+         //txouts may have been spent since the checkpoint was taken
+         auto valRef = db_->getValueRef(STXO, DB_PREFIX_TXDATA, utxo.first);
+         if (valRef.getSize() == 0)
+            continue;
+
+         StoredTxOut stxo;
+         stxo.unserializeDBKey(utxo.first);
+         stxo.unserializeDBValue(valRef);
+         if (stxo.spentness_ == TXOUT_SPENT)
+            continue;
+
+         stxo.parentHash_ = move(utxo.second);
+         auto&& outpoint = getOutpointKey(stxo.parentHash_, stxo.txOutIndex_);
+         utxoMap_.emplace(outpoint, move(stxo));
+      }
+
+      LOGINFO << "resuming from utxo checkpoint at block #" << snapshot.height_;
+      return snapshot.height_ + 1;
    }
+
+   return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unique_ptr<StoredUtxoSnapshot> BlockchainScanner::takeUtxoSnapshot(
+   ParserBatch* batch)
+{
+   if (batch->blockMap_.size() == 0)
+      return nullptr;
+
+   auto header = batch->blockMap_.rbegin()->second->getHeaderPtr();
+   if (header == nullptr)
+      return nullptr;
+
+   auto snapshot = make_unique<StoredUtxoSnapshot>();
+   snapshot->filterKey_ = scrAddrFilter_->sdbiKey();
+   snapshot->height_ = header->getBlockHeight();
+   snapshot->blockHash_ = header->getThisHash();
+   snapshot->addrMerkle_ = snapshotMerkle_;
+
+   snapshot->utxos_.reserve(utxoMap_.size());
+   for (auto& utxo : utxoMap_)
+   {
+      snapshot->utxos_.emplace_back(
+         utxo.second.getDBKey(false), utxo.second.parentHash_);
+   }
+
+   return snapshot;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1213,8 +1401,8 @@ void BlockchainScanner::undo(Blockchain::ReorganizationState& reorgState)
       auto fileIter = fileMaps.find(filenum);
       if (fileIter == fileMaps.end())
       {
-         fileIter = fileMaps.insert(make_pair(
-            filenum, blockDataLoader_.get(filenum))).first;
+         fileIter = fileMaps.insert(make_pair(filenum,
+            blockDataLoader_.get(filenum, (unsigned)fileMaps.size()))).first;
       }
 
       auto filemap = fileIter->second;
@@ -1259,6 +1447,7 @@ void BlockchainScanner::undo(Blockchain::ReorganizationState& reorgState)
             brr.resetPosition();
             uint64_t value = brr.get_uint64_t();
             ssh.totalUnspent_ -= value;
+            ssh.substractReceived(value);
             ssh.totalTxioCount_--;
             
             //mark stxo key for deletion
@@ -1364,10 +1553,34 @@ void BlockchainScanner::undo(Blockchain::ReorganizationState& reorgState)
    int branchPointHeight = 
       reorgState.reorgBranchPoint_->getBlockHeight();
 
+   //utxo checkpoints past the branch point are off the main chain
+   {
+      auto&& tx = db_->beginTransaction(UTXOSNAP, LMDB::ReadWrite);
+      db_->deleteUtxoSnapshots(branchPointHeight + 1);
+   }
+
    //ssh
    {
       auto&& tx = db_->beginTransaction(SSH, LMDB::ReadWrite);
 
+      //summaries changed by the undone blocks, pull their last touched
+      //height back to the highest summary entry left on the main branch
+      for (auto& ssh : sshMap)
+      {
+         touchedScrAddrs_->insert(ssh.first);
+
+         auto& sshObj = ssh.second;
+         if ((int)sshObj.lastTouchedHeight_ <= branchPointHeight)
+            continue;
+
+         auto sumIter = sshObj.subsshSummary_.upper_bound(
+            (unsigned)branchPointHeight);
+         if (sumIter == sshObj.subsshSummary_.begin())
+            sshObj.lastTouchedHeight_ = 0;
+         else
+            sshObj.lastTouchedHeight_ = prev(sumIter)->first;
+      }
+
       //go thourgh all ssh in scrAddrFilter
       for (auto& scrAddr : *scrAddrMap)
       {
@@ -1632,7 +1845,7 @@ bool BlockchainScanner::resolveTxHashes()
       return this->db_->getFilterPoolDataRef(fileId);
    };
    auto resultMap = TxFilterPoolReader::scanHashes(totalBlockFileCount_,
-      fetch, missingHashes, TxFilterPoolMode::Auto);
+      fetch, missingHashes, TxFilterPoolMode::Auto, taskPool_.get());
 
    set<uint32_t> heights;
    map<uint32_t, map<uint32_t, set<const TxHashHints*>>> resultsByHash;
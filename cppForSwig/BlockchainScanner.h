@@ -16,8 +16,11 @@
 #include "Progress.h"
 #include "bdmenums.h"
 #include "ThreadSafeClasses.h"
+#include "TaskPool.h"
 
 #include "SshParser.h"
+#include "TxOutScrRef.h"
+#include "FlatHashMap.h"
 
 #include <future>
 #include <atomic>
@@ -25,6 +28,13 @@
 
 #define BATCH_SIZE  1024 * 1024 * 512ULL
 
+#ifndef UNIT_TESTS
+#define UTXO_SNAPSHOT_INTERVAL 10000
+#else
+#define UTXO_SNAPSHOT_INTERVAL 2
+#endif
+#define UTXO_SNAPSHOT_DEPTH 4
+
 class ScanningException : public std::runtime_error
 {
 private:
@@ -37,7 +47,21 @@ public:
 };
 
 struct TxHashHints;
-struct TxOutScrRef;
+
+//tx hash followed by the txout id as LE uint32, the layout of a txin outpoint
+typedef FixedKey<36> OutpointKey;
+
+inline OutpointKey getOutpointKey(const BinaryDataRef& txHash, unsigned txOutId)
+{
+   if (txHash.getSize() != 32)
+      throw std::runtime_error("invalid tx hash size");
+
+   OutpointKey key;
+   memcpy(key.data_, txHash.getPtr(), 32);
+   for (unsigned i = 0; i < 4; i++)
+      key.data_[32 + i] = (uint8_t)(txOutId >> (i * 8));
+   return key;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 struct ParserBatch
@@ -55,18 +79,21 @@ public:
    const unsigned targetBlockFileID_;
 
    std::map<unsigned, std::shared_ptr<BlockData>> blockMap_;
-   std::map<BinaryData, std::map<unsigned, StoredTxOut>> outputMap_;
+   const std::shared_ptr<OffsetArena> offsetArena_ =
+      std::make_shared<OffsetArena>();
+   FlatHashMap<OutpointKey, StoredTxOut> outputMap_;
    std::map<BinaryData, std::map<BinaryData, StoredSubHistory>> sshMap_;
    std::vector<StoredTxOut> spentOutputs_;
 
-   const std::shared_ptr<std::unordered_map<TxOutScriptRef, int>> scriptRefMap_;
+   const std::shared_ptr<OutScrRefMap> scriptRefMap_;
+   std::unique_ptr<StoredUtxoSnapshot> utxoSnapshot_;
    std::promise<bool> completedPromise_;
    unsigned count_;
 
 public:
    ParserBatch(unsigned start, unsigned end,
       unsigned startID, unsigned endID,
-      std::shared_ptr<std::unordered_map<TxOutScriptRef, int>> scriptRefMap) :
+      std::shared_ptr<OutScrRefMap> scriptRefMap) :
       start_(start), end_(end), 
       startBlockFileID_(startID), targetBlockFileID_(endID),
       scriptRefMap_(scriptRefMap)
@@ -91,17 +118,28 @@ private:
    const unsigned writeQueueDepth_;
    const unsigned totalBlockFileCount_;
 
+   //shared by the output and input stages
+   std::shared_ptr<Armory::Threading::TaskPool> taskPool_;
+
    BinaryData topScannedBlockHash_;
 
+   //scrAddrs whose ssh summary was rewritten by updateSSH or undo
+   std::shared_ptr<std::set<BinaryData>> touchedScrAddrs_ =
+      std::make_shared<std::set<BinaryData>>();
+
    ProgressCallback progress_ = 
       [](BDMPhase, double, unsigned, unsigned)->void{};
    bool reportProgress_ = false;
 
    //only for relevant utxos
-   std::map<BinaryData, std::map<unsigned, StoredTxOut>> utxoMap_;
+   FlatHashMap<OutpointKey, StoredTxOut> utxoMap_;
 
    unsigned startAt_ = 0;
 
+   //utxo checkpoints are taken past this height, UINT32_MAX to disable
+   unsigned nextSnapshotHeight_ = UINT32_MAX;
+   BinaryData snapshotMerkle_;
+
    std::mutex resolverMutex_;
 
    Armory::Threading::BlockingQueue<std::unique_ptr<ParserBatch>> outputQueue_;
@@ -113,7 +151,9 @@ private:
 private:
    void writeBlockData(void);
    void processAndCommitTxHints(ParserBatch*);
-   void preloadUtxos(void);
+   void preloadUtxos(unsigned);
+   unsigned loadUtxoSnapshot(unsigned);
+   std::unique_ptr<StoredUtxoSnapshot> takeUtxoSnapshot(ParserBatch*);
 
    int32_t check_merkle(int32_t startHeight);
 
@@ -141,9 +181,11 @@ public:
       unsigned threadcount, unsigned queue_depth, 
       ProgressCallback prg, bool reportProgress) :
       blockchain_(bc), db_(db), scrAddrFilter_(saf),
-      blockDataLoader_(bf.folderPath()),
+      blockDataLoader_(bf.folderPath(),
+         Armory::Config::DBSettings::blkFileWindow()),
       totalThreadCount_(threadcount), writeQueueDepth_(queue_depth),
       totalBlockFileCount_(bf.fileCount()),
+      taskPool_(std::make_shared<Armory::Threading::TaskPool>(threadcount)),
       progress_(prg), reportProgress_(reportProgress)
    {}
 
@@ -158,6 +200,11 @@ public:
    {
       return topScannedBlockHash_;
    }
+
+   std::shared_ptr<std::set<BinaryData>> getTouchedScrAddrs(void) const
+   {
+      return touchedScrAddrs_;
+   }
 };
 
 #endif
\ No newline at end of file
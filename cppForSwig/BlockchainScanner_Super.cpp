@@ -56,14 +56,18 @@ void BlockchainScanner_Super::scan()
       //setup batch counter
       auto meta_tx = db_->beginTransaction(SUBSSH_META, LMDB::ReadOnly);
 
-      //look for last entry in subssh_meta db
+      //look for last entry in subssh_meta db, build checkpoints sort 
+      //past it
       BinaryWriter lastKey(8);
       lastKey.put_uint32_t(0xFFFFFFFF);
-      lastKey.put_uint32_t(0);
+      lastKey.put_uint32_t(0xFFFFFFFF);
 
       auto dbIter = db_->getIterator(SUBSSH_META);
-      if (dbIter->seekToBefore(lastKey.getDataRef()) != false &&
-         dbIter->getKeyRef().getSize() == 8)
+      bool found = dbIter->seekToBefore(lastKey.getDataRef());
+      while (found && dbIter->getKeyRef().getSize() != 8)
+         found = dbIter->retreat() && dbIter->readIterData();
+
+      if (found)
       {
          auto&& keyReader = dbIter->getKeyReader();
          batch_counter_ = keyReader.get_uint32_t(BE) + 1;
@@ -86,11 +90,21 @@ void BlockchainScanner_Super::scan()
    {
       while (startHeight <= topBlock->getBlockHeight())
       {
+         //committed batches are checkpoints, the next run picks up here.
+         //A spent budget still buys one batch, reruns always move forward
+         if (_count > 0 && pastDeadline())
+         {
+            LOGINFO << "build budget spent, pausing scan at block #" <<
+               startHeight;
+            paused_ = true;
+            break;
+         }
+
          //figure out how many blocks to pull for this batch
          //batches try to grab up nBlockFilesPerBatch_ worth of block data
          unsigned targetHeight = startHeight;
-         size_t targetSize = BATCH_SIZE_SUPER;
-         size_t tallySize;
+         size_t targetSize = batchSizer_.targetSize();
+         size_t tallySize = 0;
          set<unsigned> blockFileIDs;
          try
          {
@@ -134,6 +148,7 @@ void BlockchainScanner_Super::scan()
             BD_ORDER_INCREMENT,
             &blockDataLoader_, blockchain_);
          auto batch = make_unique<ParserBatch_Ssh>(move(blockDataBatch));
+         batch->blockBytes_ = tallySize;
 
          shared_future<bool> batch_fut = batch->completedPromise_.get_future();
          completedFutures.push_back(batch_fut);
@@ -144,14 +159,21 @@ void BlockchainScanner_Super::scan()
          processInputs(batch.get());
          serializeSubSsh(move(batch));
 
+         auto queueDepth = batchSizer_.queueDepth();
          if (_count > 
-            completedBatches_.load(memory_order_relaxed) + writeQueueDepth_)
+            completedBatches_.load(memory_order_relaxed) + queueDepth)
          {
             try
             {
                auto futIter = completedFutures.begin() + 
-                  (_count - writeQueueDepth_);
+                  (_count - queueDepth);
+
+               auto waitStart = chrono::steady_clock::now();
                futIter->get();
+               auto waited = chrono::duration_cast<chrono::microseconds>(
+                  chrono::steady_clock::now() - waitStart);
+               parserWaitUs_.fetch_add(
+                  waited.count(), memory_order_relaxed);
             }
             catch (future_error &e)
             {
@@ -188,37 +210,56 @@ void BlockchainScanner_Super::scan()
       LOGINFO << "scanned transaction history in " << timeSpent << "s";
    }
 
+   if (blockDataLoader_.isStreaming())
+   {
+      auto streamWindow = blockDataLoader_.streamWindow();
+      LOGINFO << "block file window: " << streamWindow->windowSize() <<
+         " files, peaked at " << streamWindow->peakCount() << ", " <<
+         streamWindow->waitCount() << " waits, " << 
+         streamWindow->evictionCount() << " evictions";
+   }
+
+   LOGINFO << "task pool: " << taskPool_->threadCount() << " workers, " <<
+      taskPool_->stealCount() << " steals";
+
+   auto recentLookups =
+      recentOutputs_.hitCount() + recentOutputs_.missCount();
+   if (recentLookups > 0)
+   {
+      LOGINFO << "recent outputs: " << recentOutputs_.hitCount() <<
+         " hits out of " << recentLookups << " input lookups (" <<
+         recentOutputs_.hitCount() * 100 / recentLookups << "%)";
+   }
+
    db_->updateHeightToIdMap(heightToId_);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 void BlockchainScanner_Super::processOutputs(ParserBatch_Ssh* batch)
 {
-   auto process_thread = [this](ParserBatch_Ssh* batch, unsigned id)->void
-   {
-      this->processOutputsThread(batch, id);
-   };
-
    //populate the next batch's file map while the first
    //batch is being processed
    batch->bdb_->populateFileMap();
 
    batch->processStart_ = chrono::system_clock::now();
    batch->parseTxOutStart_ = chrono::system_clock::now();
-   batch->txOutSshResults_.resize(totalThreadCount_);
 
-   //start processing threads
-   vector<thread> thr_vec;
-   for (int i = 1; i < (int)totalThreadCount_ - 2; i++)
-      thr_vec.push_back(thread(process_thread, batch, i));
-   process_thread(batch, 0);
+   //make room for this batch's outputs
+   recentOutputs_.evict(batch->bdb_->start_);
 
-   //wait on threads
-   for (auto& thr : thr_vec)
+   //one task per result slot, tasks pull blocks until the batch runs dry
+   auto taskCount = taskPool_->threadCount();
+   batch->txOutSshResults_.resize(taskCount);
+
+   TaskGroup tasks(taskPool_.get());
+   for (unsigned i = 0; i < taskCount; i++)
    {
-      if (thr.joinable())
-         thr.join();
+      tasks.run([this, batch, i](void)->void
+      {
+         this->processOutputsThread(batch, i);
+      });
    }
+   tasks.wait();
 
    batch->parseTxOutEnd_ = chrono::system_clock::now();
 }
@@ -226,31 +267,25 @@ void BlockchainScanner_Super::processOutputs(ParserBatch_Ssh* batch)
 ////////////////////////////////////////////////////////////////////////////////
 void BlockchainScanner_Super::processInputs(ParserBatch_Ssh* batch)
 {
-   auto process_thread = [this](ParserBatch_Ssh* batch, unsigned id)->void
-   {
-      this->processInputsThread(batch, id);
-   };
-
    //reset counter
    batch->resetCounter();
 
    //alloc result vectors
-   batch->txInSshResults_.resize(totalThreadCount_);
+   auto taskCount = taskPool_->threadCount();
+   batch->txInSshResults_.resize(taskCount);
    batch->parseTxInStart_ = chrono::system_clock::now();
    batch->bdb_->resetCounter();
 
-   //start processing threads
-   vector<thread> thr_vec;
-   for (int i = 1; i < (int)totalThreadCount_ - 2; i++)
-      thr_vec.push_back(thread(process_thread, batch, i));
-   process_thread(batch, 0);
-
-   //wait on threads
-   for (auto& thr : thr_vec)
+   //queue processing tasks
+   TaskGroup tasks(taskPool_.get());
+   for (unsigned i = 0; i < taskCount; i++)
    {
-      if (thr.joinable())
-         thr.join();
+      tasks.run([this, batch, i](void)->void
+      {
+         this->processInputsThread(batch, i);
+      });
    }
+   tasks.wait();
 
    //get spent offset
    batch->spent_offset_ = UINT32_MAX;
@@ -270,11 +305,6 @@ void BlockchainScanner_Super::processInputs(ParserBatch_Ssh* batch)
 void BlockchainScanner_Super::serializeSubSsh(
    unique_ptr<ParserBatch_Ssh> batch)
 {
-   auto process_thread = [this](ParserBatch_Ssh* batch)->void
-   {
-      this->serializeSubSshThread(batch);
-   };
-
    auto serialize_start = chrono::system_clock::now();
 
    //prepare batch
@@ -304,17 +334,24 @@ void BlockchainScanner_Super::serializeSubSsh(
 
    batch->sshKeyCounter_.store(0, memory_order_relaxed);
 
-   //start processing threads
-   deque<thread> thr_vec;
-   for (int i = 1; i < (int)totalThreadCount_ - 2; i++)
-      thr_vec.push_back(thread(process_thread, batch.get()));
-   process_thread(batch.get());
+   //queue serialization tasks
+   {
+      TaskGroup tasks(taskPool_.get());
+      auto batchPtr = batch.get();
+      for (unsigned i = 0; i < taskPool_->threadCount(); i++)
+      {
+         tasks.run([this, batchPtr](void)->void
+         {
+            this->serializeSubSshThread(batchPtr);
+         });
+      }
+      tasks.wait();
+   }
 
-   //wait on threads
-   for (auto& thr : thr_vec)
+   for (auto& ssh_pair : batch->serializedSubSsh_)
    {
-      if (thr.joinable())
-         thr.join();
+      batch->serializedBytes_ += ssh_pair.second.first.getSize() +
+         ssh_pair.second.second.getSize();
    }
 
    //push for commit
@@ -441,6 +478,8 @@ void BlockchainScanner_Super::processOutputsThread(
    ParserBatch_Ssh* batch, unsigned thisId)
 {
    map<BinaryData, BinaryData> hashToKey;
+   vector<pair<RecentOutputCache::TxHashKey,
+      RecentOutputCache::TxEntry>> recentOutputs;
    ThreadSubSshResult tsr;
    auto& sshMap = tsr.subSshMap_;
 
@@ -471,13 +510,19 @@ void BlockchainScanner_Super::processOutputsThread(
       for (unsigned i = 0; i < txns.size(); i++)
       {
          auto gethash = chrono::system_clock::now();
-         const BCTX& txn = *(txns[i].get());
+         const BCTX& txn = *txns[i];
          auto& txHash = txn.getHash();
 
          auto&& txkey = 
             DBUtils::getBlkDataKeyNoPrefix(header->getThisID(), 0xFF, i);
          hashToKey.insert(make_pair(txHash, move(txkey)));
 
+         RecentOutputCache::TxEntry recentEntry;
+         recentEntry.height_ = header->getBlockHeight();
+         recentEntry.dup_ = header->getDuplicateID();
+         recentEntry.txIndex_ = i;
+         recentEntry.outputs_.reserve(txn.txouts_.size());
+
          getHashCtr += chrono::system_clock::now() - gethash;
 
          for (unsigned y = 0; y < txn.txouts_.size(); y++)
@@ -497,6 +542,8 @@ void BlockchainScanner_Super::processOutputsThread(
             auto updatessh = chrono::system_clock::now();
 
             auto&& scrAddr = scrRef.getScrAddr();
+            recentEntry.outputs_.push_back({ scrAddr, value });
+
             auto&& txioKey = DBUtils::getBlkDataKeyNoPrefix(
                header->getBlockHeight(), header->getDuplicateID(),
                i, y);
@@ -537,12 +584,17 @@ void BlockchainScanner_Super::processOutputsThread(
 
             updateSsh += chrono::system_clock::now() - updatessh;
          }
+
+         recentOutputs.push_back(make_pair(
+            RecentOutputCache::TxHashKey(txHash.getPtr()),
+            move(recentEntry)));
       }
 
       parseBlock += chrono::system_clock::now() - parseblock_start;
    }
 
    batch->txOutSshResults_[thisId] = move(tsr);
+   recentOutputs_.insert(recentOutputs);
 
    //grab batch mutex and merge processed data in
    unique_lock<mutex> lock(batch->mergeMutex_);
@@ -560,6 +612,8 @@ void BlockchainScanner_Super::processInputsThread(
    auto&& hints_tx = db_->beginTransaction(TXHINTS, LMDB::ReadOnly);
 
    unsigned spent_offset = UINT32_MAX;
+   uint64_t recentHits = 0;
+   uint64_t recentMisses = 0;
    while (1)
    {
       auto currentBlock =
@@ -575,7 +629,7 @@ void BlockchainScanner_Super::processInputsThread(
       auto& txns = currentBlock->getTxns();
       for (unsigned i = 0; i < txns.size(); i++)
       {
-         const BCTX& txn = *(txns[i].get());
+         const BCTX& txn = *txns[i];
 
          for (unsigned y = 0; y < txn.txins_.size(); y++)
          {
@@ -589,15 +643,41 @@ void BlockchainScanner_Super::processInputsThread(
             unsigned txOutId = READ_UINT32_LE(
                txn.data_ + txin.first + 32);
 
-            auto&& stxo = getStxoByHash(
-               outHash, txOutId, batch);
+            //recent outputs first, then the db
+            BinaryData scrAddrCopy;
+            BinaryData txoutkey;
+            uint64_t value;
+            unsigned outHeight;
+
+            auto recentEntry = recentOutputs_.find(outHash);
+            if (recentEntry != nullptr &&
+               txOutId < recentEntry->outputs_.size())
+            {
+               auto& output = recentEntry->outputs_[txOutId];
+               scrAddrCopy = output.scrAddr_;
+               value = output.value_;
+               outHeight = recentEntry->height_;
+               txoutkey = DBUtils::getBlkDataKeyNoPrefix(
+                  recentEntry->height_, recentEntry->dup_,
+                  recentEntry->txIndex_, txOutId);
+               ++recentHits;
+            }
+            else
+            {
+               auto&& stxo = getStxoByHash(
+                  outHash, txOutId, batch);
+               scrAddrCopy = stxo.getScrAddressCopy();
+               value = stxo.getValue();
+               outHeight = stxo.height_;
+               txoutkey = stxo.getDBKey();
+               ++recentMisses;
+            }
 
             auto&& txinkey = DBUtils::getBlkDataKeyNoPrefix(
                header->getBlockHeight(), header->getDuplicateID(),
                i, y);
 
             //add to ssh_
-            auto&& scrAddrCopy = stxo.getScrAddressCopy();
             auto iter = sshMap.find(scrAddrCopy);
             if (iter == sshMap.end())
             {
@@ -613,17 +693,17 @@ void BlockchainScanner_Super::processInputsThread(
 
             //deal with txio count in subssh at serialization
             TxIOPair txio;
-            auto&& txoutkey = stxo.getDBKey();
             txio.setTxOut(txoutkey);
             txio.setTxIn(txinkey);
-            txio.setValue(stxo.getValue());
+            txio.setValue(value);
             subssh.txioMap_[txoutkey] = move(txio);
 
-            spent_offset = min(spent_offset, stxo.height_);
+            spent_offset = min(spent_offset, outHeight);
          }
       }
    }
 
+   recentOutputs_.countLookups(recentHits, recentMisses);
    tsr.spent_offset_ = spent_offset;
    batch->txInSshResults_[thisId] = move(tsr);
 }
@@ -684,7 +764,7 @@ void BlockchainScanner_Super::serializeSubSshThread(ParserBatch_Ssh* batch)
       auto& bw_pair = batch->serializedSubSsh_[sshKey];
       StoredSubHistory::compressMany(subsshMap, 
          batch->bdb_->start_, batch->spent_offset_, 
-         bw_pair.second);
+         bw_pair.second, db_->getSubsshFormat());
       bw_pair.first.reserve(4 + sshKey.getSize());
       bw_pair.first.put_uint32_t(batch->batch_id_, BE);
       bw_pair.first.put_BinaryDataRef(sshKey);
@@ -696,41 +776,63 @@ void BlockchainScanner_Super::writeSubSsh(ParserBatch_Ssh* batch)
 {
    batch->writeSshStart_ = chrono::system_clock::now();
    auto ctr = batch->batch_id_;
-   auto&& tx = db_->beginTransaction(SUBSSH, LMDB::ReadWrite);
-   auto&& meta_tx = db_->beginTransaction(SUBSSH_META, LMDB::ReadWrite);
-
-   {
-      //put height offset
-      BinaryWriter meta_key(8), meta_data(8);
-      meta_key.put_uint32_t(ctr, BE);
-      meta_key.put_uint32_t(0);
-
-      meta_data.put_uint32_t(batch->bdb_->start_);
-      meta_data.put_uint32_t(batch->spent_offset_);
-
-      db_->putValue(
-         SUBSSH_META,
-         meta_key.getDataRef(), meta_data.getDataRef());
-   }
-
-   for (auto& ssh_pair : batch->serializedSubSsh_)
+   auto start = batch->bdb_->start_;
+   auto spentOffset = batch->spent_offset_;
+   auto topheader = batch->bdb_->blockMap_.rbegin()->second->getHeaderPtr();
+   auto topHeight = topheader->getBlockHeight();
+   auto topHash = topheader->getThisHash();
+
+   /*
+   Keys are the batch id (big endian) followed by the ssh key, and the map 
+   is ordered by ssh key, so the puts come sorted. Batch ids only grow, the 
+   whole batch lands past the last key in the db and gets appended.
+   */
+   auto subsshPtr = make_shared<
+      map<BinaryDataRef, pair<BinaryWriter, BinaryWriter>>>(
+      move(batch->serializedSubSsh_));
+
+   auto subsshBatch = make_unique<DBWriteBatch>(SUBSSH);
+   subsshBatch->puts_.reserve(subsshPtr->size());
+   for (auto& ssh_pair : *subsshPtr)
    {
-      db_->putValue(SUBSSH,
+      subsshBatch->puts_.emplace_back(
          ssh_pair.second.first.getDataRef(),
          ssh_pair.second.second.getDataRef());
    }
+   subsshBatch->owner_ = subsshPtr;
 
-   //sdbi
-   auto topheader = batch->bdb_->blockMap_.rbegin()->second->getHeaderPtr();
-   auto&& subssh_sdbi = db_->getStoredDBInfo(SUBSSH, 0);
-   subssh_sdbi.topBlkHgt_ = topheader->getBlockHeight();
-   subssh_sdbi.topScannedBlkHash_ = topheader->getThisHash();
-   subssh_sdbi.metaInt_ = ctr;
+   subsshBatch->inTx_ = [this, ctr, start, spentOffset, topHeight, topHash]
+      (void)->void
+   {
+      {
+         //put height offset
+         auto&& meta_tx = db_->beginTransaction(SUBSSH_META, LMDB::ReadWrite);
+         BinaryWriter meta_key(8), meta_data(8);
+         meta_key.put_uint32_t(ctr, BE);
+         meta_key.put_uint32_t(0);
+
+         meta_data.put_uint32_t(start);
+         meta_data.put_uint32_t(spentOffset);
+
+         db_->putValue(
+            SUBSSH_META,
+            meta_key.getDataRef(), meta_data.getDataRef());
+      }
 
-   db_->putStoredDBInfo(SUBSSH, subssh_sdbi, 0);
+      //sdbi
+      auto&& subssh_sdbi = db_->getStoredDBInfo(SUBSSH, 0);
+      subssh_sdbi.topBlkHgt_ = topHeight;
+      subssh_sdbi.topScannedBlkHash_ = topHash;
+      subssh_sdbi.metaInt_ = ctr;
+
+      db_->putStoredDBInfo(SUBSSH, subssh_sdbi, 0);
+   };
+
+   //commits on the SUBSSH writer thread while the next batch is processed
+   db_->commitStage().push(move(subsshBatch));
 
    //keep track of height range per batch id
-   heightToId_.insert(make_pair(batch->bdb_->start_, ctr));
+   heightToId_.insert(make_pair(start, ctr));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -754,9 +856,15 @@ void BlockchainScanner_Super::commitSshBatch()
       calc.fractionCompleted(), UINT32_MAX,
       (unsigned)initVal);
 
+   //shards commit in parallel, the summed commit time overstates the writer
+   auto& commitStage = db_->commitStage();
+   auto shardCount = max(db_->getShardCount(SUBSSH), 1U);
+   auto lastCommitTime = commitStage.getStats(SUBSSH).commitTime_;
+
    while (1)
    {
       unique_ptr<ParserBatch_Ssh> batch;
+      auto waitStart = chrono::steady_clock::now();
       try
       {
          batch = move(commitQueue_.pop_front());
@@ -765,6 +873,8 @@ void BlockchainScanner_Super::commitSshBatch()
       {
          break;
       }
+      chrono::duration<double> writerWait = 
+         chrono::steady_clock::now() - waitStart;
 
       //sanity check
       if (batch->bdb_->blockMap_.size() == 0)
@@ -819,6 +929,33 @@ void BlockchainScanner_Super::commitSshBatch()
          LOGINFO << "   waited on batch for " << total.count() << "s";
       }
 
+      {
+         //commits lag a batch behind the push, close enough for a trend
+         BatchTimings timings;
+         timings.blockBytes_ = batch->blockBytes_;
+         timings.serializedBytes_ = batch->serializedBytes_;
+
+         chrono::duration<double> parseTime =
+            batch->parseTxInEnd_ - batch->parseTxOutStart_;
+         timings.parseTime_ = parseTime.count() + batch->serializeSsh_.count();
+
+         auto commitTime = commitStage.getStats(SUBSSH).commitTime_;
+         timings.writeTime_ = (commitTime - lastCommitTime) / shardCount;
+         lastCommitTime = commitTime;
+
+         timings.parserWait_ = 
+            (double)parserWaitUs_.exchange(0, memory_order_relaxed) / 1e6;
+         timings.writerWait_ = writerWait.count();
+
+         batchSizer_.update(timings);
+         if (init_)
+         {
+            LOGINFO << "   committed in " << timings.writeTime_ << 
+               "s, next batch: " << batchSizer_.targetSize() / 1024 << 
+               "kB, queue depth " << batchSizer_.queueDepth();
+         }
+      }
+
       size_t progVal = getGlobalOffsetForBlock(batch->bdb_->end_);
       calc.advance(progVal);
       if (reportProgress_)
@@ -830,28 +967,22 @@ void BlockchainScanner_Super::commitSshBatch()
       completedBatches_.fetch_add(1, memory_order_relaxed);
       batch->completedPromise_.set_value(true);
    }
+
+   commitStage.flush(SUBSSH);
+   commitStage.logStats();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 void BlockchainScanner_Super::scanSpentness()
 {
+   if (paused_)
+      return;
+
    LOGINFO << "scanning spentness";
    TIMER_RESTART("spentness");
 
    heightAndDupMap_ = move(blockchain_->getHeightAndDupMap());
 
-   completedBatches_.store(0, memory_order_relaxed);
-   unsigned _count = 0;
-
-   vector<shared_future<bool>> batchFutures;
-
-   //start writer thread
-   auto write_lbd = [this](void)->void
-   {
-      writeSpentness();
-   };
-   thread write_thread(write_lbd);
-
    //grab spentness db header to initialize scan state
    StoredDBInfo sdbi;
    {
@@ -872,11 +1003,91 @@ void BlockchainScanner_Super::scanSpentness()
    if (sdbi.metaInt_ != UINT64_MAX)
       end = (int)sdbi.metaInt_ + 1;
 
-   int start = blockchain_->top()->getBlockHeight();
+   auto updateSdbi = [this, &sdbi](unsigned height)->void
+   {
+      auto sdbitx = db_->beginTransaction(SPENTNESS, LMDB::ReadWrite);
+      sdbi.metaInt_ = height;
+      db_->putStoredDBInfo(SPENTNESS, sdbi, UINT32_MAX);
+   };
+
+   /*
+   An interrupted run left the blocks from its checkpoint's low height to 
+   its top done. Finish the blocks below first, then the ones that came in 
+   on top of it since.
+   */
+   StoredBuildCheckpoint checkpoint;
+   if (db_->getBuildCheckpoint(checkpoint, BUILD_CHECKPOINT_SPENTNESS))
+   {
+      if (isCheckpointValid(checkpoint) && 
+         (int)checkpoint.lowHeight_ >= end &&
+         (int)checkpoint.topHeight_ >= end)
+      {
+         LOGINFO << "resuming spentness from checkpoint, blocks #" <<
+            checkpoint.lowHeight_ << " to #" << checkpoint.topHeight_ <<
+            " are done";
+
+         scanSpentnessRange(
+            (int)checkpoint.lowHeight_ - 1, end, checkpoint);
+         if (paused_)
+            return;
+
+         updateSdbi(checkpoint.topHeight_);
+         end = (int)checkpoint.topHeight_ + 1;
+      }
+   }
+
+   auto topBlock = blockchain_->top();
+   checkpoint = StoredBuildCheckpoint();
+   checkpoint.type_ = BUILD_CHECKPOINT_SPENTNESS;
+   checkpoint.topHeight_ = topBlock->getBlockHeight();
+   checkpoint.topHash_ = topBlock->getThisHash();
 
    //run from current top to last commited
+   scanSpentnessRange(topBlock->getBlockHeight(), end, checkpoint);
+   if (paused_)
+      return;
+
+   //update top batch id
+   updateSdbi(topBlock->getBlockHeight());
+   if (init_)
+      db_->deleteBuildCheckpoint(BUILD_CHECKPOINT_SPENTNESS);
+
+   TIMER_STOP("spentness");
+   auto timeSpent = TIMER_READ_SEC("spentness");
+   LOGINFO << "parsed spentness in " << timeSpent << "s";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner_Super::scanSpentnessRange(
+   int start, int end, StoredBuildCheckpoint& checkpoint)
+{
+   //walks blocks from start down to end
+   completedBatches_.store(0, memory_order_relaxed);
+   unsigned _count = 0;
+
+   vector<shared_future<bool>> batchFutures;
+
+   //start writer thread, checkpoints are only kept for the initial build
+   StoredBuildCheckpoint writerCheckpoint;
+   if (init_)
+      writerCheckpoint = checkpoint;
+
+   auto write_lbd = [this, writerCheckpoint](void)->void
+   {
+      writeSpentness(writerCheckpoint);
+   };
+   thread write_thread(write_lbd);
+
    while (start >= end)
    {
+      if (_count > 0 && pastDeadline())
+      {
+         LOGINFO << "build budget spent, pausing spentness at block #" <<
+            start;
+         paused_ = true;
+         break;
+      }
+
       //figure out batch range
       set<unsigned> blockFileIDs;
       shared_ptr<BlockHeader> currentHeader = blockchain_->getHeaderByHeight(start, 0xFF);
@@ -910,12 +1121,12 @@ void BlockchainScanner_Super::scanSpentness()
 
       //check queue length, wait on commit thread if necessary
       if (_count >
-         completedBatches_.load(memory_order_relaxed) + writeQueueDepth_)
+         completedBatches_.load(memory_order_relaxed) + SPENTNESS_QUEUE_DEPTH)
       {
          try
          {
             auto futIter = batchFutures.begin() +
-               (_count - writeQueueDepth_);
+               (_count - SPENTNESS_QUEUE_DEPTH);
             futIter->get();
          }
          catch (future_error &e)
@@ -933,43 +1144,24 @@ void BlockchainScanner_Super::scanSpentness()
    if (write_thread.joinable())
       write_thread.join();
 
-   //update top batch id
-   {
-      auto sdbitx = db_->beginTransaction(SPENTNESS, LMDB::ReadWrite);
-      sdbi.metaInt_ = blockchain_->top()->getBlockHeight();;
-      db_->putStoredDBInfo(SPENTNESS, sdbi, UINT32_MAX);
-   }
-
-   TIMER_STOP("spentness");
-   auto timeSpent = TIMER_READ_SEC("spentness");
-   LOGINFO << "parsed spentness in " << timeSpent << "s";
+   //the queue is reused by the next range
+   spentnessQueue_.clear();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 void BlockchainScanner_Super::parseSpentness(ParserBatch_Spentness* batch)
 {
-   auto parse_lbd = [this, batch](void)->void
-   {
-      parseSpentnessThread(batch);
-   };
-
    batch->bdb_->populateFileMap();
-   vector<thread> threads(totalThreadCount_);
-   auto threadCount = totalThreadCount_;
-   if (threadCount > 2)
-      threadCount -= 2;
-   else
-      threadCount = 0;
-
-   for (unsigned i = 0; i < threadCount; i++)
-      threads.push_back(thread(parse_lbd));
-   parse_lbd();
 
-   for (auto& thr : threads)
+   TaskGroup tasks(taskPool_.get());
+   for (unsigned i = 0; i < taskPool_->threadCount(); i++)
    {
-      if (thr.joinable())
-         thr.join();
+      tasks.run([this, batch](void)->void
+      {
+         parseSpentnessThread(batch);
+      });
    }
+   tasks.wait();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1088,19 +1280,39 @@ void BlockchainScanner_Super::parseSpentnessThread(ParserBatch_Spentness* batch)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void BlockchainScanner_Super::writeSpentness()
+void BlockchainScanner_Super::writeSpentness(
+   StoredBuildCheckpoint checkpoint)
 {
    map<BinaryData, BinaryData> spentnessLeftOver;
+   auto& commitStage = db_->commitStage();
+   unsigned batchCount = 0;
+
+   /*
+   Leftovers are spentness for txouts below the current batch, held back to
+   keep the puts in key order. A checkpoint covers every input of the 
+   blocks above it, so it carries the leftovers with the batch it follows.
+   */
+   auto pushCheckpoint = [this, &checkpoint](
+      unsigned lowHeight, shared_future<void> after)->void
+   {
+      if (!checkpoint.isInitialized())
+         return;
+
+      checkpoint.lowHeight_ = lowHeight;
+      db_->pushBuildCheckpoint(checkpoint, { after });
+   };
+   unsigned lastLowHeight = UINT32_MAX;
+   shared_future<void> lastCommit;
 
-   auto dbPtr = db_;
-   auto commit = [dbPtr](
+   //leftovers are written after the batch keys, as they were committed
+   //in that order
+   auto merge = [](map<BinaryData, BinaryData>& dest,
       map<BinaryData, BinaryData>::iterator begin, 
       map<BinaryData, BinaryData>::iterator end)
    {
       while (begin != end)
       {
-         dbPtr->putValue(SPENTNESS, 
-            begin->first, begin->second);
+         dest[begin->first] = move(begin->second);
          ++begin;
       }
    };
@@ -1121,13 +1333,22 @@ void BlockchainScanner_Super::writeSpentness()
       auto&& bw_cutoff = DBUtils::getBlkDataKeyNoPrefix(
          UINT32_MAX - batch->bdb_->end_, 0, 0, 0);
 
-      auto dbtx = db_->beginTransaction(SPENTNESS, LMDB::ReadWrite);
-      commit(batch->keysToCommit_.begin(), batch->keysToCommit_.end());
+      auto toCommit = move(batch->keysToCommit_);
 
       //tally leftover size, commit if it breaches threshold
-      if (spentnessLeftOver.size() > LEFTOVER_THRESHOLD)
+      ++batchCount;
+      bool withCheckpoint = checkpoint.isInitialized() &&
+         batchCount % SPENTNESS_CHECKPOINT_BATCHES == 0;
+      if (withCheckpoint)
       {
-         commit(spentnessLeftOver.begin(), spentnessLeftOver.end());
+         for (auto& keyVal : batch->keysToCommitLater_)
+            spentnessLeftOver.emplace(keyVal);
+         batch->keysToCommitLater_.clear();
+      }
+
+      if (spentnessLeftOver.size() > LEFTOVER_THRESHOLD || withCheckpoint)
+      {
+         merge(toCommit, spentnessLeftOver.begin(), spentnessLeftOver.end());
          spentnessLeftOver.clear();
       }
 
@@ -1136,10 +1357,17 @@ void BlockchainScanner_Super::writeSpentness()
       if (eligible_spentness != spentnessLeftOver.begin())
       {
          //grab valid range, remove from leftovers
-         commit(spentnessLeftOver.begin(), eligible_spentness);
+         merge(toCommit, spentnessLeftOver.begin(), eligible_spentness);
          spentnessLeftOver.erase(spentnessLeftOver.begin(), eligible_spentness);
       }
 
+      //the batch owns its data, leftovers are free to change while it commits
+      lastCommit = commitStage.push(
+         DBWriteBatch::fromMap(SPENTNESS, move(toCommit)));
+      lastLowHeight = batch->bdb_->end_;
+      if (withCheckpoint)
+         pushCheckpoint(lastLowHeight, lastCommit);
+
       //merge in new leftovers from current batch
       for (auto& keyVal : batch->keysToCommitLater_)
          spentnessLeftOver.emplace(keyVal);
@@ -1154,9 +1382,34 @@ void BlockchainScanner_Super::writeSpentness()
    //commit leftovers
    if (spentnessLeftOver.size())
    {
-      auto dbtx = db_->beginTransaction(SPENTNESS, LMDB::ReadWrite);
-      commit(spentnessLeftOver.begin(), spentnessLeftOver.end());
+      lastCommit = commitStage.push(
+         DBWriteBatch::fromMap(SPENTNESS, move(spentnessLeftOver)));
    }
+
+   //covers everything written so far, the run may have been cut short
+   if (lastLowHeight != UINT32_MAX)
+      pushCheckpoint(lastLowHeight, lastCommit);
+
+   commitStage.flush(SPENTNESS);
+   commitStage.flush(SUBSSH_META);
+   commitStage.logStats();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool BlockchainScanner_Super::isCheckpointValid(
+   const StoredBuildCheckpoint& checkpoint) const
+{
+   try
+   {
+      auto header = blockchain_->getHeaderByHeight(checkpoint.topHeight_, 0xFF);
+      if (header->getThisHash() == checkpoint.topHash_)
+         return true;
+   }
+   catch (exception&)
+   {}
+
+   LOGWARN << "build checkpoint top is off the main branch, ignoring it";
+   return false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1164,6 +1417,9 @@ void BlockchainScanner_Super::updateSSH(bool force)
 {
    //loop over all subssh entiers in SUBSSH db, 
    //compile balance, txio count and summary map for each address
+   if (paused_)
+      return;
+
    unsigned scanFrom = 0;
 
    auto&& sshSdbi = db_->getStoredDBInfo(SSH, 0);
@@ -1190,13 +1446,71 @@ void BlockchainScanner_Super::updateSSH(bool force)
    if (force)
       scanFrom = 0;
 
+   /*
+   An interrupted run committed the bounds up to its checkpoint's last key.
+   Tally the rest over the same subssh range, that brings the ssh db to the
+   checkpoint's top, then carry on from there.
+   */
+   StoredBuildCheckpoint checkpoint;
+   if (db_->getBuildCheckpoint(checkpoint, BUILD_CHECKPOINT_SSH))
+   {
+      if (!force && isCheckpointValid(checkpoint) &&
+         checkpoint.firstHeight_ == scanFrom)
+      {
+         LOGINFO << "resuming ssh update from checkpoint";
+
+         ShardedSshParser sshParser(
+            db_, scanFrom, totalThreadCount_, init_, taskPool_);
+         sshParser.setCheckpoint(checkpoint, deadline_);
+         sshParser.updateSsh();
+         if (sshParser.isPaused())
+         {
+            paused_ = true;
+            return;
+         }
+
+         sshSdbi.topScannedBlkHash_ = checkpoint.topHash_;
+         sshSdbi.topBlkHgt_ = checkpoint.topHeight_;
+         {
+            auto ssh_tx = db_->beginTransaction(SSH, LMDB::ReadWrite);
+            db_->putStoredDBInfo(SSH, sshSdbi, 0);
+         }
+
+         scanFrom = checkpoint.topHeight_ + 1;
+      }
+
+      //stale checkpoints are dropped as well
+      db_->deleteBuildCheckpoint(BUILD_CHECKPOINT_SSH);
+   }
+
    if (scanFrom > topBlock->getBlockHeight())
       return;
    
    TIMER_RESTART("updateSSH");
 
-   ShardedSshParser sshParser(db_, scanFrom, totalThreadCount_, init_);
+   ShardedSshParser sshParser(
+      db_, scanFrom, totalThreadCount_, init_, taskPool_);
+   auto&& subsshSdbi = db_->getStoredDBInfo(SUBSSH, 0);
+   if (init_ && subsshSdbi.topScannedBlkHash_.getSize() == 32)
+   {
+      //checkpoint against the subssh range this run tallies
+
+      checkpoint = StoredBuildCheckpoint();
+      checkpoint.type_ = BUILD_CHECKPOINT_SSH;
+      checkpoint.topHeight_ = subsshSdbi.topBlkHgt_;
+      checkpoint.topHash_ = subsshSdbi.topScannedBlkHash_;
+      checkpoint.firstHeight_ = scanFrom;
+      checkpoint.topId_ = (uint32_t)subsshSdbi.metaInt_;
+      sshParser.setCheckpoint(checkpoint, deadline_);
+   }
+
    sshParser.updateSsh();
+   touchedScrAddrs_ = sshParser.getTouchedScrAddrs();
+   if (sshParser.isPaused())
+   {
+      paused_ = true;
+      return;
+   }
 
    {
       //update sdbi
@@ -1211,6 +1525,10 @@ void BlockchainScanner_Super::updateSSH(bool force)
       db_->putStoredDBInfo(SSH, sshSdbi, 0);
    }
 
+   //the sdbi covers the run now
+   if (init_)
+      db_->deleteBuildCheckpoint(BUILD_CHECKPOINT_SSH);
+
    TIMER_STOP("updateSSH");
    auto timeSpent = TIMER_READ_SEC("updateSSH");
    if (timeSpent >= 5)
@@ -1256,8 +1574,8 @@ void BlockchainScanner_Super::undo(Blockchain::ReorganizationState& reorgState)
       auto fileIter = fileMaps_.find(filenum);
       if (fileIter == fileMaps_.end())
       {
-         fileIter = fileMaps_.insert(make_pair(
-            filenum, blockDataLoader_.get(filenum))).first;
+         fileIter = fileMaps_.insert(make_pair(filenum, 
+            blockDataLoader_.get(filenum, (unsigned)fileMaps_.size()))).first;
       }
 
       auto filemap = fileIter->second;
@@ -1330,8 +1648,9 @@ void BlockchainScanner_Super::undo(Blockchain::ReorganizationState& reorgState)
    }
 
    ShardedSshParser sshParser(db_, *undoneHeights.begin(), 
-      totalThreadCount_, false);
+      totalThreadCount_, false, taskPool_);
    sshParser.undo();
+   touchedScrAddrs_ = sshParser.getTouchedScrAddrs();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1382,11 +1701,9 @@ void BlockDataBatch::populateFileMap()
    if (blockDataFileIDs_.size() == 0)
       return;
 
-   for(auto& id : blockDataFileIDs_)
-   {
-      fileMaps_.insert(
-         make_pair(id, blockDataLoader_->get(id)));
-   }
+   //blocks while the streaming window is full
+   if (fileMaps_.empty())
+      fileMaps_ = blockDataLoader_->get(blockDataFileIDs_);
 
    auto begin = min(start_, end_);
    auto end = max(start_, end_);
@@ -1443,7 +1760,7 @@ shared_ptr<BlockData> BlockDataBatch::getBlockData(unsigned height)
    auto bdata = BlockData::deserialize(
       filemap->getPtr() + blockheader->getOffset(),
       blockheader->getBlockSize(),
-      blockheader, getID, false, false);
+      blockheader, getID, false, false, offsetArena_);
 
    if (!bdata->isInitialized())
    {
@@ -1477,3 +1794,214 @@ shared_ptr<BlockData> BlockDataBatch::getNext()
 
    return getBlockData(height);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// RecentOutputCache
+//
+////////////////////////////////////////////////////////////////////////////////
+RecentOutputCache::RecentOutputCache(unsigned depth, size_t maxOutputs) :
+   depth_(depth), maxOutputs_(maxOutputs)
+{
+   outputCount_.store(0, memory_order_relaxed);
+   hits_.store(0, memory_order_relaxed);
+   misses_.store(0, memory_order_relaxed);
+
+   for (unsigned i = 0; i < RECENT_OUTPUTS_SHARDS; i++)
+      shards_.push_back(make_unique<Shard>());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void RecentOutputCache::insert(vector<pair<TxHashKey, TxEntry>>& entries)
+{
+   //group by shard to grab each shard lock once
+   vector<vector<size_t>> perShard(shards_.size());
+   for (size_t i = 0; i < entries.size(); i++)
+      perShard[getShardIndex(entries[i].first.getPtr())].push_back(i);
+
+   size_t added = 0;
+   for (size_t i = 0; i < perShard.size(); i++)
+   {
+      if (perShard[i].empty())
+         continue;
+
+      auto& shard = *shards_[i];
+      unique_lock<mutex> lock(shard.mu_);
+      for (auto& id : perShard[i])
+      {
+         auto& entry = entries[id];
+         auto height = entry.second.height_;
+         auto outputCount = entry.second.outputs_.size();
+
+         auto insertIter = shard.map_.emplace(
+            entry.first, move(entry.second));
+         if (!insertIter.second)
+            continue;
+
+         shard.byHeight_[height].push_back(entry.first);
+         added += outputCount;
+      }
+   }
+
+   outputCount_.fetch_add(added, memory_order_relaxed);
+   entries.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void RecentOutputCache::evictBelow(unsigned height)
+{
+   size_t removed = 0;
+   for (auto& shardPtr : shards_)
+   {
+      auto& shard = *shardPtr;
+      unique_lock<mutex> lock(shard.mu_);
+
+      auto heightIter = shard.byHeight_.begin();
+      while (heightIter != shard.byHeight_.end() &&
+         heightIter->first < height)
+      {
+         for (auto& key : heightIter->second)
+         {
+            //a duplicate hash only lives in the map under its first height
+            auto iter = shard.map_.find(key);
+            if (iter == shard.map_.end() ||
+               iter->second.height_ != heightIter->first)
+            {
+               continue;
+            }
+
+            removed += iter->second.outputs_.size();
+            shard.map_.erase(iter);
+         }
+
+         heightIter = shard.byHeight_.erase(heightIter);
+      }
+   }
+
+   outputCount_.fetch_sub(removed, memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void RecentOutputCache::evict(unsigned nextHeight)
+{
+   unsigned cutoff = 0;
+   if (nextHeight > depth_)
+      cutoff = nextHeight - depth_;
+   evictBelow(cutoff);
+
+   //over the cap, move the cutoff up until it fits
+   auto step = max(depth_ / 16, 1U);
+   while (outputCount() > maxOutputs_ && cutoff < nextHeight)
+   {
+      cutoff = min(cutoff + step, nextHeight);
+      evictBelow(cutoff);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const RecentOutputCache::TxEntry* RecentOutputCache::find(
+   const BinaryDataRef& txHash) const
+{
+   if (txHash.getSize() != 32)
+      return nullptr;
+
+   TxHashKey key(txHash.getPtr());
+   auto& shard = *shards_[getShardIndex(key.getPtr())];
+   auto iter = shard.map_.find(key);
+   if (iter == shard.map_.end())
+      return nullptr;
+
+   return &iter->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void RecentOutputCache::countLookups(uint64_t hits, uint64_t misses)
+{
+   hits_.fetch_add(hits, memory_order_relaxed);
+   misses_.fetch_add(misses, memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+BatchSizeController::BatchSizeController(size_t ramBudget,
+   size_t initSize, size_t minSize, size_t maxSize, unsigned maxDepth) :
+   ramBudget_(ramBudget), minSize_(minSize), maxSize_(maxSize),
+   maxDepth_(max(maxDepth, 1U))
+{
+   targetSize_ = min(max(initSize, minSize_), maxSize_);
+   targetSize_ = max(min(targetSize_, maxSizeForDepth(queueDepth_)), minSize_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t BatchSizeController::maxSizeForDepth(unsigned depth) const
+{
+   //the batch being parsed and those queued for the writer
+   return (size_t)((double)ramBudget_ / ((depth + 1) * footprint_));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BatchSizeController::update(const BatchTimings& timings)
+{
+   if (timings.blockBytes_ == 0 || timings.parseTime_ <= 0)
+      return;
+
+   unique_lock<mutex> lock(mu_);
+
+   //the parsed results stay alive with their serialized form, count them
+   //at the same size
+   double footprint = 1.0 + 
+      2.0 * (double)timings.serializedBytes_ / (double)timings.blockBytes_;
+
+   //the pipeline runs at the pace of its slower stage
+   auto stageTime = max(timings.parseTime_, timings.writeTime_);
+   double stageRate = (double)timings.blockBytes_ / stageTime;
+
+   if (stageRate_ == 0)
+   {
+      footprint_ = footprint;
+      stageRate_ = stageRate;
+   }
+   else
+   {
+      footprint_ = (footprint_ + footprint) / 2.0;
+      stageRate_ = (stageRate_ + stageRate) / 2.0;
+   }
+
+   //queue depth
+   auto stallThreshold = stageTime / 20.0;
+   bool parserStalled = timings.parserWait_ > stallThreshold;
+   bool writerStalled = timings.writerWait_ > stallThreshold;
+
+   if (parserStalled && writerStalled)
+   {
+      //uneven batches, let the faster stage run ahead
+      if (queueDepth_ < maxDepth_ &&
+         maxSizeForDepth(queueDepth_ + 1) >= targetSize_)
+         ++queueDepth_;
+   }
+   else if (parserStalled != writerStalled && queueDepth_ > 1)
+   {
+      //one stage sets the pace, a deeper queue only holds RAM
+      --queueDepth_;
+   }
+
+   //batch size, the floor wins over the ram cap
+   auto size = (size_t)(stageRate_ * BATCH_TARGET_SECONDS);
+   size = min(max(size, targetSize_ / 2), targetSize_ * 2);
+   size = min(size, maxSizeForDepth(queueDepth_));
+   targetSize_ = min(max(size, minSize_), maxSize_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t BatchSizeController::targetSize() const
+{
+   unique_lock<mutex> lock(mu_);
+   return targetSize_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned BatchSizeController::queueDepth() const
+{
+   unique_lock<mutex> lock(mu_);
+   return queueDepth_;
+}
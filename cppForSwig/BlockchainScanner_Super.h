@@ -15,6 +15,8 @@
 #include "Progress.h"
 #include "bdmenums.h"
 #include "ThreadSafeClasses.h"
+#include "TaskPool.h"
+#include "FlatHashMap.h"
 
 #include "SshParser.h"
 
@@ -31,6 +33,39 @@
 #define BATCH_SIZE_SUPER 1024
 #endif
 
+//history scan batch sizing: bounds, and the stage time a batch aims for
+#ifndef UNIT_TESTS
+#define BATCH_SIZE_SUPER_MIN 1024 * 1024 * 8ULL
+#define BATCH_SIZE_SUPER_MAX 1024 * 1024 * 1024ULL
+#else
+#define BATCH_SIZE_SUPER_MIN 1024
+#define BATCH_SIZE_SUPER_MAX 1024
+#endif
+#define BATCH_TARGET_SECONDS 10.0
+
+//ram budget per --ram-usage level
+#define RAM_USAGE_LEVEL_SIZE 1024 * 1024 * 128ULL
+
+//how far back in blocks the recent output cache reaches, and its size cap
+#ifndef UNIT_TESTS
+#define RECENT_OUTPUTS_DEPTH 1000
+#define RECENT_OUTPUTS_MAX 1024 * 1024 * 2ULL
+#else
+#define RECENT_OUTPUTS_DEPTH 2
+#define RECENT_OUTPUTS_MAX 64
+#endif
+#define RECENT_OUTPUTS_SHARDS 64
+
+//spentness batches parsed ahead of the writer
+#define SPENTNESS_QUEUE_DEPTH 1
+
+//spentness batches between build checkpoints
+#ifndef UNIT_TESTS
+#define SPENTNESS_CHECKPOINT_BATCHES 64
+#else
+#define SPENTNESS_CHECKPOINT_BATCHES 2
+#endif
+
 enum BLOCKDATA_ORDER
 {
    BD_ORDER_INCREMENT,
@@ -54,6 +89,8 @@ struct BlockDataBatch
 
    std::map<unsigned, std::shared_ptr<BlockDataFileMap>> fileMaps_;
    std::map<unsigned, std::shared_ptr<BlockData>> blockMap_;
+   const std::shared_ptr<OffsetArena> offsetArena_ =
+      std::make_shared<OffsetArena>();
 
    std::set<unsigned> blockDataFileIDs_;
    BlockDataLoader* blockDataLoader_;
@@ -108,6 +145,10 @@ public:
    std::chrono::system_clock::time_point processStart_;
    std::chrono::system_clock::time_point insertToCommitQueue_;
 
+   //raw block data and serialized subssh size, for the batch sizer
+   size_t blockBytes_ = 0;
+   size_t serializedBytes_ = 0;
+
 public:
    ParserBatch_Ssh(std::unique_ptr<BlockDataBatch> blockDataBatch) :
       bdb_(std::move(blockDataBatch))
@@ -153,6 +194,149 @@ struct StxoRef
    uint64_t getValue(void) const;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+class RecentOutputCache
+{
+   /***
+   Outputs created by the last few batches, keyed by tx hash. Most inputs
+   spend recent outputs, a hit spares them the tx hints and STXO lookups.
+
+   Filled by the txout parsing tasks, read by the txin parsing tasks. The
+   scanner runs these stages one after the other, so lookups take no lock.
+   The shard mutexes only serialize the txout tasks merging their results.
+   Eviction runs on the scan thread, ahead of each batch.
+
+   The size cap is checked on eviction, a batch can overshoot it.
+   ***/
+
+public:
+   typedef FixedKey<32> TxHashKey;
+
+   struct Output
+   {
+      BinaryData scrAddr_;
+      uint64_t value_;
+   };
+
+   struct TxEntry
+   {
+      unsigned height_;
+      uint8_t dup_;
+      uint16_t txIndex_;
+      std::vector<Output> outputs_;
+   };
+
+private:
+   struct Shard
+   {
+      std::mutex mu_;
+      FlatHashMap<TxHashKey, TxEntry> map_;
+      std::map<unsigned, std::vector<TxHashKey>> byHeight_;
+   };
+
+   std::vector<std::unique_ptr<Shard>> shards_;
+   const unsigned depth_;
+   const size_t maxOutputs_;
+
+   std::atomic<size_t> outputCount_;
+   std::atomic<uint64_t> hits_;
+   std::atomic<uint64_t> misses_;
+
+private:
+   size_t getShardIndex(const uint8_t* hash) const
+   {
+      return hash[0] % shards_.size();
+   }
+
+   void evictBelow(unsigned height);
+
+public:
+   RecentOutputCache(unsigned depth, size_t maxOutputs);
+
+   //entries are taken over, the first entry for a hash sticks
+   void insert(std::vector<std::pair<TxHashKey, TxEntry>>&);
+
+   //drops outputs more than depth blocks below the next batch start
+   void evict(unsigned nextHeight);
+
+   //nullptr on miss
+   const TxEntry* find(const BinaryDataRef& txHash) const;
+
+   void countLookups(uint64_t hits, uint64_t misses);
+   uint64_t hitCount(void) const { return hits_.load(std::memory_order_relaxed); }
+   uint64_t missCount(void) const { return misses_.load(std::memory_order_relaxed); }
+   size_t outputCount(void) const
+   {
+      return outputCount_.load(std::memory_order_relaxed);
+   }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct BatchTimings
+{
+   size_t blockBytes_ = 0;
+   size_t serializedBytes_ = 0;
+
+   //seconds
+   double parseTime_ = 0;
+   double writeTime_ = 0;
+   double parserWait_ = 0;
+   double writerWait_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class BatchSizeController
+{
+   /***
+   Sizes the history scan batches and the depth of the queue between the
+   parser and the writer, from the stage times of the batches committed so
+   far. Tx density grows by orders of magnitude along the chain, a fixed
+   byte size makes early batches too short to amortize the per batch costs
+   and recent ones slow to clear the pipeline.
+
+   The batch size aims at BATCH_TARGET_SECONDS in the slower of the parse
+   and write stages, at the rate measured through it, moving at most 2x per
+   batch. A batch the writer takes longer over than the parser would
+   otherwise grow past the target while the parser waits on the queue. The
+   queue deepens while both stages stall on each other (uneven batches),
+   and drops back when only one side waits, as the extra batch then only
+   holds RAM.
+
+   The batch in the parser and those queued behind the writer stay within
+   the ram budget, scaled by the measured footprint per block data byte.
+
+   update() runs on the commit thread, the getters on the scan thread.
+   ***/
+
+private:
+   mutable std::mutex mu_;
+
+   const size_t ramBudget_;
+   const size_t minSize_;
+   const size_t maxSize_;
+   const unsigned maxDepth_;
+
+   size_t targetSize_;
+   unsigned queueDepth_ = 1;
+
+   //block data bytes per second through the slower stage, and RAM held
+   //per block data byte
+   double stageRate_ = 0;
+   double footprint_ = 1;
+
+private:
+   size_t maxSizeForDepth(unsigned) const;
+
+public:
+   BatchSizeController(size_t ramBudget,
+      size_t initSize, size_t minSize, size_t maxSize, unsigned maxDepth);
+
+   void update(const BatchTimings&);
+
+   size_t targetSize(void) const;
+   unsigned queueDepth(void) const;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 class BlockchainScanner_Super
 {
@@ -178,12 +362,19 @@ private:
    std::set<BinaryData> updateSshHints_;
 
    const unsigned totalThreadCount_;
-   const unsigned writeQueueDepth_;
    const unsigned totalBlockFileCount_;
    std::map<unsigned, HeightAndDup> heightAndDupMap_;
 
+   //shared by all parsing stages and the ssh parser, leaves room for the
+   //commit thread and the scan thread
+   std::shared_ptr<Armory::Threading::TaskPool> taskPool_;
+
    BinaryData topScannedBlockHash_;
 
+   //scrAddrs whose ssh summary was rewritten by updateSSH or undo
+   std::shared_ptr<std::set<BinaryData>> touchedScrAddrs_ =
+      std::make_shared<std::set<BinaryData>>();
+
    ProgressCallback progress_ =
       [](BDMPhase, double, unsigned, unsigned)->void{};
    bool reportProgress_ = false;
@@ -193,6 +384,19 @@ private:
    
    std::map<unsigned, unsigned> heightToId_;
 
+   RecentOutputCache recentOutputs_;
+
+   //history scan batch size and write queue depth
+   BatchSizeController batchSizer_;
+
+   //time the scan thread stalled on the write queue since the last update
+   std::atomic<uint64_t> parserWaitUs_;
+
+   //initial builds stop at their next checkpoint past the deadline
+   std::chrono::steady_clock::time_point deadline_ =
+      std::chrono::steady_clock::time_point::max();
+   bool paused_ = false;
+
 private:  
    void commitSshBatch(void);
    void writeSubSsh(ParserBatch_Ssh*);
@@ -206,7 +410,11 @@ private:
    void serializeSubSsh(std::unique_ptr<ParserBatch_Ssh>);
    void serializeSubSshThread(ParserBatch_Ssh*);
 
-   void writeSpentness(void);
+   void scanSpentnessRange(int, int, StoredBuildCheckpoint&);
+   void writeSpentness(StoredBuildCheckpoint);
+   bool isCheckpointValid(const StoredBuildCheckpoint&) const;
+   bool pastDeadline(void) const
+   { return std::chrono::steady_clock::now() >= deadline_; }
 
    bool getTxKeyForHash(const BinaryDataRef&, BinaryData&);
    StxoRef getStxoByHash(
@@ -220,13 +428,21 @@ public:
    BlockchainScanner_Super(
       std::shared_ptr<Blockchain> bc, LMDBBlockDatabase* db,
       BlockFiles& bf, bool init,
-      unsigned threadcount, unsigned,
+      unsigned threadcount, unsigned ramUsage,
       ProgressCallback prg, bool reportProgress) :
       init_(init), blockchain_(bc), db_(db),
-      blockDataLoader_(bf.folderPath()),
-      totalThreadCount_(threadcount), writeQueueDepth_(1/*queue_depth*/),
+      blockDataLoader_(bf.folderPath(),
+         Armory::Config::DBSettings::blkFileWindow()),
+      totalThreadCount_(threadcount),
       totalBlockFileCount_(bf.fileCount()),
-      progress_(prg), reportProgress_(reportProgress)
+      taskPool_(std::make_shared<Armory::Threading::TaskPool>(
+         threadcount > 2 ? threadcount - 2 : 1)),
+      progress_(prg), reportProgress_(reportProgress),
+      recentOutputs_(RECENT_OUTPUTS_DEPTH, RECENT_OUTPUTS_MAX),
+      batchSizer_(RAM_USAGE_LEVEL_SIZE * std::max(ramUsage, 1U),
+         BATCH_SIZE_SUPER, BATCH_SIZE_SUPER_MIN, BATCH_SIZE_SUPER_MAX,
+         std::max(ramUsage, 1U)),
+      parserWaitUs_(0)
    {}
 
    void scan(void);
@@ -238,6 +454,24 @@ public:
    {
       return topScannedBlockHash_;
    }
+
+   std::shared_ptr<std::set<BinaryData>> getTouchedScrAddrs(void) const
+   {
+      return touchedScrAddrs_;
+   }
+
+   const RecentOutputCache& getRecentOutputs(void) const
+   {
+      return recentOutputs_;
+   }
+
+   void setDeadline(std::chrono::steady_clock::time_point deadline)
+   {
+      deadline_ = deadline;
+   }
+
+   //true if the deadline cut the build short, the next run resumes it
+   bool isPaused(void) const { return paused_; }
 };
 
 #endif
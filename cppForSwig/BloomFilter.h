@@ -0,0 +1,192 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _BLOOMFILTER_H
+#define _BLOOMFILTER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+   (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOOM_SSE2
+#endif
+
+#define BLOOM_BLOCK_WORDS 8
+#define BLOOM_BITS_PER_KEY 12
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename K, typename H = std::hash<K>>
+class BlockedBloomFilter
+{
+   /***
+   Split block bloom filter. Each key maps to a single 256 bit block and
+   sets one bit in each of the block's 8 words, so a probe costs a single
+   cache line and the 8 bits are tested in one go (SSE2 where available).
+
+   At 12 bits per key the false positive rate is about 0.5%. Never yields
+   false negatives.
+
+   Not thread safe for writes. Probes can run concurrently once the filter
+   is populated.
+
+   A filter can also be a read only view over words serialized elsewhere
+   (see data()), the caller keeps them alive. The key hasher has to be
+   stable across runs for serialized filters.
+   ***/
+
+private:
+   std::vector<uint32_t> words_;
+   const uint32_t* view_ = nullptr;
+   size_t blockCount_ = 0;
+   H hasher_;
+
+private:
+   static uint64_t mix(uint64_t h)
+   {
+      //the hasher output may be the key bytes as is, spread it
+      h ^= h >> 33;
+      h *= 0xFF51AFD7ED558CCDULL;
+      h ^= h >> 33;
+      return h;
+   }
+
+   size_t blockIndex(uint64_t h) const
+   {
+      //map the upper bits on [0, blockCount_) without a division
+      return (size_t)(((h >> 32) * (uint64_t)blockCount_) >> 32);
+   }
+
+   static void blockMask(uint64_t h, uint32_t* mask)
+   {
+      static const uint32_t salts[BLOOM_BLOCK_WORDS] = {
+         0x47B6137BU, 0x44974D91U, 0x8824AD5BU, 0xA2B7289DU,
+         0x705495C7U, 0x2DF1424BU, 0x9EFC4947U, 0x5C6BFB31U };
+
+      auto lo = (uint32_t)h;
+      for (unsigned i = 0; i < BLOOM_BLOCK_WORDS; i++)
+         mask[i] = 1U << ((lo * salts[i]) >> 27);
+   }
+
+   const uint32_t* wordPtr(void) const
+   {
+      return view_ != nullptr ? view_ : words_.data();
+   }
+
+   bool testBlock(uint64_t h) const
+   {
+      uint32_t mask[BLOOM_BLOCK_WORDS];
+      blockMask(h, mask);
+      auto block = wordPtr() + blockIndex(h) * BLOOM_BLOCK_WORDS;
+
+#ifdef BLOOM_SSE2
+      auto m0 = _mm_loadu_si128((const __m128i*)mask);
+      auto m1 = _mm_loadu_si128((const __m128i*)(mask + 4));
+      auto b0 = _mm_loadu_si128((const __m128i*)block);
+      auto b1 = _mm_loadu_si128((const __m128i*)(block + 4));
+
+      //all mask bits have to be set in the block
+      auto eq0 = _mm_cmpeq_epi32(_mm_and_si128(b0, m0), m0);
+      auto eq1 = _mm_cmpeq_epi32(_mm_and_si128(b1, m1), m1);
+      return _mm_movemask_epi8(_mm_and_si128(eq0, eq1)) == 0xFFFF;
+#else
+      for (unsigned i = 0; i < BLOOM_BLOCK_WORDS; i++)
+      {
+         if ((block[i] & mask[i]) != mask[i])
+            return false;
+      }
+      return true;
+#endif
+   }
+
+   void prefetch(uint64_t h) const
+   {
+      auto ptr = wordPtr() + blockIndex(h) * BLOOM_BLOCK_WORDS;
+#ifdef BLOOM_SSE2
+      _mm_prefetch((const char*)ptr, _MM_HINT_T0);
+#elif defined(__GNUC__)
+      __builtin_prefetch(ptr);
+#else
+      (void)ptr;
+#endif
+   }
+
+public:
+   BlockedBloomFilter(size_t count, unsigned bitsPerKey = BLOOM_BITS_PER_KEY)
+   {
+      auto bitCount = (uint64_t)count * bitsPerKey;
+      blockCount_ = (size_t)(
+         (bitCount + BLOOM_BLOCK_WORDS * 32 - 1) / (BLOOM_BLOCK_WORDS * 32));
+      if (blockCount_ == 0)
+         blockCount_ = 1;
+
+      words_.resize(blockCount_ * BLOOM_BLOCK_WORDS, 0);
+   }
+
+   //view over blockCount * BLOOM_BLOCK_WORDS words
+   BlockedBloomFilter(const uint32_t* words, size_t blockCount) :
+      view_(words), blockCount_(blockCount)
+   {
+      if (words == nullptr || blockCount == 0)
+         throw std::runtime_error("invalid bloom filter view");
+   }
+
+   void insert(const K& key)
+   {
+      if (view_ != nullptr)
+         throw std::runtime_error("bloom filter view is read only");
+
+      auto h = mix(hasher_(key));
+      uint32_t mask[BLOOM_BLOCK_WORDS];
+      blockMask(h, mask);
+
+      auto block = words_.data() + blockIndex(h) * BLOOM_BLOCK_WORDS;
+      for (unsigned i = 0; i < BLOOM_BLOCK_WORDS; i++)
+         block[i] |= mask[i];
+   }
+
+   bool mayContain(const K& key) const
+   {
+      return testBlock(mix(hasher_(key)));
+   }
+
+   //probes keys[0, count), hits[i] is set to 1 if keys[i] may be in the
+   //set, 0 otherwise. Blocks are prefetched ahead of the tests.
+   void mayContain(const K* keys, size_t count, uint8_t* hits) const
+   {
+      const size_t window = 8;
+      uint64_t hashes[window];
+
+      for (size_t pos = 0; pos < count; pos += window)
+      {
+         auto len = count - pos < window ? count - pos : window;
+         for (size_t i = 0; i < len; i++)
+         {
+            hashes[i] = mix(hasher_(keys[pos + i]));
+            prefetch(hashes[i]);
+         }
+
+         for (size_t i = 0; i < len; i++)
+            hits[pos + i] = testBlock(hashes[i]) ? 1 : 0;
+      }
+   }
+
+   size_t sizeInBytes(void) const
+   {
+      return blockCount_ * BLOOM_BLOCK_WORDS * sizeof(uint32_t);
+   }
+
+   const uint32_t* data(void) const { return wordPtr(); }
+   size_t blockCount(void) const { return blockCount_; }
+};
+
+#endif
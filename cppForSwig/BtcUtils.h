@@ -33,6 +33,7 @@
 #include "log.h"
 #include "BitcoinSettings.h"
 #include "EncryptionUtils.h"
+#include "Hash256Batch.h"
 
 #include "btc/base58.h"
 
@@ -565,56 +566,67 @@ public:
    /////////////////////////////////////////////////////////////////////////////
    static BinaryData calculateMerkleRoot(std::vector<BinaryData> const & txhashlist)
    {
-      std::vector<BinaryData> mtree = calculateMerkleTree(txhashlist);
-      return mtree[mtree.size()-1];
+      if (txhashlist.size() == 0)
+         return BinaryData();
+
+      //flat copy of the current level, each level is hashed in one batch
+      size_t levelSize = txhashlist.size();
+      BinaryData level(levelSize * 32);
+      for (size_t i = 0; i < levelSize; i++)
+         txhashlist[i].copyTo(level.getPtr() + i * 32, 32);
+
+      while (levelSize > 1)
+         levelSize = hashMerkleLevel(level, levelSize);
+
+      return BinaryData(level.getPtr(), 32);
    }
 
    /////////////////////////////////////////////////////////////////////////////
    static std::vector<BinaryData> calculateMerkleTree(std::vector<BinaryData> const & txhashlist)
    {
-      // Don't know in advance how big this list will be, make a list too big
-      // and copy the result to the right size list afterwards
-      size_t numTx = txhashlist.size();
-      std::vector<BinaryData> merkleTree(3*numTx);
-      BinaryData hashInput(64);
-   
-      for(uint32_t i=0; i<numTx; i++)
-         merkleTree[i] = txhashlist[i];
-   
-      size_t thisLevelStart = 0;
-      size_t nextLevelStart = numTx;
-      size_t levelSize = numTx;
-      BinaryData hashOutput(32);
-      while(levelSize>1)
+      std::vector<BinaryData> merkleTree(txhashlist);
+      if (txhashlist.size() == 0)
+         return merkleTree;
+
+      size_t levelSize = txhashlist.size();
+      BinaryData level(levelSize * 32);
+      for (size_t i = 0; i < levelSize; i++)
+         txhashlist[i].copyTo(level.getPtr() + i * 32, 32);
+
+      while (levelSize > 1)
       {
-         for(uint32_t j=0; j<(levelSize+1)/2; j++)
-         {
-            uint8_t* half1Ptr = hashInput.getPtr();
-            uint8_t* half2Ptr = hashInput.getPtr()+32;
-         
-            if(j < levelSize/2)
-            {
-               merkleTree[thisLevelStart+(2*j)  ].copyTo(half1Ptr, 32);
-               merkleTree[thisLevelStart+(2*j)+1].copyTo(half2Ptr, 32);
-            }
-            else 
-            {
-               merkleTree[nextLevelStart-1].copyTo(half1Ptr, 32);
-               merkleTree[nextLevelStart-1].copyTo(half2Ptr, 32);
-            }
-            
-            CryptoSHA2::getHash256(hashInput.getRef(), hashOutput.getPtr());
-            merkleTree[nextLevelStart+j] = hashOutput;
-         }
-         levelSize = (levelSize+1)/2;
-         thisLevelStart = nextLevelStart;
-         nextLevelStart = nextLevelStart+levelSize;
+         levelSize = hashMerkleLevel(level, levelSize);
+         for (size_t i = 0; i < levelSize; i++)
+            merkleTree.emplace_back(level.getPtr() + i * 32, 32);
       }
 
-      // nextLevelStart is the size of the merkle tree
-      merkleTree.erase(merkleTree.begin()+nextLevelStart, merkleTree.end());
       return merkleTree;
-   
+   }
+
+   /////////////////////////////////////////////////////////////////////////////
+   // Hashes the levelSize nodes in level pairwise, in place. The last node is
+   // paired with itself on odd levels. Returns the size of the new level.
+   static size_t hashMerkleLevel(BinaryData& level, size_t levelSize)
+   {
+      size_t nextSize = (levelSize + 1) / 2;
+      BinaryData pairs(nextSize * 64);
+      std::vector<BinaryDataRef> preimages;
+      preimages.reserve(nextSize);
+
+      for (size_t j = 0; j < nextSize; j++)
+      {
+         auto pairPtr = pairs.getPtr() + j * 64;
+         auto leftId = 2 * j;
+         auto rightId = leftId + 1 < levelSize ? leftId + 1 : leftId;
+
+         memcpy(pairPtr, level.getPtr() + leftId * 32, 32);
+         memcpy(pairPtr + 32, level.getPtr() + rightId * 32, 32);
+         preimages.emplace_back(pairPtr, 64);
+      }
+
+      Hash256Batch::getHash256(
+         preimages.data(), preimages.size(), level.getPtr());
+      return nextSize;
    }
    
    /////////////////////////////////////////////////////////////////////////////
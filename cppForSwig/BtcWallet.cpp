@@ -488,9 +488,8 @@ bool BtcWallet::scanWallet(ScanWalletStruct& scanInfo, int32_t updateID)
 {
    if (scanInfo.action_ != BDV_ZC)
    {
-      //new top block         
-      auto&& tx = bdvPtr_->getDB()->beginTransaction(SSH, LMDB::ReadOnly);
-      balance_ = getFullBalanceFromDB(updateID);
+      //new top block
+      updateBalanceAndCount(scanInfo.touchedScrAddrs_.get(), updateID);
    }
   
    if (scanInfo.saStruct_.scrAddrToTxioKeys_.size() != 0 ||
@@ -519,7 +518,16 @@ bool BtcWallet::scanWallet(ScanWalletStruct& scanInfo, int32_t updateID)
             }
          }
 
-         balance_ = getFullBalanceFromDB(updateID);
+         //scanZC flags the addresses it changed with this update id
+         set<BinaryData> zcScrAddrs;
+         auto addrMap = scrAddrMap_.get();
+         for (auto& scrAddr : *addrMap)
+         {
+            if (scrAddr.second->updateID_ == updateID)
+               zcScrAddrs.insert(scrAddr.first);
+         }
+
+         updateBalanceAndCount(&zcScrAddrs, updateID);
          updateID_ = updateID;
 
          //return false because no new block was parsed
@@ -531,6 +539,65 @@ bool BtcWallet::scanWallet(ScanWalletStruct& scanInfo, int32_t updateID)
    return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void BtcWallet::updateBalanceAndCount(
+   const set<BinaryData>* scrAddrs, int32_t updateID)
+{
+   auto addrMap = scrAddrMap_.get();
+   auto&& tx = bdvPtr_->getDB()->beginTransaction(SSH, LMDB::ReadOnly);
+
+   //no list of changed addresses or the address set changed since the
+   //last full pass, go over all of them
+   if (scrAddrs == nullptr || addrMap != summaryAddrMap_)
+   {
+      balance_ = 0;
+      txioCount_ = 0;
+      addrSummaries_.clear();
+      for (auto& scrAddr : *addrMap)
+      {
+         auto summary = scrAddr.second->updateSummary(updateID);
+         balance_ += summary.first;
+         txioCount_ += summary.second;
+         addrSummaries_.emplace(scrAddr.first, summary);
+      }
+
+      summaryAddrMap_ = addrMap;
+      return;
+   }
+
+   //otherwise refresh the changed addresses and carry the difference
+   auto updateAddr = [this, updateID](const ScrAddrObj& addrObj)->void
+   {
+      auto& summary = addrSummaries_[addrObj.getScrAddr()];
+      balance_ -= summary.first;
+      txioCount_ -= summary.second;
+
+      summary = addrObj.updateSummary(updateID);
+
+      balance_ += summary.first;
+      txioCount_ += summary.second;
+   };
+
+   //walk the smaller of the 2 sets
+   if (scrAddrs->size() < addrMap->size())
+   {
+      for (auto& scrAddr : *scrAddrs)
+      {
+         auto iter = addrMap->find(scrAddr.getRef());
+         if (iter != addrMap->end())
+            updateAddr(*iter->second);
+      }
+   }
+   else
+   {
+      for (auto& scrAddr : *addrMap)
+      {
+         if (scrAddrs->find(scrAddr.first) != scrAddrs->end())
+            updateAddr(*scrAddr.second);
+      }
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void BtcWallet::reset()
 {
@@ -797,14 +864,8 @@ void BtcWallet::needsRefresh(bool refresh)
 ////////////////////////////////////////////////////////////////////////////////
 uint64_t BtcWallet::getWltTotalTxnCount(void) const
 {
-   uint64_t ntxn = 0;
-
-   auto addrMap = scrAddrMap_.get();
-
-   for (const auto& scrAddrPair : *addrMap)
-      ntxn += scrAddrPair.second->getTxioCountFromSSH(true);
-
-   return ntxn;
+   //kept up to date by scanWallet
+   return txioCount_;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
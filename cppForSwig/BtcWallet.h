@@ -33,6 +33,9 @@ struct ScanWalletStruct
    unsigned endBlock_ = UINT32_MAX;
    bool reorg_ = false;
 
+   //scrAddrs with a new ssh summary, null to check them all
+   std::shared_ptr<const std::set<BinaryData>> touchedScrAddrs_;
+
    ScanAddressStruct saStruct_;
 };
 
@@ -119,6 +122,7 @@ public:
 private:
    //returns true on bootstrap and new block, false on ZC
    bool scanWallet(ScanWalletStruct&, int32_t);
+   void updateBalanceAndCount(const std::set<BinaryData>*, int32_t);
 
    //wallet side reorg processing
    //void updateAfterReorg(uint32_t lastValidBlockHeight);
@@ -164,6 +168,15 @@ private:
    std::string walletID_;
 
    uint64_t                      balance_ = 0;
+   uint64_t                      txioCount_ = 0;
+
+   //address map the balance and count were last fully computed over
+   std::shared_ptr<const std::map<BinaryDataRef, std::shared_ptr<ScrAddrObj>>>
+      summaryAddrMap_;
+
+   //what each address adds to balance_ and txioCount_. Kept by the wallet,
+   //the ScrAddrObj cache is also refreshed by balance requests
+   std::map<BinaryData, std::pair<uint64_t, uint32_t>> addrSummaries_;
 
    //set to true to add wallet paged history to global ledgers 
    bool                          uiFilter_ = true;
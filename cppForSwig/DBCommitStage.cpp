@@ -0,0 +1,396 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include "DBCommitStage.h"
+#include "lmdb_wrapper.h"
+#include "log.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+DBCommitStage::DBCommitStage(LMDBBlockDatabase* db) :
+   db_(db)
+{
+   if (db_ == nullptr)
+      throw runtime_error("null db");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+DBCommitStage::~DBCommitStage()
+{
+   //writer threads drain their queue before exiting
+   unique_lock<mutex> lock(queueMutex_);
+   for (auto& queuePair : queues_)
+   {
+      auto& queue = *queuePair.second;
+      {
+         unique_lock<mutex> queueLock(queue.mu_);
+         queue.run_ = false;
+      }
+      queue.cv_.notify_all();
+
+      if (queue.thread_.joinable())
+         queue.thread_.join();
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+DBCommitStage::DbQueue& DBCommitStage::getQueue(DB_SELECT db, unsigned shard)
+{
+   unique_lock<mutex> lock(queueMutex_);
+   auto key = make_pair(db, shard);
+   auto iter = queues_.find(key);
+   if (iter != queues_.end())
+      return *iter->second;
+
+   //writer threads are started on first use
+   auto queuePtr = make_unique<DbQueue>();
+   auto queueRawPtr = queuePtr.get();
+   queuePtr->thread_ = thread([this, queueRawPtr](void)->void
+   {
+      commitLoop(queueRawPtr);
+   });
+
+   queues_.insert(make_pair(key, move(queuePtr)));
+   return *queueRawPtr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<DBCommitStage::DbQueue*> DBCommitStage::getQueues(DB_SELECT db)
+{
+   vector<DbQueue*> result;
+
+   unique_lock<mutex> lock(queueMutex_);
+   auto iter = queues_.lower_bound(make_pair(db, 0U));
+   while (iter != queues_.end() && iter->first.first == db)
+   {
+      result.push_back(iter->second.get());
+      ++iter;
+   }
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<DB_SELECT> DBCommitStage::getDbs()
+{
+   vector<DB_SELECT> dbs;
+
+   unique_lock<mutex> lock(queueMutex_);
+   for (auto& queuePair : queues_)
+   {
+      if (dbs.empty() || dbs.back() != queuePair.first.first)
+         dbs.push_back(queuePair.first.first);
+   }
+
+   return dbs;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_future<void> DBCommitStage::push(unique_ptr<DBWriteBatch> batch)
+{
+   if (batch == nullptr)
+      throw runtime_error("null batch");
+
+   auto shardCount = db_->getShardCount(batch->db_);
+   if (shardCount > 1)
+      return pushSharded(move(batch), shardCount);
+
+   return pushToQueue(move(batch), 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_future<void> DBCommitStage::pushToQueue(
+   unique_ptr<DBWriteBatch> batch, unsigned shard)
+{
+   auto& queue = getQueue(batch->db_, shard);
+   auto prom = make_shared<promise<void>>();
+   shared_future<void> fut = prom->get_future();
+
+   {
+      unique_lock<mutex> lock(queue.mu_);
+      queue.cv_.wait(lock, [&queue]()->bool
+      {
+         return queue.error_ != nullptr ||
+            queue.inFlight_ < DB_COMMIT_QUEUE_DEPTH;
+      });
+
+      if (queue.error_ != nullptr)
+         rethrow_exception(queue.error_);
+
+      ++queue.inFlight_;
+      queue.batches_.push_back(make_pair(move(batch), prom));
+   }
+
+   queue.cv_.notify_all();
+   return fut;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_future<void> DBCommitStage::pushSharded(
+   unique_ptr<DBWriteBatch> batch, unsigned shardCount)
+{
+   auto db = batch->db_;
+   vector<unique_ptr<DBWriteBatch>> shardBatches(shardCount);
+   auto getShardBatch = [&](unsigned id)->DBWriteBatch&
+   {
+      auto& shardBatch = shardBatches[id];
+      if (shardBatch == nullptr)
+      {
+         shardBatch = make_unique<DBWriteBatch>(db);
+         shardBatch->owner_ = batch->owner_;
+         shardBatch->after_ = batch->after_;
+      }
+
+      return *shardBatch;
+   };
+
+   //the split keeps each shard's puts sorted
+   for (auto& keyVal : batch->puts_)
+      getShardBatch(db_->getShardId(db, keyVal.first)).puts_.push_back(keyVal);
+   for (auto& key : batch->deletes_)
+      getShardBatch(db_->getShardId(db, key)).deletes_.push_back(key);
+
+   //shard 0 goes last, it waits on the other parts then runs inTx_
+   auto& lastBatch = getShardBatch(0);
+   lastBatch.inTx_ = move(batch->inTx_);
+   for (unsigned i = 1; i < shardCount; i++)
+   {
+      if (shardBatches[i] == nullptr)
+         continue;
+
+      lastBatch.after_.push_back(pushToQueue(move(shardBatches[i]), i));
+   }
+
+   return pushToQueue(move(shardBatches[0]), 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBCommitStage::commit(DBWriteBatch& batch)
+{
+   //runs on this thread, sharded dbs take the whole batch in one go
+   commitBatch(batch, getQueue(batch.db_, 0));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBCommitStage::commitBatch(DBWriteBatch& batch, DbQueue& queue)
+{
+   for (auto& fut : batch.after_)
+      fut.get();
+
+   size_t appended = 0;
+   auto start = chrono::steady_clock::now();
+
+   //make room for the whole batch rather than let it fill the map
+   db_->reserveMapSpace(batch.db_, batch.puts_);
+
+   unsigned attempt = 0;
+   while (true)
+   {
+      try
+      {
+         auto&& tx = db_->beginTransaction(batch.db_, LMDB::ReadWrite);
+         appended = db_->putValues(batch.db_, batch.puts_);
+         for (auto& key : batch.deletes_)
+            db_->deleteValue(batch.db_, key);
+
+         if (batch.inTx_)
+            batch.inTx_();
+
+         tx->commit();
+         break;
+      }
+      catch (LMDBMapFullException& e)
+      {
+         //the txn was rolled back and the map grown, write it again
+         if (++attempt > DB_COMMIT_MAP_FULL_RETRIES)
+            throw;
+
+         LOGWARN << "batch for db " << 
+            DatabaseContainer::getDbName(batch.db_) << " filled the map (" <<
+            e.what() << "), retrying";
+      }
+   }
+   chrono::duration<double> duration = chrono::steady_clock::now() - start;
+
+   uint64_t bytes = 0;
+   for (auto& keyVal : batch.puts_)
+      bytes += keyVal.first.getSize() + keyVal.second.getSize();
+
+   unique_lock<mutex> lock(queue.mu_);
+   auto& stats = queue.stats_;
+   ++stats.batches_;
+   stats.puts_ += batch.puts_.size();
+   stats.appended_ += appended;
+   stats.bytes_ += bytes;
+   stats.commitTime_ += duration.count();
+   if (duration.count() > stats.maxCommitTime_)
+      stats.maxCommitTime_ = duration.count();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBCommitStage::commitLoop(DbQueue* queuePtr)
+{
+   auto& queue = *queuePtr;
+
+   while (true)
+   {
+      unique_ptr<DBWriteBatch> batch;
+      shared_ptr<promise<void>> prom;
+      exception_ptr error = nullptr;
+
+      {
+         unique_lock<mutex> lock(queue.mu_);
+         queue.cv_.wait(lock, [&queue]()->bool
+         {
+            return !queue.run_ || !queue.batches_.empty();
+         });
+
+         if (queue.batches_.empty())
+            break;
+
+         batch = move(queue.batches_.front().first);
+         prom = move(queue.batches_.front().second);
+         queue.batches_.pop_front();
+         error = queue.error_;
+      }
+
+      //don't commit past a failed batch
+      if (error == nullptr)
+      {
+         try
+         {
+            commitBatch(*batch, queue);
+         }
+         catch (exception& e)
+         {
+            LOGERR << "failed to commit batch for db " <<
+               DatabaseContainer::getDbName(batch->db_) << ": " << e.what();
+            error = current_exception();
+         }
+         catch (...)
+         {
+            error = current_exception();
+         }
+      }
+
+      //release the batch data before signaling
+      batch.reset();
+
+      {
+         unique_lock<mutex> lock(queue.mu_);
+         if (error != nullptr && queue.error_ == nullptr)
+            queue.error_ = error;
+         --queue.inFlight_;
+      }
+      queue.cv_.notify_all();
+
+      if (error != nullptr)
+         prom->set_exception(error);
+      else
+         prom->set_value();
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBCommitStage::flush(DB_SELECT db)
+{
+   exception_ptr error = nullptr;
+   for (auto queuePtr : getQueues(db))
+   {
+      auto& queue = *queuePtr;
+      exception_ptr queueError = nullptr;
+      {
+         unique_lock<mutex> lock(queue.mu_);
+         queue.cv_.wait(lock, [&queue]()->bool
+         {
+            return queue.inFlight_ == 0;
+         });
+
+         //clear the error, the db takes batches again
+         swap(queueError, queue.error_);
+      }
+
+      if (error == nullptr)
+         error = queueError;
+   }
+
+   if (error != nullptr)
+      rethrow_exception(error);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBCommitStage::flushAll()
+{
+   exception_ptr error = nullptr;
+   for (auto& db : getDbs())
+   {
+      try
+      {
+         flush(db);
+      }
+      catch (...)
+      {
+         if (error == nullptr)
+            error = current_exception();
+      }
+   }
+
+   if (error != nullptr)
+      rethrow_exception(error);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+DBCommitStats DBCommitStage::getStats(DB_SELECT db)
+{
+   DBCommitStats stats;
+   for (auto queuePtr : getQueues(db))
+   {
+      unique_lock<mutex> lock(queuePtr->mu_);
+      auto& queueStats = queuePtr->stats_;
+      stats.batches_ += queueStats.batches_;
+      stats.puts_ += queueStats.puts_;
+      stats.appended_ += queueStats.appended_;
+      stats.bytes_ += queueStats.bytes_;
+      stats.commitTime_ += queueStats.commitTime_;
+      if (queueStats.maxCommitTime_ > stats.maxCommitTime_)
+         stats.maxCommitTime_ = queueStats.maxCommitTime_;
+   }
+
+   return stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBCommitStage::logStats()
+{
+   for (auto& db : getDbs())
+   {
+      auto&& stats = getStats(db);
+      if (stats.batches_ == 0)
+         continue;
+
+      LOGINFO << DatabaseContainer::getDbName(db) << ": " <<
+         stats.batches_ << " commits, " << stats.puts_ << " puts (" <<
+         stats.appended_ << " appended), " <<
+         stats.bytes_ / (1024 * 1024) << " MB, " <<
+         stats.commitTime_ << "s total, " <<
+         stats.commitTime_ / stats.batches_ << "s avg, " <<
+         stats.maxCommitTime_ << "s max";
+
+      auto&& mapStats = db_->getMapStats(db);
+      LOGINFO << DatabaseContainer::getDbName(db) << " map: " <<
+         mapStats.usedSize_ / (1024 * 1024) << "/" << 
+         mapStats.mapSize_ / (1024 * 1024) << " MB, " <<
+         mapStats.resizeCount_ << " resizes (" << 
+         mapStats.skippedResizes_ << " skipped, " << 
+         mapStats.mapFullCount_ << " on a full map), paused " << 
+         mapStats.pauseTime_ << "s total, " << 
+         mapStats.maxPause_ << "s max";
+   }
+}
@@ -0,0 +1,188 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _DBCOMMITSTAGE_H
+#define _DBCOMMITSTAGE_H
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+
+#include "BinaryData.h"
+#include "StoredBlockObj.h"
+
+class LMDBBlockDatabase;
+
+//batches per db in flight: one committing, one queued behind it
+#define DB_COMMIT_QUEUE_DEPTH 2
+
+//a batch that fills the map is rolled back and written again this many
+//times, the map grows by at least half each time
+#define DB_COMMIT_MAP_FULL_RETRIES 8
+
+////////////////////////////////////////////////////////////////////////////////
+struct DBWriteBatch
+{
+   /***
+   Puts for a single db, sorted by key, and deletes, applied after the
+   puts. The refs point into data kept alive by owner_ until the batch is
+   committed.
+
+   inTx_ runs within the batch's write transaction, after the puts. The
+   commit waits on after_ before opening its transaction, use it to order
+   batches across dbs.
+   ***/
+
+   const DB_SELECT db_;
+   std::vector<std::pair<BinaryDataRef, BinaryDataRef>> puts_;
+   std::vector<BinaryDataRef> deletes_;
+   std::shared_ptr<void> owner_;
+   std::function<void(void)> inTx_;
+   std::vector<std::shared_future<void>> after_;
+
+   DBWriteBatch(DB_SELECT db) :
+      db_(db)
+   {}
+
+   //takes over a sorted key/value map, values are BinaryData or BinaryWriter
+   template<typename T>
+   static std::unique_ptr<DBWriteBatch> fromMap(
+      DB_SELECT db, std::map<BinaryData, T>&& data)
+   {
+      auto dataPtr = std::make_shared<std::map<BinaryData, T>>(
+         std::move(data));
+
+      auto batch = std::make_unique<DBWriteBatch>(db);
+      batch->puts_.reserve(dataPtr->size());
+      for (auto& keyVal : *dataPtr)
+      {
+         batch->puts_.emplace_back(
+            keyVal.first.getRef(), valueRef(keyVal.second));
+      }
+
+      batch->owner_ = dataPtr;
+      return batch;
+   }
+
+private:
+   static BinaryDataRef valueRef(const BinaryData& val)
+   { return val.getRef(); }
+
+   static BinaryDataRef valueRef(const BinaryWriter& val)
+   { return val.getDataRef(); }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct DBCommitStats
+{
+   uint64_t batches_ = 0;
+   uint64_t puts_ = 0;
+   uint64_t appended_ = 0;
+   uint64_t bytes_ = 0;
+
+   //seconds, from opening the write transaction to its commit
+   double commitTime_ = 0;
+   double maxCommitTime_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class DBCommitStage
+{
+   /***
+   Shared write path for the put heavy phases (scanner batches, spentness,
+   tx hints).
+
+   push() hands a batch to the writer thread of its db and returns, so the
+   caller can serialize its next batch while this one commits, and batches
+   for different dbs commit in parallel. A db takes up to
+   DB_COMMIT_QUEUE_DEPTH batches, push() blocks beyond that. Batches for the
+   same db commit in the order they were pushed.
+
+   commit() runs the same write path on the calling thread, for puts that
+   have to land before the caller reads them back.
+
+   Puts are written in key order. Keys past the last key in the db go in
+   with MDB_APPEND, which skips the btree descent and fills pages instead of
+   splitting them.
+
+   The map is grown ahead of each batch to fit it. A batch that fills the
+   map anyway is rolled back and committed again once the map has grown,
+   inTx_ runs again with it.
+
+   A failed commit fails the batches queued behind it. The error is rethrown
+   by the next push() or flush() for that db.
+
+   Sharded dbs have a writer per shard. push() splits the batch by shard,
+   the part for shard 0 waits on the others then runs inTx_, so the batch
+   future is only ready once every shard has its part.
+   ***/
+
+private:
+   struct DbQueue
+   {
+      std::mutex mu_;
+      std::condition_variable cv_;
+
+      std::deque<std::pair<
+         std::unique_ptr<DBWriteBatch>,
+         std::shared_ptr<std::promise<void>>>> batches_;
+      unsigned inFlight_ = 0;
+      bool run_ = true;
+      std::exception_ptr error_ = nullptr;
+
+      DBCommitStats stats_;
+      std::thread thread_;
+   };
+
+   typedef std::pair<DB_SELECT, unsigned> QueueKey;
+
+   LMDBBlockDatabase* db_;
+
+   std::mutex queueMutex_;
+   std::map<QueueKey, std::unique_ptr<DbQueue>> queues_;
+
+private:
+   DbQueue& getQueue(DB_SELECT, unsigned shard);
+   std::vector<DbQueue*> getQueues(DB_SELECT);
+   std::vector<DB_SELECT> getDbs(void);
+   void commitLoop(DbQueue*);
+   void commitBatch(DBWriteBatch&, DbQueue&);
+
+   std::shared_future<void> pushToQueue(
+      std::unique_ptr<DBWriteBatch>, unsigned shard);
+   std::shared_future<void> pushSharded(
+      std::unique_ptr<DBWriteBatch>, unsigned shardCount);
+
+public:
+   DBCommitStage(LMDBBlockDatabase*);
+   ~DBCommitStage(void);
+
+   DBCommitStage(const DBCommitStage&) = delete;
+   DBCommitStage& operator=(const DBCommitStage&) = delete;
+
+   //the future is ready once the batch is committed
+   std::shared_future<void> push(std::unique_ptr<DBWriteBatch>);
+   void commit(DBWriteBatch&);
+
+   //wait on the batches pushed so far, rethrows the first commit error
+   void flush(DB_SELECT);
+   void flushAll(void);
+
+   //summed over the shards of the db
+   DBCommitStats getStats(DB_SELECT);
+   void logStats(void);
+};
+
+#endif
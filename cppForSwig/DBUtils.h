@@ -40,7 +40,8 @@ enum DB_PREFIX
    DB_PREFIX_POOL,
    DB_PREFIX_MISSING_HASHES,
    DB_PREFIX_SUBSSH,
-   DB_PREFIX_TEMPSCRIPT
+   DB_PREFIX_TEMPSCRIPT,
+   DB_PREFIX_UTXOSNAP
 };
 
 struct FileMap
@@ -18,6 +18,7 @@
 
 using namespace std;
 using namespace Armory::Config;
+using namespace Armory::Threading;
 
 /////////////////////////////////////////////////////////////////////////////
 void dumpBlock(
@@ -68,8 +69,16 @@ DatabaseBuilder::DatabaseBuilder(BlockFiles& blockFiles,
    : blockFiles_(blockFiles), blockchain_(bdm.blockchain()),
    db_(bdm.getIFace()), scrAddrFilter_(bdm.getScrAddrFilter()),
    progress_(progress), topBlockOffset_(0, 0),
-   forceRescanSSH_(forceRescanSSH)
-{}
+   forceRescanSSH_(forceRescanSSH),
+   taskPool_(make_shared<TaskPool>(max(DBSettings::threadCount(), 1U)))
+{
+   auto budget = DBSettings::buildBudget();
+   if (budget > 0)
+   {
+      buildDeadline_ = chrono::steady_clock::now() + 
+         BUILD_BUDGET_UNIT(budget);
+   }
+}
 
 /////////////////////////////////////////////////////////////////////////////
 void DatabaseBuilder::init()
@@ -85,14 +94,21 @@ void DatabaseBuilder::init()
    //list all files in block data folder
    blockFiles_.detectAllBlockFiles();
 
-   //read all blocks already in DB and populate blockchain
-   topBlockOffset_ = loadBlockHeadersFromDB(progress_);
+   //try the block index first, it carries the organized chain
+   Blockchain::ReorganizationState initialReorgState;
+   headersFromIndex_ = loadBlockHeadersFromIndex(initialReorgState);
+   if (!headersFromIndex_)
+   {
+      //read all blocks already in DB and populate blockchain
+      topBlockOffset_ = loadBlockHeadersFromDB(progress_);
    
-   if (DBSettings::reportProgress())
-      progress_(BDMPhase_OrganizingChain, 0, UINT32_MAX, 0);
+      if (DBSettings::reportProgress())
+         progress_(BDMPhase_OrganizingChain, 0, UINT32_MAX, 0);
+
+      LOGINFO << "organizing chain";
+      initialReorgState = blockchain_->forceOrganize();
+   }
 
-   LOGINFO << "organizing chain";
-   auto&& initialReorgState = blockchain_->forceOrganize();
    LOGINFO << "updating branches";
    blockchain_->updateBranchingMaps(db_, initialReorgState);
 
@@ -125,6 +141,9 @@ void DatabaseBuilder::init()
    double updatetime = TIMER_READ_SEC("updateblocksindb");
    LOGINFO << "updated HEADERS db in " << updatetime << "s";
 
+   //covers the case where the index was rebuilt but no new blocks came in
+   blockchain_->updateBlockIndex(db_);
+
    cycleDatabases();
 
    int scanFrom = -1;
@@ -292,12 +311,50 @@ BlockOffset DatabaseBuilder::loadBlockHeadersFromDB(
    return topBlockOffet;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+bool DatabaseBuilder::loadBlockHeadersFromIndex(
+   Blockchain::ReorganizationState& reorgState)
+{
+   LOGINFO << "Reading headers from block index";
+   blockchain_->clear();
+
+   TIMER_START("loadBlockIndex");
+   if (!blockchain_->loadBlockIndex(db_, reorgState))
+   {
+      blockchain_->clear();
+      return false;
+   }
+
+   //find the furthest block offset to resume parsing from
+   BlockOffset topBlockOffset(0, 0);
+   auto headermap = blockchain_->allHeaders();
+   for (auto& headerPair : *headermap)
+   {
+      auto& header = headerPair.second;
+      if (!header->hasFilePos())
+         continue;
+
+      BlockOffset currblock(header->getBlockFileNum(), header->getOffset());
+      if (currblock > topBlockOffset)
+         topBlockOffset = currblock;
+   }
+
+   topBlockOffset_ = topBlockOffset;
+
+   TIMER_STOP("loadBlockIndex");
+   double loadtime = TIMER_READ_SEC("loadBlockIndex");
+   LOGINFO << "loaded block index in " << loadtime << "s";
+
+   return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 Blockchain::ReorganizationState DatabaseBuilder::updateBlocksInDB(
    const ProgressCallback &progress, bool verbose, bool fullHints)
 {
    //preload and prefetch
-   BlockDataLoader bdl(blockFiles_.folderPath());
+   BlockDataLoader bdl(
+      blockFiles_.folderPath(), DBSettings::blkFileWindow());
 
    unsigned threadcount = min(DBSettings::threadCount(),
       blockFiles_.fileCount() - topBlockOffset_.fileID_);
@@ -305,6 +362,11 @@ Blockchain::ReorganizationState DatabaseBuilder::updateBlocksInDB(
    mutex progressMutex;
    unsigned baseID = topBlockOffset_.fileID_;
 
+   //files are handed out in order from a shared counter rather than striped
+   //per thread, a large file only holds back the thread parsing it
+   atomic<unsigned> nextFileID;
+   nextFileID.store(topBlockOffset_.fileID_ + 1, memory_order_relaxed);
+
    //init progress
    ProgressCalculator calc(blockFiles_.fileCount());
    if (verbose)
@@ -342,7 +404,7 @@ Blockchain::ReorganizationState DatabaseBuilder::updateBlocksInDB(
 
          //reset startOffset for the next file
          startOffset = 0;
-         fileID += threadcount;
+         fileID = nextFileID.fetch_add(1, memory_order_relaxed);
       }
    };
 
@@ -353,7 +415,7 @@ Blockchain::ReorganizationState DatabaseBuilder::updateBlocksInDB(
    {
       boVec.push_back(make_shared<BlockOffset>(topBlockOffset_));
       tIDs.push_back(thread(
-         addblocks, topBlockOffset_.fileID_ + i,
+         addblocks, nextFileID.fetch_add(1, memory_order_relaxed),
          0, boVec.back(), verbose));
    }
 
@@ -397,42 +459,42 @@ bool DatabaseBuilder::addBlocksToDB(BlockDataLoader& bdl,
 
    map<uint32_t, shared_ptr<BlockData>> bdMap;
 
-   auto getID = [&](const BinaryData&)->uint32_t
+   //deser full block, check merkle, nullptr on failure
+   auto deserBlock = [fileID, fullHints](const uint8_t* data, size_t size,
+      const function<uint32_t(const BinaryData&)>& getID, 
+      bool verbose)->shared_ptr<BlockData>
    {
-      return blockchain_->getNewUniqueID();
-   };
-
-   auto tallyBlocks =
-      [&](const uint8_t* data, size_t size, size_t offset)->bool
-   {
-      //deser full block, check merkle
-      shared_ptr<BlockData> bd;
-      BinaryRefReader brr(data, size);
-
       try
       {
-         bd = BlockData::deserialize(
+         return BlockData::deserialize(
             data, size, nullptr,
             getID, true, fullHints);
       }
       catch (const BlockDeserializingException &e)
       {
-         LOGERR << "block deser except: " << e.what();
-         LOGERR << "block fileID: " << fileID;
-         return false;
+         if (verbose)
+         {
+            LOGERR << "block deser except: " << e.what();
+            LOGERR << "block fileID: " << fileID;
+         }
       }
       catch (const exception &e)
       {
-         LOGERR << "exception: " << e.what();
-         return false;
+         if (verbose)
+            LOGERR << "exception: " << e.what();
       }
       catch (...)
       {
          //deser failed, ignore this block
-         LOGERR << "unknown exception";
-         return false;
+         if (verbose)
+            LOGERR << "unknown exception";
       }
 
+      return nullptr;
+   };
+
+   auto addBlock = [&](shared_ptr<BlockData> bd, size_t offset)->void
+   {
       //block is valid, add to container
       bd->setFileID(fileID);
       bd->setOffset(offset);
@@ -442,11 +504,98 @@ bool DatabaseBuilder::addBlocksToDB(BlockDataLoader& bdl,
          *bo = blockoffset;
 
       bdMap.emplace(bd->uniqueID(), bd);
+   };
+
+   /*
+   Split the file into blocks with a header only pass, then deser the
+   blocks and check their merkle root on the pool. Ids are drawn up front,
+   in file order.
+   */
+   vector<pair<size_t, uint32_t>> blocks;
+   auto locateBlocks =
+      [&blocks](const uint8_t*, size_t size, size_t offset)->bool
+   {
+      //too short to be deserialized, resync past it like a failed block
+      if (size <= HEADER_SIZE)
+         return false;
+
+      blocks.emplace_back(offset, (uint32_t)size);
       return true;
    };
 
-   parseBlockFile(ptr, blockfilemappointer->size(),
-      startOffset, tallyBlocks);
+   auto fileSize = blockfilemappointer->size();
+   parseBlockFile(ptr, fileSize, startOffset, locateBlocks);
+
+   vector<uint32_t> ids(blocks.size());
+   for (auto& id : ids)
+      id = blockchain_->getNewUniqueID();
+
+   vector<shared_ptr<BlockData>> blockSlots(blocks.size());
+   atomic<unsigned> counter;
+   counter.store(0, memory_order_relaxed);
+   {
+      TaskGroup tasks(taskPool_.get());
+      for (unsigned i = 0; i < taskPool_->threadCount(); i++)
+      {
+         tasks.run([&](void)->void
+         {
+            while (1)
+            {
+               auto index = counter.fetch_add(1, memory_order_relaxed);
+               if (index >= blocks.size())
+                  return;
+
+               auto id = ids[index];
+               auto getID = [id](const BinaryData&)->uint32_t
+               { return id; };
+
+               auto& block = blocks[index];
+               blockSlots[index] = deserBlock(
+                  ptr + block.first, block.second, getID, false);
+            }
+         });
+      }
+      tasks.wait();
+   }
+
+   size_t resyncOffset = SIZE_MAX;
+   for (unsigned i = 0; i < blockSlots.size(); i++)
+   {
+      if (blockSlots[i] == nullptr)
+      {
+         //step back to the magic bytes and size preceding the block
+         resyncOffset = blocks[i].first - 8;
+         break;
+      }
+
+      addBlock(blockSlots[i], blocks[i].first);
+   }
+
+   if (resyncOffset != SIZE_MAX)
+   {
+      /*
+      A block failed to deser, its size may well be off. Carry on serially 
+      from there, a failed block makes the parser look for the next magic 
+      bytes rather than trust the size.
+      */
+      auto getID = [this](const BinaryData&)->uint32_t
+      {
+         return blockchain_->getNewUniqueID();
+      };
+
+      auto tallyBlocks =
+         [&](const uint8_t* data, size_t size, size_t offset)->bool
+      {
+         auto bd = deserBlock(data, size, getID, true);
+         if (bd == nullptr)
+            return false;
+
+         addBlock(bd, offset);
+         return true;
+      };
+
+      parseBlockFile(ptr, fileSize, resyncOffset, tallyBlocks);
+   }
 
    //done parsing, add the headers to the blockchain object
    //convert BlockData vector to BlockHeader map first
@@ -576,6 +725,97 @@ void DatabaseBuilder::parseBlockFile(
    }
 }
 
+/////////////////////////////////////////////////////////////////////////////
+BlockFileRun DatabaseBuilder::discoverBlockFile(
+   BlockDataLoader& bdl, unsigned fileID)
+{
+   BlockFileRun run;
+
+   auto&& blockfilemappointer = bdl.get(fileID);
+   auto ptr = blockfilemappointer->getPtr();
+
+   //ptr is null if we're out of block files
+   if (ptr == nullptr)
+      return run;
+
+   run.fileID_ = fileID;
+
+   auto tallyHeaders =
+      [&run](const uint8_t* data, size_t size, size_t offset)->bool
+   {
+      //header + at least the tx count varint
+      if (size <= HEADER_SIZE)
+         return false;
+
+      DiscoveredBlock block;
+      block.rawHeader_.copyFrom(data, HEADER_SIZE);
+      BtcUtils::getHash256(data, HEADER_SIZE, block.hash_);
+      block.offset_ = offset;
+      block.size_ = (uint32_t)size;
+
+      run.blocks_.emplace_back(move(block));
+      return true;
+   };
+
+   try
+   {
+      parseBlockFile(ptr, blockfilemappointer->size(), 0, tallyHeaders);
+   }
+   catch (exception& e)
+   {
+      LOGWARN << "failed to parse block file #" << fileID << ": " << e.what();
+   }
+
+   return run;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+vector<BlockFileRun> DatabaseBuilder::discoverBlockFiles(
+   BlockDataLoader& bdl, unsigned fromID, unsigned fileCount,
+   TaskPool* taskPool)
+{
+   if (fromID >= fileCount)
+      return {};
+
+   /***
+   Files are scanned independently, workers pull the next file id from a
+   shared counter so a few large files do not stall the others. Each run
+   lands in its own slot, which keeps the result in file order without
+   any merge step.
+   ***/
+
+   auto runCount = fileCount - fromID;
+   vector<BlockFileRun> runs(runCount);
+   atomic<unsigned> counter;
+   counter.store(0, memory_order_relaxed);
+
+   auto discoverLambda = [&](void)->void
+   {
+      while (1)
+      {
+         auto index = counter.fetch_add(1, memory_order_relaxed);
+         if (index >= runCount)
+            return;
+
+         runs[index] = move(discoverBlockFile(bdl, fromID + index));
+      }
+   };
+
+   {
+      TaskGroup tasks(taskPool);
+      auto taskCount = min(taskPool->threadCount(), runCount);
+      for (unsigned i = 0; i < taskCount; i++)
+         tasks.run(discoverLambda);
+      tasks.wait();
+   }
+
+   //drop the trailing empty runs, if any
+   while (runs.size() > 0 && runs.back().fileID_ == UINT32_MAX)
+      runs.pop_back();
+
+   return runs;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 BinaryData DatabaseBuilder::initTransactionHistory(int32_t startHeight)
 {
@@ -603,6 +843,7 @@ BinaryData DatabaseBuilder::scanHistory(int32_t startHeight,
 
       bcs.scan(startHeight);
       bcs.updateSSH(forceRescanSSH_, startHeight);
+      addTouchedScrAddrs(bcs.getTouchedScrAddrs());
 
       unsigned count = 0;
       while (!bcs.resolveTxHashes())
@@ -617,6 +858,7 @@ BinaryData DatabaseBuilder::scanHistory(int32_t startHeight,
          }
       }
 
+      updateTxHintIndex();
       return bcs.getTopScannedBlockHash();
    }
    else
@@ -627,14 +869,41 @@ BinaryData DatabaseBuilder::scanHistory(int32_t startHeight,
          DBSettings::threadCount(), DBSettings::ramUsage(),
          progress_, reportprogress);
 
+      //only the initial build is budgeted, each phase returns right away
+      //once the scan is paused
+      if (init)
+         bcs.setDeadline(buildDeadline_);
+
       bcs.scan();
       bcs.scanSpentness();
       bcs.updateSSH(forceRescanSSH_ & init);
+      if (bcs.isPaused())
+      {
+         LOGINFO << "initial build paused at its last checkpoint";
+         throw BuildPausedException();
+      }
 
+      addTouchedScrAddrs(bcs.getTouchedScrAddrs());
+
+      updateTxHintIndex();
       return bcs.getTopScannedBlockHash();
    }
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void DatabaseBuilder::updateTxHintIndex()
+{
+   //the index only speeds up lookups, don't fail the scan over it
+   try
+   {
+      db_->updateTxHintIndex();
+   }
+   catch (exception& e)
+   {
+      LOGWARN << "failed to update tx hint index: " << e.what();
+   }
+}
+
 /////////////////////////////////////////////////////////////////////////////
 Blockchain::ReorganizationState DatabaseBuilder::update(void)
 {
@@ -650,6 +919,9 @@ Blockchain::ReorganizationState DatabaseBuilder::update(void)
    if (!reorgState.hasNewTop_)
       return reorgState;
 
+   touchedScrAddrs_ = make_shared<set<BinaryData>>();
+   touchedUnknown_ = false;
+
    uint32_t startHeight = reorgState.prevTop_->getBlockHeight() + 1;
 
    if (!reorgState.prevTopStillValid_)
@@ -669,6 +941,10 @@ Blockchain::ReorganizationState DatabaseBuilder::update(void)
 
    //TODO: recover from failed scan 
 
+   if (!touchedUnknown_)
+      reorgState.touchedScrAddrs_ = touchedScrAddrs_;
+   touchedScrAddrs_.reset();
+
    return reorgState;
 }
 
@@ -683,6 +959,7 @@ void DatabaseBuilder::undoHistory(
          DBSettings::threadCount(), DBSettings::ramUsage(),
          progress_, false);
       bcs.undo(reorgState);
+      addTouchedScrAddrs(bcs.getTouchedScrAddrs());
    }
    else
    {
@@ -691,11 +968,30 @@ void DatabaseBuilder::undoHistory(
          DBSettings::threadCount(), DBSettings::ramUsage(),
          progress_, false);
       bcs.undo(reorgState);
+      addTouchedScrAddrs(bcs.getTouchedScrAddrs());
    }
 
    blockchain_->updateBranchingMaps(db_, reorgState);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void DatabaseBuilder::addTouchedScrAddrs(
+   shared_ptr<set<BinaryData>> scrAddrs)
+{
+   //only tracked within update()
+   if (touchedScrAddrs_ == nullptr)
+      return;
+
+   //the scanner didn't track them, wallets will have to check everything
+   if (scrAddrs == nullptr)
+   {
+      touchedUnknown_ = true;
+      return;
+   }
+
+   touchedScrAddrs_->insert(scrAddrs->begin(), scrAddrs->end());
+}
+
 /////////////////////////////////////////////////////////////////////////////
 void DatabaseBuilder::resetHistory()
 {
@@ -707,40 +1003,97 @@ void DatabaseBuilder::resetHistory()
 /////////////////////////////////////////////////////////////////////////////
 bool DatabaseBuilder::reparseBlkFiles(unsigned fromID)
 {
-   mutex mu;
-   map<BinaryData, shared_ptr<BlockHeader>> headerMap;
-
    BlockDataLoader bdl(blockFiles_.folderPath());
 
-   auto assessLambda = [&](unsigned fileID)->void
+   //header only pass over the blk files, runs come back in file order
+   auto&& runs = discoverBlockFiles(
+      bdl, fromID, blockFiles_.fileCount(), taskPool_.get());
+
+   //blocks either missing from the blockchain object or recorded under
+   //another fileID/offset
+   vector<pair<unsigned, const DiscoveredBlock*>> candidates;
+   map<unsigned, shared_ptr<BlockDataFileMap>> fileMaps;
+   for (auto& run : runs)
    {
-      while (fileID < blockFiles_.fileCount())
+      for (auto& block : run.blocks_)
       {
-         auto&& hmap = assessBlkFile(bdl, fileID);
-
-         fileID += DBSettings::threadCount();
+         //skip blocks the blockchain object already has at this location
+         try
+         {
+            auto bhPtr = blockchain_->getHeaderByHash(block.hash_);
+            if (bhPtr->getBlockFileNum() == run.fileID_ &&
+               bhPtr->getOffset() == block.offset_)
+               continue;
+         }
+         catch (range_error&)
+         {
+            //catch and continue
+         }
 
-         if (hmap.size() == 0)
-            continue;
+         if (fileMaps.find(run.fileID_) == fileMaps.end())
+            fileMaps.emplace(run.fileID_, bdl.get(run.fileID_));
 
-         unique_lock<mutex> lock(mu);
-         headerMap.insert(hmap.begin(), hmap.end());
+         candidates.emplace_back(run.fileID_, &block);
       }
-   };
+   }
 
-   unsigned threadcount = min(DBSettings::threadCount(),
-      blockFiles_.fileCount() - topBlockOffset_.fileID_);
+   //deser them in full on the pool to check the merkle root before adding
+   //them, ids are drawn in file order
+   vector<uint32_t> ids(candidates.size());
+   for (auto& id : ids)
+      id = blockchain_->getNewUniqueID();
 
-   vector<thread> tIDs;
-   for (unsigned i = 1; i < threadcount; i++)
-      tIDs.push_back(thread(assessLambda, fromID + i));
+   vector<shared_ptr<BlockHeader>> headerSlots(candidates.size());
+   atomic<unsigned> counter;
+   counter.store(0, memory_order_relaxed);
+   {
+      TaskGroup tasks(taskPool_.get());
+      for (unsigned i = 0; i < taskPool_->threadCount(); i++)
+      {
+         tasks.run([&](void)->void
+         {
+            while (1)
+            {
+               auto index = counter.fetch_add(1, memory_order_relaxed);
+               if (index >= candidates.size())
+                  return;
 
-   assessLambda(fromID);
+               auto id = ids[index];
+               auto getID = [id](const BinaryData&)->uint32_t
+               { return id; };
 
-   for (auto& tID : tIDs)
+               auto fileID = candidates[index].first;
+               auto& block = *candidates[index].second;
+               auto& fileMap = fileMaps.at(fileID);
+
+               shared_ptr<BlockData> bd;
+               try
+               {
+                  bd = BlockData::deserialize(
+                     fileMap->getPtr() + block.offset_, block.size_,
+                     nullptr, getID, true, false);
+               }
+               catch (...)
+               {
+                  //deser failed, ignore this block
+                  continue;
+               }
+
+               bd->setFileID(fileID);
+               bd->setOffset(block.offset_);
+               headerSlots[index] = bd->createBlockHeader();
+            }
+         });
+      }
+      tasks.wait();
+   }
+
+   //later copies of a block win, as with the serial pass
+   map<BinaryData, shared_ptr<BlockHeader>> headerMap;
+   for (auto& bh : headerSlots)
    {
-      if (tID.joinable())
-         tID.join();
+      if (bh != nullptr)
+         headerMap[bh->getThisHash()] = bh;
    }
 
    //headerMap contains blocks that are either missing from our blockchain 
@@ -763,83 +1116,6 @@ bool DatabaseBuilder::reparseBlkFiles(unsigned fromID)
    return true;
 }
 
-/////////////////////////////////////////////////////////////////////////////
-map<BinaryData, shared_ptr<BlockHeader>> DatabaseBuilder::assessBlkFile(
-   BlockDataLoader& bdl, unsigned fileID)
-{
-   map<BinaryData, shared_ptr<BlockHeader>> returnMap;
-
-   auto&& blockfilemappointer = bdl.get(fileID);
-   auto ptr = blockfilemappointer->getPtr();
-
-   //ptr is null if we're out of block files
-   if (ptr == nullptr)
-      return returnMap;
-
-   vector<shared_ptr<BlockData>> bdVec;
-
-   auto tallyBlocks =
-      [&](const uint8_t* data, size_t size, size_t offset)->bool
-   {
-      //deser full block, check merkle
-      shared_ptr<BlockData> bd;
-      BinaryRefReader brr(data, size);
-
-      auto getID = [this](const BinaryData&)->uint32_t
-      { return blockchain_->getNewUniqueID(); };
-
-      try
-      {
-         bd = BlockData::deserialize(
-            data, size, nullptr, getID, true, false);
-      }
-      catch (...)
-      {
-         //deser failed, ignore this block
-         return false;
-      }
-
-      bd->setFileID(fileID);
-      bd->setOffset(offset);
-
-      //query blockchain object for block by hash
-      BlockHeader* bhPtr = nullptr;
-      try
-      {
-         blockchain_->getHeaderByHash(bd->getHash());
-      }
-      catch (range_error&)
-      {
-         //catch and continue
-      }
-
-      //add the block either if we don't have it in our blockchain object,
-      //or if the offsets and/or fileID mismatch
-      if (bhPtr != nullptr)
-      {
-         if (bhPtr->getBlockFileNum() == fileID &&
-            bhPtr->getOffset() == offset)
-            return true;
-      }
-
-      bdVec.emplace_back(move(bd));
-      return true;
-   };
-
-   parseBlockFile(ptr, blockfilemappointer->size(), 0, tallyBlocks);
-
-   //done parsing, add the headers to the blockchain object
-   //convert BlockData vector to BlockHeader map first
-   map<HashString, shared_ptr<BlockHeader>> bhmap;
-   for (auto& bd : bdVec)
-   {
-      auto bh = bd->createBlockHeader();
-      bhmap.insert(make_pair(bh->getThisHash(), bh));
-   }
-
-   return returnMap;
-}
-
 /////////////////////////////////////////////////////////////////////////////
 void DatabaseBuilder::verifyChain()
 {
@@ -898,7 +1174,7 @@ void DatabaseBuilder::commitAllTxHints(
 
    {
       auto addTxHintMap =
-         [&](const shared_ptr<BCTX>& txn, const BinaryData& txkey)->void
+         [&](const BCTX* txn, const BinaryData& txkey)->void
       {
          auto txHashPrefix = txn->getHash().getSliceCopy(0, 4);
          auto& stxh = txHints[txHashPrefix];
@@ -943,15 +1219,10 @@ void DatabaseBuilder::commitAllTxHints(
       txhint.second.serializeDBValue(bw);
    }
 
-   //write
-   {
-      for (const auto& txhint : serializedHints)
-      {
-         db_->putValue(TXHINTS,
-            txhint.first.getRef(),
-            txhint.second.getDataRef());
-      }
-   }
+   //write, within hintdbtx so the read-modify-write stays serialized
+   auto hintBatch = 
+      DBWriteBatch::fromMap(TXHINTS, move(serializedHints));
+   db_->commitStage().commit(*hintBatch);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -1009,6 +1280,9 @@ void DatabaseBuilder::commitAllStxos(
 
    auto&& tx = db_->beginTransaction(STXO, LMDB::ReadWrite);
 
+   //keys follow block id then tx and txout index, new blocks get appended
+   DBWriteBatch stxoBatch(STXO);
+   stxoBatch.puts_.reserve(serializedStxos.size());
    for (auto& bwPair : serializedStxos)
    {
       if (bwPair.first.getSize() == 6)
@@ -1023,9 +1297,11 @@ void DatabaseBuilder::commitAllStxos(
          }
       }
 
-      db_->putValue(
-         STXO, bwPair.first.getRef(), bwPair.second.getDataRef());
+      stxoBatch.puts_.emplace_back(
+         bwPair.first.getRef(), bwPair.second.getDataRef());
    }
+
+   db_->commitStage().commit(stxoBatch);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -1072,7 +1348,7 @@ void DatabaseBuilder::verifyTransactions()
       };
 
       auto getUtxoMap = [&bdl, stateStruct, getFileMap, this]
-         (shared_ptr<BCTX> txn)->Armory::Signer::TransactionVerifier::utxoMap
+         (const BCTX* txn)->Armory::Signer::TransactionVerifier::utxoMap
       {
          Armory::Signer::TransactionVerifier::utxoMap utxomap;
          for (auto& txin : txn->txins_)
@@ -10,13 +10,51 @@
 #include "Blockchain.h"
 #include "bdmenums.h"
 #include "Progress.h"
+#include "TaskPool.h"
 
 class BlockDataManager;
 class ScrAddrFilter;
 class UnresolvedHashException {};
 
+//thrown once an initial build ran out of --build-budget, the db is left at
+//a checkpoint the next run resumes from
+class BuildPausedException {};
+
+//--build-budget is in minutes, unit tests spend it before the scan starts
+#ifndef UNIT_TESTS
+#define BUILD_BUDGET_UNIT std::chrono::minutes
+#else
+#define BUILD_BUDGET_UNIT std::chrono::microseconds
+#endif
+
 typedef std::function<void(BDMPhase, double, unsigned, unsigned)> ProgressCallback;
 
+/////////////////////////////////////////////////////////////////////////////
+struct DiscoveredBlock
+{
+   BinaryData rawHeader_;
+   BinaryData hash_;
+   size_t offset_;
+   uint32_t size_;
+
+   BinaryDataRef getPrevHash(void) const
+   {
+      return BinaryDataRef(rawHeader_.getPtr() + 4, 32);
+   }
+};
+
+////
+struct BlockFileRun
+{
+   /***
+   Header only pass over a single blk file: block hashes and locations in
+   file order, no tx data is deserialized.
+   ***/
+
+   unsigned fileID_ = UINT32_MAX;
+   std::vector<DiscoveredBlock> blocks_;
+};
+
 /////////////////////////////////////////////////////////////////////////////
 class DatabaseBuilder
 {
@@ -31,26 +69,39 @@ private:
 
    unsigned checkedTransactions_ = 0;
    const bool forceRescanSSH_;
+   bool headersFromIndex_ = false;
+
+   std::chrono::steady_clock::time_point buildDeadline_ =
+      std::chrono::steady_clock::time_point::max();
+
+   //scrAddrs with a new ssh summary, collected through update()
+   std::shared_ptr<std::set<BinaryData>> touchedScrAddrs_;
+   bool touchedUnknown_ = false;
+
+   //block deser and merkle checks of the blk file passes
+   std::shared_ptr<Armory::Threading::TaskPool> taskPool_;
 
 private:
    BlockOffset loadBlockHeadersFromDB(const ProgressCallback &progress);
+   bool loadBlockHeadersFromIndex(Blockchain::ReorganizationState&);
    
    bool addBlocksToDB(
       BlockDataLoader& bdl, uint16_t fileID, size_t startOffset,
       std::shared_ptr<BlockOffset> bo, bool fullHints);
-   void parseBlockFile(const uint8_t* fileMap, size_t fileSize, size_t startOffset,
+   static void parseBlockFile(
+      const uint8_t* fileMap, size_t fileSize, size_t startOffset,
       std::function<bool(const uint8_t* data, size_t size, size_t offset)>);
 
    Blockchain::ReorganizationState updateBlocksInDB(
       const ProgressCallback &progress, bool verbose, bool fullHints);
    BinaryData initTransactionHistory(int32_t startHeight);
    BinaryData scanHistory(int32_t startHeight, bool reportprogress, bool init);
+   void updateTxHintIndex(void);
    void undoHistory(Blockchain::ReorganizationState& reorgState);
+   void addTouchedScrAddrs(std::shared_ptr<std::set<BinaryData>>);
 
    void resetHistory(void);
    bool reparseBlkFiles(unsigned fromID);
-   std::map<BinaryData, std::shared_ptr<BlockHeader>> assessBlkFile(BlockDataLoader& bdl,
-      unsigned fileID);
 
    void verifyTransactions(void);
    void commitAllTxHints(
@@ -74,6 +125,13 @@ public:
 
    void verifyChain(void);
    unsigned getCheckedTxCount(void) const { return checkedTransactions_; }
+   bool loadedHeadersFromIndex(void) const { return headersFromIndex_; }
+
+   //header only passes over blk files, see BlockFileRun
+   static BlockFileRun discoverBlockFile(BlockDataLoader&, unsigned fileID);
+   static std::vector<BlockFileRun> discoverBlockFiles(
+      BlockDataLoader&, unsigned fromID, unsigned fileCount,
+      Armory::Threading::TaskPool*);
 
    //void verifyTxFilters(void);
 };
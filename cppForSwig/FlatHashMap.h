@@ -0,0 +1,569 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _FLATHASHMAP_H
+#define _FLATHASHMAP_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <tuple>
+#include <stdexcept>
+#include <type_traits>
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+   (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLATMAP_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define FLATMAP_GROUP_SIZE 16
+
+////////////////////////////////////////////////////////////////////////////////
+template<size_t N> struct FixedKey
+{
+   /***
+   Inline, fixed length key for FlatHashMap. Meant for tx hashes, outpoints
+   and script hashes, i.e. data that does not need a heap allocation.
+   ***/
+
+   uint8_t data_[N];
+
+   FixedKey(void)
+   {
+      memset(data_, 0, N);
+   }
+
+   explicit FixedKey(const uint8_t* ptr)
+   {
+      memcpy(data_, ptr, N);
+   }
+
+   bool operator==(const FixedKey& rhs) const
+   {
+      return memcmp(data_, rhs.data_, N) == 0;
+   }
+
+   bool operator!=(const FixedKey& rhs) const
+   {
+      return !(*this == rhs);
+   }
+
+   const uint8_t* getPtr(void) const { return data_; }
+   static size_t getSize(void) { return N; }
+};
+
+namespace std
+{
+   template<size_t N> struct hash<FixedKey<N>>
+   {
+      size_t operator()(const FixedKey<N>& key) const
+      {
+         //keys are mostly hashes already, fold and mix the words
+         uint64_t h = N;
+         size_t i = 0;
+         for (; i + 8 <= N; i += 8)
+         {
+            uint64_t word;
+            memcpy(&word, key.data_ + i, 8);
+            h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+            h ^= h >> 32;
+         }
+
+         if (i < N)
+         {
+            uint64_t tail = 0;
+            memcpy(&tail, key.data_ + i, N - i);
+            h = (h ^ tail) * 0x9E3779B97F4A7C15ULL;
+         }
+
+         h ^= h >> 29;
+         return (size_t)h;
+      }
+   };
+};
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename K, typename V, typename H = std::hash<K>>
+class FlatHashMap
+{
+   /***
+   Open addressing hash map with inline entries.
+
+   Each slot has a control byte: empty, deleted or the low 7 bits of the
+   key hash. Slots are probed 16 at a time: the control bytes of a group
+   are matched against the hash bits in one go (SSE2 where available), so
+   a lookup usually touches a single group and compares a single key.
+
+   Not thread safe. Lookups can run concurrently as long as there are no
+   writers. Iterators are invalidated by inserts.
+   ***/
+
+public:
+   typedef std::pair<const K, V> value_type;
+
+private:
+   static const int8_t ctrlEmpty_ = -128;
+   static const int8_t ctrlDeleted_ = -2;
+
+   std::unique_ptr<int8_t[]> ctrl_;
+   value_type* slots_ = nullptr;
+   size_t capacity_ = 0;
+   size_t size_ = 0;
+   size_t tombstones_ = 0;
+   H hasher_;
+
+public:
+   ////
+   template<bool CONST> class iterator_base
+   {
+      friend class FlatHashMap;
+      template<bool> friend class iterator_base;
+      typedef typename std::conditional<CONST,
+         const FlatHashMap*, FlatHashMap*>::type map_ptr;
+
+   private:
+      map_ptr map_ = nullptr;
+      size_t index_ = 0;
+
+   private:
+      void skipToFull(void)
+      {
+         while (index_ < map_->capacity_ && map_->ctrl_[index_] < 0)
+            ++index_;
+      }
+
+   public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef typename FlatHashMap::value_type value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef typename std::conditional<CONST,
+         const value_type*, value_type*>::type pointer;
+      typedef typename std::conditional<CONST,
+         const value_type&, value_type&>::type reference;
+
+      iterator_base(void)
+      {}
+
+      iterator_base(map_ptr mapPtr, size_t index) :
+         map_(mapPtr), index_(index)
+      {}
+
+      //iterator to const_iterator
+      template<bool OTHER, typename = typename std::enable_if<
+         CONST && !OTHER>::type>
+      iterator_base(const iterator_base<OTHER>& rhs) :
+         map_(rhs.map_), index_(rhs.index_)
+      {}
+
+      reference operator*(void) const { return map_->slots_[index_]; }
+      pointer operator->(void) const { return map_->slots_ + index_; }
+
+      iterator_base& operator++(void)
+      {
+         ++index_;
+         skipToFull();
+         return *this;
+      }
+
+      iterator_base operator++(int)
+      {
+         auto copy = *this;
+         ++(*this);
+         return copy;
+      }
+
+      bool operator==(const iterator_base& rhs) const
+      {
+         return index_ == rhs.index_;
+      }
+
+      bool operator!=(const iterator_base& rhs) const
+      {
+         return index_ != rhs.index_;
+      }
+   };
+
+   typedef iterator_base<false> iterator;
+   typedef iterator_base<true> const_iterator;
+
+private:
+   ////
+   static unsigned lowestBit(uint32_t mask)
+   {
+#ifdef _MSC_VER
+      unsigned long index;
+      _BitScanForward(&index, mask);
+      return (unsigned)index;
+#else
+      return (unsigned)__builtin_ctz(mask);
+#endif
+   }
+
+   //bit i is set if ctrl[i] == val
+   static uint32_t matchByte(const int8_t* ctrl, int8_t val)
+   {
+#ifdef FLATMAP_SSE2
+      auto group = _mm_loadu_si128((const __m128i*)ctrl);
+      return (uint32_t)_mm_movemask_epi8(
+         _mm_cmpeq_epi8(group, _mm_set1_epi8(val)));
+#else
+      uint32_t mask = 0;
+      for (unsigned i = 0; i < FLATMAP_GROUP_SIZE; i++)
+      {
+         if (ctrl[i] == val)
+            mask |= 1U << i;
+      }
+      return mask;
+#endif
+   }
+
+   //bit i is set if ctrl[i] is empty or deleted, i.e. has its sign bit set
+   static uint32_t matchFree(const int8_t* ctrl)
+   {
+#ifdef FLATMAP_SSE2
+      auto group = _mm_loadu_si128((const __m128i*)ctrl);
+      return (uint32_t)_mm_movemask_epi8(group);
+#else
+      uint32_t mask = 0;
+      for (unsigned i = 0; i < FLATMAP_GROUP_SIZE; i++)
+      {
+         if (ctrl[i] < 0)
+            mask |= 1U << i;
+      }
+      return mask;
+#endif
+   }
+
+   static int8_t hashTag(size_t h) { return (int8_t)(h & 0x7F); }
+   size_t groupMask(void) const
+   { return capacity_ / FLATMAP_GROUP_SIZE - 1; }
+
+   //triangular probing over groups, visits every group once since the
+   //group count is a power of 2
+   size_t findSlot(const K& key, size_t h) const
+   {
+      if (capacity_ == 0)
+         return capacity_;
+
+      auto tag = hashTag(h);
+      auto mask = groupMask();
+      auto group = (h >> 7) & mask;
+      for (size_t probe = 0; probe <= mask; probe++)
+      {
+         auto ctrl = ctrl_.get() + group * FLATMAP_GROUP_SIZE;
+         auto match = matchByte(ctrl, tag);
+         while (match != 0)
+         {
+            auto slot = group * FLATMAP_GROUP_SIZE + lowestBit(match);
+            if (slots_[slot].first == key)
+               return slot;
+            match &= match - 1;
+         }
+
+         //an empty slot ends the probe sequence
+         if (matchByte(ctrl, ctrlEmpty_) != 0)
+            break;
+
+         group = (group + probe + 1) & mask;
+      }
+
+      return capacity_;
+   }
+
+   size_t findFreeSlot(size_t h) const
+   {
+      auto mask = groupMask();
+      auto group = (h >> 7) & mask;
+      for (size_t probe = 0; probe <= mask; probe++)
+      {
+         auto ctrl = ctrl_.get() + group * FLATMAP_GROUP_SIZE;
+         auto match = matchFree(ctrl);
+         if (match != 0)
+            return group * FLATMAP_GROUP_SIZE + lowestBit(match);
+
+         group = (group + probe + 1) & mask;
+      }
+
+      throw std::runtime_error("FlatHashMap is full");
+   }
+
+   static size_t maxLoad(size_t capacity)
+   {
+      return capacity - capacity / 8;
+   }
+
+   void rehash(size_t newCapacity)
+   {
+      auto oldCtrl = std::move(ctrl_);
+      auto oldSlots = slots_;
+      auto oldCapacity = capacity_;
+
+      ctrl_.reset(new int8_t[newCapacity]);
+      memset(ctrl_.get(), ctrlEmpty_, newCapacity);
+      slots_ = static_cast<value_type*>(
+         ::operator new(sizeof(value_type) * newCapacity));
+      capacity_ = newCapacity;
+      tombstones_ = 0;
+
+      for (size_t i = 0; i < oldCapacity; i++)
+      {
+         if (oldCtrl[i] < 0)
+            continue;
+
+         auto& entry = oldSlots[i];
+         auto h = hasher_(entry.first);
+         auto slot = findFreeSlot(h);
+         ctrl_[slot] = hashTag(h);
+         new (slots_ + slot) value_type(std::move(entry));
+         entry.~value_type();
+      }
+
+      ::operator delete(oldSlots);
+   }
+
+   void growIfNeeded(void)
+   {
+      if (capacity_ == 0)
+      {
+         rehash(FLATMAP_GROUP_SIZE);
+         return;
+      }
+
+      if (size_ + tombstones_ + 1 <= maxLoad(capacity_))
+         return;
+
+      //mostly tombstones, rehash in place
+      if (size_ + 1 <= maxLoad(capacity_) / 2)
+         rehash(capacity_);
+      else
+         rehash(capacity_ * 2);
+   }
+
+   void destroyAll(void)
+   {
+      for (size_t i = 0; i < capacity_; i++)
+      {
+         if (ctrl_[i] >= 0)
+            slots_[i].~value_type();
+      }
+   }
+
+   void release(void)
+   {
+      destroyAll();
+      ::operator delete(slots_);
+      slots_ = nullptr;
+      ctrl_.reset();
+      capacity_ = 0;
+      size_ = 0;
+      tombstones_ = 0;
+   }
+
+public:
+   FlatHashMap(void)
+   {}
+
+   FlatHashMap(const FlatHashMap& rhs) :
+      hasher_(rhs.hasher_)
+   {
+      reserve(rhs.size_);
+      for (auto& entry : rhs)
+         emplace(entry.first, entry.second);
+   }
+
+   FlatHashMap(FlatHashMap&& rhs) :
+      ctrl_(std::move(rhs.ctrl_)), slots_(rhs.slots_),
+      capacity_(rhs.capacity_), size_(rhs.size_),
+      tombstones_(rhs.tombstones_), hasher_(std::move(rhs.hasher_))
+   {
+      rhs.slots_ = nullptr;
+      rhs.capacity_ = 0;
+      rhs.size_ = 0;
+      rhs.tombstones_ = 0;
+   }
+
+   FlatHashMap& operator=(const FlatHashMap& rhs)
+   {
+      if (this != &rhs)
+      {
+         FlatHashMap copy(rhs);
+         *this = std::move(copy);
+      }
+
+      return *this;
+   }
+
+   FlatHashMap& operator=(FlatHashMap&& rhs)
+   {
+      if (this != &rhs)
+      {
+         release();
+         ctrl_ = std::move(rhs.ctrl_);
+         slots_ = rhs.slots_;
+         capacity_ = rhs.capacity_;
+         size_ = rhs.size_;
+         tombstones_ = rhs.tombstones_;
+         hasher_ = std::move(rhs.hasher_);
+
+         rhs.slots_ = nullptr;
+         rhs.capacity_ = 0;
+         rhs.size_ = 0;
+         rhs.tombstones_ = 0;
+      }
+
+      return *this;
+   }
+
+   ~FlatHashMap(void)
+   {
+      release();
+   }
+
+   ////
+   size_t size(void) const { return size_; }
+   bool empty(void) const { return size_ == 0; }
+   size_t capacity(void) const { return capacity_; }
+
+   iterator begin(void)
+   {
+      iterator iter(this, 0);
+      iter.skipToFull();
+      return iter;
+   }
+
+   const_iterator begin(void) const
+   {
+      const_iterator iter(this, 0);
+      iter.skipToFull();
+      return iter;
+   }
+
+   iterator end(void) { return iterator(this, capacity_); }
+   const_iterator end(void) const { return const_iterator(this, capacity_); }
+   const_iterator cbegin(void) const { return begin(); }
+   const_iterator cend(void) const { return end(); }
+
+   ////
+   iterator find(const K& key)
+   {
+      return iterator(this, findSlot(key, hasher_(key)));
+   }
+
+   const_iterator find(const K& key) const
+   {
+      return const_iterator(this, findSlot(key, hasher_(key)));
+   }
+
+   size_t count(const K& key) const
+   {
+      return find(key) == end() ? 0 : 1;
+   }
+
+   //does not overwrite existing entries, same as std::map::emplace
+   template<typename... Args>
+   std::pair<iterator, bool> emplace(const K& key, Args&&... args)
+   {
+      auto h = hasher_(key);
+      auto slot = findSlot(key, h);
+      if (slot != capacity_)
+         return std::make_pair(iterator(this, slot), false);
+
+      growIfNeeded();
+      slot = findFreeSlot(h);
+      if (ctrl_[slot] == ctrlDeleted_)
+         --tombstones_;
+
+      new (slots_ + slot) value_type(std::piecewise_construct,
+         std::forward_as_tuple(key),
+         std::forward_as_tuple(std::forward<Args>(args)...));
+      ctrl_[slot] = hashTag(h);
+      ++size_;
+
+      return std::make_pair(iterator(this, slot), true);
+   }
+
+   std::pair<iterator, bool> insert(const value_type& entry)
+   {
+      return emplace(entry.first, entry.second);
+   }
+
+   std::pair<iterator, bool> insert(value_type&& entry)
+   {
+      return emplace(entry.first, std::move(entry.second));
+   }
+
+   V& operator[](const K& key)
+   {
+      return emplace(key).first->second;
+   }
+
+   ////
+   iterator erase(iterator iter)
+   {
+      auto slot = iter.index_;
+      slots_[slot].~value_type();
+      --size_;
+
+      //a group with an empty slot never had a probe sequence run through
+      //it, the slot can go back to empty rather than tombstoned
+      auto groupStart = slot - (slot % FLATMAP_GROUP_SIZE);
+      if (matchByte(ctrl_.get() + groupStart, ctrlEmpty_) != 0)
+      {
+         ctrl_[slot] = ctrlEmpty_;
+      }
+      else
+      {
+         ctrl_[slot] = ctrlDeleted_;
+         ++tombstones_;
+      }
+
+      ++iter;
+      return iter;
+   }
+
+   size_t erase(const K& key)
+   {
+      auto iter = find(key);
+      if (iter == end())
+         return 0;
+
+      erase(iter);
+      return 1;
+   }
+
+   void clear(void)
+   {
+      destroyAll();
+      if (capacity_ > 0)
+         memset(ctrl_.get(), ctrlEmpty_, capacity_);
+      size_ = 0;
+      tombstones_ = 0;
+   }
+
+   void reserve(size_t count)
+   {
+      size_t newCapacity = FLATMAP_GROUP_SIZE;
+      while (maxLoad(newCapacity) < count)
+         newCapacity *= 2;
+
+      if (newCapacity > capacity_)
+         rehash(newCapacity);
+   }
+};
+
+#endif
@@ -0,0 +1,645 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstring>
+
+#include "Hash256Batch.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+   defined(__i386__) || defined(_M_IX86)
+#define HASH256_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+//gcc & clang need the isa enabled per function, msvc allows the intrinsics
+//without any flags
+#if defined(HASH256_X86) && !defined(_MSC_VER)
+#define HASH256_TARGET(isa) __attribute__((target(isa)))
+#else
+#define HASH256_TARGET(isa)
+#endif
+
+#define HASH256_MIN_AVX2_BATCH 4
+
+using namespace std;
+
+namespace
+{
+   const uint32_t sha256_K[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+      0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+      0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+      0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+      0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+      0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+      0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+      0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+      0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+      0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+      0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+      0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+      0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+      0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+   };
+
+   const uint32_t sha256_IV[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+   };
+
+   typedef void(*TransformFunc)(uint32_t*, const uint8_t*, size_t);
+
+   /////////////////////////////////////////////////////////////////////////////
+   inline uint32_t readBE32(const uint8_t* ptr)
+   {
+      return ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) |
+         ((uint32_t)ptr[2] << 8) | (uint32_t)ptr[3];
+   }
+
+   inline void writeBE32(uint8_t* ptr, uint32_t val)
+   {
+      ptr[0] = (uint8_t)(val >> 24);
+      ptr[1] = (uint8_t)(val >> 16);
+      ptr[2] = (uint8_t)(val >> 8);
+      ptr[3] = (uint8_t)val;
+   }
+
+   inline void writeBE64(uint8_t* ptr, uint64_t val)
+   {
+      writeBE32(ptr, (uint32_t)(val >> 32));
+      writeBE32(ptr + 4, (uint32_t)val);
+   }
+
+   /////////////////////////////////////////////////////////////////////////////
+   //splits a message into its full blocks and a padded tail of 1 or 2 blocks
+   struct PaddedMessage
+   {
+      const uint8_t* data_ = nullptr;
+      size_t fullBlocks_ = 0;
+      size_t totalBlocks_ = 0;
+      uint8_t tail_[128];
+
+      void set(const uint8_t* data, size_t len)
+      {
+         data_ = data;
+         fullBlocks_ = len / 64;
+         auto rem = len % 64;
+         size_t tailBlocks = rem + 9 <= 64 ? 1 : 2;
+         totalBlocks_ = fullBlocks_ + tailBlocks;
+
+         auto tailLen = tailBlocks * 64;
+         if (rem > 0)
+            memcpy(tail_, data + fullBlocks_ * 64, rem);
+         tail_[rem] = 0x80;
+         memset(tail_ + rem + 1, 0, tailLen - rem - 9);
+         writeBE64(tail_ + tailLen - 8, (uint64_t)len * 8);
+      }
+
+      const uint8_t* block(size_t id) const
+      {
+         if (id < fullBlocks_)
+            return data_ + id * 64;
+         return tail_ + (id - fullBlocks_) * 64;
+      }
+   };
+
+   /////////////////////////////////////////////////////////////////////////////
+   void storeState(const uint32_t* state, uint8_t* digest)
+   {
+      for (unsigned i = 0; i < 8; i++)
+         writeBE32(digest + i * 4, state[i]);
+   }
+
+   //sha256 of a 32 byte digest, done in place
+   void rehashDigest(TransformFunc transform, uint8_t* digest)
+   {
+      uint8_t block[64];
+      memcpy(block, digest, 32);
+      block[32] = 0x80;
+      memset(block + 33, 0, 31);
+      block[62] = 0x01; //256 bits
+
+      uint32_t state[8];
+      memcpy(state, sha256_IV, sizeof(state));
+      transform(state, block, 1);
+      storeState(state, digest);
+   }
+
+   void hash256Single(TransformFunc transform,
+      const uint8_t* data, size_t len, uint8_t* digest)
+   {
+      PaddedMessage msg;
+      msg.set(data, len);
+
+      uint32_t state[8];
+      memcpy(state, sha256_IV, sizeof(state));
+      if (msg.fullBlocks_ > 0)
+         transform(state, data, msg.fullBlocks_);
+      transform(state, msg.tail_, msg.totalBlocks_ - msg.fullBlocks_);
+      storeState(state, digest);
+
+      rehashDigest(transform, digest);
+   }
+
+   /////////////////////////////////////////////////////////////////////////////
+   //// scalar
+   /////////////////////////////////////////////////////////////////////////////
+   inline uint32_t rotr(uint32_t x, unsigned n)
+   {
+      return (x >> n) | (x << (32 - n));
+   }
+
+   void transformScalar(uint32_t* state, const uint8_t* data, size_t blocks)
+   {
+      uint32_t w[64];
+
+      for (size_t blk = 0; blk < blocks; blk++, data += 64)
+      {
+         for (unsigned i = 0; i < 16; i++)
+            w[i] = readBE32(data + i * 4);
+
+         for (unsigned i = 16; i < 64; i++)
+         {
+            auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^
+               (w[i - 15] >> 3);
+            auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^
+               (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+         }
+
+         auto a = state[0], b = state[1], c = state[2], d = state[3];
+         auto e = state[4], f = state[5], g = state[6], h = state[7];
+
+         for (unsigned i = 0; i < 64; i++)
+         {
+            auto S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            auto ch = (e & f) ^ (~e & g);
+            auto t1 = h + S1 + ch + sha256_K[i] + w[i];
+            auto S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            auto maj = (a & b) ^ (a & c) ^ (b & c);
+            auto t2 = S0 + maj;
+
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+         }
+
+         state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+         state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+      }
+   }
+
+#ifdef HASH256_X86
+   /////////////////////////////////////////////////////////////////////////////
+   //// SHA_NI
+   /////////////////////////////////////////////////////////////////////////////
+   HASH256_TARGET("sha,sse4.1,ssse3")
+   void transformSHANI(uint32_t* state, const uint8_t* data, size_t blocks)
+   {
+      const __m128i MASK = _mm_set_epi64x(
+         0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+      //state is carried as ABEF/CDGH by the sha rounds instructions
+      __m128i tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+      __m128i state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+      tmp = _mm_shuffle_epi32(tmp, 0xB1);
+      state1 = _mm_shuffle_epi32(state1, 0x1B);
+      __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+      state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+      for (size_t blk = 0; blk < blocks; blk++, data += 64)
+      {
+         auto abefSave = state0;
+         auto cdghSave = state1;
+         __m128i msgs[4];
+
+         for (unsigned g = 0; g < 16; g++)
+         {
+            if (g < 4)
+            {
+               msgs[g] = _mm_shuffle_epi8(
+                  _mm_loadu_si128((const __m128i*)(data + g * 16)), MASK);
+            }
+
+            auto& cur = msgs[g % 4];
+            auto msg = _mm_add_epi32(cur,
+               _mm_loadu_si128((const __m128i*)&sha256_K[g * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+            //schedule the message words 4 rounds ahead
+            if (g >= 3 && g <= 14)
+            {
+               auto& next = msgs[(g + 1) % 4];
+               tmp = _mm_alignr_epi8(cur, msgs[(g + 3) % 4], 4);
+               next = _mm_add_epi32(next, tmp);
+               next = _mm_sha256msg2_epu32(next, cur);
+            }
+
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+            if (g >= 1 && g <= 12)
+            {
+               auto& prev = msgs[(g + 3) % 4];
+               prev = _mm_sha256msg1_epu32(prev, cur);
+            }
+         }
+
+         state0 = _mm_add_epi32(state0, abefSave);
+         state1 = _mm_add_epi32(state1, cdghSave);
+      }
+
+      tmp = _mm_shuffle_epi32(state0, 0x1B);
+      state1 = _mm_shuffle_epi32(state1, 0xB1);
+      state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+      state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+      _mm_storeu_si128((__m128i*)&state[0], state0);
+      _mm_storeu_si128((__m128i*)&state[4], state1);
+   }
+
+   /////////////////////////////////////////////////////////////////////////////
+   //// AVX2, 8 lanes
+   /////////////////////////////////////////////////////////////////////////////
+   HASH256_TARGET("avx2")
+   inline __m256i rotr8(__m256i x, int n)
+   {
+      return _mm256_or_si256(
+         _mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+   }
+
+   //state is laid out as [word][lane], one block per lane
+   HASH256_TARGET("avx2")
+   void transformAVX2(uint32_t* state, const uint8_t* const* blocks)
+   {
+      __m256i w[16];
+      for (unsigned i = 0; i < 16; i++)
+      {
+         w[i] = _mm256_set_epi32(
+            (int)readBE32(blocks[7] + i * 4), (int)readBE32(blocks[6] + i * 4),
+            (int)readBE32(blocks[5] + i * 4), (int)readBE32(blocks[4] + i * 4),
+            (int)readBE32(blocks[3] + i * 4), (int)readBE32(blocks[2] + i * 4),
+            (int)readBE32(blocks[1] + i * 4), (int)readBE32(blocks[0] + i * 4));
+      }
+
+      __m256i s[8];
+      for (unsigned i = 0; i < 8; i++)
+         s[i] = _mm256_loadu_si256((const __m256i*)(state + i * 8));
+
+      auto a = s[0], b = s[1], c = s[2], d = s[3];
+      auto e = s[4], f = s[5], g = s[6], h = s[7];
+
+      for (unsigned i = 0; i < 64; i++)
+      {
+         __m256i wi;
+         if (i < 16)
+         {
+            wi = w[i];
+         }
+         else
+         {
+            auto& w15 = w[(i - 15) & 15];
+            auto& w2 = w[(i - 2) & 15];
+            auto s0 = _mm256_xor_si256(_mm256_xor_si256(
+               rotr8(w15, 7), rotr8(w15, 18)), _mm256_srli_epi32(w15, 3));
+            auto s1 = _mm256_xor_si256(_mm256_xor_si256(
+               rotr8(w2, 17), rotr8(w2, 19)), _mm256_srli_epi32(w2, 10));
+
+            wi = _mm256_add_epi32(
+               _mm256_add_epi32(w[i & 15], s0),
+               _mm256_add_epi32(w[(i - 7) & 15], s1));
+            w[i & 15] = wi;
+         }
+
+         auto S1 = _mm256_xor_si256(_mm256_xor_si256(
+            rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+         auto ch = _mm256_xor_si256(
+            _mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+         auto t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1),
+            _mm256_add_epi32(ch, _mm256_add_epi32(
+               _mm256_set1_epi32((int)sha256_K[i]), wi)));
+
+         auto S0 = _mm256_xor_si256(_mm256_xor_si256(
+            rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+         auto maj = _mm256_or_si256(_mm256_and_si256(a, b),
+            _mm256_and_si256(c, _mm256_or_si256(a, b)));
+         auto t2 = _mm256_add_epi32(S0, maj);
+
+         h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+         d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+      }
+
+      s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+      s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+      s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+      s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+
+      for (unsigned i = 0; i < 8; i++)
+         _mm256_storeu_si256((__m256i*)(state + i * 8), s[i]);
+   }
+
+   /////////////////////////////////////////////////////////////////////////////
+   //single sha256 over count messages, 8 at a time
+   void sha256AVX2(const BinaryDataRef* msgs, size_t count, uint8_t* digests)
+   {
+      static const uint8_t dummyBlock[64] = { 0 };
+
+      uint32_t state[64];
+      PaddedMessage lanes[8];
+      size_t laneMsgId[8];
+      size_t laneBlock[8];
+      bool active[8];
+      unsigned activeCount = 0;
+      size_t nextMsg = 0;
+
+      auto loadLane = [&](unsigned lane)->void
+      {
+         if (nextMsg >= count)
+         {
+            active[lane] = false;
+            return;
+         }
+
+         auto& msg = msgs[nextMsg];
+         lanes[lane].set(msg.getPtr(), msg.getSize());
+         laneMsgId[lane] = nextMsg++;
+         laneBlock[lane] = 0;
+         for (unsigned i = 0; i < 8; i++)
+            state[i * 8 + lane] = sha256_IV[i];
+
+         active[lane] = true;
+         ++activeCount;
+      };
+
+      for (unsigned lane = 0; lane < 8; lane++)
+         loadLane(lane);
+
+      const uint8_t* blocks[8];
+      while (activeCount > 0)
+      {
+         for (unsigned lane = 0; lane < 8; lane++)
+         {
+            if (active[lane])
+               blocks[lane] = lanes[lane].block(laneBlock[lane]);
+            else
+               blocks[lane] = dummyBlock;
+         }
+
+         transformAVX2(state, blocks);
+
+         //finished lanes pick up the next message right away
+         for (unsigned lane = 0; lane < 8; lane++)
+         {
+            if (!active[lane])
+               continue;
+
+            if (++laneBlock[lane] < lanes[lane].totalBlocks_)
+               continue;
+
+            auto digest = digests + laneMsgId[lane] * 32;
+            for (unsigned i = 0; i < 8; i++)
+               writeBE32(digest + i * 4, state[i * 8 + lane]);
+
+            --activeCount;
+            loadLane(lane);
+         }
+      }
+   }
+
+   void hash256AVX2(const BinaryDataRef* msgs, size_t count, uint8_t* digests)
+   {
+      sha256AVX2(msgs, count, digests);
+
+      //second pass is hashing 32 byte digests, all of them a single block
+      vector<BinaryDataRef> firstPass;
+      firstPass.reserve(count);
+      vector<uint8_t> firstPassData(digests, digests + count * 32);
+      for (size_t i = 0; i < count; i++)
+         firstPass.emplace_back(firstPassData.data() + i * 32, 32);
+
+      sha256AVX2(firstPass.data(), count, digests);
+   }
+
+   /////////////////////////////////////////////////////////////////////////////
+   //// cpu detection
+   /////////////////////////////////////////////////////////////////////////////
+   void cpuid(uint32_t leaf, uint32_t subleaf,
+      uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+   {
+#ifdef _MSC_VER
+      int regs[4];
+      __cpuidex(regs, (int)leaf, (int)subleaf);
+      a = regs[0]; b = regs[1]; c = regs[2]; d = regs[3];
+#else
+      __cpuid_count(leaf, subleaf, a, b, c, d);
+#endif
+   }
+
+   uint64_t xgetbv0(void)
+   {
+#ifdef _MSC_VER
+      return _xgetbv(0);
+#else
+      uint32_t a, d;
+      __asm__ volatile("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+      return ((uint64_t)d << 32) | a;
+#endif
+   }
+
+   void detectCpu(bool& hasSHANI, bool& hasAVX2)
+   {
+      hasSHANI = false;
+      hasAVX2 = false;
+
+      uint32_t a, b, c, d;
+      cpuid(0, 0, a, b, c, d);
+      auto maxLeaf = a;
+      if (maxLeaf < 7)
+         return;
+
+      cpuid(1, 0, a, b, c, d);
+      bool hasSSSE3 = (c >> 9) & 1;
+      bool hasSSE41 = (c >> 19) & 1;
+      bool hasOSXSAVE = (c >> 27) & 1;
+      bool hasAVX = (c >> 28) & 1;
+
+      //the os has to save the ymm registers for avx2 to be usable
+      bool ymmEnabled = false;
+      if (hasOSXSAVE && hasAVX)
+         ymmEnabled = (xgetbv0() & 6) == 6;
+
+      cpuid(7, 0, a, b, c, d);
+      hasAVX2 = ymmEnabled && ((b >> 5) & 1);
+      hasSHANI = hasSSSE3 && hasSSE41 && ((b >> 29) & 1);
+   }
+#endif
+
+   /////////////////////////////////////////////////////////////////////////////
+   //// engine state
+   /////////////////////////////////////////////////////////////////////////////
+   struct EngineSupport
+   {
+      bool shani_ = false;
+      bool avx2_ = false;
+      Hash256BatchEngine best_ = Hash256Engine_Scalar;
+
+      EngineSupport(void)
+      {
+#ifdef HASH256_X86
+         detectCpu(shani_, avx2_);
+#endif
+         //sha_ni beats 8 avx2 lanes on the cpus that have both
+         if (shani_)
+            best_ = Hash256Engine_SHANI;
+         else if (avx2_)
+            best_ = Hash256Engine_AVX2;
+      }
+   };
+
+   const EngineSupport& engineSupport(void)
+   {
+      static EngineSupport support;
+      return support;
+   }
+
+   atomic<int>& engineOverride(void)
+   {
+      static atomic<int> val(-1);
+      return val;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// Hash256Batch
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+Hash256BatchEngine Hash256Batch::engine()
+{
+   auto val = engineOverride().load(memory_order_relaxed);
+   if (val != -1)
+      return (Hash256BatchEngine)val;
+
+   return engineSupport().best_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool Hash256Batch::isSupported(Hash256BatchEngine engine)
+{
+   switch (engine)
+   {
+   case Hash256Engine_Scalar:
+      return true;
+
+   case Hash256Engine_SHANI:
+      return engineSupport().shani_;
+
+   case Hash256Engine_AVX2:
+      return engineSupport().avx2_;
+
+   default:
+      return false;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+string Hash256Batch::engineName(Hash256BatchEngine engine)
+{
+   switch (engine)
+   {
+   case Hash256Engine_Scalar:
+      return "scalar";
+
+   case Hash256Engine_SHANI:
+      return "sha_ni";
+
+   case Hash256Engine_AVX2:
+      return "avx2";
+
+   default:
+      return "unknown";
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void Hash256Batch::setEngine(Hash256BatchEngine engine)
+{
+   if (!isSupported(engine))
+      throw Hash256BatchException("unsupported hash engine");
+
+   engineOverride().store((int)engine, memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void Hash256Batch::resetEngine()
+{
+   engineOverride().store(-1, memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void Hash256Batch::getHash256(
+   const BinaryDataRef* msgs, size_t count, uint8_t* digests)
+{
+   if (count == 0)
+      return;
+
+   TransformFunc transform = transformScalar;
+   switch (engine())
+   {
+#ifdef HASH256_X86
+   case Hash256Engine_SHANI:
+      transform = transformSHANI;
+      break;
+
+   case Hash256Engine_AVX2:
+   {
+      //not worth spinning the lanes for a handful of messages
+      if (count >= HASH256_MIN_AVX2_BATCH)
+      {
+         hash256AVX2(msgs, count, digests);
+         return;
+      }
+
+      break;
+   }
+#endif
+
+   default:
+      break;
+   }
+
+   for (size_t i = 0; i < count; i++)
+   {
+      hash256Single(transform,
+         msgs[i].getPtr(), msgs[i].getSize(), digests + i * 32);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<BinaryData> Hash256Batch::getHash256(const vector<BinaryDataRef>& msgs)
+{
+   vector<BinaryData> result;
+   if (msgs.size() == 0)
+      return result;
+
+   BinaryData digests(msgs.size() * 32);
+   getHash256(msgs.data(), msgs.size(), digests.getPtr());
+
+   result.reserve(msgs.size());
+   for (size_t i = 0; i < msgs.size(); i++)
+      result.emplace_back(digests.getPtr() + i * 32, 32);
+
+   return result;
+}
@@ -0,0 +1,65 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _HASH256BATCH_H
+#define _HASH256BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "BinaryData.h"
+
+////////////////////////////////////////////////////////////////////////////////
+enum Hash256BatchEngine
+{
+   Hash256Engine_Scalar,
+   Hash256Engine_SHANI,
+   Hash256Engine_AVX2
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct Hash256BatchException : public std::runtime_error
+{
+   Hash256BatchException(const std::string& err) : std::runtime_error(err)
+   {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class Hash256Batch
+{
+   /***
+   Computes N independent sha256(sha256(msg)) digests per call.
+
+   The engine is picked at runtime from what the cpu supports:
+      - SHA_NI: hardware sha256 rounds, one message at a time
+      - AVX2: 8 messages hashed in lockstep, a lane picks up the next
+        message as soon as it is done with its current one
+      - Scalar: portable fallback
+
+   All engines yield the same digests as CryptoSHA2::getHash256.
+   ***/
+
+public:
+   //writes count * 32 bytes to digests
+   static void getHash256(
+      const BinaryDataRef* msgs, size_t count, uint8_t* digests);
+   static std::vector<BinaryData> getHash256(
+      const std::vector<BinaryDataRef>& msgs);
+
+   static Hash256BatchEngine engine(void);
+   static bool isSupported(Hash256BatchEngine);
+   static std::string engineName(Hash256BatchEngine);
+
+   //override the detected engine, for tests and benchmarks
+   static void setEngine(Hash256BatchEngine);
+   static void resetEngine(void);
+};
+
+#endif
@@ -326,6 +326,9 @@ void ScrAddrFilter::registrationThread()
 
          LOGINFO << "Starting address registration process";
 
+         //side scans write history, hold snapshots back until done
+         DbWriteGate::Section writeSection(lmdb_->writeGate());
+
          //BDM is initialized and maintenance thread is running, scan batch
          uint32_t topBlockHeight = blockchain()->top()->getBlockHeight();
          
@@ -339,12 +342,16 @@ void ScrAddrFilter::registrationThread()
             continue;
          }
 
-         //scan the batch
+         //scan the batch, starting from the lowest height any of the new
+         //addresses has unscanned history at
+         TIMER_RESTART("addressRegistration");
+         auto sideScanFrom = getSideScanFrom(addrSet, batchPtr->scanFrom_);
+
          vector<string> walletIDs;
          walletIDs.push_back(batchPtr->walletID_);
          auto saf = getNew(SIDESCAN_ID);
          saf->updateAddrMap(addrSet, 0, false);
-         saf->applyBlockRangeToDB(0, walletIDs, true);
+         saf->applyBlockRangeToDB(sideScanFrom, walletIDs, true);
 
          //merge with main address filter
          set<BinaryDataRef> newAddrSet;
@@ -361,8 +368,14 @@ void ScrAddrFilter::registrationThread()
          saf->cleanUpSdbis();
 
          //notify
+         TIMER_STOP("addressRegistration");
+         auto timeSpent = TIMER_READ_SEC("addressRegistration");
          for (const auto& wID : walletIDs)
-            LOGINFO << "Completed scan of wallet " << wID;
+         {
+            LOGINFO << "Completed scan of wallet " << wID << ": " <<
+               addrSet.size() << " addresses, blocks #" << sideScanFrom <<
+               " to #" << topBlockHeight << " in " << timeSpent << "s";
+         }
 
          auto&& scaSet = updateAddrMap(batchPtr->scrAddrSet_, 0, false);
          batchPtr->callback_(scaSet);
@@ -389,6 +402,40 @@ void ScrAddrFilter::registrationThread()
    }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+unsigned ScrAddrFilter::getSideScanFrom(
+   const set<BinaryDataRef>& addrSet, unsigned floor) const
+{
+   /***
+   Addresses that were registered before still have their history in the 
+   db up to the height they were last scanned at, only the blocks past that
+   need visited. Fresh addresses start at floor.
+   ***/
+
+   unsigned lowest = UINT32_MAX;
+   {
+      auto&& tx = lmdb_->beginTransaction(SSH, LMDB::ReadOnly);
+      for (auto& scrAddr : addrSet)
+      {
+         StoredScriptHistory ssh;
+         lmdb_->getStoredScriptHistorySummary(ssh, scrAddr);
+
+         //scanHeight_ is -1 for addresses without history
+         unsigned addrFrom = 0;
+         if (ssh.scanHeight_ >= 0)
+            addrFrom = (unsigned)ssh.scanHeight_ + 1;
+
+         if (addrFrom < lowest)
+            lowest = addrFrom;
+      }
+   }
+
+   if (lowest == UINT32_MAX || lowest < floor)
+      lowest = floor;
+
+   return lowest;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 int32_t ScrAddrFilter::scanFrom() const
 {
@@ -505,12 +552,14 @@ bool ScrAddrFilter::hasNewAddresses(void) const
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-shared_ptr<unordered_map<TxOutScriptRef, int>> ScrAddrFilter::getOutScrRefMap()
+shared_ptr<OutScrRefMap> ScrAddrFilter::getOutScrRefMap()
 {
+   //built from the current address set, scanners grab a new one per scan
+   //so this follows registered batches
    getScrAddrCurrentSyncState();
-   auto outset = make_shared<unordered_map<TxOutScriptRef, int>>();
 
    auto scrAddrMap = scanFilterAddrMap_->get();
+   auto outset = make_shared<OutScrRefMap>(scrAddrMap->size());
 
    for (auto& scrAddr : *scrAddrMap)
    {
@@ -519,7 +568,10 @@ shared_ptr<unordered_map<TxOutScriptRef, int>> ScrAddrFilter::getOutScrRefMap()
 
       TxOutScriptRef scrRef;
       scrRef.setRef(scrAddr.first);
-      outset->emplace(move(scrRef), scrAddr.second->scannedHeight_);
+
+      auto&& key = scrRef.getKey();
+      outset->filter_.insert(key);
+      outset->map_.emplace(key, scrAddr.second->scannedHeight_);
    }
 
    return outset;
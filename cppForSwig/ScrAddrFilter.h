@@ -25,6 +25,8 @@
 #include "BtcUtils.h"
 #include "StoredBlockObj.h"
 #include "lmdb_wrapper.h"
+#include "TxOutScrRef.h"
+#include "BloomFilter.h"
 #include "Blockchain.h"
 
 #define SIDESCAN_ID 0x100000ff
@@ -64,6 +66,9 @@ struct RegistrationBatch : public AddressBatch
    bool isNew_;
    std::string walletID_;
 
+   //history below this height is not scanned for the batch's addresses
+   unsigned scanFrom_ = 0;
+
    RegistrationBatch(void) : 
       AddressBatch(AddressBatch_register)
    {}
@@ -114,7 +119,20 @@ public:
    }
 };
 
-struct TxOutScriptRef;
+////////////////////////////////////////////////////////////////////////////////
+struct OutScrRefMap
+{
+   //script key to the height the script was scanned up to
+   FlatHashMap<TxOutScriptKey, int> map_;
+
+   //prefilter for map_, the bulk of txouts do not match any script
+   BlockedBloomFilter<TxOutScriptKey> filter_;
+
+   OutScrRefMap(size_t count) : filter_(count)
+   {
+      map_.reserve(count);
+   }
+};
 
 ////////////////////////////////////////////////////////////////////////////////
 class ScrAddrFilter
@@ -186,6 +204,7 @@ private:
    std::set<BinaryDataRef> updateAddrMap(
       const std::set<BinaryDataRef>&, unsigned, bool );
    void setSSHLastScanned(std::set<BinaryDataRef>&, unsigned);
+   unsigned getSideScanFrom(const std::set<BinaryDataRef>&, unsigned) const;
 
 protected:
    std::function<void(
@@ -205,6 +224,7 @@ public:
    virtual ~ScrAddrFilter() { shutdown(); }
 
    LMDBBlockDatabase* db() { return lmdb_; }
+   unsigned sdbiKey(void) const { return sdbiKey_; }
 
    ////
    std::shared_ptr<const std::map<BinaryDataRef, std::shared_ptr<AddrAndHash>>>
@@ -219,7 +239,7 @@ public:
    }
 
    ////
-   std::shared_ptr<std::unordered_map<TxOutScriptRef, int>> getOutScrRefMap(void);
+   std::shared_ptr<OutScrRefMap> getOutScrRefMap(void);
    int32_t scanFrom(void) const;
    void pushAddressBatch(std::shared_ptr<AddressBatch>);
 
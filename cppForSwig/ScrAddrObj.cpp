@@ -62,10 +62,18 @@ uint64_t ScrAddrObj::getUnconfirmedBalance(
 ////////////////////////////////////////////////////////////////////////////////
 uint64_t ScrAddrObj::getFullBalance(unsigned updateID) const
 {
-   //grab mined balance
+   updateSummary(updateID);
+   return internalBalance_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+pair<uint64_t, uint32_t> ScrAddrObj::updateSummary(unsigned updateID) const
+{
+   //grab mined balance and txio count
    StoredScriptHistory ssh;
    db_->getStoredScriptHistorySummary(ssh, scrAddr_);
    uint64_t balance = ssh.getScriptBalance(false);
+   uint32_t count = (uint32_t)ssh.totalTxioCount_;
 
    //grab zc balances
    auto&& zcTxios = getHistoryForScrAddr(UINT32_MAX, UINT32_MAX, 0, false);
@@ -75,8 +83,11 @@ uint64_t ScrAddrObj::getFullBalance(unsigned updateID) const
          balance += txio.second.getValue();
       if (txio.second.hasTxInZC())
          balance -= txio.second.getValue();
+      if (txio.second.hasTxOutZC() || txio.second.hasTxInZC())
+         ++count;
    }
 
+   internalTxioCount_ = count;
    if (balance != internalBalance_)
    {
       internalBalance_ = balance;
@@ -84,7 +95,7 @@ uint64_t ScrAddrObj::getFullBalance(unsigned updateID) const
          updateID_ = updateID;
    }
 
-   return balance;
+   return make_pair(balance, count);
 }
    
 ////////////////////////////////////////////////////////////////////////////////
@@ -268,10 +279,13 @@ map<BinaryData, TxIOPair> ScrAddrObj::getHistoryForScrAddr(
 {
    map<BinaryData, TxIOPair> outMap;
 
-   //grab txio range from ssh
+   if (scrAddr_[0] == SCRIPT_PREFIX_MULTISIG)
+      withMultisig = true;
+
+   //grab txio range from ssh, the db keeps the latest state of each txio
    StoredScriptHistory ssh;
-   auto start = startBlock;
-   db_->getStoredScriptHistory(ssh, scrAddr_, start, endBlock);
+   db_->getHistoryTxios(
+      ssh, scrAddr_, outMap, startBlock, endBlock, withMultisig);
 
    //update scrAddrObj containers
    totalTxioCount_ = ssh.totalTxioCount_;
@@ -281,34 +295,8 @@ map<BinaryData, TxIOPair> ScrAddrObj::getHistoryForScrAddr(
    else if (lastSeenBlock_ == 0)
       lastSeenBlock_ = bc_->top()->getBlockHeight();
 
-   if (scrAddr_[0] == SCRIPT_PREFIX_MULTISIG)
-      withMultisig = true;
-
-   if (ssh.isInitialized())
-   {
-      //Serve content as a map. Do not overwrite existing TxIOs to avoid wiping ZC
-      //data, Since the data isn't overwritten, iterate the map from its end to make
-      //sure newer txio aren't ignored due to older ones being inserted first.
-      auto subSSHiter = ssh.subHistMap_.rbegin();
-      while (subSSHiter != ssh.subHistMap_.rend())
-      {
-         StoredSubHistory & subssh = subSSHiter->second;
-
-         for (auto &txiop : subssh.txioMap_)
-         {
-            if (withMultisig || !txiop.second.isMultisig())
-            {
-               auto& txio = outMap[txiop.first];
-               if (!txio.hasValue())
-                  txio = txiop.second;
-
-               txio.setScrAddrRef(getScrAddr());
-            }
-         }
-
-         ++subSSHiter;
-      }
-   }
+   for (auto& txioPair : outMap)
+      txioPair.second.setScrAddrRef(getScrAddr());
 
    if (endBlock == UINT32_MAX)
    {
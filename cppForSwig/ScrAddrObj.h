@@ -111,33 +111,28 @@ private:
          uint32_t nutxo = 0;
          uint64_t val = 0;
 
+         //isMultisig only signifies this scrAddr was used in the
+         //composition of a funded multisig transaction. This is purely
+         //meta-data and shouldn't be returned as a spendable txout
          StoredScriptHistory ssh;
-         scrAddrObj_->db_->getStoredScriptHistory(ssh, 
-            scrAddrObj_->scrAddr_, start, end);
+         std::map<BinaryData, TxIOPair> txioMap;
+         scrAddrObj_->db_->getHistoryTxios(ssh, 
+            scrAddrObj_->scrAddr_, txioMap, start, end, false);
 
-         for (const auto& subsshPair : ssh.subHistMap_)
+         for (const auto& txioPair : txioMap)
          {
-            for (const auto& txioPair : subsshPair.second.txioMap_)
+            if (!txioPair.second.isUTXO())
+               continue;
+
+            if (spentByZC(txioPair.second.getDBKeyOfOutput()) == true)
+               continue;
+
+            auto txioAdded = utxoList_.insert(txioPair);
+
+            if (txioAdded.second == true)
             {
-               if (txioPair.second.isUTXO())
-               {
-                  //isMultisig only signifies this scrAddr was used in the
-                  //composition of a funded multisig transaction. This is purely
-                  //meta-data and shouldn't be returned as a spendable txout
-                  if (txioPair.second.isMultisig())
-                     continue;
-
-                  if (spentByZC(txioPair.second.getDBKeyOfOutput()) == true)
-                     continue;
-
-                  auto txioAdded = utxoList_.insert(txioPair);
-
-                  if (txioAdded.second == true)
-                  {
-                     val += txioPair.second.getValue();
-                     nutxo++;
-                  }
-               }
+               val += txioPair.second.getValue();
+               nutxo++;
             }
          }
 
@@ -229,6 +224,11 @@ public:
    uint64_t getTxioCount(void) const { return getTxioCountFromSSH(true); }
    uint32_t getTxioCountFromSSH(bool withZc) const;
 
+   //refreshes the cached full balance and txio count, one ssh read.
+   //Returns the values it computed, the cache is shared with other callers
+   std::pair<uint64_t, uint32_t> updateSummary(
+      unsigned updateID = UINT32_MAX) const;
+
    void mapHistory(void);
 
    const std::map<uint32_t, uint32_t>& getHistSSHsummary(void) const
@@ -305,7 +305,10 @@ private:
    std::map<BinaryData, TxIOPair> zcTxios_;
 
    mutable int32_t updateID_ = 0;
+
+   //full balance and txio count with zc, as of the last updateSummary
    mutable uint64_t internalBalance_ = 0;
+   mutable uint32_t internalTxioCount_ = 0;
 };
 
 #endif
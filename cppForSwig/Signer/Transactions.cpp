@@ -267,10 +267,10 @@ BinaryData Armory::Signer::TransactionVerifier::getSubScript(unsigned index) con
 ////////////////////////////////////////////////////////////////////////////////
 BinaryDataRef Armory::Signer::TransactionVerifier::getWitnessData(unsigned inputId) const
 {
-   if (inputId >= theTx_.witnesses_.size())
+   if (inputId >= witnesses_.size())
       throw runtime_error("invalid witness data id");
 
-   auto& witOffsetAndSize = theTx_.witnesses_[inputId];
+   auto& witOffsetAndSize = witnesses_[inputId];
    return BinaryDataRef(theTx_.data_ + witOffsetAndSize.first, 
       witOffsetAndSize.second);
 }
@@ -151,6 +151,7 @@ namespace Armory
       private:
          utxoMap utxos_;
          const BCTX theTx_;
+         const std::vector<OffsetAndSize> witnesses_;
 
          uint64_t checkOutputs(void) const;
          void checkSigs(void) const;
@@ -165,7 +166,8 @@ namespace Armory
 
       public:
          TransactionVerifier(const BCTX& theTx, const utxoMap& utxos) :
-            utxos_(utxos), theTx_(theTx)
+            utxos_(utxos), theTx_(theTx),
+            witnesses_(theTx.getWitnessOffsets())
          {
             if (theTx.usesWitness_)
                setFlags(SCRIPT_VERIFY_SEGWIT);
@@ -173,7 +175,7 @@ namespace Armory
 
          TransactionVerifier(
             const BCTX& theTx, const std::vector<UnspentTxOut>& utxoVec) :
-            theTx_(theTx)
+            theTx_(theTx), witnesses_(theTx.getWitnessOffsets())
          {
             for (auto& utxo : utxoVec)
             {
@@ -191,7 +193,7 @@ namespace Armory
 
          TransactionVerifier(
             const BCTX& theTx, const std::vector<UTXO>& utxoVec) :
-            theTx_(theTx)
+            theTx_(theTx), witnesses_(theTx.getWitnessOffsets())
          {
             for (auto& utxo : utxoVec)
             {
@@ -9,6 +9,7 @@
 #include "SshParser.h"
 
 using namespace std;
+using namespace Armory::Threading;
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -132,6 +133,7 @@ subSshParserResult parseSubSsh(
                {
                   //both output and input are part of the same block, skip
                   ++extraTxioCount;
+                  sshPtr->addReceived(txioPair.second.getValue());
                   continue;
                }
 
@@ -147,12 +149,15 @@ subSshParserResult parseSubSsh(
             else
             {
                sshPtr->totalUnspent_ += txioPair.second.getValue();
+               sshPtr->addReceived(txioPair.second.getValue());
             }
          }
       }
 
       //txio count
       sshPtr->totalTxioCount_ += subssh.txioCount_ + extraTxioCount;
+      if (subssh.height_ > sshPtr->lastTouchedHeight_)
+         sshPtr->lastTouchedHeight_ = subssh.height_;
 
       //build subssh summary
       sshPtr->subsshSummary_[subssh.height_] = subssh.txioCount_;
@@ -180,29 +185,25 @@ void ShardedSshParser::updateSsh()
 
    //initialize bounds vector
    firstShard_ = db_->getShardIdForHeight(firstHeight_);
+   if (checkpoint_ != nullptr)
+      topId_ = checkpoint_->topId_;
+   else
+      topId_ = (unsigned)db_->getStoredDBInfo(SUBSSH, 0).metaInt_;
    setupBounds();
 
 
-   //parser lambda
-   auto ssh_lambda = [this](void)->void
+   //queue parser tasks, this thread writes the results
+   TaskGroup tasks(taskPool_.get());
+   for (unsigned i = 0; i < taskPool_->threadCount(); i++)
    {
-      parseSshThread();
-   };
-
-   vector<thread> threads;
-   unsigned count = threadCount_;
-   if (threadCount_ > 1)
-      --count;
-   for (unsigned i = 0; i < count; i++)
-      threads.push_back(thread(ssh_lambda));
+      tasks.run([this](void)->void
+      {
+         parseSshThread();
+      });
+   }
 
    putSSH();
-
-   for (auto& thr : threads)
-   {
-      if (thr.joinable())
-         thr.join();
-   }
+   tasks.wait();
 
    chrono::duration<double> length = chrono::system_clock::now() - now;
    LOGINFO << "Updated SSH in " << length.count() << "s";
@@ -216,25 +217,22 @@ void ShardedSshParser::undo()
 
    //initialize
    firstShard_ = db_->getShardIdForHeight(firstHeight_);
+   topId_ = (unsigned)db_->getStoredDBInfo(SUBSSH, 0).metaInt_;
    undo_ = true;
    setupBounds();
 
-   //parser lambda
-   auto ssh_lambda = [this](void)->void
+   //queue parser tasks
+   TaskGroup tasks(taskPool_.get());
+   for (unsigned i = 0; i < taskPool_->threadCount(); i++)
    {
-      parseSshThread();
-   };
+      tasks.run([this](void)->void
+      {
+         parseSshThread();
+      });
+   }
 
-   vector<thread> threads;
-   for (unsigned i = 1; i < threadCount_; i++)
-      threads.push_back(thread(ssh_lambda));
    putSSH();
-
-   for (auto& thr : threads)
-   {
-      if (thr.joinable())
-         thr.join();
-   }
+   tasks.wait();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -243,29 +241,80 @@ void ShardedSshParser::putSSH()
    auto len = boundsVector_.size();
    auto increment = len / 100;
 
+   if (!init_)
+      touchedScrAddrs_ = make_shared<set<BinaryData>>();
+
+   //checkpoints land after the ssh they cover
+   shared_future<void> lastCommit;
+   BinaryData lastKey;
+   auto pushCheckpoint = [this, &lastCommit, &lastKey](void)->void
+   {
+      if (checkpoint_ == nullptr || lastKey.getSize() == 0)
+         return;
+
+      checkpoint_->lastKey_ = lastKey;
+      vector<shared_future<void>> after;
+      if (lastCommit.valid())
+         after.push_back(lastCommit);
+      db_->pushBuildCheckpoint(*checkpoint_, move(after));
+   };
+
    for (unsigned i = 0; i < len; i++)
    {
+      //at least one bound per run, like the scan batches
+      if (checkpoint_ != nullptr && i > 0 &&
+         chrono::steady_clock::now() >= deadline_)
+      {
+         LOGINFO << "build budget spent, pausing ssh update";
+         paused_ = true;
+
+         {
+            unique_lock<mutex> lock(cvMutex_);
+            stop_.store(true, memory_order_relaxed);
+         }
+         writeThreadCV_.notify_all();
+         break;
+      }
+
       auto batch = boundsVector_[i].get();
       batch->fut_.wait();
 
       if (batch->serializedSsh_.size() > 0)
       {
-         auto tx = db_->beginTransaction(SSH, LMDB::ReadWrite);
-         for (auto& ssh_pair : batch->serializedSsh_)
+         auto sshPtr = make_shared<map<BinaryData, BinaryWriter>>(
+            move(batch->serializedSsh_));
+
+         auto sshBatch = make_unique<DBWriteBatch>(SSH);
+         for (auto& ssh_pair : *sshPtr)
          {
+            if (touchedScrAddrs_ != nullptr)
+            {
+               touchedScrAddrs_->insert(ssh_pair.first.getSliceCopy(
+                  1, ssh_pair.first.getSize() - 1));
+            }
+
             if (ssh_pair.second.getSize() > 0)
             {
-               db_->putValue(SSH,
+               sshBatch->puts_.emplace_back(
                   ssh_pair.first.getRef(),
                   ssh_pair.second.getDataRef());
             }
             else
             {
-               db_->deleteValue(SSH, ssh_pair.first.getRef());
+               sshBatch->deletes_.push_back(ssh_pair.first.getRef());
             }
          }
+         sshBatch->owner_ = sshPtr;
+
+         //commits on the SSH writers (one per shard) while the parser 
+         //threads move on to the next bounds
+         lastCommit = db_->commitStage().push(move(sshBatch));
       }
 
+      lastKey = batch->bounds_.second;
+      if ((i + 1) % SSH_CHECKPOINT_BOUNDS == 0)
+         pushCheckpoint();
+
       commitedBoundsCounter_.fetch_add(1, memory_order_relaxed);
       writeThreadCV_.notify_all();
 
@@ -278,6 +327,20 @@ void ShardedSshParser::putSSH()
          LOGINFO << "ssh scan progress: " << progress * 100.0f << "%";
       }
    }
+
+   if (paused_)
+      pushCheckpoint();
+
+   db_->commitStage().flush(SSH);
+   db_->commitStage().flush(SUBSSH_META);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ShardedSshParser::setCheckpoint(const StoredBuildCheckpoint& checkpoint,
+   chrono::steady_clock::time_point deadline)
+{
+   checkpoint_ = make_unique<StoredBuildCheckpoint>(checkpoint);
+   deadline_ = deadline;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -365,18 +428,34 @@ void ShardedSshParser::setupBounds()
       addBounds(startKey, bw_last.getData());
    }
 
+   //skip the bounds an interrupted run committed
+   if (checkpoint_ != nullptr && checkpoint_->lastKey_.getSize() > 0)
+   {
+      auto& lastKey = checkpoint_->lastKey_;
+      auto iter = boundsVector_.begin();
+      while (iter != boundsVector_.end() && 
+         !(lastKey < (*iter)->bounds_.second))
+         ++iter;
+
+      auto skipped = (unsigned)distance(boundsVector_.begin(), iter);
+      boundsVector_.erase(boundsVector_.begin(), iter);
+      LOGINFO << "skipping " << skipped <<
+         " ssh bounds committed before the checkpoint";
+
+      //the same subssh range maps to the same bounds, this is not expected
+      if (!boundsVector_.empty() &&
+         !(lastKey < boundsVector_.front()->bounds_.first))
+      {
+         LOGWARN << "ssh bounds straddle the checkpoint";
+      }
+   }
+
    LOGINFO << "scanning " << boundsVector_.size() << " ssh bounds";
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 SshMapping ShardedSshParser::mapSubSshDB()
 {
-   //lambda
-   auto processLbd = [this](unsigned index)->void
-   {
-      mapSubSshDBThread(index);
-   };
-
    LOGINFO << "mapping subssh db";
    SshMapping sshMapping;
 
@@ -384,20 +463,19 @@ SshMapping ShardedSshParser::mapSubSshDB()
 
    //initialize
    mapCount_.store(firstShard_, memory_order_relaxed);
-   mappingResults_.resize(threadCount_);
-   vector<thread> threads;
+   auto taskCount = taskPool_->threadCount();
+   mappingResults_.resize(taskCount);
 
-   //start processing threads
-   for (unsigned i = 1; i < threadCount_; i++)
-      threads.push_back(thread(processLbd, i));
-   processLbd(0);
-
-   //wait on completion
-   for (auto& thr : threads)
+   //queue mapping tasks, one per result slot
+   TaskGroup tasks(taskPool_.get());
+   for (unsigned i = 0; i < taskCount; i++)
    {
-      if (thr.joinable())
-         thr.join();
+      tasks.run([this, i](void)->void
+      {
+         mapSubSshDBThread(i);
+      });
    }
+   tasks.wait();
 
    //merge results
    for (auto& mapping : mappingResults_)
@@ -412,11 +490,9 @@ void ShardedSshParser::mapSubSshDBThread(unsigned index)
 
    auto& sshMapping = mappingResults_[index];
 
-   auto&& subssh_sdbi = db_->getStoredDBInfo(SUBSSH, 0);
-   auto top_id = subssh_sdbi.metaInt_;
    auto current_id = mapCount_.fetch_add(1, memory_order_relaxed);
 
-   while (current_id <= top_id)
+   while (current_id <= topId_)
    {
       auto dbIter = db_->getIterator(SUBSSH);
 
@@ -485,9 +561,15 @@ SshBounds* ShardedSshParser::getNext()
           threadCount_ * 2)
    {
       unique_lock<mutex> lock(cvMutex_);
+      if (stop_.load(memory_order_relaxed))
+         break;
       writeThreadCV_.wait(lock);
    }
 
+   //the writer stopped at a checkpoint
+   if (stop_.load(memory_order_relaxed))
+      return nullptr;
+
    //increment counter, grab bound ptr from vector
    auto id = fetchBoundsCounter_.fetch_add(1, memory_order_relaxed);
    if (id >= boundsVector_.size())
@@ -501,8 +583,7 @@ SshBounds* ShardedSshParser::getNext()
 void ShardedSshParser::parseSshThread()
 {
    //get top batch id
-   auto&& subssh_sdbi = db_->getStoredDBInfo(SUBSSH, 0);
-   auto id_max = subssh_sdbi.metaInt_;
+   auto id_max = topId_;
 
    //seek lambda
    auto seekToBoundsStart = [](LDBIter* iterPtr,
@@ -574,6 +655,9 @@ void ShardedSshParser::parseSshThread()
       return brr.get_uint32_t();
    };
 
+   auto subsshFormat = db_->getSubsshFormat();
+   SubsshColumns columns;
+
    auto tx = db_->beginTransaction(SUBSSH, LMDB::ReadOnly);
    while (true)
    {
@@ -632,84 +716,137 @@ void ShardedSshParser::parseSshThread()
             ++bounds->count_;
             size_t totalTxioCount = 0;
 
-            //read through values
-            auto&& brr_data = dbIter->getValueReader();
-            auto subsshcount = brr_data.get_var_int();
-
-            for (unsigned z = 0; z < subsshcount; z++)
+            auto tallySubssh = [&](uint64_t subsshHeight, uint8_t subssh_dupid,
+               uint64_t txio_count, uint64_t totalValue, 
+               uint64_t receivedValue, unsigned extraTxCount)->void
             {
-               uint64_t totalValue = 0;
-               unsigned extraTxCount = 0;
-               auto subssh_height = brr_data.get_var_int();
-               auto subssh_dupid = brr_data.get_uint8_t();
+               if (subsshHeight < firstHeight_)
+                  return;
+               if(!checkDupId((unsigned)subsshHeight, subssh_dupid) && !undo_)
+                  return;
 
-               //grab txio count
-               auto txio_count = brr_data.get_var_int();
+               ssh.totalUnspent_ += totalValue;
+               ssh.totalReceived_ += receivedValue;
+               if (subsshHeight > ssh.lastTouchedHeight_)
+                  ssh.lastTouchedHeight_ = (uint32_t)subsshHeight;
+               totalTxioCount += txio_count + extraTxCount;
+            };
 
-               for (unsigned y = 0; y < txio_count; y++)
+            if (subsshFormat == SUBSSH_FORMAT_COLUMNS)
+            {
+               //only the values and spent flags are needed here
+               columns.decode(dbIter->getValueRef(), base_height, 0, false);
+               for (size_t z = 0; z < columns.size(); z++)
                {
-                  //get value
-                  auto value = brr_data.get_var_int();
-
-                  //get spent flag
-                  auto spent_flag = brr_data.get_uint8_t();
+                  uint64_t totalValue = 0;
+                  uint64_t receivedValue = 0;
+                  unsigned extraTxCount = 0;
+                  auto txioStart = columns.txioOffsets_[z];
+                  auto txioEnd = columns.txioOffsets_[z + 1];
 
-                  switch (spent_flag)
+                  for (auto y = txioStart; y < txioEnd; y++)
                   {
-                  case 0:
-                  {
-                     //unspent, add value to ssh
-                     totalValue += value;
-
-                     //skip 2 varints
-                     brr_data.get_var_int();
-                     brr_data.get_var_int();
-                     break;
+                     switch (columns.flags_[y])
+                     {
+                     case SUBSSH_TXIO_UNSPENT:
+                        totalValue += columns.values_[y];
+                        receivedValue += columns.values_[y];
+                        break;
+
+                     case SUBSSH_TXIO_SAME_BLOCK:
+                        receivedValue += columns.values_[y];
+                        ++extraTxCount;
+                        break;
+
+                     case SUBSSH_TXIO_SPENT:
+                        totalValue -= columns.values_[y];
+                        break;
+                     }
                   }
 
-                  case 1:
-                  {
-                     //funds and spends in same block, no effect 
-                     //on value, skip 4 varints
-                     brr_data.get_var_int();
-                     brr_data.get_var_int();
-                     brr_data.get_var_int();
-                     brr_data.get_var_int();
-
-                     //add an extra txio since this entry covers 2 tx
-                     ++extraTxCount;
-                     break;
-                  }
+                  tallySubssh(columns.heights_[z], columns.dupIds_[z],
+                     txioEnd - txioStart, totalValue, receivedValue,
+                     extraTxCount);
+               }
+            }
+            else
+            {
+               //read through values
+               auto&& brr_data = dbIter->getValueReader();
+               auto subsshcount = brr_data.get_var_int();
+
+               for (unsigned z = 0; z < subsshcount; z++)
+               {
+                  uint64_t totalValue = 0;
+                  uint64_t receivedValue = 0;
+                  unsigned extraTxCount = 0;
+                  auto subssh_height = brr_data.get_var_int();
+                  auto subssh_dupid = brr_data.get_uint8_t();
 
-                  case 0xFF:
+                  //grab txio count
+                  auto txio_count = brr_data.get_var_int();
+
+                  for (unsigned y = 0; y < txio_count; y++)
                   {
-                     //spent, substract value from ssh
-                     totalValue -= value;
-
-                     //skip 5 varints and 1 byte
-                     brr_data.get_var_int();
-                     brr_data.get_uint8_t();
-                     brr_data.get_var_int();
-                     brr_data.get_var_int();
-                     brr_data.get_var_int();
-                     brr_data.get_var_int();
-                     break;
+                     //get value
+                     auto value = brr_data.get_var_int();
+
+                     //get spent flag
+                     auto spent_flag = brr_data.get_uint8_t();
+
+                     switch (spent_flag)
+                     {
+                     case 0:
+                     {
+                        //unspent, add value to ssh
+                        totalValue += value;
+                        receivedValue += value;
+
+                        //skip 2 varints
+                        brr_data.get_var_int();
+                        brr_data.get_var_int();
+                        break;
+                     }
+
+                     case 1:
+                     {
+                        //funds and spends in same block, no effect 
+                        //on value, skip 4 varints
+                        brr_data.get_var_int();
+                        brr_data.get_var_int();
+                        brr_data.get_var_int();
+                        brr_data.get_var_int();
+
+                        //add an extra txio since this entry covers 2 tx
+                        ++extraTxCount;
+                        receivedValue += value;
+                        break;
+                     }
+
+                     case 0xFF:
+                     {
+                        //spent, substract value from ssh
+                        totalValue -= value;
+
+                        //skip 5 varints and 1 byte
+                        brr_data.get_var_int();
+                        brr_data.get_uint8_t();
+                        brr_data.get_var_int();
+                        brr_data.get_var_int();
+                        brr_data.get_var_int();
+                        brr_data.get_var_int();
+                        break;
+                     }
+
+                     default:
+                        LOGERR << "unexpected spent flag";
+                        throw runtime_error("unexpected spent flag");
+                     }
                   }
 
-                  default:
-                     LOGERR << "unexpected spent flag";
-                     throw runtime_error("unexpected spent flag");
-                  }
+                  tallySubssh(base_height + subssh_height, subssh_dupid,
+                     txio_count, totalValue, receivedValue, extraTxCount);
                }
-
-               auto subsshHeight = base_height + subssh_height;
-               if (subsshHeight < firstHeight_)
-                  continue;
-               if(!checkDupId((unsigned)subsshHeight, subssh_dupid) && !undo_)
-                  continue;
-
-               ssh.totalUnspent_ += totalValue;
-               totalTxioCount += txio_count + extraTxCount;
             }
 
             //tally count
@@ -756,6 +893,13 @@ void ShardedSshParser::parseSshThread()
             else
             {
                dbSsh.substractSummary(subIter->second);
+
+               //txios below the undone range aren't tallied here, fall back
+               //to the branch point
+               if (firstHeight_ > 0 && 
+                  dbSsh.lastTouchedHeight_ >= firstHeight_)
+                  dbSsh.lastTouchedHeight_ = firstHeight_ - 1;
+
                substractedMap.insert(make_pair(
                   dbSsh.uniqueKey_.getRef(), move(dbSsh)));
                sshMap.erase(subIter++);
@@ -15,11 +15,14 @@
 #include "lmdb_wrapper.h"
 #include "Blockchain.h"
 #include "ScrAddrFilter.h"
+#include "TaskPool.h"
 
 #ifndef UNIT_TESTS
 #define SSH_BOUNDS_BATCH_SIZE 100000
+#define SSH_CHECKPOINT_BOUNDS 64
 #else
 #define SSH_BOUNDS_BATCH_SIZE 2
+#define SSH_CHECKPOINT_BOUNDS 2
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -77,6 +80,8 @@ private:
    bool init_;
    bool undo_ = false;
 
+   std::shared_ptr<Armory::Threading::TaskPool> taskPool_;
+
    std::vector<std::unique_ptr<SshBounds>> boundsVector_;
 
    std::atomic<unsigned> commitedBoundsCounter_;
@@ -87,6 +92,19 @@ private:
    std::atomic<unsigned> mapCount_;
    std::vector<SshMapping> mappingResults_;
 
+   //scrAddrs of the ssh entries written, not tracked on init
+   std::shared_ptr<std::set<BinaryData>> touchedScrAddrs_;
+
+   //last subssh batch id tallied
+   unsigned topId_ = 0;
+
+   //build checkpoints, putSSH stops at the next one past the deadline
+   std::unique_ptr<StoredBuildCheckpoint> checkpoint_;
+   std::chrono::steady_clock::time_point deadline_ =
+      std::chrono::steady_clock::time_point::max();
+   std::atomic<bool> stop_;
+   bool paused_ = false;
+
 private:
    void putSSH(void);
    SshBounds* getNext();
@@ -101,16 +119,35 @@ public:
    ShardedSshParser(
       LMDBBlockDatabase* db,
       unsigned firstHeight, 
-      unsigned threadCount, bool init)
+      unsigned threadCount, bool init,
+      std::shared_ptr<Armory::Threading::TaskPool> taskPool = nullptr)
       : db_(db),
       firstHeight_(firstHeight),
-      threadCount_(threadCount), init_(init)
+      threadCount_(threadCount), init_(init),
+      taskPool_(taskPool)
    {
       counter_.store(0, std::memory_order_relaxed);
+      stop_.store(false, std::memory_order_relaxed);
+
+      //standalone use, run on a pool of our own
+      if (taskPool_ == nullptr)
+      {
+         taskPool_ = std::make_shared<Armory::Threading::TaskPool>(
+            threadCount_);
+      }
    }
 
    void updateSsh(void);
    void undo(void);
+
+   //checkpoints updateSsh as it commits bounds. A checkpoint with a last
+   //key resumes past it, over the checkpoint's subssh range
+   void setCheckpoint(const StoredBuildCheckpoint&,
+      std::chrono::steady_clock::time_point);
+   bool isPaused(void) const { return paused_; }
+
+   std::shared_ptr<std::set<BinaryData>> getTouchedScrAddrs(void) const
+   { return touchedScrAddrs_; }
 };
 
 typedef std::pair<std::set<BinaryData>, std::map<BinaryData, StoredScriptHistory>> subSshParserResult;
@@ -52,6 +52,7 @@ void StoredDBInfo::unserializeDBValue(BinaryRefReader & brr)
    }
 
    armoryType_ = (ARMORY_DB_TYPE)bitunpack.getBits(4);
+   subsshFormat_ = (uint8_t)bitunpack.getBits(4);
    
    topBlkHgt_    = brr.get_uint32_t();
    appliedToHgt_ = brr.get_uint32_t();
@@ -66,6 +67,7 @@ void StoredDBInfo::serializeDBValue(BinaryWriter & bw ) const
    BitPacker<uint32_t> bitpack;
    bitpack.putBits((uint32_t)armoryVer_,   16);
    bitpack.putBits((uint32_t)armoryType_,  4);
+   bitpack.putBits((uint32_t)subsshFormat_, 4);
 
    bw.put_BinaryData(magic_);
    bw.put_BitPacker(bitpack);
@@ -1428,6 +1430,8 @@ void StoredScriptHistory::unserializeDBValue(BinaryRefReader & brr)
    // Now read the stored data fro this registered address
    BitUnpacker<uint16_t> bitunpack(brr);
    auto dbType = (ARMORY_DB_TYPE)bitunpack.getBits(4);
+   bitunpack.getBits(2);
+   bool hasReceived = bitunpack.getBit();
 
    if (dbType != ARMORY_DB_SUPER)
    {
@@ -1439,6 +1443,8 @@ void StoredScriptHistory::unserializeDBValue(BinaryRefReader & brr)
    
    subHistMap_.clear();
    subsshSummary_.clear();
+   totalReceived_ = 0;
+   lastTouchedHeight_ = 0;
 
    // We shouldn't end up with empty ssh's, but should catch it just in case
    if(totalTxioCount_==0)
@@ -1457,6 +1463,16 @@ void StoredScriptHistory::unserializeDBValue(BinaryRefReader & brr)
 
          subsshSummary_[height] = sum;
       }
+
+      if (hasReceived)
+      {
+         totalReceived_ = brr.get_var_int();
+         lastTouchedHeight_ = (uint32_t)brr.get_var_int();
+      }
+      else
+      {
+         totalReceived_ = SSH_RECEIVED_UNKNOWN;
+      }
    }
    catch (runtime_error& e)
    {
@@ -1470,9 +1486,19 @@ void StoredScriptHistory::serializeDBValue(BinaryWriter & bw,
    ARMORY_DB_TYPE dbType) 
    const
 {
+   //the received total and last touched height are left out when unknown
+   //or both 0, which keeps the legacy layout for those summaries
+   bool hasReceived = totalReceived_ != SSH_RECEIVED_UNKNOWN &&
+      (totalReceived_ != 0 || lastTouchedHeight_ != 0);
+
    size_t len = 13 + BtcUtils::get_varint_len(totalTxioCount_);
    if (dbType != ARMORY_DB_SUPER)
       len += 8;
+   if (hasReceived)
+   {
+      len += BtcUtils::get_varint_len(totalReceived_) +
+         BtcUtils::get_varint_len(lastTouchedHeight_);
+   }
 
    for (auto& sum : subsshSummary_)
    {
@@ -1486,6 +1512,7 @@ void StoredScriptHistory::serializeDBValue(BinaryWriter & bw,
    BitPacker<uint16_t> bitpack;
    bitpack.putBits((uint16_t)dbType,                  4);
    bitpack.putBits((uint16_t)SCRIPT_UTXO_VECTOR,      2);
+   bitpack.putBit(hasReceived);
    bw.put_BitPacker(bitpack);
 
    //
@@ -1505,6 +1532,12 @@ void StoredScriptHistory::serializeDBValue(BinaryWriter & bw,
       bw.put_var_int(sum.first);
       bw.put_var_int(sum.second);
    }
+
+   if (hasReceived)
+   {
+      bw.put_var_int(totalReceived_);
+      bw.put_var_int(lastTouchedHeight_);
+   }
 }
 
 
@@ -1647,6 +1680,39 @@ void StoredScriptHistory::decompressManySubssh(const BinaryDataRef& data,
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void StoredScriptHistory::insertSubsshColumns(const SubsshColumns& columns,
+   unsigned lower_bound, unsigned upper_bound,
+   function<bool(unsigned, uint8_t)>& isDupIdValid)
+{
+   for (size_t i = 0; i < columns.size(); i++)
+   {
+      auto this_height = columns.heights_[i];
+      if (this_height > upper_bound)
+         return;
+
+      auto dupId = columns.dupIds_[i];
+      if (!isDupIdValid(this_height, dupId))
+         continue;
+
+      StoredSubHistory subssh;
+      subssh.height_ = this_height;
+
+      if (this_height >= lower_bound)
+      {
+         for (auto y = columns.txioOffsets_[i];
+            y < columns.txioOffsets_[i + 1]; y++)
+         {
+            subssh.txioMap_.insert(make_pair(
+               columns.getOutputKey(y), columns.getTxio(i, y)));
+         }
+      }
+
+      auto hgtx = DBUtils::getBlkDataKeyNoPrefix(this_height, dupId);
+      subHistMap_.insert(make_pair(move(hgtx), move(subssh)));
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 BinaryData StoredScriptHistory::getDBKey(bool withPrefix) const
 {
@@ -1713,6 +1779,10 @@ bool StoredScriptHistory::haveFullHistoryLoaded(void) const
 ////////////////////////////////////////////////////////////////////////////////
 uint64_t StoredScriptHistory::getScriptReceived(bool withMultisig)
 {
+   //the summary carries the total, history is only needed for multisig
+   if (!withMultisig && totalReceived_ != SSH_RECEIVED_UNKNOWN)
+      return totalReceived_;
+
    if(!haveFullHistoryLoaded())
       return UINT64_MAX;
 
@@ -1836,6 +1906,8 @@ void StoredScriptHistory::clear()
    scanHeight_ = tallyHeight_ = -1;
 
    totalTxioCount_ = totalUnspent_ = 0;
+   totalReceived_ = 0;
+   lastTouchedHeight_ = 0;
 
    subsshSummary_.clear();
    subHistMap_.clear();
@@ -1846,17 +1918,49 @@ void StoredScriptHistory::addSummary(const StoredScriptHistory& ssh)
 {
    totalTxioCount_ += ssh.totalTxioCount_;
    totalUnspent_ += ssh.totalUnspent_;
+   addReceived(ssh.totalReceived_);
+   if (ssh.lastTouchedHeight_ > lastTouchedHeight_)
+      lastTouchedHeight_ = ssh.lastTouchedHeight_;
 
    subsshSummary_.insert(
       ssh.subsshSummary_.begin(),
       ssh.subsshSummary_.end());
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void StoredScriptHistory::addReceived(uint64_t value)
+{
+   //an unknown total stays unknown until the ssh is rescanned
+   if (totalReceived_ == SSH_RECEIVED_UNKNOWN)
+      return;
+
+   if (value == SSH_RECEIVED_UNKNOWN)
+   {
+      totalReceived_ = SSH_RECEIVED_UNKNOWN;
+      return;
+   }
+
+   totalReceived_ += value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredScriptHistory::substractReceived(uint64_t value)
+{
+   if (totalReceived_ == SSH_RECEIVED_UNKNOWN)
+      return;
+
+   totalReceived_ -= value;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void StoredScriptHistory::substractSummary(const StoredScriptHistory& ssh)
 {
    totalTxioCount_ -= ssh.totalTxioCount_;
    totalUnspent_ -= ssh.totalUnspent_;
+   if (ssh.totalReceived_ == SSH_RECEIVED_UNKNOWN)
+      totalReceived_ = SSH_RECEIVED_UNKNOWN;
+   else
+      substractReceived(ssh.totalReceived_);
 
    for (auto& summary_pair : ssh.subsshSummary_)
    {
@@ -2166,8 +2270,14 @@ void StoredSubHistory::markTxOutUnspent(const BinaryData& txOutKey8B,
 void StoredSubHistory::compressMany(
    const map<BinaryDataRef, StoredSubHistory*>& ssh, 
    unsigned start_offset, unsigned spent_offset, 
-   BinaryWriter& bw)
+   BinaryWriter& bw, uint8_t format)
 {
+   if (format == SUBSSH_FORMAT_COLUMNS)
+   {
+      compressManyColumns(ssh, start_offset, spent_offset, bw);
+      return;
+   }
+
    //compute serialized size to prealloc bw
    size_t len = BtcUtils::get_varint_len(ssh.size());
    for (auto& subssh : ssh)
@@ -2332,6 +2442,294 @@ void StoredSubHistory::compressMany(
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+static uint64_t zigzagEncode(int64_t val)
+{
+   return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static int64_t zigzagDecode(uint64_t val)
+{
+   return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredSubHistory::compressManyColumns(
+   const map<BinaryDataRef, StoredSubHistory*>& ssh,
+   unsigned start_offset, unsigned spent_offset,
+   BinaryWriter& bw)
+{
+   //see SubsshColumns for the layout
+   BinaryWriter heights, dupIds, counts, flags, values;
+   BinaryWriter outTxIds, outIds, inputs, spentOutputs;
+
+   uint64_t txioCount = 0;
+   unsigned prevHeight = start_offset;
+   int64_t prevSpentHeight = spent_offset;
+   uint8_t flagByte = 0;
+   unsigned flagBits = 0;
+
+   for (auto& subssh : ssh)
+   {
+      //map is ordered by hgtx, heights don't go down
+      auto height = subssh.second->height_;
+      heights.put_var_int(height - prevHeight);
+      prevHeight = height;
+
+      dupIds.put_uint8_t(DBUtils::hgtxToDupID(subssh.first));
+      counts.put_var_int(subssh.second->txioMap_.size());
+
+      int64_t prevTxId = 0;
+      for (auto& txio_pair : subssh.second->txioMap_)
+      {
+         const auto& txio = txio_pair.second;
+         auto& outputRef = txio.getTxRefOfOutput();
+
+         values.put_var_int(txio.getValue());
+
+         int64_t txId = outputRef.getBlockTxIndex();
+         outTxIds.put_var_int(zigzagEncode(txId - prevTxId));
+         prevTxId = txId;
+         outIds.put_var_int(txio.getIndexOfOutput());
+
+         uint8_t flag = SUBSSH_TXIO_UNSPENT;
+         if (txio.hasTxIn())
+         {
+            //TxIOPair is slow, convert hgtx manually
+            auto keyptr = outputRef.getDBKey().getPtr();
+            int64_t output_height =
+               (keyptr[0] << 16) | (keyptr[1] << 8) | keyptr[2];
+
+            if (output_height != height)
+            {
+               flag = SUBSSH_TXIO_SPENT;
+               spentOutputs.put_var_int(
+                  zigzagEncode(output_height - prevSpentHeight));
+               spentOutputs.put_uint8_t(keyptr[3]);
+               prevSpentHeight = output_height;
+            }
+            else
+            {
+               flag = SUBSSH_TXIO_SAME_BLOCK;
+            }
+
+            inputs.put_var_int(txio.getTxRefOfInput().getBlockTxIndex());
+            inputs.put_var_int(txio.getIndexOfInput());
+         }
+
+         flagByte |= flag << flagBits;
+         flagBits += 2;
+         if (flagBits == 8)
+         {
+            flags.put_uint8_t(flagByte);
+            flagByte = 0;
+            flagBits = 0;
+         }
+
+         ++txioCount;
+      }
+   }
+
+   if (flagBits > 0)
+      flags.put_uint8_t(flagByte);
+
+   BinaryWriter* columns[SUBSSH_COLUMN_COUNT] = {
+      &heights, &dupIds, &counts, &flags, &values,
+      &outTxIds, &outIds, &inputs, &spentOutputs };
+
+   size_t len = 0;
+   for (auto& column : columns)
+      len += column->getSize() + 5;
+   bw.reserve(len + 18);
+
+   //counts and column sizes up front, readers skip the columns they don't use
+   bw.put_var_int(ssh.size());
+   bw.put_var_int(txioCount);
+   for (auto& column : columns)
+      bw.put_var_int(column->getSize());
+   for (auto& column : columns)
+      bw.put_BinaryDataRef(column->getDataRef());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SubsshColumns::decode(BinaryDataRef data,
+   unsigned heightOffset, unsigned spentOffset, bool withKeys)
+{
+   BinaryRefReader brr(data);
+   auto count = brr.get_var_int();
+   auto txioCount = brr.get_var_int();
+
+   size_t sizes[SUBSSH_COLUMN_COUNT];
+   for (auto& size : sizes)
+      size = brr.get_var_int();
+
+   BinaryDataRef columns[SUBSSH_COLUMN_COUNT];
+   for (unsigned i = 0; i < SUBSSH_COLUMN_COUNT; i++)
+      columns[i] = brr.get_BinaryDataRef((uint32_t)sizes[i]);
+
+   //subssh columns
+   BinaryRefReader brrHeights(columns[0]);
+   BinaryRefReader brrDupIds(columns[1]);
+   BinaryRefReader brrCounts(columns[2]);
+
+   heights_.resize(count);
+   dupIds_.resize(count);
+   txioOffsets_.resize(count + 1);
+   txioOffsets_[0] = 0;
+
+   unsigned height = heightOffset;
+   for (size_t i = 0; i < count; i++)
+   {
+      height += (unsigned)brrHeights.get_var_int();
+      heights_[i] = height;
+      dupIds_[i] = brrDupIds.get_uint8_t();
+      txioOffsets_[i + 1] =
+         txioOffsets_[i] + (uint32_t)brrCounts.get_var_int();
+   }
+
+   if (txioOffsets_[count] != txioCount ||
+      columns[3].getSize() != (txioCount + 3) / 4)
+   {
+      LOGERR << "unexpected txio count in columnar subssh";
+      throw runtime_error("unexpected txio count in columnar subssh");
+   }
+
+   //flags and values
+   flags_.resize(txioCount);
+   values_.resize(txioCount);
+
+   auto flagPtr = columns[3].getPtr();
+   BinaryRefReader brrValues(columns[4]);
+   for (size_t i = 0; i < txioCount; i++)
+   {
+      flags_[i] = (flagPtr[i / 4] >> ((i % 4) * 2)) & 0x03;
+      if (flags_[i] > SUBSSH_TXIO_SPENT)
+      {
+         LOGERR << "unexpected spent flag in columnar subssh";
+         throw runtime_error("unexpected spent flag in columnar subssh");
+      }
+
+      values_[i] = brrValues.get_var_int();
+   }
+
+   if (!withKeys)
+   {
+      outHeights_.clear();
+      outDupIds_.clear();
+      outTxIds_.clear();
+      outIds_.clear();
+      inTxIds_.clear();
+      inIds_.clear();
+      return;
+   }
+
+   //keys
+   outHeights_.resize(txioCount);
+   outDupIds_.resize(txioCount);
+   outTxIds_.resize(txioCount);
+   outIds_.resize(txioCount);
+   inTxIds_.resize(txioCount);
+   inIds_.resize(txioCount);
+
+   BinaryRefReader brrOutTxIds(columns[5]);
+   BinaryRefReader brrOutIds(columns[6]);
+   BinaryRefReader brrInputs(columns[7]);
+   BinaryRefReader brrSpent(columns[8]);
+
+   int64_t spentHeight = spentOffset;
+   for (size_t i = 0; i < count; i++)
+   {
+      int64_t txId = 0;
+      for (auto y = txioOffsets_[i]; y < txioOffsets_[i + 1]; y++)
+      {
+         txId += zigzagDecode(brrOutTxIds.get_var_int());
+         outTxIds_[y] = (uint16_t)txId;
+         outIds_[y] = (uint16_t)brrOutIds.get_var_int();
+
+         switch (flags_[y])
+         {
+         case SUBSSH_TXIO_UNSPENT:
+            outHeights_[y] = heights_[i];
+            outDupIds_[y] = dupIds_[i];
+            inTxIds_[y] = 0;
+            inIds_[y] = 0;
+            continue;
+
+         case SUBSSH_TXIO_SAME_BLOCK:
+            outHeights_[y] = heights_[i];
+            outDupIds_[y] = dupIds_[i];
+            break;
+
+         case SUBSSH_TXIO_SPENT:
+            spentHeight += zigzagDecode(brrSpent.get_var_int());
+            outHeights_[y] = (uint32_t)spentHeight;
+            outDupIds_[y] = brrSpent.get_uint8_t();
+            break;
+         }
+
+         inTxIds_[y] = (uint16_t)brrInputs.get_var_int();
+         inIds_[y] = (uint16_t)brrInputs.get_var_int();
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData SubsshColumns::getOutputKey(uint32_t y) const
+{
+   return DBUtils::getBlkDataKeyNoPrefix(
+      outHeights_[y], outDupIds_[y], outTxIds_[y], outIds_[y]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TxIOPair SubsshColumns::getTxio(size_t i, uint32_t y) const
+{
+   TxIOPair txio;
+   txio.setValue(values_[y]);
+   txio.setTxOut(getOutputKey(y));
+
+   if (flags_[y] == SUBSSH_TXIO_UNSPENT)
+   {
+      if (outTxIds_[y] == 0)
+         txio.setFromCoinbase(true);
+   }
+   else
+   {
+      txio.setTxIn(DBUtils::getBlkDataKeyNoPrefix(
+         heights_[i], dupIds_[i], inTxIds_[y], inIds_[y]));
+   }
+
+   return txio;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SubsshColumns::getTxios(map<BinaryData, TxIOPair>& txioMap,
+   unsigned lower_bound, unsigned upper_bound,
+   function<bool(unsigned, uint8_t)>& isDupIdValid) const
+{
+   for (size_t i = size(); i-- > 0;)
+   {
+      auto height = heights_[i];
+      if (height > upper_bound)
+         continue;
+      if (height < lower_bound)
+         return;
+
+      if (!isDupIdValid(height, dupIds_[i]))
+         continue;
+
+      for (auto y = txioOffsets_[i]; y < txioOffsets_[i + 1]; y++)
+      {
+         auto&& outputKey = getOutputKey(y);
+         auto iter = txioMap.lower_bound(outputKey);
+         if (iter != txioMap.end() && iter->first == outputKey)
+            continue;
+
+         txioMap.emplace_hint(iter, move(outputKey), getTxio(i, y));
+      }
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void StoredUndoData::unserializeDBValue(BinaryRefReader & brr)
 {
@@ -2646,4 +3044,164 @@ void StoredHeadHgtList::unserializeDBKey(BinaryDataRef key)
    height_ = brr.get_uint32_t(BE);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void StoredUtxoSnapshot::unserializeDBValue(BinaryRefReader & brr)
+{
+   version_ = brr.get_uint8_t();
+   if (version_ != UTXO_SNAPSHOT_VERSION)
+   {
+      //caller checks the version and discards the snapshot
+      utxos_.clear();
+      return;
+   }
+
+   blockHash_ = brr.get_BinaryData(32);
+   auto merkleSize = brr.get_var_int();
+   addrMerkle_ = brr.get_BinaryData((uint32_t)merkleSize);
+
+   auto count = brr.get_var_int();
+   if (count * 40 > brr.getSizeRemaining())
+      throw BlockDeserializingException("invalid utxo snapshot count");
+
+   utxos_.clear();
+   utxos_.reserve(count);
+   for (uint64_t i = 0; i < count; i++)
+   {
+      auto&& stxoKey = brr.get_BinaryData(8);
+      auto&& parentHash = brr.get_BinaryData(32);
+      utxos_.emplace_back(move(stxoKey), move(parentHash));
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredUtxoSnapshot::serializeDBValue(BinaryWriter & bw) const
+{
+   if (blockHash_.getSize() != 32)
+      throw runtime_error("invalid utxo snapshot block hash");
+
+   bw.put_uint8_t(version_);
+   bw.put_BinaryData(blockHash_);
+   bw.put_var_int(addrMerkle_.getSize());
+   bw.put_BinaryData(addrMerkle_);
+
+   bw.put_var_int(utxos_.size());
+   for (auto& utxo : utxos_)
+   {
+      if (utxo.first.getSize() != 8 || utxo.second.getSize() != 32)
+         throw runtime_error("invalid utxo snapshot entry");
+
+      bw.put_BinaryData(utxo.first);
+      bw.put_BinaryData(utxo.second);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredUtxoSnapshot::unserializeDBValue(BinaryDataRef bdr)
+{
+   BinaryRefReader brr(bdr);
+   unserializeDBValue(brr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredUtxoSnapshot::serializeDBValue(void) const
+{
+   BinaryWriter bw;
+   serializeDBValue(bw);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredUtxoSnapshot::getDBKey(uint32_t filterKey, uint32_t height)
+{
+   BinaryWriter bw(9);
+   bw.put_uint8_t((uint8_t)DB_PREFIX_UTXOSNAP);
+   bw.put_uint32_t(filterKey, BE);
+   bw.put_uint32_t(height, BE);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredUtxoSnapshot::getDBKey(void) const
+{
+   return getDBKey(filterKey_, height_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredUtxoSnapshot::unserializeDBKey(BinaryDataRef key)
+{
+   BinaryRefReader brr(key);
+   if (key.getSize() != 9 || brr.get_uint8_t() != DB_PREFIX_UTXOSNAP)
+   {
+      LOGERR << "Unserialized UTXOSNAP key but wrong prefix";
+      return;
+   }
+
+   filterKey_ = brr.get_uint32_t(BE);
+   height_ = brr.get_uint32_t(BE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBuildCheckpoint::unserializeDBValue(BinaryRefReader & brr)
+{
+   version_ = brr.get_uint8_t();
+   if (version_ != BUILD_CHECKPOINT_VERSION)
+   {
+      //caller checks the version and starts the phase over
+      topHeight_ = UINT32_MAX;
+      return;
+   }
+
+   topHeight_ = brr.get_uint32_t();
+   topHash_ = brr.get_BinaryData(32);
+   lowHeight_ = brr.get_uint32_t();
+   firstHeight_ = brr.get_uint32_t();
+   topId_ = brr.get_uint32_t();
+
+   auto keySize = brr.get_var_int();
+   if (keySize > brr.getSizeRemaining())
+      throw BlockDeserializingException("invalid build checkpoint key");
+   lastKey_ = brr.get_BinaryData((uint32_t)keySize);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBuildCheckpoint::serializeDBValue(BinaryWriter & bw) const
+{
+   if (topHash_.getSize() != 32)
+      throw runtime_error("invalid build checkpoint block hash");
+
+   bw.put_uint8_t(version_);
+   bw.put_uint32_t(topHeight_);
+   bw.put_BinaryData(topHash_);
+   bw.put_uint32_t(lowHeight_);
+   bw.put_uint32_t(firstHeight_);
+   bw.put_uint32_t(topId_);
+   bw.put_var_int(lastKey_.getSize());
+   bw.put_BinaryData(lastKey_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBuildCheckpoint::unserializeDBValue(BinaryDataRef bdr)
+{
+   BinaryRefReader brr(bdr);
+   unserializeDBValue(brr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredBuildCheckpoint::serializeDBValue(void) const
+{
+   BinaryWriter bw;
+   serializeDBValue(bw);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredBuildCheckpoint::getDBKey(BUILD_CHECKPOINT_TYPE type)
+{
+   //sorts after every batch id key (id BE | 0x00000000)
+   BinaryWriter bw(5);
+   bw.put_uint32_t(BUILD_CHECKPOINT_KEY_PREFIX, BE);
+   bw.put_uint8_t((uint8_t)type);
+   return bw.getData();
+}
+
 // kate: indent-width 3; replace-tabs on;
@@ -29,6 +29,25 @@
 #define ARMORY_DB_VERSION   0x9701
 #define ARMORY_DB_DEFAULT   ARMORY_DB_FULL
 #define UTXO_STORAGE        SCRIPT_UTXO_VECTOR
+#define UTXO_SNAPSHOT_VERSION 1
+
+//supernode SUBSSH value layout, carried by the SUBSSH sdbi
+#define SUBSSH_FORMAT_ROWS       0
+#define SUBSSH_FORMAT_COLUMNS    1
+#define SUBSSH_COLUMN_COUNT      9
+
+//ssh summaries written before the received total carry none
+#define SSH_RECEIVED_UNKNOWN     UINT64_MAX
+
+//supernode build checkpoints, keyed in SUBSSH_META past the batch entries
+#define BUILD_CHECKPOINT_VERSION    1
+#define BUILD_CHECKPOINT_KEY_PREFIX UINT32_MAX
+
+enum BUILD_CHECKPOINT_TYPE
+{
+   BUILD_CHECKPOINT_SPENTNESS = 1,
+   BUILD_CHECKPOINT_SSH
+};
 
 enum DB_TX_AVAIL
 {
@@ -50,6 +69,7 @@ enum DB_SELECT
    ZERO_CONF,
    TXFILTERS,
    SPENTNESS,
+   UTXOSNAP,
    COUNT
 };
 
@@ -80,6 +100,13 @@ enum SCRIPT_UTXO_TYPE
   SCRIPT_UTXO_TREE
 };
 
+enum SUBSSH_TXIO_FLAG
+{
+  SUBSSH_TXIO_UNSPENT,
+  SUBSSH_TXIO_SAME_BLOCK,
+  SUBSSH_TXIO_SPENT
+};
+
 class BlockHeader;
 class Tx;
 class TxIn;
@@ -128,6 +155,9 @@ public:
    uint32_t        armoryVer_=ARMORY_DB_VERSION;
    ARMORY_DB_TYPE  armoryType_=ARMORY_DB_FULL; //default db mode
    uint64_t metaInt_ = UINT64_MAX;
+
+   //dbs predating the flag read back as SUBSSH_FORMAT_ROWS
+   uint8_t subsshFormat_ = SUBSSH_FORMAT_ROWS;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -468,10 +498,18 @@ public:
    }
 
    static void compressMany(
+      const std::map<BinaryDataRef, StoredSubHistory*>& ssh,
+      unsigned heightOffset, unsigned spentOffset,
+      BinaryWriter& bw, uint8_t format);
+
+private:
+   static void compressManyColumns(
       const std::map<BinaryDataRef, StoredSubHistory*>& ssh,
       unsigned heightOffset, unsigned spentOffset,
       BinaryWriter& bw);
 
+public:
+
    StoredSubHistory& operator=(const StoredSubHistory& copy)
    {
       if (&copy == this)
@@ -501,6 +539,74 @@ public:
 };
 
 
+////////////////////////////////////////////////////////////////////////////////
+struct SubsshColumns
+{
+   /***
+   Flat decode of a SUBSSH_FORMAT_COLUMNS value, the subssh of one address
+   over a batch of blocks.
+
+   The value carries the subssh and txio counts, the byte size of each
+   column, then the columns:
+
+      subssh heights: varint, delta from the previous height
+      subssh dup ids: 1 byte each
+      subssh txio counts: varint
+      txio flags: SUBSSH_TXIO_FLAG, 2 bits each, 4 per byte
+      txio values: varint
+      output tx ids: zigzag varint, delta from the previous txio in the
+         same subssh
+      output ids: varint
+      inputs: tx id and input id varints, spent txios only
+      spent outputs: zigzag varint height delta from the previous one,
+         then the dup id, for outputs funded in an earlier block
+
+   Heights are relative to the batch height and the spent offset in
+   SUBSSH_META, like the row format.
+
+   The vectors hold one entry per subssh or per txio. They are reused
+   across decode() calls: walking many values allocates nothing per txio.
+   With withKeys false, only the subssh columns, flags and values are
+   decoded, which is all balance tallies need.
+   ***/
+
+   std::vector<uint32_t> heights_;
+   std::vector<uint8_t> dupIds_;
+
+   //txios of subssh i are [txioOffsets_[i], txioOffsets_[i+1])
+   std::vector<uint32_t> txioOffsets_;
+
+   std::vector<uint8_t> flags_;
+   std::vector<uint64_t> values_;
+
+   std::vector<uint32_t> outHeights_;
+   std::vector<uint8_t> outDupIds_;
+   std::vector<uint16_t> outTxIds_;
+   std::vector<uint16_t> outIds_;
+   std::vector<uint16_t> inTxIds_;
+   std::vector<uint16_t> inIds_;
+
+   void decode(BinaryDataRef, unsigned heightOffset, unsigned spentOffset,
+      bool withKeys = true);
+
+   //txio y of subssh i, these need the keys decoded
+   BinaryData getOutputKey(uint32_t y) const;
+   TxIOPair getTxio(size_t i, uint32_t y) const;
+
+   /*
+   Adds the txios of the subssh in [lower_bound, upper_bound] to the map,
+   walking from the newest. Outputs already in the map are left alone, so
+   feeding batches newest first keeps the latest state of each output and
+   only the kept rows are turned into TxIOPairs.
+   */
+   void getTxios(std::map<BinaryData, TxIOPair>&,
+      unsigned lower_bound, unsigned upper_bound,
+      std::function<bool(unsigned, uint8_t)>& isDupIdValid) const;
+
+   size_t size(void) const { return heights_.size(); }
+   size_t txioCount(void) const { return flags_.size(); }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // TODO:  I just realized that this should probably hold a "first-born-block"
 //        field for each address in the summary entry.  Though, maybe it's 
@@ -527,9 +633,14 @@ public:
       unsigned height_offset, unsigned spent_offset,
       unsigned lower_bound, unsigned upper_bound,
       std::function<bool(unsigned, uint8_t)>& isDupIdValid);
+   void insertSubsshColumns(const SubsshColumns&,
+      unsigned lower_bound, unsigned upper_bound,
+      std::function<bool(unsigned, uint8_t)>& isDupIdValid);
    
    void addSummary(const StoredScriptHistory&);
    void substractSummary(const StoredScriptHistory&);
+   void addReceived(uint64_t);
+   void substractReceived(uint64_t);
    
    BinaryData    getDBKey(bool withPrefix=true) const;
    SCRIPT_PREFIX getScriptType(void) const;
@@ -556,6 +667,12 @@ public:
    uint64_t       totalUnspent_;
    std::map<unsigned, unsigned> subsshSummary_;
 
+   //sum of the outputs funding this address, SSH_RECEIVED_UNKNOWN for 
+   //summaries predating it. lastTouchedHeight_ is the highest block with
+   //a txio for this address, an upper bound past a supernode reorg.
+   uint64_t       totalReceived_ = 0;
+   uint32_t       lastTouchedHeight_ = 0;
+
    // If this ssh has only one TxIO (most of them), then we don't bother
    // with supplemental entries just to hold that one TxIO in the DB.
    // We always stored them in RAM using the StoredSubHistory 
@@ -666,6 +783,82 @@ public:
 };
 
 
+////////////////////////////////////////////////////////////////////////////////
+class StoredUtxoSnapshot
+{
+   /***
+   Utxo set of a ScrAddrFilter as of a given block. Entries only carry the
+   stxo key and the parent tx hash, the rest of the txout and its current
+   spentness is read from the STXO db when the snapshot is loaded.
+
+   The snapshot is only valid for the address set it was created with 
+   (addrMerkle_) and as long as blockHash_ is on the main branch.
+   ***/
+
+public:
+   bool isInitialized(void) const { return height_ != UINT32_MAX; }
+
+   void       unserializeDBValue(BinaryRefReader & brr);
+   void         serializeDBValue(BinaryWriter    & bw ) const;
+   void       unserializeDBValue(BinaryDataRef      bd);
+   BinaryData   serializeDBValue(void) const;
+   void       unserializeDBKey(BinaryDataRef key);
+
+   BinaryData getDBKey(void) const;
+   static BinaryData getDBKey(uint32_t filterKey, uint32_t height);
+
+   uint32_t   filterKey_ = UINT32_MAX;
+   uint32_t   height_ = UINT32_MAX;
+   uint8_t    version_ = UTXO_SNAPSHOT_VERSION;
+   BinaryData blockHash_;
+   BinaryData addrMerkle_;
+
+   //stxo key without prefix, parent tx hash
+   std::vector<std::pair<BinaryData, BinaryData>> utxos_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class StoredBuildCheckpoint
+{
+   /***
+   Resume point of a supernode build phase that did not run to completion.
+
+   Spentness is parsed from the top block down: the checkpoint covers
+   lowHeight_ to topHeight_, the blocks below lowHeight_ are left.
+
+   The ssh phase walks ssh bounds in key order: lastKey_ is the end key of
+   the last committed bounds, firstHeight_ and topId_ are the subssh range
+   the phase was tallying, so that the bounds past lastKey_ are tallied
+   over the same range on resume.
+
+   A checkpoint is only valid as long as topHash_ is on the main branch.
+   ***/
+
+public:
+   bool isInitialized(void) const { return topHeight_ != UINT32_MAX; }
+
+   void       unserializeDBValue(BinaryRefReader & brr);
+   void         serializeDBValue(BinaryWriter    & bw ) const;
+   void       unserializeDBValue(BinaryDataRef      bd);
+   BinaryData   serializeDBValue(void) const;
+
+   BinaryData getDBKey(void) const { return getDBKey(type_); }
+   static BinaryData getDBKey(BUILD_CHECKPOINT_TYPE);
+
+   BUILD_CHECKPOINT_TYPE type_ = BUILD_CHECKPOINT_SPENTNESS;
+   uint8_t    version_ = BUILD_CHECKPOINT_VERSION;
+   uint32_t   topHeight_ = UINT32_MAX;
+   BinaryData topHash_;
+
+   //spentness
+   uint32_t   lowHeight_ = UINT32_MAX;
+
+   //ssh
+   uint32_t   firstHeight_ = 0;
+   uint32_t   topId_ = 0;
+   BinaryData lastKey_;
+};
+
 #endif
 
 // kate: indent-width 3; replace-tabs on;
@@ -0,0 +1,283 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdexcept>
+#include "TaskPool.h"
+
+using namespace std;
+using namespace Armory::Threading;
+
+namespace
+{
+   //set on worker threads so that submit and runPending can tell which
+   //deque belongs to the caller
+   thread_local const TaskPool* currentPool_ = nullptr;
+   thread_local unsigned currentWorkerId_ = UINT32_MAX;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// TaskGroup
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+TaskGroup::TaskGroup(TaskPool* pool) :
+   pool_(pool)
+{
+   if (pool_ == nullptr)
+      throw runtime_error("null task pool");
+
+   pending_.store(0, memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TaskGroup::~TaskGroup()
+{
+   //tasks hold a pointer to the group, they have to be done before it goes
+   try
+   {
+      wait();
+   }
+   catch (...)
+   {}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskGroup::run(function<void(void)> func)
+{
+   pending_.fetch_add(1, memory_order_relaxed);
+
+   TaskPool::Task task;
+   task.func_ = move(func);
+   task.group_ = this;
+   pool_->submit(move(task));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskGroup::taskDone(exception_ptr eptr)
+{
+   /*
+   Count down and signal in the same critical section. wait() only returns
+   once it holds mu_ with nothing pending, the group may be destroyed as
+   soon as the last task lets go of the lock.
+   */
+   unique_lock<mutex> lock(mu_);
+   if (eptr != nullptr && error_ == nullptr)
+      error_ = eptr;
+
+   if (pending_.fetch_sub(1, memory_order_acq_rel) == 1)
+      cv_.notify_all();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskGroup::wait()
+{
+   while (pending_.load(memory_order_acquire) > 0)
+   {
+      //help out rather than idle
+      if (pool_->runPending())
+         continue;
+
+      //nothing left in the queues, our remaining tasks are running
+      unique_lock<mutex> lock(mu_);
+      cv_.wait(lock, [this]()->bool
+      {
+         return pending_.load(memory_order_acquire) == 0;
+      });
+   }
+
+   exception_ptr eptr = nullptr;
+   {
+      //the last taskDone is out of the group once we hold the lock
+      unique_lock<mutex> lock(mu_);
+      cv_.wait(lock, [this]()->bool
+      {
+         return pending_.load(memory_order_acquire) == 0;
+      });
+      swap(eptr, error_);
+   }
+
+   if (eptr != nullptr)
+      rethrow_exception(eptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// TaskPool
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+TaskPool::TaskPool(unsigned threadCount)
+{
+   if (threadCount == 0)
+      threadCount = 1;
+
+   queued_.store(0, memory_order_relaxed);
+   nextQueue_.store(0, memory_order_relaxed);
+   stealCount_.store(0, memory_order_relaxed);
+
+   for (unsigned i = 0; i < threadCount; i++)
+      queues_.push_back(make_unique<WorkQueue>());
+
+   auto workerLbd = [this](unsigned id)->void
+   {
+      workerLoop(id);
+   };
+
+   for (unsigned i = 0; i < threadCount; i++)
+      threads_.push_back(thread(workerLbd, i));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TaskPool::~TaskPool()
+{
+   {
+      unique_lock<mutex> lock(sleepMutex_);
+      run_ = false;
+   }
+   sleepCV_.notify_all();
+
+   for (auto& thr : threads_)
+   {
+      if (thr.joinable())
+         thr.join();
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned TaskPool::workerId() const
+{
+   if (currentPool_ != this)
+      return UINT32_MAX;
+
+   return currentWorkerId_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskPool::submit(Task task)
+{
+   auto id = workerId();
+   if (id == UINT32_MAX)
+   {
+      id = nextQueue_.fetch_add(1, memory_order_relaxed) %
+         (unsigned)queues_.size();
+   }
+
+   //count the task before it is visible so that the counter never goes
+   //below the actual queue size
+   queued_.fetch_add(1, memory_order_release);
+
+   {
+      auto& queue = *queues_[id];
+      unique_lock<mutex> lock(queue.mu_);
+      queue.tasks_.push_back(move(task));
+   }
+
+   {
+      unique_lock<mutex> lock(sleepMutex_);
+   }
+   sleepCV_.notify_one();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool TaskPool::popTask(unsigned id, Task& task)
+{
+   if (queued_.load(memory_order_acquire) == 0)
+      return false;
+
+   //own deque first, newest task
+   if (id < queues_.size())
+   {
+      auto& queue = *queues_[id];
+      unique_lock<mutex> lock(queue.mu_);
+      if (!queue.tasks_.empty())
+      {
+         task = move(queue.tasks_.back());
+         queue.tasks_.pop_back();
+         queued_.fetch_sub(1, memory_order_relaxed);
+         return true;
+      }
+   }
+
+   //steal the oldest task from the others
+   auto count = (unsigned)queues_.size();
+   auto start = id < count ? id + 1 : 0;
+   for (unsigned i = 0; i < count; i++)
+   {
+      auto victim = (start + i) % count;
+      if (victim == id)
+         continue;
+
+      auto& queue = *queues_[victim];
+      unique_lock<mutex> lock(queue.mu_);
+      if (queue.tasks_.empty())
+         continue;
+
+      task = move(queue.tasks_.front());
+      queue.tasks_.pop_front();
+      queued_.fetch_sub(1, memory_order_relaxed);
+      stealCount_.fetch_add(1, memory_order_relaxed);
+      return true;
+   }
+
+   return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskPool::execute(Task& task)
+{
+   exception_ptr eptr = nullptr;
+   try
+   {
+      task.func_();
+   }
+   catch (...)
+   {
+      eptr = current_exception();
+   }
+
+   //release captures before the group is signaled
+   task.func_ = nullptr;
+   task.group_->taskDone(eptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool TaskPool::runPending()
+{
+   Task task;
+   if (!popTask(workerId(), task))
+      return false;
+
+   execute(task);
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskPool::workerLoop(unsigned id)
+{
+   currentPool_ = this;
+   currentWorkerId_ = id;
+
+   while (true)
+   {
+      Task task;
+      if (popTask(id, task))
+      {
+         execute(task);
+         continue;
+      }
+
+      unique_lock<mutex> lock(sleepMutex_);
+      sleepCV_.wait(lock, [this]()->bool
+      {
+         return !run_ || queued_.load(memory_order_acquire) > 0;
+      });
+
+      //drain the queues before exiting
+      if (!run_ && queued_.load(memory_order_acquire) == 0)
+         break;
+   }
+}
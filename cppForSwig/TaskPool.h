@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TASKPOOL_H
+#define _TASKPOOL_H
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <exception>
+
+namespace Armory
+{
+   namespace Threading
+   {
+      class TaskPool;
+
+      //////////////////////////////////////////////////////////////////////////
+      class TaskGroup
+      {
+         /***
+         Tracks a set of tasks submitted to a TaskPool. wait() runs pending
+         pool tasks on the calling thread until all tasks in the group are
+         done, then rethrows the first exception a task threw, if any.
+
+         Tasks should not block on other tasks, short of waiting on a nested
+         TaskGroup.
+         ***/
+
+         friend class TaskPool;
+
+      private:
+         TaskPool* pool_;
+         std::atomic<unsigned> pending_;
+
+         std::mutex mu_;
+         std::condition_variable cv_;
+         std::exception_ptr error_ = nullptr;
+
+      private:
+         void taskDone(std::exception_ptr);
+
+      public:
+         TaskGroup(TaskPool*);
+         ~TaskGroup(void);
+
+         TaskGroup(const TaskGroup&) = delete;
+         TaskGroup& operator=(const TaskGroup&) = delete;
+
+         void run(std::function<void(void)>);
+         void wait(void);
+      };
+
+      //////////////////////////////////////////////////////////////////////////
+      class TaskPool
+      {
+         /***
+         Fixed set of worker threads, each with its own task deque. Workers
+         pop their own deque from the back and steal from the front of the
+         other deques when they run dry, so a stage that is done with its
+         own tasks picks up whatever the other stages have queued.
+
+         Tasks submitted from a worker land in that worker's deque, other
+         threads spread their tasks round robin.
+         ***/
+
+         friend class TaskGroup;
+
+      private:
+         struct Task
+         {
+            std::function<void(void)> func_;
+            TaskGroup* group_ = nullptr;
+         };
+
+         struct WorkQueue
+         {
+            std::mutex mu_;
+            std::deque<Task> tasks_;
+         };
+
+         std::vector<std::unique_ptr<WorkQueue>> queues_;
+         std::vector<std::thread> threads_;
+
+         std::atomic<unsigned> queued_;
+         std::atomic<unsigned> nextQueue_;
+         std::atomic<uint64_t> stealCount_;
+
+         std::mutex sleepMutex_;
+         std::condition_variable sleepCV_;
+         bool run_ = true;
+
+      private:
+         void submit(Task);
+         bool popTask(unsigned, Task&);
+         void execute(Task&);
+         void workerLoop(unsigned);
+
+         //worker id of the calling thread, UINT32_MAX if not a worker
+         unsigned workerId(void) const;
+
+         //pops and runs a single task, returns false if all queues are empty
+         bool runPending(void);
+
+      public:
+         TaskPool(unsigned threadCount);
+         ~TaskPool(void);
+
+         TaskPool(const TaskPool&) = delete;
+         TaskPool& operator=(const TaskPool&) = delete;
+
+         unsigned threadCount(void) const
+         { return (unsigned)threads_.size(); }
+
+         uint64_t stealCount(void) const
+         { return stealCount_.load(std::memory_order_relaxed); }
+      };
+   }; //namespace Threading
+}; //namespace Armory
+
+#endif
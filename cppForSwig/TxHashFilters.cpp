@@ -7,10 +7,12 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <memory>
+#include <algorithm>
 #include <functional>
 #include "TxHashFilters.h"
 
 using namespace std;
+using namespace Armory::Threading;
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -60,6 +62,67 @@ bool checkPtrLen(const uint8_t* ptr)
    return true;
 }
 
+////
+template<typename T> void forEachFilter(BinaryDataRef bdr,
+   const TxFilterPoolLayout& layout, const T& callback)
+{
+   auto thisPtr = bdr.getPtr();
+   size_t pos = layout.filtersOffset_;
+
+   for (uint32_t i = 0; i < layout.filterCount_; i++)
+   {
+      if (pos + 12 > bdr.getSize())
+         throw TxFilterException("[TxFilterPool] overflow");
+
+      auto filterSize = getSizeFromPtr(thisPtr + pos);
+      if (filterSize < 12 || pos + filterSize > bdr.getSize())
+         throw TxFilterException("[TxFilterPool] overflow");
+
+      callback(thisPtr + pos);
+      pos += filterSize;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//// TxFilterPoolLayout
+//
+////////////////////////////////////////////////////////////////////////////////
+TxFilterPoolLayout TxFilterPoolLayout::parse(BinaryDataRef bdr)
+{
+   if (bdr.getSize() < 4)
+      throw TxFilterException("[TxFilterPool] truncated pool");
+
+   TxFilterPoolLayout layout;
+   auto ptr = bdr.getPtr();
+   auto header = getSizeFromPtr(ptr);
+   if (header != TXFILTER_POOL_MARKER)
+   {
+      //v1, the header is the filter count
+      layout.filterCount_ = header;
+      return layout;
+   }
+
+   if (bdr.getSize() < 16)
+      throw TxFilterException("[TxFilterPool] truncated pool");
+
+   memcpy(&layout.version_, ptr + 4, sizeof(uint32_t));
+   if (layout.version_ != TXFILTER_POOL_VERSION)
+      throw TxFilterException("[TxFilterPool] unsupported pool version");
+
+   memcpy(&layout.filterCount_, ptr + 8, sizeof(uint32_t));
+   memcpy(&layout.bloomBlockCount_, ptr + 12, sizeof(uint32_t));
+
+   size_t bloomSize = (size_t)layout.bloomBlockCount_ *
+      BLOOM_BLOCK_WORDS * sizeof(uint32_t);
+   if (layout.bloomBlockCount_ == 0 || 16 + bloomSize > bdr.getSize())
+      throw TxFilterException("[TxFilterPool] invalid bloom filter");
+
+   layout.bloomPtr_ = ptr + 16;
+   layout.filtersOffset_ = 16 + bloomSize;
+   return layout;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 //// BlockHashVector
@@ -140,7 +203,26 @@ set<uint32_t> BlockHashVector::compare(uint32_t key) const
    else if (filterPtr_ != nullptr)
    {
       auto ptr = (uint32_t*)(filterPtr_ + 12);
-      for (unsigned i = 0; i < len_; i++)
+      unsigned i = 0;
+
+#ifdef BLOOM_SSE2
+      //4 heads per compare, hits are rare
+      auto keyVec = _mm_set1_epi32((int)key);
+      for (; i + 4 <= len_; i += 4)
+      {
+         auto heads = _mm_loadu_si128((const __m128i*)(ptr + i));
+         if (_mm_movemask_epi8(_mm_cmpeq_epi32(heads, keyVec)) == 0)
+            continue;
+
+         for (unsigned y = i; y < i + 4; y++)
+         {
+            if (ptr[y] == key)
+               resultSet.insert(y);
+         }
+      }
+#endif
+
+      for (; i < len_; i++)
       {
          if (ptr[i] == key)
             resultSet.insert(i);
@@ -347,21 +429,61 @@ void TxFilterPoolWriter::serialize(BinaryWriter& bw) const
       throw TxFilterException("[serialize] invalid state");
    }
 
-   //get total count
-   uint32_t len = 0;
+   //existing filters, v1 or v2
+   TxFilterPoolLayout layout;
+   if (!dataRef_.empty())
+      layout = TxFilterPoolLayout::parse(dataRef_);
 
+   //the bloom filter covers all hash heads in the pool, rebuild it
+   size_t headCount = 0;
    if (!dataRef_.empty())
-      len = getSizeFromPtr(dataRef_.getPtr());
-   len += (uint32_t)pool_.size();
+   {
+      forEachFilter(dataRef_, layout, [&headCount](const uint8_t* ptr)
+      {
+         headCount += getLenFromPtr(ptr);
+      });
+   }
 
-   //write count header as a 32bit integer
-   bw.put_uint32_t(len);
+   for (auto& filter : pool_)
+      headCount += filter.second.filterVector_.size();
 
-   //if we have serialized data, write it without the header
+   TxHashHeadFilter bloom(headCount, TXFILTER_BLOOM_BITS_PER_KEY);
    if (!dataRef_.empty())
    {
-      bw.put_BinaryDataRef(dataRef_.getSliceRef(
-         4, dataRef_.getSize() - 4));
+      forEachFilter(dataRef_, layout, [&bloom](const uint8_t* ptr)
+      {
+         auto len = getLenFromPtr(ptr);
+         if (len * sizeof(uint32_t) + 12 != getSizeFromPtr(ptr))
+            throw TxFilterException("[serialize] invalid filter");
+
+         for (uint32_t i = 0; i < len; i++)
+         {
+            uint32_t head;
+            memcpy(&head, ptr + 12 + i * 4, sizeof(uint32_t));
+            bloom.insert(head);
+         }
+      });
+   }
+
+   for (auto& filter : pool_)
+   {
+      for (auto& head : filter.second.filterVector_)
+         bloom.insert(head);
+   }
+
+   //v2 header
+   bw.put_uint32_t(TXFILTER_POOL_MARKER);
+   bw.put_uint32_t(TXFILTER_POOL_VERSION);
+   bw.put_uint32_t(layout.filterCount_ + (uint32_t)pool_.size());
+   bw.put_uint32_t((uint32_t)bloom.blockCount());
+   bw.put_BinaryDataRef(BinaryDataRef(
+      (const uint8_t*)bloom.data(), bloom.sizeInBytes()));
+
+   //if we have serialized data, write its filters as is
+   if (!dataRef_.empty())
+   {
+      bw.put_BinaryDataRef(dataRef_.getSliceRef(layout.filtersOffset_,
+         dataRef_.getSize() - layout.filtersOffset_));
    }
 
    //serialize the pool objects
@@ -380,8 +502,8 @@ TxFilterPoolReader::TxFilterPoolReader(const TxFilterPoolReader& filter) :
 
 ////
 TxFilterPoolReader::TxFilterPoolReader(TxFilterPoolReader&& filter) :
-   dataRef_(filter.dataRef_), poolMap_(move(filter.poolMap_)),
-   fullMap_(move(filter.fullMap_))
+   dataRef_(filter.dataRef_), bloom_(move(filter.bloom_)),
+   poolMap_(move(filter.poolMap_)), fullMap_(move(filter.fullMap_))
 {}
 
 ////
@@ -392,6 +514,13 @@ TxFilterPoolReader::TxFilterPoolReader(
    if (bdr.empty())
       throw TxFilterException("[TxFilterPool] empty dataref");
 
+   auto layout = TxFilterPoolLayout::parse(dataRef_);
+   if (layout.bloomPtr_ != nullptr)
+   {
+      bloom_ = make_shared<TxHashHeadFilter>(
+         (const uint32_t*)layout.bloomPtr_, layout.bloomBlockCount_);
+   }
+
    switch (mode)
    {
    case TxFilterPoolMode::Bucket_Vector:
@@ -399,42 +528,19 @@ TxFilterPoolReader::TxFilterPoolReader(
 
    case TxFilterPoolMode::Bucket_Map:
    {
-      auto thisPtr = dataRef_.getPtr();
-      auto size = getSizeFromPtr(thisPtr);
-      uint32_t filterSize;
-      size_t pos = 4;
-
-      for (uint32_t i = 0; i < size; i++)
+      forEachFilter(dataRef_, layout, [this](const uint8_t* thisPtr)
       {
-         if (pos >= dataRef_.getSize())
-            throw TxFilterException("[TxFilterPool] overflow");
-
-         //iterate through entries
-         filterSize = getSizeFromPtr(thisPtr + pos);
-
-         auto filterObj = BlockHashMap::deserialize(thisPtr + pos);
+         auto filterObj = BlockHashMap::deserialize(thisPtr);
          poolMap_.emplace(filterObj.blockKey_, move(filterObj));
-         pos += filterSize;
-      }
+      });
 
       break;
    }
 
    case TxFilterPoolMode::Pool_Map:
    {
-      auto size = getSizeFromPtr(dataRef_.getPtr());
-      uint32_t filterSize;
-      size_t pos = 4;
-
-      for (uint32_t i = 0; i < size; i++)
+      forEachFilter(dataRef_, layout, [this](const uint8_t* thisPtr)
       {
-         if (pos >= dataRef_.getSize())
-            throw TxFilterException("[TxFilterPool] overflow");
-
-         //iterate through entries
-         auto thisPtr = dataRef_.getPtr() + pos;
-         filterSize = getSizeFromPtr(thisPtr);
-
          auto blockkey = getBlockKeyFromPtr(thisPtr);
          auto len = getLenFromPtr(thisPtr);
 
@@ -450,9 +556,7 @@ TxFilterPoolReader::TxFilterPoolReader(
                blockkey, set<uint32_t>());
             keyInsertIter.first->second.emplace(i);
          }
-
-         pos += filterSize;
-      }
+      });
 
       break;
    }
@@ -478,12 +582,21 @@ map<uint32_t, set<uint32_t>> TxFilterPoolReader::compare(
    if (!isValid())
       throw TxFilterException("[compare] invalid pool");
 
+   uint32_t shortHand;
+   memcpy(&shortHand, hash.getPtr(), 4);
+   return compareHead(shortHand);
+}
+
+////
+map<uint32_t, set<uint32_t>> TxFilterPoolReader::compareHead(
+   uint32_t shortHand) const
+{
    map<uint32_t, set<uint32_t>> returnMap;
+   if (bloom_ != nullptr && !bloom_->mayContain(shortHand))
+      return returnMap;
 
    if (!fullMap_.empty())
    {
-      uint32_t shortHand;
-      memcpy(&shortHand, hash.getPtr(), 4);
       auto iter = fullMap_.find(shortHand);
       if (iter != fullMap_.end())
          returnMap = iter->second;
@@ -492,68 +605,172 @@ map<uint32_t, set<uint32_t>> TxFilterPoolReader::compare(
    {
       for (const auto& filterIt : poolMap_)
       {
-         auto resultSet = filterIt.second.compare(hash);
+         auto resultSet = filterIt.second.compare(shortHand);
          if (!resultSet.empty())
             returnMap.emplace(filterIt.second.getBlockKey(), move(resultSet));
       }
    }
    else if (!dataRef_.empty()) //running against a pointer
    {
-      //get count
-      auto thisPtr = dataRef_.getPtr();
-      auto size = getSizeFromPtr(thisPtr);
-      uint32_t filterSize;
-      size_t pos = 4;
-
-      for (uint32_t i = 0; i < size; i++)
+      auto layout = TxFilterPoolLayout::parse(dataRef_);
+      forEachFilter(dataRef_, layout,
+         [&returnMap, shortHand](const uint8_t* thisPtr)
       {
-         if (pos >= dataRef_.getSize())
-            throw TxFilterException("overflow while reading pool ptr");
-
-         //iterate through entries
-         filterSize = getSizeFromPtr(thisPtr + pos);
-
-         auto filterObj = BlockHashVector::deserialize(thisPtr + pos);
-         auto resultSet = filterObj.compare(hash);
+         auto filterObj = BlockHashVector::deserialize(thisPtr);
+         auto resultSet = filterObj.compare(shortHand);
          if (!resultSet.empty())
             returnMap.emplace(filterObj.getBlockKey(), move(resultSet));
+      });
+   }
+
+   return returnMap;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+map<uint32_t, map<uint32_t, set<uint32_t>>> TxFilterPoolReader::compare(
+   const vector<uint32_t>& heads) const
+{
+   if (!isValid())
+      throw TxFilterException("[compare] invalid pool");
 
-         pos += filterSize;
+   map<uint32_t, map<uint32_t, set<uint32_t>>> returnMap;
+   if (!fullMap_.empty() || !poolMap_.empty())
+   {
+      for (auto& head : heads)
+      {
+         auto hits = compareHead(head);
+         if (!hits.empty())
+            returnMap.emplace(head, move(hits));
       }
+
+      return returnMap;
    }
 
+   //sorted heads, with a bitmap on their top 16 bits to skip the search
+   //for nearly all pool entries
+   vector<uint32_t> sortedHeads(heads);
+   sort(sortedHeads.begin(), sortedHeads.end());
+   sortedHeads.erase(unique(sortedHeads.begin(), sortedHeads.end()),
+      sortedHeads.end());
+   if (sortedHeads.empty())
+      return returnMap;
+
+   vector<uint64_t> bitmap(1024, 0);
+   for (auto& head : sortedHeads)
+      bitmap[head >> 22] |= 1ULL << ((head >> 16) & 0x3F);
+
+   auto layout = TxFilterPoolLayout::parse(dataRef_);
+   forEachFilter(dataRef_, layout,
+      [&returnMap, &sortedHeads, &bitmap](const uint8_t* thisPtr)
+   {
+      auto blockKey = getBlockKeyFromPtr(thisPtr);
+      auto len = getLenFromPtr(thisPtr);
+      if (len * sizeof(uint32_t) + 12 != getSizeFromPtr(thisPtr))
+         throw TxFilterException("[compare] invalid filter");
+
+      for (uint32_t i = 0; i < len; i++)
+      {
+         uint32_t head;
+         memcpy(&head, thisPtr + 12 + i * 4, sizeof(uint32_t));
+         if ((bitmap[head >> 22] & (1ULL << ((head >> 16) & 0x3F))) == 0)
+            continue;
+
+         if (!binary_search(sortedHeads.begin(), sortedHeads.end(), head))
+            continue;
+
+         returnMap[head][blockKey].insert(i);
+      }
+   });
+
    return returnMap;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void TxFilterPoolReader::mayContain(
+   const uint32_t* heads, size_t count, uint8_t* hits) const
+{
+   if (bloom_ == nullptr)
+   {
+      memset(hits, 1, count);
+      return;
+   }
+
+   bloom_->mayContain(heads, count, hits);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TaskPool* TxFilterPoolReader::defaultTaskPool()
+{
+   //built on first use and kept for the life of the process, callers
+   //without a pool of their own share it
+   static TaskPool pool(thread::hardware_concurrency());
+   return &pool;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 map<uint32_t, TxHashHintsSet> TxFilterPoolReader::scanHashes(
    uint32_t blockFileCount,
    const function<BinaryDataRef(uint32_t)>& fetch,
    const set<BinaryData>& hashes,
-   TxFilterPoolMode mode)
+   TxFilterPoolMode mode,
+   TaskPool* taskPool)
 {
-   auto parseBlockFile = [&fetch, &hashes, &mode](uint32_t id)->TxHashHintsSet
+   //hash heads, probed against each pool's bloom filter in one go
+   vector<const BinaryData*> hashPtrs;
+   vector<uint32_t> heads;
+   hashPtrs.reserve(hashes.size());
+   heads.reserve(hashes.size());
+   for (auto& hash : hashes)
+   {
+      if (hash.getSize() != 32)
+         throw TxFilterException("hash is 32 bytes long");
+
+      uint32_t head;
+      memcpy(&head, hash.getPtr(), sizeof(uint32_t));
+      hashPtrs.push_back(&hash);
+      heads.push_back(head);
+   }
+
+   auto parseBlockFile = [&fetch, &mode, &hashPtrs, &heads](
+      uint32_t id, TxHashHintsSet& result)->void
    {
       auto filterRawData = fetch(id);
       if (filterRawData.empty())
-         return {};
+         return;
 
+      //the single pass compare beats building maps at any hash count,
+      //explicit map modes are left to the caller
       TxFilterPoolMode thisMode = mode;
       if (thisMode == TxFilterPoolMode::Auto)
+         thisMode = TxFilterPoolMode::Bucket_Vector;
+
+      TxFilterPoolReader pool(filterRawData, thisMode);
+
+      vector<uint8_t> mayHit(heads.size());
+      pool.mayContain(heads.data(), heads.size(), mayHit.data());
+
+      vector<uint32_t> hitHeads;
+      for (size_t i = 0; i < heads.size(); i++)
       {
-         thisMode = TxFilterPoolMode::Pool_Map;
-         if (hashes.size() <= 200)
-            thisMode = TxFilterPoolMode::Bucket_Vector;
-         else if (hashes.size() <= 2300)
-            thisMode = TxFilterPoolMode::Bucket_Map;
+         if (mayHit[i] != 0)
+            hitHeads.push_back(heads[i]);
       }
 
-      TxFilterPoolReader pool(filterRawData, thisMode);
-      TxHashHintsSet result;
+      if (hitHeads.empty())
+         return;
 
-      for (auto& hash : hashes)
+      auto hitsByHead = pool.compare(hitHeads);
+      for (size_t i = 0; i < hashPtrs.size(); i++)
       {
-         auto hits = pool.compare(hash);
+         if (mayHit[i] == 0)
+            continue;
+
+         auto hitsIter = hitsByHead.find(heads[i]);
+         if (hitsIter == hitsByHead.end())
+            continue;
+
+         auto& hash = *hashPtrs[i];
+         auto hits = hitsIter->second;
          if (hits.empty())
             continue;
 
@@ -562,42 +779,31 @@ map<uint32_t, TxHashHintsSet> TxFilterPoolReader::scanHashes(
 
          result.emplace(move(hint));
       }
-
-      return result;
    };
 
-   map<uint32_t, TxHashHintsSet> finalResult;
-   auto counterPtr = make_shared<atomic<uint32_t>>();
-   counterPtr->store(0, memory_order_relaxed);
-   auto mutexPtr = make_shared<mutex>();
+   if (taskPool == nullptr)
+      taskPool = defaultTaskPool();
 
-   auto workerThread =
-      [&parseBlockFile, &finalResult, &blockFileCount,
-      counterPtr, mutexPtr](void)
+   //one result slot per file, tasks never share a slot so there is
+   //nothing to lock or merge
+   vector<TxHashHintsSet> slots(blockFileCount);
    {
-      map<uint32_t, TxHashHintsSet> result;
-      while (true)
+      TaskGroup group(taskPool);
+      for (uint32_t fileID = 0; fileID < blockFileCount; fileID++)
       {
-         auto fileID = counterPtr->fetch_add(1, memory_order_relaxed);
-         if (fileID >= blockFileCount)
-            break;
-
-         auto hits = parseBlockFile(fileID);
-         result.emplace(fileID, move(hits));
+         auto slotPtr = &slots[fileID];
+         group.run([&parseBlockFile, fileID, slotPtr](void)
+         {
+            parseBlockFile(fileID, *slotPtr);
+         });
       }
 
-      auto lock = unique_lock<mutex>(*mutexPtr);
-      for (auto& it : result)
-         finalResult.emplace(it.first, move(it.second));
-   };
-
-   vector<thread> workers;
-   for (unsigned i=1; i<thread::hardware_concurrency(); i++)
-      workers.emplace_back(thread(workerThread));
-   workerThread();
+      group.wait();
+   }
 
-   for (auto& thr : workers)
-      thr.join();
+   map<uint32_t, TxHashHintsSet> finalResult;
+   for (uint32_t fileID = 0; fileID < blockFileCount; fileID++)
+      finalResult.emplace_hint(finalResult.end(), fileID, move(slots[fileID]));
 
    return finalResult;
 }
\ No newline at end of file
@@ -16,8 +16,22 @@
 #include <set>
 #include <map>
 #include <unordered_map>
+#include <memory>
 
 #include "BinaryData.h"
+#include "BloomFilter.h"
+#include "TaskPool.h"
+
+/***
+Pool versions:
+   1: uint32 filter count, then the BlockHashVector entries
+   2: uint32 marker, uint32 version, uint32 filter count, uint32 bloom
+      block count, the bloom filter words over all the pool's hash heads,
+      then the BlockHashVector entries
+***/
+#define TXFILTER_POOL_MARKER UINT32_MAX
+#define TXFILTER_POOL_VERSION 2
+#define TXFILTER_BLOOM_BITS_PER_KEY 16
 
 ////////////////////////////////////////////////////////////////////////////////
 struct TxFilterException : public std::runtime_error
@@ -26,6 +40,28 @@ struct TxFilterException : public std::runtime_error
    {}
 };
 
+////////////////////////////////////////////////////////////////////////////////
+struct TxHashHeadHasher
+{
+   //the bloom filter mixes the bits, this has to be stable across builds
+   size_t operator()(uint32_t head) const { return head; }
+};
+
+typedef BlockedBloomFilter<uint32_t, TxHashHeadHasher> TxHashHeadFilter;
+
+////////////////////////////////////////////////////////////////////////////////
+struct TxFilterPoolLayout
+{
+   uint32_t version_ = 1;
+   uint32_t filterCount_ = 0;
+   size_t filtersOffset_ = 4;
+
+   const uint8_t* bloomPtr_ = nullptr;
+   uint32_t bloomBlockCount_ = 0;
+
+   static TxFilterPoolLayout parse(BinaryDataRef);
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 struct TxHashHints
 {
@@ -168,11 +204,15 @@ class TxFilterPoolReader
 {
 private:
    const BinaryDataRef dataRef_;
+   std::shared_ptr<const TxHashHeadFilter> bloom_;
 
    std::map<uint32_t, BlockHashMap> poolMap_;
    std::unordered_map<uint32_t,
       std::map<uint32_t, std::set<uint32_t>>> fullMap_;
 
+private:
+   std::map<uint32_t, std::set<uint32_t>> compareHead(uint32_t) const;
+
 public:
    //tors
    TxFilterPoolReader(void);
@@ -183,13 +223,27 @@ public:
 
    //helpers
    bool isValid(void) const;
+   bool hasBloom(void) const { return bloom_ != nullptr; }
 
    //getters
    std::map<uint32_t, std::set<uint32_t>> compare(const BinaryData&) const;
 
-   //multithreaded search
+   //map<hash head, map<blockId, set<tx id>>>, pointer pools are read in
+   //a single pass for all heads
+   std::map<uint32_t, std::map<uint32_t, std::set<uint32_t>>> compare(
+      const std::vector<uint32_t>&) const;
+
+   //hits[i] is 0 if heads[i] is not in the pool. v1 pools have no bloom
+   //filter, all heads hit
+   void mayContain(const uint32_t* heads, size_t count, uint8_t* hits) const;
+
+   //multithreaded search, one task per pool file. Runs on the process
+   //wide pool if no pool is passed
    static std::map<uint32_t, TxHashHintsSet> scanHashes(
       uint32_t, const std::function<BinaryDataRef(uint32_t)>&,
-      const std::set<BinaryData>&, TxFilterPoolMode);
+      const std::set<BinaryData>&, TxFilterPoolMode,
+      Armory::Threading::TaskPool* = nullptr);
+
+   static Armory::Threading::TaskPool* defaultTaskPool(void);
 };
 #endif
\ No newline at end of file
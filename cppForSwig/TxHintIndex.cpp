@@ -0,0 +1,653 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+
+#include "TxHintIndex.h"
+#include "log.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// TxHintEntry
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+bool TxHintEntry::operator<(const TxHintEntry& rhs) const
+{
+   if (fingerprint_ != rhs.fingerprint_)
+      return fingerprint_ < rhs.fingerprint_;
+
+   return memcmp(key_, rhs.key_, TXHINTINDEX_KEY_SIZE) < 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// TxHintSegment
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+TxHintSegment::~TxHintSegment()
+{
+   try
+   {
+      fileMap_.unmap();
+   }
+   catch (exception&)
+   {}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t TxHintSegment::fingerprintOffset(unsigned bucketBits)
+{
+   //fingerprints are read in place, keep them 8 bytes aligned
+   size_t offset = sizeof(TxHintSegmentHeader) +
+      ((1ULL << bucketBits) + 1) * sizeof(uint32_t);
+   return (offset + 7) & ~(size_t)7;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned TxHintSegment::getBucketBits(uint64_t count)
+{
+   unsigned bits = 0;
+   while (bits < 30 && (count >> (bits + 1)) >= TXHINTINDEX_BUCKET_LOAD)
+      ++bits;
+
+   return bits;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t TxHintSegment::getFingerprint(BinaryDataRef txHash)
+{
+   if (txHash.getSize() < 8)
+      throw TxHintIndexException("hash is too short to fingerprint");
+
+   auto ptr = txHash.getPtr();
+   uint64_t fingerprint = 0;
+   for (unsigned i = 0; i < 8; i++)
+      fingerprint = (fingerprint << 8) | ptr[i];
+
+   return fingerprint;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool TxHintSegment::open()
+{
+   if (!DBUtils::fileExists(path_, 2))
+      return false;
+
+   try
+   {
+      fileMap_ = DBUtils::getMmapOfFile(path_, false);
+   }
+   catch (...)
+   {
+      LOGWARN << "failed to map tx hint segment " << path_;
+      fileMap_.unmap();
+      return false;
+   }
+
+   auto fail = [this](const char* reason)->bool
+   {
+      LOGWARN << "tx hint segment " << path_ << ": " << reason;
+      fileMap_.unmap();
+      header_ = nullptr;
+      return false;
+   };
+
+   if (fileMap_.size_ < sizeof(TxHintSegmentHeader))
+      return fail("file is too short");
+
+   header_ = (const TxHintSegmentHeader*)fileMap_.filePtr_;
+   if (header_->magic_ != TXHINTINDEX_MAGIC ||
+      header_->version_ != TXHINTINDEX_VERSION ||
+      header_->keySize_ != TXHINTINDEX_KEY_SIZE ||
+      header_->bucketBits_ > 30)
+   {
+      return fail("version mismatch");
+   }
+
+   auto fpOffset = fingerprintOffset(header_->bucketBits_);
+   auto expectedSize = fpOffset +
+      header_->count_ * (sizeof(uint64_t) + TXHINTINDEX_KEY_SIZE);
+   if (fileMap_.size_ != expectedSize)
+      return fail("unexpected file size");
+
+   directory_ = (const uint32_t*)(fileMap_.filePtr_ +
+      sizeof(TxHintSegmentHeader));
+   fingerprints_ = (const uint64_t*)(fileMap_.filePtr_ + fpOffset);
+   keys_ = fileMap_.filePtr_ + fpOffset + header_->count_ * sizeof(uint64_t);
+
+   if (directory_[1ULL << header_->bucketBits_] != header_->count_)
+      return fail("corrupt bucket directory");
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryDataRef TxHintSegment::firstKey() const
+{
+   return BinaryDataRef(header_->firstKey_, TXHINTINDEX_KEY_SIZE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryDataRef TxHintSegment::lastKey() const
+{
+   return BinaryDataRef(header_->lastKey_, TXHINTINDEX_KEY_SIZE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TxHintRun TxHintSegment::getRun() const
+{
+   TxHintRun run;
+   run.fingerprints_ = fingerprints_;
+   run.keys_ = keys_;
+   run.count_ = header_->count_;
+   return run;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TxHintSegment::find(uint64_t fingerprint, vector<BinaryData>& result) const
+{
+   auto bits = header_->bucketBits_;
+   uint64_t bucket = 0;
+   if (bits > 0)
+      bucket = fingerprint >> (64 - bits);
+
+   uint64_t i = directory_[bucket];
+   uint64_t end = directory_[bucket + 1];
+
+   //buckets only hold a handful of fingerprints, compare them 4 at a time
+   //rather than branching on each one
+   for (; i + 4 <= end; i += 4)
+   {
+      auto fps = fingerprints_ + i;
+      unsigned hits =
+         (unsigned)(fps[0] == fingerprint) |
+         (unsigned)(fps[1] == fingerprint) << 1 |
+         (unsigned)(fps[2] == fingerprint) << 2 |
+         (unsigned)(fps[3] == fingerprint) << 3;
+
+      if (hits != 0)
+      {
+         for (unsigned y = 0; y < 4; y++)
+         {
+            if (hits & (1 << y))
+            {
+               result.emplace_back(
+                  keys_ + (i + y) * TXHINTINDEX_KEY_SIZE, TXHINTINDEX_KEY_SIZE);
+            }
+         }
+      }
+
+      if (fps[3] > fingerprint)
+         return;
+   }
+
+   for (; i < end; i++)
+   {
+      if (fingerprints_[i] > fingerprint)
+         return;
+
+      if (fingerprints_[i] == fingerprint)
+      {
+         result.emplace_back(
+            keys_ + i * TXHINTINDEX_KEY_SIZE, TXHINTINDEX_KEY_SIZE);
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TxHintSegment::write(const string& path, const vector<TxHintRun>& runs,
+   BinaryDataRef firstKey, BinaryDataRef lastKey)
+{
+   if (firstKey.getSize() != TXHINTINDEX_KEY_SIZE ||
+      lastKey.getSize() != TXHINTINDEX_KEY_SIZE)
+   {
+      throw TxHintIndexException("invalid tx hint segment range");
+   }
+
+   uint64_t count = 0;
+   for (auto& run : runs)
+      count += run.count_;
+
+   if (count > UINT32_MAX)
+      throw TxHintIndexException("too many entries for tx hint segment");
+
+   auto bits = getBucketBits(count);
+
+   //walks the runs in (fingerprint, key) order
+   auto forEach = [&runs](auto callback)->void
+   {
+      vector<uint64_t> pos(runs.size(), 0);
+      while (true)
+      {
+         int next = -1;
+         for (unsigned i = 0; i < runs.size(); i++)
+         {
+            if (pos[i] >= runs[i].count_)
+               continue;
+
+            if (next == -1)
+            {
+               next = i;
+               continue;
+            }
+
+            auto fp = runs[i].fingerprints_[pos[i]];
+            auto nextFp = runs[next].fingerprints_[pos[next]];
+            if (fp > nextFp)
+               continue;
+
+            if (fp < nextFp || memcmp(
+               runs[i].keys_ + pos[i] * TXHINTINDEX_KEY_SIZE,
+               runs[next].keys_ + pos[next] * TXHINTINDEX_KEY_SIZE,
+               TXHINTINDEX_KEY_SIZE) < 0)
+            {
+               next = i;
+            }
+         }
+
+         if (next == -1)
+            return;
+
+         auto& run = runs[next];
+         callback(run.fingerprints_[pos[next]],
+            run.keys_ + pos[next] * TXHINTINDEX_KEY_SIZE);
+         ++pos[next];
+      }
+   };
+
+   //bucket directory
+   vector<uint32_t> directory((1ULL << bits) + 1, 0);
+   forEach([&directory, bits](uint64_t fp, const uint8_t*)->void
+   {
+      uint64_t bucket = 0;
+      if (bits > 0)
+         bucket = fp >> (64 - bits);
+      ++directory[bucket + 1];
+   });
+
+   for (size_t i = 1; i < directory.size(); i++)
+      directory[i] += directory[i - 1];
+
+   TxHintSegmentHeader header;
+   memset(&header, 0, sizeof(TxHintSegmentHeader));
+   header.magic_ = TXHINTINDEX_MAGIC;
+   header.version_ = TXHINTINDEX_VERSION;
+   header.keySize_ = TXHINTINDEX_KEY_SIZE;
+   header.bucketBits_ = bits;
+   header.count_ = count;
+   memcpy(header.firstKey_, firstKey.getPtr(), TXHINTINDEX_KEY_SIZE);
+   memcpy(header.lastKey_, lastKey.getPtr(), TXHINTINDEX_KEY_SIZE);
+
+   ofstream fs(path, ios::binary | ios::trunc);
+   if (!fs.is_open())
+      throw TxHintIndexException("failed to open tx hint segment for writing");
+
+   fs.write((const char*)&header, sizeof(TxHintSegmentHeader));
+   fs.write((const char*)directory.data(),
+      directory.size() * sizeof(uint32_t));
+
+   auto dirEnd = sizeof(TxHintSegmentHeader) +
+      directory.size() * sizeof(uint32_t);
+   uint64_t zero = 0;
+   fs.write((const char*)&zero, fingerprintOffset(bits) - dirEnd);
+
+   vector<uint8_t> buffer;
+   buffer.reserve(1024 * 1024);
+   auto flushBuffer = [&fs, &buffer](void)->void
+   {
+      fs.write((const char*)buffer.data(), buffer.size());
+      buffer.clear();
+   };
+
+   forEach([&](uint64_t fp, const uint8_t*)->void
+   {
+      auto fpPtr = (const uint8_t*)&fp;
+      buffer.insert(buffer.end(), fpPtr, fpPtr + sizeof(uint64_t));
+      if (buffer.size() >= buffer.capacity() - sizeof(uint64_t))
+         flushBuffer();
+   });
+   flushBuffer();
+
+   forEach([&](uint64_t, const uint8_t* key)->void
+   {
+      buffer.insert(buffer.end(), key, key + TXHINTINDEX_KEY_SIZE);
+      if (buffer.size() >= buffer.capacity() - TXHINTINDEX_KEY_SIZE)
+         flushBuffer();
+   });
+   flushBuffer();
+
+   if (!fs.good())
+      throw TxHintIndexException("failed to write tx hint segment");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// TxHintIndex
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+string TxHintIndex::getSegmentPath(unsigned id) const
+{
+   stringstream ss;
+   ss << path_ << "." << id;
+   return ss.str();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<const TxHintSegmentList> TxHintIndex::getSegments() const
+{
+   auto segments = atomic_load(&segments_);
+   if (segments == nullptr)
+      return make_shared<TxHintSegmentList>();
+
+   return segments;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TxHintIndex::setSegments(shared_ptr<const TxHintSegmentList> segments)
+{
+   atomic_store(&segments_, segments);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TxHintIndex::load(const function<bool(BinaryDataRef)>& keyExists)
+{
+   unique_lock<mutex> lock(updateMutex_);
+
+   auto segments = make_shared<TxHintSegmentList>();
+   pendingDeletes_.clear();
+   nextId_ = 0;
+
+   if (!DBUtils::fileExists(path_, 2))
+   {
+      setSegments(segments);
+      return;
+   }
+
+   vector<unsigned> segmentIds;
+   {
+      ifstream fs(path_, ios::binary);
+      TxHintManifestHeader header;
+      memset(&header, 0, sizeof(TxHintManifestHeader));
+      fs.read((char*)&header, sizeof(TxHintManifestHeader));
+
+      if (!fs.good() ||
+         header.magic_ != TXHINTINDEX_MAGIC ||
+         header.version_ != TXHINTINDEX_VERSION)
+      {
+         LOGWARN << "tx hint index version mismatch, rebuilding";
+         setSegments(segments);
+         return;
+      }
+
+      segmentIds.resize(header.segmentCount_);
+      pendingDeletes_.resize(header.pendingCount_);
+      fs.read((char*)segmentIds.data(),
+         segmentIds.size() * sizeof(unsigned));
+      fs.read((char*)pendingDeletes_.data(),
+         pendingDeletes_.size() * sizeof(unsigned));
+
+      if (!fs.good())
+      {
+         LOGWARN << "truncated tx hint index manifest, rebuilding";
+         segmentIds.clear();
+         pendingDeletes_.clear();
+      }
+
+      nextId_ = header.nextId_;
+
+      //keys mean different things across db modes
+      if (header.dbType_ != (uint32_t)dbType_)
+      {
+         pendingDeletes_.insert(pendingDeletes_.end(),
+            segmentIds.begin(), segmentIds.end());
+         segmentIds.clear();
+      }
+   }
+
+   bool dropped = false;
+   for (auto& id : segmentIds)
+   {
+      //segments chain their key ranges, a missing one drops the rest
+      if (dropped)
+      {
+         pendingDeletes_.push_back(id);
+         continue;
+      }
+
+      auto segment = make_shared<TxHintSegment>(getSegmentPath(id), id);
+      if (!segment->open())
+      {
+         pendingDeletes_.push_back(id);
+         dropped = true;
+         continue;
+      }
+
+      segments->push_back(segment);
+   }
+
+   //the db may be behind the index if it was replaced or rolled back
+   while (!segments->empty() && !keyExists(segments->back()->lastKey()))
+   {
+      pendingDeletes_.push_back(segments->back()->id());
+      segments->pop_back();
+      dropped = true;
+   }
+
+   if (dropped)
+   {
+      LOGWARN << "dropped stale tx hint index segments";
+      writeManifest(*segments);
+   }
+
+   setSegments(segments);
+   purge();
+
+   LOGINFO << "tx hint index: " << segmentCount() << " segments, " <<
+      entryCount() << " entries";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TxHintIndex::writeManifest(const TxHintSegmentList& segments)
+{
+   TxHintManifestHeader header;
+   memset(&header, 0, sizeof(TxHintManifestHeader));
+   header.magic_ = TXHINTINDEX_MAGIC;
+   header.version_ = TXHINTINDEX_VERSION;
+   header.dbType_ = (uint32_t)dbType_;
+   header.nextId_ = nextId_;
+   header.segmentCount_ = segments.size();
+   header.pendingCount_ = pendingDeletes_.size();
+
+   vector<unsigned> segmentIds;
+   for (auto& segment : segments)
+      segmentIds.push_back(segment->id());
+
+   //write to a swap file first, the manifest is what makes a segment live
+   auto swapPath = path_;
+   swapPath.append(".tmp");
+
+   {
+      ofstream fs(swapPath, ios::binary | ios::trunc);
+      if (!fs.is_open())
+         throw TxHintIndexException("failed to open tx hint manifest");
+
+      fs.write((const char*)&header, sizeof(TxHintManifestHeader));
+      fs.write((const char*)segmentIds.data(),
+         segmentIds.size() * sizeof(unsigned));
+      fs.write((const char*)pendingDeletes_.data(),
+         pendingDeletes_.size() * sizeof(unsigned));
+
+      if (!fs.good())
+         throw TxHintIndexException("failed to write tx hint manifest");
+   }
+
+   remove(path_.c_str());
+   if (rename(swapPath.c_str(), path_.c_str()) != 0)
+      throw TxHintIndexException("failed to replace tx hint manifest");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TxHintIndex::purge()
+{
+   //mapped files can't be deleted on Windows, these wait for the readers
+   //to let go of them
+   vector<unsigned> remaining;
+   for (auto& id : pendingDeletes_)
+   {
+      auto&& path = getSegmentPath(id);
+      if (remove(path.c_str()) != 0 && DBUtils::fileExists(path, 0))
+         remaining.push_back(id);
+   }
+
+   pendingDeletes_ = move(remaining);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<const TxHintSegment> TxHintIndex::merge(
+   const TxHintSegmentList& segments, size_t from)
+{
+   vector<TxHintRun> runs;
+   for (size_t i = from; i < segments.size(); i++)
+      runs.push_back(segments[i]->getRun());
+
+   auto id = nextId_++;
+   auto&& path = getSegmentPath(id);
+   TxHintSegment::write(path, runs,
+      segments[from]->firstKey(), segments.back()->lastKey());
+
+   auto segment = make_shared<TxHintSegment>(path, id);
+   if (!segment->open())
+      throw TxHintIndexException("failed to open merged tx hint segment");
+
+   return segment;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TxHintIndex::clear()
+{
+   unique_lock<mutex> lock(updateMutex_);
+
+   {
+      //readers may still be on the old list, the files are deleted the
+      //same way as merged segments
+      auto segments = getSegments();
+      for (auto& segment : *segments)
+         pendingDeletes_.push_back(segment->id());
+   }
+
+   auto segments = make_shared<TxHintSegmentList>();
+   writeManifest(*segments);
+   setSegments(segments);
+   purge();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TxHintIndex::append(vector<TxHintEntry>& entries,
+   BinaryDataRef firstKey, BinaryDataRef lastKey)
+{
+   if (entries.size() == 0)
+      return;
+
+   unique_lock<mutex> lock(updateMutex_);
+
+   sort(entries.begin(), entries.end());
+
+   vector<uint64_t> fingerprints(entries.size());
+   vector<uint8_t> keys(entries.size() * TXHINTINDEX_KEY_SIZE);
+   for (size_t i = 0; i < entries.size(); i++)
+   {
+      fingerprints[i] = entries[i].fingerprint_;
+      memcpy(&keys[i * TXHINTINDEX_KEY_SIZE],
+         entries[i].key_, TXHINTINDEX_KEY_SIZE);
+   }
+
+   TxHintRun run;
+   run.fingerprints_ = fingerprints.data();
+   run.keys_ = keys.data();
+   run.count_ = entries.size();
+
+   auto id = nextId_++;
+   auto&& path = getSegmentPath(id);
+   TxHintSegment::write(path, { run }, firstKey, lastKey);
+
+   auto segment = make_shared<TxHintSegment>(path, id);
+   if (!segment->open())
+      throw TxHintIndexException("failed to open new tx hint segment");
+
+   auto newSegments = make_shared<TxHintSegmentList>(*getSegments());
+   newSegments->push_back(segment);
+
+   //fold the newest segments together while they are of similar size
+   while (newSegments->size() >= 2)
+   {
+      auto& older = (*newSegments)[newSegments->size() - 2];
+      auto& newer = newSegments->back();
+      if (older->count() > newer->count() * 2)
+         break;
+
+      auto merged = merge(*newSegments, newSegments->size() - 2);
+      pendingDeletes_.push_back(older->id());
+      pendingDeletes_.push_back(newer->id());
+
+      newSegments->pop_back();
+      newSegments->back() = merged;
+   }
+
+   writeManifest(*newSegments);
+   setSegments(newSegments);
+   purge();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<BinaryData> TxHintIndex::find(BinaryDataRef txHash) const
+{
+   vector<BinaryData> result;
+   if (txHash.getSize() < 8)
+      return result;
+
+   auto fingerprint = TxHintSegment::getFingerprint(txHash);
+   auto segments = getSegments();
+
+   //newest first, recent txs are the likeliest to be looked up
+   for (auto iter = segments->rbegin(); iter != segments->rend(); ++iter)
+      (*iter)->find(fingerprint, result);
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData TxHintIndex::indexedTo() const
+{
+   auto segments = getSegments();
+   if (segments->empty())
+      return BinaryData();
+
+   return segments->back()->lastKey();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t TxHintIndex::segmentCount() const
+{
+   return getSegments()->size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t TxHintIndex::entryCount() const
+{
+   uint64_t count = 0;
+   auto segments = getSegments();
+   for (auto& segment : *segments)
+      count += segment->count();
+
+   return count;
+}
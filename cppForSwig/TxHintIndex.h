@@ -0,0 +1,229 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2021, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TXHINTINDEX_H
+#define _TXHINTINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <stdexcept>
+
+#include "BinaryData.h"
+#include "bdmenums.h"
+#include "DBUtils.h"
+
+#define TXHINTINDEX_MAGIC        0x58444948 //"HIDX"
+#define TXHINTINDEX_VERSION      1
+#define TXHINTINDEX_FILENAME     "txhintindex"
+
+#define TXHINTINDEX_KEY_SIZE     6
+
+//average fingerprints per directory bucket
+#define TXHINTINDEX_BUCKET_LOAD  4
+
+//entries pulled from the db per segment build
+#define TXHINTINDEX_CHUNK_ENTRIES   (1 << 22)
+
+#ifndef UNIT_TESTS
+#define TXHINTINDEX_MIN_ENTRIES  100000
+#else
+#define TXHINTINDEX_MIN_ENTRIES  16
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+struct TxHintIndexException : public std::runtime_error
+{
+   TxHintIndexException(const std::string& err) : std::runtime_error(err)
+   {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct TxHintSegmentHeader
+{
+   uint32_t magic_;
+   uint32_t version_;
+   uint32_t keySize_;
+   uint32_t bucketBits_;
+   uint64_t count_;
+
+   //db key range the segment was built from, inclusive
+   uint8_t firstKey_[8];
+   uint8_t lastKey_[8];
+
+   uint8_t padding_[24];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct TxHintManifestHeader
+{
+   uint32_t magic_;
+   uint32_t version_;
+   uint32_t dbType_;
+   uint32_t nextId_;
+   uint32_t segmentCount_;
+   uint32_t pendingCount_;
+};
+
+static_assert(sizeof(TxHintSegmentHeader) == 64,
+   "unexpected tx hint segment header size");
+
+////////////////////////////////////////////////////////////////////////////////
+struct TxHintEntry
+{
+   uint64_t fingerprint_;
+   uint8_t key_[TXHINTINDEX_KEY_SIZE];
+
+   bool operator<(const TxHintEntry&) const;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct TxHintRun
+{
+   //sorted fingerprints and their keys, from a segment or a fresh chunk
+   const uint64_t* fingerprints_ = nullptr;
+   const uint8_t* keys_ = nullptr;
+   uint64_t count_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class TxHintSegment
+{
+   /***
+   Immutable, memory mapped table of (hash fingerprint, db key) for a range
+   of db keys. Layout, in host endianness:
+
+      header
+      bucket directory: (1 << bucketBits) + 1 uint32 offsets
+      fingerprints: count sorted uint64
+      keys: count 6 byte db keys, in fingerprint order
+
+   The fingerprint is the first 8 bytes of the tx hash read big endian, so
+   its top bits pick the bucket directly and the directory stands in for
+   the search: a lookup reads 2 offsets, then scans the few fingerprints of
+   its bucket.
+   ***/
+
+private:
+   const std::string path_;
+   const unsigned id_;
+   FileMap fileMap_;
+
+   const TxHintSegmentHeader* header_ = nullptr;
+   const uint32_t* directory_ = nullptr;
+   const uint64_t* fingerprints_ = nullptr;
+   const uint8_t* keys_ = nullptr;
+
+private:
+   static size_t fingerprintOffset(unsigned bucketBits);
+   static unsigned getBucketBits(uint64_t count);
+
+public:
+   TxHintSegment(const std::string& path, unsigned id) :
+      path_(path), id_(id)
+   {}
+
+   ~TxHintSegment(void);
+
+   TxHintSegment(const TxHintSegment&) = delete;
+   TxHintSegment& operator=(const TxHintSegment&) = delete;
+
+   //returns false if missing or unusable
+   bool open(void);
+
+   unsigned id(void) const { return id_; }
+   const std::string& path(void) const { return path_; }
+   uint64_t count(void) const { return header_->count_; }
+   BinaryDataRef firstKey(void) const;
+   BinaryDataRef lastKey(void) const;
+   TxHintRun getRun(void) const;
+
+   void find(uint64_t fingerprint, std::vector<BinaryData>&) const;
+
+   static uint64_t getFingerprint(BinaryDataRef txHash);
+
+   //merges the sorted runs into a new segment file
+   static void write(const std::string& path,
+      const std::vector<TxHintRun>&,
+      BinaryDataRef firstKey, BinaryDataRef lastKey);
+};
+
+typedef std::vector<std::shared_ptr<const TxHintSegment>> TxHintSegmentList;
+
+////////////////////////////////////////////////////////////////////////////////
+class TxHintIndex
+{
+   /***
+   Static hash -> db key index for the tx hints, on top of the TXHINTS db.
+
+   Each segment covers the db keys past the previous one. Blocks are added
+   with append(), which writes a new segment for the keys past indexedTo()
+   then folds the newest segments together while the older one is no more
+   than twice the size of the newer one. This keeps the segment count
+   logarithmic in the entry count.
+
+   The set of live segments is listed in the manifest file, written to a
+   swap file then renamed over. Readers grab the segment list as a whole
+   and are not blocked by updates. Replaced segment files are deleted once
+   the manifest no longer lists them, the ones that can't be deleted yet
+   are retried on the next update.
+
+   Lookups return candidate keys, which the caller has to check against
+   the db: the fingerprint is only 8 bytes of the hash and keys from
+   reorganized blocks are not evicted.
+   ***/
+
+private:
+   const std::string path_;
+   const ARMORY_DB_TYPE dbType_;
+
+   std::shared_ptr<const TxHintSegmentList> segments_;
+   std::vector<unsigned> pendingDeletes_;
+   unsigned nextId_ = 0;
+
+   std::mutex updateMutex_;
+
+private:
+   std::string getSegmentPath(unsigned) const;
+   std::shared_ptr<const TxHintSegmentList> getSegments(void) const;
+   void setSegments(std::shared_ptr<const TxHintSegmentList>);
+   void writeManifest(const TxHintSegmentList&);
+   void purge(void);
+   std::shared_ptr<const TxHintSegment> merge(
+      const TxHintSegmentList&, size_t from);
+
+public:
+   TxHintIndex(const std::string& path, ARMORY_DB_TYPE dbType) :
+      path_(path), dbType_(dbType)
+   {}
+
+   TxHintIndex(const TxHintIndex&) = delete;
+   TxHintIndex& operator=(const TxHintIndex&) = delete;
+
+   //keyExists checks a segment's last key against the db, segments past
+   //the db content are dropped
+   void load(const std::function<bool(BinaryDataRef)>& keyExists);
+
+   //entries are taken over and sorted, keys past indexedTo() only
+   void append(std::vector<TxHintEntry>&,
+      BinaryDataRef firstKey, BinaryDataRef lastKey);
+
+   //drops all segments, for when the TXHINTS db is wiped
+   void clear(void);
+
+   std::vector<BinaryData> find(BinaryDataRef txHash) const;
+   BinaryData indexedTo(void) const;
+
+   size_t segmentCount(void) const;
+   uint64_t entryCount(void) const;
+};
+
+#endif
@@ -8,6 +8,7 @@
 
 #include "TxOutScrRef.h"
 #include "BinaryData.h"
+#include "BtcUtils.h"
 
 using namespace std;
 
@@ -92,6 +93,30 @@ BinaryData TxOutScriptRef::getScrAddr(void) const
    return bw.getData();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TxOutScriptKey TxOutScriptRef::getKey() const
+{
+   TxOutScriptKey key;
+   key.data_[0] = (uint8_t)type_;
+
+   auto len = scriptRef_.getSize();
+   if (len <= TXOUT_SCRIPT_KEY_SIZE - 2)
+   {
+      key.data_[1] = (uint8_t)len;
+      if (len > 0)
+         memcpy(key.data_ + 2, scriptRef_.getPtr(), len);
+   }
+   else
+   {
+      key.data_[1] = 0xFF;
+      BinaryData digest(32);
+      BtcUtils::getSha256(scriptRef_.getPtr(), len, digest);
+      memcpy(key.data_ + 2, digest.getPtr(), 32);
+   }
+
+   return key;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 std::size_t hash<TxOutScriptRef>::operator()(const TxOutScriptRef& key) const
 {
@@ -11,6 +11,12 @@
 
 #include "BinaryData.h"
 #include "BitcoinSettings.h"
+#include "FlatHashMap.h"
+
+//script prefix, ref length then the ref, zero padded. Refs longer than
+//32 bytes (multisig unique keys, op_return payloads) are sha256'd
+#define TXOUT_SCRIPT_KEY_SIZE 34
+typedef FixedKey<TXOUT_SCRIPT_KEY_SIZE> TxOutScriptKey;
 
 struct TxOutScriptRef
 {
@@ -32,6 +38,7 @@ public:
    void setRef(const BinaryDataRef& bd);
 
    BinaryData getScrAddr(void) const;
+   TxOutScriptKey getKey(void) const;
 };
 
 namespace std
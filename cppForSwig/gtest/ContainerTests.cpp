@@ -12,6 +12,9 @@
 #include <gtest/gtest.h>
 
 #include "../ThreadSafeClasses.h"
+#include "../TaskPool.h"
+#include "../FlatHashMap.h"
+#include "../BloomFilter.h"
 
 using namespace std;
 
@@ -696,6 +699,253 @@ TEST_F(ContainerTests, TimedStackTest_Concurrent)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(ContainerTests, TaskPool)
+{
+   TaskPool pool((unsigned)threadCount_);
+   EXPECT_EQ(pool.threadCount(), threadCount_);
+
+   //flat tasks
+   {
+      atomic<uint64_t> tally;
+      tally.store(0, memory_order_relaxed);
+
+      TaskGroup group(&pool);
+      for (unsigned i = 1; i <= 10000; i++)
+      {
+         group.run([&tally, i](void)->void
+         {
+            tally.fetch_add(i, memory_order_relaxed);
+         });
+      }
+      group.wait();
+
+      EXPECT_EQ(tally.load(memory_order_relaxed), 50005000ULL);
+   }
+
+   //nested groups, tasks submitted from within workers
+   {
+      atomic<uint64_t> tally;
+      tally.store(0, memory_order_relaxed);
+
+      TaskGroup outer(&pool);
+      for (unsigned i = 0; i < 64; i++)
+      {
+         outer.run([&pool, &tally](void)->void
+         {
+            TaskGroup inner(&pool);
+            for (unsigned y = 0; y < 64; y++)
+            {
+               inner.run([&tally](void)->void
+               {
+                  tally.fetch_add(1, memory_order_relaxed);
+               });
+            }
+            inner.wait();
+         });
+      }
+      outer.wait();
+
+      EXPECT_EQ(tally.load(memory_order_relaxed), 64ULL * 64ULL);
+   }
+
+   //exceptions carry over to the waiting thread
+   {
+      atomic<unsigned> ran;
+      ran.store(0, memory_order_relaxed);
+
+      TaskGroup group(&pool);
+      for (unsigned i = 0; i < 100; i++)
+      {
+         group.run([&ran, i](void)->void
+         {
+            ran.fetch_add(1, memory_order_relaxed);
+            if (i == 50)
+               throw runtime_error("task error");
+         });
+      }
+
+      EXPECT_THROW(group.wait(), runtime_error);
+      EXPECT_EQ(ran.load(memory_order_relaxed), 100U);
+
+      //error is cleared once thrown
+      group.run([](void)->void {});
+      group.wait();
+   }
+
+   /*
+   Short lived groups on the stack, the way the scanners use them. The
+   group goes out of scope as soon as wait() returns, the worker that ran
+   the last task must be done with it by then.
+   */
+   {
+      atomic<uint64_t> tally;
+      tally.store(0, memory_order_relaxed);
+
+      for (unsigned i = 0; i < 20000; i++)
+      {
+         TaskGroup group(&pool);
+         for (unsigned y = 0; y < 2; y++)
+         {
+            group.run([&tally](void)->void
+            {
+               tally.fetch_add(1, memory_order_relaxed);
+            });
+         }
+         group.wait();
+      }
+
+      EXPECT_EQ(tally.load(memory_order_relaxed), 40000ULL);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(ContainerTests, FlatHashMap)
+{
+   typedef FixedKey<36> KeyType;
+   auto getKey = [](uint64_t val)->KeyType
+   {
+      uint8_t keyData[36];
+      memset(keyData, 0xA5, 36);
+      memcpy(keyData, &val, 8);
+      keyData[35] = (uint8_t)val;
+      return KeyType(keyData);
+   };
+
+   FlatHashMap<KeyType, uint64_t> flatMap;
+   map<uint64_t, uint64_t> refMap;
+   EXPECT_TRUE(flatMap.find(getKey(0)) == flatMap.end());
+
+   //random inserts, erases and lookups checked against std::map
+   srand(0x1234);
+   for (unsigned i = 0; i < 200000; i++)
+   {
+      uint64_t val = rand() % 20000;
+      auto key = getKey(val);
+      switch (rand() % 3)
+      {
+      case 0:
+      {
+         auto result = flatMap.emplace(key, val * 2);
+         auto refResult = refMap.emplace(val, val * 2);
+         ASSERT_EQ(result.second, refResult.second);
+         break;
+      }
+
+      case 1:
+         ASSERT_EQ(flatMap.erase(key), refMap.erase(val));
+         break;
+
+      default:
+      {
+         auto iter = flatMap.find(key);
+         auto refIter = refMap.find(val);
+         ASSERT_EQ(iter == flatMap.end(), refIter == refMap.end());
+         if (refIter != refMap.end())
+         {
+            EXPECT_EQ(iter->second, refIter->second);
+         }
+      }
+      }
+
+      ASSERT_EQ(flatMap.size(), refMap.size());
+   }
+
+   //iteration covers every entry once
+   uint64_t tally = 0, refTally = 0;
+   for (auto& entry : flatMap)
+      tally += entry.second;
+   for (auto& entry : refMap)
+      refTally += entry.second;
+   EXPECT_EQ(tally, refTally);
+
+   //erase while iterating
+   auto iter = flatMap.begin();
+   while (iter != flatMap.end())
+   {
+      if (iter->second % 4 == 0)
+      {
+         refMap.erase(iter->second / 2);
+         iter = flatMap.erase(iter);
+         continue;
+      }
+
+      ++iter;
+   }
+   EXPECT_EQ(flatMap.size(), refMap.size());
+
+   //copy, move, operator[]
+   auto copyMap = flatMap;
+   auto moveMap = move(copyMap);
+   EXPECT_EQ(moveMap.size(), refMap.size());
+   EXPECT_EQ(copyMap.size(), 0ULL);
+
+   moveMap[getKey(1000000)] = 12;
+   EXPECT_EQ(moveMap.find(getKey(1000000))->second, 12ULL);
+   EXPECT_EQ(moveMap.size(), refMap.size() + 1);
+
+   moveMap.clear();
+   EXPECT_TRUE(moveMap.empty());
+   EXPECT_TRUE(moveMap.find(getKey(1000000)) == moveMap.end());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(ContainerTests, BlockedBloomFilter)
+{
+   typedef FixedKey<34> KeyType;
+   auto getKey = [](uint64_t val)->KeyType
+   {
+      uint8_t keyData[34];
+      memset(keyData, 0, 34);
+      keyData[0] = 1;
+      keyData[1] = 20;
+      memcpy(keyData + 2, &val, 8);
+      return KeyType(keyData);
+   };
+
+   const unsigned count = 20000;
+   BlockedBloomFilter<KeyType> filter(count);
+   EXPECT_FALSE(filter.mayContain(getKey(0)));
+
+   for (unsigned i = 0; i < count; i++)
+      filter.insert(getKey(i * 2));
+
+   //no false negatives
+   for (unsigned i = 0; i < count; i++)
+      ASSERT_TRUE(filter.mayContain(getKey(i * 2)));
+
+   //batched probes match single probes
+   vector<KeyType> keys;
+   for (unsigned i = 0; i < 100000; i++)
+      keys.push_back(getKey(i));
+
+   vector<uint8_t> hits(keys.size());
+   filter.mayContain(keys.data(), keys.size(), hits.data());
+
+   unsigned falsePositives = 0;
+   for (unsigned i = 0; i < keys.size(); i++)
+   {
+      ASSERT_EQ(hits[i] == 1, filter.mayContain(keys[i]));
+      if (i % 2 == 0 && i < count * 2)
+         ASSERT_EQ(hits[i], 1);
+      else if (hits[i] == 1)
+         ++falsePositives;
+   }
+
+   //~0.5% at 12 bits per key, leave some slack
+   EXPECT_LT(falsePositives, (keys.size() - count) / 50);
+
+   //views over the serialized words probe the same
+   vector<uint32_t> words(filter.data(),
+      filter.data() + filter.sizeInBytes() / sizeof(uint32_t));
+   BlockedBloomFilter<KeyType> view(words.data(), filter.blockCount());
+   EXPECT_ANY_THROW(view.insert(getKey(1)));
+
+   vector<uint8_t> viewHits(keys.size());
+   view.mayContain(keys.data(), keys.size(), viewHits.data());
+   EXPECT_EQ(viewHits, hits);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 GTEST_API_ int main(int argc, char **argv)
 {
@@ -12,6 +12,8 @@
 ////////////////////////////////////////////////////////////////////////////////
 #include "TestUtils.h"
 #include "hkdf.h"
+#include "../DatabaseBuilder.h"
+#include "../BlockchainScanner.h"
 
 using namespace std;
 using namespace Armory::Signer;
@@ -393,6 +395,157 @@ TEST_F(BlockDir, BlockFileSplitUpdate)
    delete BDMt;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockDir, DiscoverBlockFiles)
+{
+   auto blocksDir = blkdir_ + "/blocks";
+   TestUtils::setBlocks({ "0", "1" }, blk0dat_);
+   TestUtils::setBlocks({ "2", "3", "4" }, 
+      BtcUtils::getBlkFilename(blocksDir, 1));
+
+   //last file ends on a truncated block
+   auto blk2dat = BtcUtils::getBlkFilename(blocksDir, 2);
+   TestUtils::setBlocks({ "5", "5A" }, blk2dat);
+   {
+      auto fileSize = BtcUtils::GetFileSize(blk2dat);
+      BinaryData temp(fileSize);
+      {
+         ifstream is(blk2dat.c_str(), ios::in | ios::binary);
+         is.read((char*)temp.getPtr(), fileSize);
+      }
+
+      ofstream os(blk2dat.c_str(), ios::out | ios::trunc | ios::binary);
+      os.write((char*)temp.getPtr(), fileSize - 20);
+   }
+
+   BlockDataLoader bdl(blocksDir);
+   Armory::Threading::TaskPool pool(3);
+
+   auto&& runs = DatabaseBuilder::discoverBlockFiles(bdl, 0, 4, &pool);
+   ASSERT_EQ(runs.size(), 3U);
+   EXPECT_EQ(runs[0].blocks_.size(), 2U);
+   EXPECT_EQ(runs[1].blocks_.size(), 3U);
+   EXPECT_EQ(runs[2].blocks_.size(), 1U);
+
+   //runs come back in file order, blocks in file order and chained
+   BinaryData prevHash;
+   for (unsigned i = 0; i < runs.size(); i++)
+   {
+      auto& run = runs[i];
+      EXPECT_EQ(run.fileID_, i);
+
+      //each block sits past the magic bytes and size of the one before
+      size_t offset = 0;
+      for (auto& block : run.blocks_)
+      {
+         offset += 8;
+         EXPECT_EQ(block.offset_, offset);
+         offset += block.size_;
+
+         if (prevHash.getSize() > 0)
+         {
+            EXPECT_EQ(block.getPrevHash(), prevHash);
+         }
+         prevHash = block.hash_;
+      }
+
+      //complete files are fully accounted for
+      if (i < 2)
+      {
+         EXPECT_EQ(offset, 
+            BtcUtils::GetFileSize(BtcUtils::getBlkFilename(blocksDir, i)));
+      }
+   }
+
+   //same result for a single file, and past the last file
+   auto&& run1 = DatabaseBuilder::discoverBlockFile(bdl, 1);
+   ASSERT_EQ(run1.blocks_.size(), 3U);
+   for (unsigned i = 0; i < 3; i++)
+   {
+      EXPECT_EQ(run1.blocks_[i].offset_, runs[1].blocks_[i].offset_);
+      EXPECT_EQ(run1.blocks_[i].hash_, runs[1].blocks_[i].hash_);
+   }
+
+   auto&& tail = DatabaseBuilder::discoverBlockFiles(bdl, 2, 4, &pool);
+   ASSERT_EQ(tail.size(), 1U);
+   EXPECT_EQ(tail[0].fileID_, 2U);
+   EXPECT_TRUE(DatabaseBuilder::discoverBlockFiles(bdl, 4, 4, &pool).empty());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockDir, StreamWindow)
+{
+   auto blocksDir = blkdir_ + "/blocks";
+   TestUtils::setBlocks({ "0", "1" }, blk0dat_);
+   TestUtils::setBlocks({ "2", "3" }, BtcUtils::getBlkFilename(blocksDir, 1));
+   TestUtils::setBlocks({ "4", "5" }, BtcUtils::getBlkFilename(blocksDir, 2));
+
+   BlockDataLoader bdl(blocksDir, 2);
+   ASSERT_TRUE(bdl.isStreaming());
+   auto window = bdl.streamWindow();
+
+   auto map0 = bdl.get(0);
+   auto map1 = bdl.get(1);
+   ASSERT_NE(map0->getPtr(), nullptr);
+   EXPECT_EQ(BinaryDataRef(map0->getPtr(), 4), 
+      BitcoinSettings::getMagicBytes());
+   EXPECT_EQ(window->residentCount(), 2U);
+   EXPECT_EQ(window->waitCount(), 0U);
+
+   //full window, no room for a third file
+   map<unsigned, shared_ptr<BlockDataFileMap>> tryMaps;
+   EXPECT_FALSE(bdl.tryGet({ 2 }, tryMaps));
+   EXPECT_TRUE(tryMaps.empty());
+   EXPECT_EQ(window->residentCount(), 2U);
+
+   //blocks until a live map is let go of, live maps are never evicted
+   promise<shared_ptr<BlockDataFileMap>> map2Prom;
+   auto map2Fut = map2Prom.get_future();
+   thread getThr([&bdl, &map2Prom](void)->void
+   {
+      map2Prom.set_value(bdl.get(2));
+   });
+
+   EXPECT_EQ(map2Fut.wait_for(chrono::milliseconds(200)), 
+      future_status::timeout);
+   EXPECT_EQ(window->evictionCount(), 0U);
+   EXPECT_EQ(BinaryDataRef(map1->getPtr(), 4), 
+      BitcoinSettings::getMagicBytes());
+
+   map0.reset();
+   auto map2 = map2Fut.get();
+   getThr.join();
+
+   ASSERT_NE(map2->getPtr(), nullptr);
+   EXPECT_EQ(window->evictionCount(), 1U);
+   EXPECT_EQ(window->waitCount(), 1U);
+   EXPECT_EQ(window->residentCount(), 2U);
+   EXPECT_EQ(window->peakCount(), 2U);
+
+   //a group overshooting the window goes through once the window holds 
+   //nothing but the caller's own maps
+   map2.reset();
+   auto group = bdl.get({ 0, 2 }, 1);
+   EXPECT_EQ(group.size(), 2U);
+   EXPECT_EQ(window->residentCount(), 3U);
+   EXPECT_EQ(window->peakCount(), 3U);
+   EXPECT_EQ(window->waitCount(), 1U);
+   EXPECT_EQ(window->evictionCount(), 2U);
+
+   map1.reset();
+   group.clear();
+   EXPECT_EQ(window->residentCount(), 0U);
+   EXPECT_EQ(window->evictionCount(), 5U);
+
+   //missing files take a slot all the same
+   {
+      auto map9 = bdl.get(9);
+      EXPECT_EQ(map9->getPtr(), nullptr);
+      EXPECT_EQ(window->residentCount(), 1U);
+   }
+   EXPECT_EQ(window->residentCount(), 0U);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -725,6 +878,196 @@ TEST_F(BlockUtilsFull, Load4Blocks_Plus2)
    wltLB2.reset();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsFull, Load4Blocks_Plus2_ReadBeforeScan)
+{
+   TestUtils::setBlocks({ "0", "1", "2", "3" }, blk0dat_);
+
+   theBDMt_->start(DBSettings::initMode());
+   auto&& bdvID = DBTestUtils::registerBDV(clients_, BitcoinSettings::getMagicBytes());
+
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   DBTestUtils::registerWallet(clients_, bdvID, scrAddrVec, "wallet1");
+
+   auto bdvPtr = DBTestUtils::getBDV(clients_, bdvID);
+
+   //wait on signals
+   DBTestUtils::goOnline(clients_, bdvID);
+   DBTestUtils::waitOnBDMReady(clients_, bdvID);
+   auto wlt = bdvPtr->getWalletOrLockbox(wallet1id);
+   EXPECT_EQ(wlt->getFullBalance(), 175*COIN);
+
+   //hold the bdv back so the new blocks land in the db before it scans
+   DBTestUtils::holdNotifications(clients_, bdvID, true);
+   TestUtils::setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+   DBTestUtils::triggerNewBlockNotification(theBDMt_);
+
+   //client balance requests in the meantime refresh the address summaries
+   uint64_t total = 0;
+   for (unsigned i = 0; i < 100; i++)
+   {
+      //update id -1 gets all addresses every time
+      auto&& balances = wlt->getAddrBalances(-1, 5);
+
+      total = 0;
+      for (auto& balance : balances)
+         total += get<0>(balance.second);
+
+      if (total == 240*COIN)
+         break;
+
+      this_thread::sleep_for(chrono::milliseconds(100));
+   }
+   EXPECT_EQ(total, 240*COIN);
+
+   //the wallet carries its own deltas, these reads don't hide the change
+   DBTestUtils::holdNotifications(clients_, bdvID, false);
+   DBTestUtils::waitOnNewBlockSignal(clients_, bdvID);
+
+   EXPECT_EQ(wlt->getFullBalance(), 240*COIN);
+   auto scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
+
+   //cleanup
+   bdvPtr.reset();
+   wlt.reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsFull, Load3Blocks_Plus3_UtxoSnapshot)
+{
+   TestUtils::setBlocks({ "0", "1", "2" }, blk0dat_);
+
+   theBDMt_->start(DBSettings::initMode());
+   auto&& bdvID = DBTestUtils::registerBDV(clients_, BitcoinSettings::getMagicBytes());
+
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+
+   DBTestUtils::registerWallet(clients_, bdvID, scrAddrVec, "wallet1");
+   auto bdvPtr = DBTestUtils::getBDV(clients_, bdvID);
+
+   //wait on signals
+   DBTestUtils::goOnline(clients_, bdvID);
+   DBTestUtils::waitOnBDMReady(clients_, bdvID);
+   auto wlt = bdvPtr->getWalletOrLockbox(wallet1id);
+
+   auto filter = theBDMt_->bdm()->getScrAddrFilter();
+   auto filterKey = filter->sdbiKey();
+
+   //unspent txouts as the scanner pulls them without a checkpoint
+   auto getStxoWalk = [this](void)->set<BinaryData>
+   {
+      set<BinaryData> keys;
+      auto&& tx = iface_->beginTransaction(STXO, LMDB::ReadOnly);
+      auto dbIter = iface_->getIterator(STXO);
+      dbIter->seekToFirst();
+      if (!dbIter->advanceAndRead())
+         return keys;
+
+      do
+      {
+         StoredTxOut stxo;
+         stxo.unserializeDBKey(dbIter->getKeyRef());
+         stxo.unserializeDBValue(dbIter->getValueRef());
+         if (stxo.spentness_ != TXOUT_SPENT)
+            keys.insert(stxo.getDBKey(false));
+      } while (dbIter->advanceAndRead());
+
+      return keys;
+   };
+
+   auto getSnapshot = [this, filterKey](uint32_t height)->StoredUtxoSnapshot
+   {
+      StoredUtxoSnapshot snapshot;
+      auto&& tx = iface_->beginTransaction(UTXOSNAP, LMDB::ReadOnly);
+      EXPECT_TRUE(iface_->getUtxoSnapshot(snapshot, filterKey, height));
+      return snapshot;
+   };
+
+   auto getSnapshotKeys = [](const StoredUtxoSnapshot& snapshot)
+   {
+      set<BinaryData> keys;
+      for (auto& utxo : snapshot.utxos_)
+         keys.insert(utxo.first);
+      return keys;
+   };
+
+   //the initial scan crosses the checkpoint interval at #2
+   auto snapshot = getSnapshot(2);
+   EXPECT_EQ(snapshot.blockHash_, TestChain::blkHash2);
+   EXPECT_EQ(snapshot.addrMerkle_, filter->getAddressMapMerkle());
+   EXPECT_FALSE(snapshot.utxos_.empty());
+   EXPECT_EQ(getSnapshotKeys(snapshot), getStxoWalk());
+
+   //checkpoints for another address set, these can't be resumed from and 
+   //only count towards the pruning depth
+   {
+      auto&& tx = iface_->beginTransaction(UTXOSNAP, LMDB::ReadWrite);
+      for (auto height : { 0U, 1U, 4U })
+      {
+         StoredUtxoSnapshot staleSnapshot;
+         staleSnapshot.filterKey_ = filterKey;
+         staleSnapshot.height_ = height;
+         staleSnapshot.blockHash_ = BtcUtils::EmptyHash();
+         staleSnapshot.addrMerkle_ = BtcUtils::EmptyHash();
+         iface_->putUtxoSnapshot(staleSnapshot);
+      }
+   }
+
+   //the next scan resumes from the checkpoint at #2
+   TestUtils::setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+   DBTestUtils::triggerNewBlockNotification(theBDMt_);
+   DBTestUtils::waitOnNewBlockSignal(clients_, bdvID);
+
+   EXPECT_EQ(DBTestUtils::getTopBlockHeight(iface_, HEADERS), 5U);
+
+   //balances have to match a scan that walked the full STXO db
+   const ScrAddrObj* scrObj;
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70 * COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20 * COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 65 * COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
+
+   //so does the utxo set it checkpointed at the new top
+   snapshot = getSnapshot(5);
+   EXPECT_EQ(snapshot.blockHash_, TestChain::blkHash5);
+   EXPECT_EQ(getSnapshotKeys(snapshot), getStxoWalk());
+
+   //only the most recent checkpoints are kept
+   {
+      auto&& tx = iface_->beginTransaction(UTXOSNAP, LMDB::ReadOnly);
+      auto&& heights = iface_->getUtxoSnapshotHeights(filterKey);
+      ASSERT_EQ(heights.size(), UTXO_SNAPSHOT_DEPTH);
+      EXPECT_EQ(heights, vector<uint32_t>({ 1, 2, 4, 5 }));
+   }
+
+   //cleanup
+   bdvPtr.reset();
+   wlt.reset();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(BlockUtilsFull, Load5Blocks_FullReorg)
 {
@@ -1027,6 +1370,78 @@ TEST_F(BlockUtilsFull, Load5Blocks_ReloadBDM_Reorg)
    EXPECT_EQ(wltLB2->getFullBalance(), 10 * COIN);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsFull, Load5Blocks_ReloadBDM_BlockIndex)
+{
+   theBDMt_->start(DBSettings::initMode());
+   auto&& bdvID = DBTestUtils::registerBDV(clients_, BitcoinSettings::getMagicBytes());
+
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   DBTestUtils::registerWallet(clients_, bdvID, scrAddrVec, "wallet1");
+
+   auto bdvPtr = DBTestUtils::getBDV(clients_, bdvID);
+
+   //wait on signals
+   DBTestUtils::goOnline(clients_, bdvID);
+   DBTestUtils::waitOnBDMReady(clients_, bdvID);
+
+   auto topHash = theBDMt_->bdm()->blockchain()->top()->getThisHash();
+   auto headerCount = theBDMt_->bdm()->blockchain()->allHeaders()->size();
+
+   //fresh db, headers came from the full scan and filled the index
+   EXPECT_FALSE(theBDMt_->bdm()->loadedHeadersFromIndex());
+   auto indexPath = ldbdir_ + "/" + BLOCKINDEX_FILENAME;
+   EXPECT_TRUE(DBUtils::fileExists(indexPath, 2));
+
+   //shutdown bdm
+   bdvPtr.reset();
+   clients_->exitRequestLoop();
+   clients_->shutdown();
+
+   delete clients_;
+   delete theBDMt_;
+
+   //restart bdm, headers are loaded from the index this time
+   initBDM();
+
+   theBDMt_->start(DBSettings::initMode());
+   bdvID = DBTestUtils::registerBDV(clients_, BitcoinSettings::getMagicBytes());
+   DBTestUtils::registerWallet(clients_, bdvID, scrAddrVec, "wallet1");
+   bdvPtr = DBTestUtils::getBDV(clients_, bdvID);
+
+   DBTestUtils::goOnline(clients_, bdvID);
+   DBTestUtils::waitOnBDMReady(clients_, bdvID);
+   auto wlt = bdvPtr->getWalletOrLockbox(wallet1id);
+
+   //no fallback to readAllHeaders
+   EXPECT_TRUE(theBDMt_->bdm()->loadedHeadersFromIndex());
+
+   auto blockchain = theBDMt_->bdm()->blockchain();
+   EXPECT_EQ(blockchain->top()->getBlockHeight(), 5U);
+   EXPECT_EQ(blockchain->top()->getThisHash(), topHash);
+   EXPECT_EQ(blockchain->allHeaders()->size(), headerCount);
+
+   //main branch has to be linked all the way from genesis
+   auto header = blockchain->getGenesisBlock();
+   for (unsigned i = 0; i < 5; i++)
+   {
+      EXPECT_TRUE(header->isMainBranch());
+      header = blockchain->getHeaderByHash(header->getNextHash());
+      EXPECT_EQ(header->getBlockHeight(), i + 1);
+   }
+
+   const ScrAddrObj* scrObj;
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70 * COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20 * COIN);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(BlockUtilsFull, CorruptedBlock)
 {
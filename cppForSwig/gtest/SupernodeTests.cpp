@@ -12,6 +12,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "TestUtils.h"
+#include "../BlockchainScanner_Super.h"
 using namespace std;
 using namespace Armory::Signer;
 using namespace Armory::Config;
@@ -218,6 +219,129 @@ TEST_F(DISABLED_PartialMerkleTest, EmptyTree)
 
 }
 
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+class BatchSizeControllerTest : public ::testing::Test
+{
+protected:
+   static const size_t MB = 1024 * 1024;
+
+   BatchTimings getTimings(size_t blockBytes, double parseTime,
+      double writeTime, double parserWait = 0, double writerWait = 0,
+      size_t serializedBytes = 0)
+   {
+      BatchTimings timings;
+      timings.blockBytes_ = blockBytes;
+      timings.serializedBytes_ = serializedBytes;
+      timings.parseTime_ = parseTime;
+      timings.writeTime_ = writeTime;
+      timings.parserWait_ = parserWait;
+      timings.writerWait_ = writerWait;
+      return timings;
+   }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BatchSizeControllerTest, StepAndClamps)
+{
+   //160MB/s aims at 1.6GB batches, the size doubles at most per batch up
+   //to the max
+   BatchSizeController sizer(1024 * MB, 16 * MB, 8 * MB, 256 * MB, 4);
+   EXPECT_EQ(sizer.targetSize(), 16 * MB);
+
+   for (auto expected : { 32, 64, 128, 256, 256 })
+   {
+      sizer.update(getTimings(16 * MB, 0.1, 0.05));
+      EXPECT_EQ(sizer.targetSize(), expected * MB);
+   }
+
+   //empty or untimed batches don't count
+   sizer.update(getTimings(0, 0.1, 0.1));
+   sizer.update(getTimings(16 * MB, 0, 0.1));
+   EXPECT_EQ(sizer.targetSize(), 256 * MB);
+   EXPECT_EQ(sizer.queueDepth(), 1U);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BatchSizeControllerTest, WriteBound)
+{
+   /*
+   Parsing runs at 64MB/s but the writer only clears 1MB/s. The size goes
+   by the writer: 10MB per batch, reached by halving at most per batch and
+   held at the min past that.
+   */
+   BatchSizeController sizer(1024 * MB, 64 * MB, 16 * MB, 256 * MB, 4);
+
+   for (auto expected : { 32, 16, 16 })
+   {
+      sizer.update(getTimings(64 * MB, 1, 64));
+      EXPECT_EQ(sizer.targetSize(), expected * MB);
+   }
+
+   //same batches with a fast writer grow again
+   BatchSizeController fastWriter(1024 * MB, 64 * MB, 16 * MB, 256 * MB, 4);
+   fastWriter.update(getTimings(64 * MB, 1, 0.5));
+   EXPECT_EQ(fastWriter.targetSize(), 128 * MB);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BatchSizeControllerTest, RamCap)
+{
+   //serialized data as large as the block data triples the footprint, the
+   //parsed batch and the queued one share 64MB
+   BatchSizeController sizer(64 * MB, 16 * MB, 1 * MB, 256 * MB, 4);
+   sizer.update(getTimings(16 * MB, 0.1, 0.1, 0, 0, 16 * MB));
+
+   auto ramCap = (size_t)(64.0 * MB / 6.0);
+   EXPECT_EQ(sizer.targetSize(), ramCap);
+
+   //the min wins over the cap
+   BatchSizeController floored(64 * MB, 16 * MB, 12 * MB, 256 * MB, 4);
+   floored.update(getTimings(16 * MB, 0.1, 0.1, 0, 0, 16 * MB));
+   EXPECT_EQ(floored.targetSize(), 12 * MB);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BatchSizeControllerTest, QueueDepth)
+{
+   //size pinned to 16MB, only the depth moves
+   BatchSizeController sizer(1024 * MB, 16 * MB, 16 * MB, 16 * MB, 3);
+   EXPECT_EQ(sizer.queueDepth(), 1U);
+
+   //both stages waiting on each other deepen the queue, up to the max
+   for (auto expected : { 2U, 3U, 3U })
+   {
+      sizer.update(getTimings(16 * MB, 1, 0.5, 0.5, 0.5));
+      EXPECT_EQ(sizer.queueDepth(), expected);
+   }
+
+   //waits under 1/20th of the slower stage are noise
+   sizer.update(getTimings(16 * MB, 1, 2, 0.09, 0));
+   EXPECT_EQ(sizer.queueDepth(), 3U);
+
+   //a single stage waiting brings it back down
+   for (auto expected : { 2U, 1U, 1U })
+   {
+      sizer.update(getTimings(16 * MB, 1, 0.5, 0.5, 0));
+      EXPECT_EQ(sizer.queueDepth(), expected);
+   }
+
+   sizer.update(getTimings(16 * MB, 1, 0.5, 0.5, 0.5));
+   sizer.update(getTimings(16 * MB, 1, 0.5, 0, 0.5));
+   EXPECT_EQ(sizer.queueDepth(), 1U);
+   EXPECT_EQ(sizer.targetSize(), 16 * MB);
+
+   //a deeper queue has to fit the ram budget: 48MB holds 3 batches of 16MB
+   //but not 4
+   BatchSizeController capped(48 * MB, 16 * MB, 16 * MB, 16 * MB, 4);
+   for (auto expected : { 2U, 2U })
+   {
+      capped.update(getTimings(16 * MB, 1, 0.5, 0.5, 0.5));
+      EXPECT_EQ(capped.queueDepth(), expected);
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -227,19 +351,21 @@ protected:
    BlockDataManagerThread *theBDMt_;
    Clients* clients_;
 
-   void initBDM(void)
+   void initBDM(const vector<string>& extraArgs = {})
    {
       DBTestUtils::init();
 
       Armory::Config::reset();
       DBSettings::setServiceType(SERVICE_UNITTEST);
-      Armory::Config::parseArgs({
+
+      vector<string> args {
          "--datadir=./fakehomedir",
          "--dbdir=./ldbtestdir",
          "--satoshi-datadir=./blkfiletest",
          "--db-type=DB_SUPER",
-         "--thread-count=3"},
-         Armory::Config::ProcessType::DB);
+         "--thread-count=3"};
+      args.insert(args.end(), extraArgs.begin(), extraArgs.end());
+      Armory::Config::parseArgs(args, Armory::Config::ProcessType::DB);
 
       theBDMt_ = new BlockDataManagerThread();
       iface_ = theBDMt_->bdm()->getIFace();
@@ -909,6 +1035,126 @@ TEST_F(BlockUtilsSuper, Load5Blocks_RescanSSH)
    EXPECT_EQ(ssh.totalTxioCount_, 2U);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsSuper, Load5Blocks_BuildBudget)
+{
+   auto dumpDbs = [this](void)->map<DB_SELECT, map<BinaryData, BinaryData>>
+   {
+      map<DB_SELECT, map<BinaryData, BinaryData>> result;
+      for (auto db : { SUBSSH, SUBSSH_META, SPENTNESS, SSH })
+      {
+         auto& dbMap = result[db];
+         auto&& tx = iface_->beginTransaction(db, LMDB::ReadOnly);
+         auto dbIter = iface_->getIterator(db);
+         if (!dbIter->seekToFirst())
+            continue;
+
+         do
+         {
+            dbMap.emplace(dbIter->getKeyRef(), dbIter->getValueRef());
+         } while (dbIter->advanceAndRead());
+      }
+
+      return result;
+   };
+
+   auto shutdownBDM = [this](void)->void
+   {
+      clients_->exitRequestLoop();
+      clients_->shutdown();
+
+      delete clients_;
+      delete theBDMt_;
+
+      clients_ = nullptr;
+      theBDMt_ = nullptr;
+   };
+
+   //uninterrupted build to compare against
+   theBDMt_->start(DBSettings::initMode());
+   auto&& bdvID = DBTestUtils::registerBDV(clients_, BitcoinSettings::getMagicBytes());
+   DBTestUtils::goOnline(clients_, bdvID);
+   DBTestUtils::waitOnBDMReady(clients_, bdvID);
+   auto&& fullBuild = dumpDbs();
+   shutdownBDM();
+
+   DBUtils::removeDirectory(ldbdir_);
+   mkdir(ldbdir_);
+
+   /*
+   Rebuild with the budget spent before each run starts scanning. Every run
+   commits a single step of the phase it is at, then stops at the checkpoint
+   after it. The spentness checkpoint has to go down and the ssh one up from
+   one run to the next, a phase that restarts from scratch never gets done.
+   */
+   unsigned runs = 0;
+   unsigned spentnessLow = UINT32_MAX;
+   BinaryData sshLastKey;
+   unsigned spentnessResumes = 0;
+   unsigned sshResumes = 0;
+
+   while (true)
+   {
+      ASSERT_LT(runs, 100U);
+
+      initBDM({ "--build-budget=1" });
+      theBDMt_->start(DBSettings::initMode());
+      theBDMt_->join();
+      ++runs;
+
+      if (!theBDMt_->buildPaused())
+         break;
+
+      StoredBuildCheckpoint checkpoint;
+      if (iface_->getBuildCheckpoint(checkpoint, BUILD_CHECKPOINT_SPENTNESS))
+      {
+         EXPECT_EQ(checkpoint.topHeight_, 5U);
+         if (spentnessLow != UINT32_MAX)
+         {
+            EXPECT_LT(checkpoint.lowHeight_, spentnessLow);
+            ++spentnessResumes;
+         }
+
+         spentnessLow = checkpoint.lowHeight_;
+      }
+
+      if (iface_->getBuildCheckpoint(checkpoint, BUILD_CHECKPOINT_SSH))
+      {
+         ASSERT_NE(checkpoint.lastKey_.getSize(), 0U);
+         if (sshLastKey.getSize() != 0)
+         {
+            EXPECT_TRUE(sshLastKey < checkpoint.lastKey_);
+            ++sshResumes;
+         }
+
+         sshLastKey = checkpoint.lastKey_;
+      }
+
+      shutdownBDM();
+   }
+
+   EXPECT_GT(spentnessResumes, 0U);
+   EXPECT_GT(sshResumes, 0U);
+
+   //the last run is done with the build, its checkpoints are gone
+   StoredBuildCheckpoint checkpoint;
+   EXPECT_FALSE(
+      iface_->getBuildCheckpoint(checkpoint, BUILD_CHECKPOINT_SPENTNESS));
+   EXPECT_FALSE(iface_->getBuildCheckpoint(checkpoint, BUILD_CHECKPOINT_SSH));
+
+   auto&& ssh_sdbi = iface_->getStoredDBInfo(SSH, 0);
+   EXPECT_EQ(ssh_sdbi.topBlkHgt_, 5U);
+
+   auto&& resumedBuild = dumpDbs();
+   for (auto& dbPair : fullBuild)
+   {
+      auto& resumedMap = resumedBuild[dbPair.first];
+      EXPECT_EQ(resumedMap.size(), dbPair.second.size());
+      EXPECT_TRUE(resumedMap == dbPair.second) << 
+         "db " << DatabaseContainer::getDbName(dbPair.first);
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(BlockUtilsSuper, Load3BlocksPlus3)
 {
@@ -236,6 +236,32 @@ namespace DBTestUtils
       return clients->get(id);
    }
 
+   /////////////////////////////////////////////////////////////////////////////
+   void holdNotifications(Clients* clients, const string& bdvId, bool hold)
+   {
+      /*
+      Takes the bdv notification lock the maintenance threads use, the bdv
+      won't process new blocks or zc until it is released. Waits on a
+      notification being processed, if any.
+      */
+      auto bdvPtr = clients->get(bdvId);
+      if (!hold)
+      {
+         bdvPtr->notificationProcess_threadLock_.store(0);
+         return;
+      }
+
+      while (true)
+      {
+         unsigned zero = 0;
+         if (bdvPtr->notificationProcess_threadLock_.compare_exchange_weak(
+            zero, 1))
+            break;
+
+         this_thread::sleep_for(chrono::milliseconds(10));
+      }
+   }
+
    /////////////////////////////////////////////////////////////////////////////
    void registerWallet(Clients* clients, const string& bdvId,
       const vector<BinaryData>& scrAddrs, const string& wltName)
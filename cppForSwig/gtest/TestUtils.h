@@ -146,6 +146,8 @@ namespace DBTestUtils
       waitOnNewZcSignal(Clients* clients, const std::string& bdvId);
    void waitOnWalletRefresh(Clients* clients, const std::string& bdvId,
       const BinaryData& wltId);
+   void holdNotifications(Clients* clients, const std::string& bdvId,
+      bool hold);
    void triggerNewBlockNotification(BlockDataManagerThread* bdmt);
    void mineNewBlock(BlockDataManagerThread* bdmt, const BinaryData& h160,
       unsigned count);
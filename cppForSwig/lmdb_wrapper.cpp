@@ -12,7 +12,10 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <iostream>
+#include <fstream>
 #include <sstream>
+#include <thread>
+#include <chrono>
 #include <map>
 #include <list>
 #include <vector>
@@ -37,19 +40,24 @@
 using namespace std;
 using namespace Armory::Config;
 
-const set<DB_SELECT> LMDBBlockDatabase::supernodeDBs_({});
-const map<string, size_t> LMDBBlockDatabase::mapSizes_ = {
-   {"headers", 4 * 1024 * 1024 * 1024ULL},
+//the put heavy supernode dbs, split across envs with --db-shards
+const set<DB_SELECT> LMDBBlockDatabase::shardedDBs_({ SSH, SUBSSH, SPENTNESS });
+
+//free space kept ahead of the writes in each map, has to cover the largest 
+//write txn the db sees
+const map<string, size_t> LMDBBlockDatabase::mapHeadroom_ = {
+   {"headers", 256 * 1024 * 1024ULL},
    {"blkdata", 1024 * 1024ULL},
    {"history", 1024 * 1024ULL},
-   {"txhints", 20 * 1024 * 1024 * 1024ULL},
-   {"ssh",   500 * 1024 * 1024 * 1024ULL},
-   {"subssh", 2000 * 1024 * 1024 * 1024ULL},
-   {"subssh_meta", 100 * 1024 * 1024ULL},
-   {"stxo", 2000 * 1024 * 1024 * 1024ULL},
-   {"zeroconf", 10 * 1024 * 1024 * 1024ULL},
-   {"txfilters", 10 * 1024 * 1024 * 1024ULL},
-   {"spentness", 500 * 1024 * 1024 * 1024ULL},
+   {"txhints", 1024 * 1024 * 1024ULL},
+   {"ssh",   1024 * 1024 * 1024ULL},
+   {"subssh", 4 * 1024 * 1024 * 1024ULL},
+   {"subssh_meta", 16 * 1024 * 1024ULL},
+   {"stxo", 4 * 1024 * 1024 * 1024ULL},
+   {"zeroconf", 256 * 1024 * 1024ULL},
+   {"txfilters", 256 * 1024 * 1024ULL},
+   {"spentness", 2 * 1024 * 1024 * 1024ULL},
+   {"utxosnap", 256 * 1024 * 1024ULL},
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -366,7 +374,9 @@ bool LDBIter_Single::seekToLast(void)
 LMDBBlockDatabase::LMDBBlockDatabase(
    shared_ptr<Blockchain> bcPtr, const string& blkFolder) :
    blockchainPtr_(bcPtr), blkFolder_(blkFolder)
-{}
+{
+   commitStage_ = make_unique<DBCommitStage>(this);
+}
 
 /////////////////////////////////////////////////////////////////////////////
 LMDBBlockDatabase::~LMDBBlockDatabase(void)
@@ -406,14 +416,18 @@ void LMDBBlockDatabase::openDatabases(
       auto iter = dbMap_.find(CURRDB);
       if (iter == dbMap_.end())
       {
-         if (getDbType() == ARMORY_DB_SUPER)
+         if (getDbType() == ARMORY_DB_SUPER &&
+            shardedDBs_.find(CURRDB) != shardedDBs_.end())
          {
-            if (supernodeDBs_.find(CURRDB) != supernodeDBs_.end())
-               continue;
+            dbMap_.insert(make_pair(CURRDB, 
+               make_shared<DatabaseContainer_Sharded>(CURRDB, 
+                  getShardFilter(CURRDB), DBSettings::dbShardCount())));
+         }
+         else
+         {
+            dbMap_.insert(make_pair(
+               CURRDB, make_shared<DatabaseContainer_Single>(CURRDB)));
          }
-            
-         dbMap_.insert(make_pair(
-            CURRDB, make_shared<DatabaseContainer_Single>(CURRDB)));
       }
 
       StoredDBInfo sdbi = openDB(CURRDB);
@@ -432,6 +446,16 @@ void LMDBBlockDatabase::openDatabases(
             exit(-2);
          }
       }
+
+      if (CURRDB == SUBSSH)
+         subsshFormat_ = sdbi.subsshFormat_;
+
+      auto shardCount = getShardCount(CURRDB);
+      if (shardCount > 1)
+      {
+         LOGINFO << DatabaseContainer::getDbName(CURRDB) << ": " <<
+            shardCount << " shards";
+      }
    }
 
    if (getDbType() == ARMORY_DB_SUPER)
@@ -455,12 +479,47 @@ void LMDBBlockDatabase::openDatabases(
       }
    }
 
+   //the db process rewrites the index files as it goes, replicas look up
+   //TXHINTS/STXO directly
+   if (!DBSettings::isReplica())
+   {
+      txHintPending_.clear();
+      txHintPendingTo_.clear();
+
+      try
+      {
+         txHintIndex_ = make_unique<TxHintIndex>(
+            DatabaseContainer::getDbPath(TXHINTINDEX_FILENAME), getDbType());
+         txHintIndex_->load([this](BinaryDataRef dbKey)->bool
+         {
+            return txHintKeyExists(dbKey);
+         });
+      }
+      catch (exception& e)
+      {
+         //lookups fall back to the TXHINTS db
+         LOGWARN << "failed to load tx hint index: " << e.what();
+         txHintIndex_.reset();
+      }
+   }
+
    dbIsOpen_ = true;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void LMDBBlockDatabase::closeDatabases(void)
 {
+   //land pending batches before the envs go away
+   try
+   {
+      commitStage_->flushAll();
+   }
+   catch (exception& e)
+   {
+      LOGERR << "failed to commit pending batches: " << e.what();
+   }
+
+   txHintIndex_.reset();
    for (auto& dbPair : dbMap_)
       dbPair.second->close();
    dbMap_.clear();
@@ -502,6 +561,7 @@ void LMDBBlockDatabase::replaceDatabases(
 /////////////////////////////////////////////////////////////////////////////
 void LMDBBlockDatabase::cycleDatabase(DB_SELECT db)
 {
+   commitStage_->flush(db);
    auto dbPtr = getDbPtr(db);
    dbPtr->close();
    dbPtr->open();
@@ -514,14 +574,29 @@ void LMDBBlockDatabase::resetHistoryDatabases(void)
    {
       resetSSHdb();
 
+      //the tx hint index is built from TXHINTS, it goes with it
+      try
+      {
+         if (txHintIndex_ != nullptr)
+            txHintIndex_->clear();
+      }
+      catch (exception& e)
+      {
+         //without a manifest the index starts over empty on load
+         LOGWARN << "failed to clear tx hint index: " << e.what();
+         remove(DatabaseContainer::getDbPath(TXHINTINDEX_FILENAME).c_str());
+      }
+
       auto db_subssh = getDbPtr(SUBSSH);
       auto db_hints = getDbPtr(TXHINTS);
       auto db_stxo = getDbPtr(STXO);
+      auto db_utxosnap = getDbPtr(UTXOSNAP);
       closeDatabases();
 
       db_subssh->eraseOnDisk();
       db_hints->eraseOnDisk();
       db_stxo->eraseOnDisk();
+      db_utxosnap->eraseOnDisk();
    }
    else
    {
@@ -572,6 +647,14 @@ BinaryDataRef LMDBBlockDatabase::getValueNoCopy(DB_SELECT db,
    return dbPtr->getValue(key);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+vector<BinaryDataRef> LMDBBlockDatabase::multiGet(DB_SELECT db,
+   const vector<BinaryDataRef>& keys) const
+{
+   auto dbPtr = getDbPtr(db);
+   return dbPtr->multiGet(keys);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Get value using BinaryDataRef object.  The data from the get* call is 
 // actually copied to a member variable, and thus the refs are valid only 
@@ -678,11 +761,67 @@ BinaryData LMDBBlockDatabase::getDBKeyForHash(const BinaryData& txhash,
       return BinaryData();
    }
 
+   auto&& indexKey = getDBKeyFromIndex(txhash, expectedDupId);
+   if (!indexKey.empty())
+      return indexKey;
+
    BinaryData hash4(txhash.getSliceRef(0, 4));
 
    auto&& txHints = beginTransaction(TXHINTS, LMDB::ReadOnly);
    BinaryRefReader brrHints = getValueRef(TXHINTS, DB_PREFIX_TXHINTS, hash4);
+   return getDBKeyFromHints(txhash, brrHints, expectedDupId);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+vector<BinaryData> LMDBBlockDatabase::getDBKeysForHashes(
+   const vector<BinaryDataRef>& txhashes) const
+{
+   vector<BinaryData> result(txhashes.size());
+   auto&& txHints = beginTransaction(TXHINTS, LMDB::ReadOnly);
+
+   //hint keys are the hash prefix, grab the ones the index missed in one walk
+   vector<unsigned> misses;
+   vector<BinaryData> hintKeys;
+   for (unsigned i = 0; i < txhashes.size(); i++)
+   {
+      auto& txhash = txhashes[i];
+      if (txhash.getSize() < 4)
+      {
+         LOGWARN << "txhash is less than 4 bytes long";
+         continue;
+      }
+
+      result[i] = getDBKeyFromIndex(txhash, UINT8_MAX);
+      if (!result[i].empty())
+         continue;
+
+      BinaryWriter bw(5);
+      bw.put_uint8_t((uint8_t)DB_PREFIX_TXHINTS);
+      bw.put_BinaryDataRef(txhash.getSliceRef(0, 4));
+      hintKeys.emplace_back(bw.getData());
+      misses.push_back(i);
+   }
+
+   if (misses.empty())
+      return result;
+
+   vector<BinaryDataRef> hintKeyRefs(hintKeys.begin(), hintKeys.end());
+   auto&& hintVals = multiGet(TXHINTS, hintKeyRefs);
 
+   for (unsigned i = 0; i < misses.size(); i++)
+   {
+      BinaryRefReader brrHints(hintVals[i]);
+      result[misses[i]] = getDBKeyFromHints(
+         txhashes[misses[i]], brrHints, UINT8_MAX);
+   }
+
+   return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+BinaryData LMDBBlockDatabase::getDBKeyFromHints(BinaryDataRef txhash,
+   BinaryRefReader& brrHints, uint8_t expectedDupId) const
+{
    uint32_t valSize = (uint32_t)brrHints.getSize();
    if (valSize < 6)
       return BinaryData();
@@ -763,6 +902,293 @@ BinaryData LMDBBlockDatabase::getDBKeyForHash(const BinaryData& txhash,
    return BinaryData();
 }
 
+/////////////////////////////////////////////////////////////////////////////
+BinaryData LMDBBlockDatabase::getDBKeyFromIndex(BinaryDataRef txhash,
+   uint8_t expectedDupId) const
+{
+   if (txHintIndex_ == nullptr)
+      return BinaryData();
+
+   auto&& candidates = txHintIndex_->find(txhash);
+   if (candidates.empty())
+      return BinaryData();
+
+   //run the candidates through the same checks as the TXHINTS entries
+   BinaryWriter bw;
+   bw.put_var_int(candidates.size());
+   for (auto& candidate : candidates)
+      bw.put_BinaryData(candidate);
+
+   BinaryRefReader brrHints(bw.getDataRef());
+   auto&& dbKey = getDBKeyFromHints(txhash, brrHints, expectedDupId);
+   if (dbKey.getSize() != 6)
+      return BinaryData();
+
+   //the index doesn't see reorgs, off branch hits go through TXHINTS
+   if (getDbType() == ARMORY_DB_SUPER)
+   {
+      auto blockId = DBUtils::hgtxToHeight(dbKey.getSliceRef(0, 4));
+      if (!isBlockIDOnMainBranch(blockId))
+         return BinaryData();
+   }
+   else
+   {
+      uint32_t height;
+      uint8_t dup;
+      uint16_t txIdx;
+      BinaryRefReader brrKey(dbKey);
+      DBUtils::readBlkDataKeyNoPrefix(brrKey, height, dup, txIdx);
+
+      if (dup != expectedDupId && dup != getValidDupIDForHeight(height))
+         return BinaryData();
+   }
+
+   return dbKey;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::txHintKeyExists(BinaryDataRef dbKey6B) const
+{
+   if (getDbType() == ARMORY_DB_SUPER)
+   {
+      auto&& tx = beginTransaction(STXO, LMDB::ReadOnly);
+      return getValueNoCopy(STXO, dbKey6B).getSize() > 32;
+   }
+
+   BinaryWriter bw(7);
+   bw.put_uint8_t((uint8_t)DB_PREFIX_TXDATA);
+   bw.put_BinaryDataRef(dbKey6B);
+
+   auto&& tx = beginTransaction(TXHINTS, LMDB::ReadOnly);
+   return getValueNoCopy(TXHINTS, bw.getDataRef()).getSize() >= 36;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::updateTxHintIndex()
+{
+   if (txHintIndex_ == nullptr)
+      return;
+
+   /*
+   Supernode: tx entries are the 6 byte keys in STXO, the value starts with
+   the tx hash. Fullnode: TXDATA prefixed keys in TXHINTS, the hash follows
+   the 4 byte tx count.
+   */
+   bool isSuper = getDbType() == ARMORY_DB_SUPER;
+   auto db = isSuper ? STXO : TXHINTS;
+   size_t hashOffset = isSuper ? 0 : 4;
+
+   /*
+   Entries read past the index wait in txHintPending_ until there are
+   enough of them for a segment, each call only walks the keys committed
+   since the previous one.
+   */
+   auto scanFrom = txHintPendingTo_;
+   if (scanFrom.empty())
+      scanFrom = txHintIndex_->indexedTo();
+
+   while (true)
+   {
+      bool fullChunk = false;
+
+      {
+         auto&& tx = beginTransaction(db, LMDB::ReadOnly);
+         auto dbIter = getIterator(db);
+
+         if (!isSuper)
+            dbIter->seekTo(DB_PREFIX_TXDATA, scanFrom);
+         else if (!scanFrom.empty())
+            dbIter->seekTo(scanFrom);
+         else
+            dbIter->seekToFirst();
+
+         for (; dbIter->isValid(); dbIter->advanceAndRead())
+         {
+            auto keyRef = dbIter->getKeyRef();
+            BinaryDataRef key6B;
+            if (isSuper)
+            {
+               //skip the txout entries
+               if (keyRef.getSize() != 6)
+                  continue;
+               key6B = keyRef;
+            }
+            else
+            {
+               if (keyRef.getSize() == 0 ||
+                  keyRef.getPtr()[0] != (uint8_t)DB_PREFIX_TXDATA)
+                  break;
+
+               if (keyRef.getSize() != 7)
+                  continue;
+               key6B = keyRef.getSliceRef(1, 6);
+            }
+
+            if (key6B == scanFrom.getRef())
+               continue;
+
+            auto valRef = dbIter->getValueRef();
+            if (valRef.getSize() < hashOffset + 32)
+               continue;
+
+            TxHintEntry entry;
+            entry.fingerprint_ = TxHintSegment::getFingerprint(
+               valRef.getSliceRef(hashOffset, 32));
+            memcpy(entry.key_, key6B.getPtr(), 6);
+            txHintPending_.push_back(entry);
+            txHintPendingTo_ = key6B;
+
+            if (txHintPending_.size() >= TXHINTINDEX_CHUNK_ENTRIES)
+            {
+               fullChunk = true;
+               break;
+            }
+         }
+      }
+
+      //too few to be worth a segment, leave these to TXHINTS for now
+      if (txHintPending_.size() < TXHINTINDEX_MIN_ENTRIES)
+         break;
+
+      //append sorts the entries by fingerprint, grab the range first
+      BinaryData firstKey(txHintPending_.front().key_, 6);
+      BinaryData lastKey(txHintPending_.back().key_, 6);
+      try
+      {
+         txHintIndex_->append(txHintPending_, firstKey, lastKey);
+      }
+      catch (exception&)
+      {
+         //start over from the index on the next call
+         txHintPending_.clear();
+         txHintPendingTo_.clear();
+         throw;
+      }
+
+      txHintPending_.clear();
+      scanFrom = lastKey;
+
+      if (!fullChunk)
+         break;
+   }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+DbSnapshot LMDBBlockDatabase::snapshot(const string& dir)
+{
+   /*
+   mdb_env_copyfd2 opens a read txn of its own when it starts, it can't be
+   handed one. The only way to get every env at the same block is to keep
+   the top from moving until the last copy is done, so writers are held at
+   the gate for the length of the copy. Readers are not affected.
+
+   The read txns pinned here are where the sdbis are read from. They also
+   hold back map resizes (see LMDBEnv::resizeMap) while the copies run. A
+   thread can't have 2 read txns on an env, the copies run on threads of
+   their own.
+   */
+
+   if (!dbIsOpen_)
+      throw LmdbWrapperException("dbs are not open");
+
+   if (!DBUtils::fileExists(dir, 0))
+      throw LmdbWrapperException("snapshot dir " + dir + " does not exist");
+
+   struct GateFreeze
+   {
+      DbWriteGate& gate_;
+
+      GateFreeze(DbWriteGate& gate) :
+         gate_(gate)
+      {
+         gate_.freeze();
+      }
+
+      ~GateFreeze(void)
+      {
+         gate_.thaw();
+      }
+   };
+
+   auto start = chrono::steady_clock::now();
+   GateFreeze freeze(writeGate_);
+   commitStage_->flushAll();
+
+   DbSnapshot result;
+   vector<pair<string, LMDBEnv*>> envs;
+   vector<LMDBEnv::Transaction> pinnedTxs;
+
+   for (auto& dbPair : dbMap_)
+   {
+      if (dbPair.first == ZERO_CONF)
+         continue;
+
+      DbSnapshot::Entry entry;
+      entry.db_ = dbPair.first;
+      for (auto& envPair : dbPair.second->getEnvs())
+      {
+         pinnedTxs.emplace_back(envPair.second, LMDB::ReadOnly);
+         entry.files_.push_back(envPair.first);
+         envs.push_back(envPair);
+      }
+
+      entry.sdbi_ = getStoredDBInfo(dbPair.first, 0);
+      if (dbPair.first == SSH)
+      {
+         result.topHeight_ = entry.sdbi_.topBlkHgt_;
+         result.topHash_ = entry.sdbi_.topScannedBlkHash_;
+      }
+
+      result.dbs_.push_back(move(entry));
+   }
+
+   vector<thread> copyThreads;
+   vector<exception_ptr> errors(envs.size());
+   for (unsigned i = 0; i < envs.size(); i++)
+   {
+      auto copyLbd = [&dir, &envs, &errors, i](void)->void
+      {
+         try
+         {
+            envs[i].second->copy(dir + "/" + envs[i].first);
+         }
+         catch (...)
+         {
+            errors[i] = current_exception();
+         }
+      };
+
+      copyThreads.push_back(thread(copyLbd));
+   }
+
+   for (auto& thr : copyThreads)
+      thr.join();
+
+   for (auto& err : errors)
+   {
+      if (err != nullptr)
+         rethrow_exception(err);
+   }
+
+   auto&& manifest = result.serialize();
+   {
+      ofstream fs(dir + "/" + DB_SNAPSHOT_MANIFEST, ios::binary | ios::trunc);
+      if (!fs.is_open())
+         throw LmdbWrapperException("failed to write snapshot manifest");
+
+      fs.write((const char*)manifest.getPtr(), manifest.getSize());
+      if (!fs.good())
+         throw LmdbWrapperException("failed to write snapshot manifest");
+   }
+
+   chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+   LOGINFO << "snapshot of " << envs.size() << " envs at block #" <<
+      result.topHeight_ << " written to " << dir << " in " <<
+      elapsed.count() << "s";
+
+   return result;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 unsigned LMDBBlockDatabase::getHeightForTxHash(
    const BinaryDataRef& hash) const
@@ -814,6 +1240,65 @@ void LMDBBlockDatabase::putValue(DB_SELECT db,
    putValue(db, bw.getDataRef(), value);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+LMDBEnv::MapStats LMDBBlockDatabase::getMapStats(DB_SELECT db) const
+{
+   auto dbPtr = getDbPtr(db);
+   return dbPtr->getMapStats();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::reserveMapSpace(DB_SELECT db,
+   const vector<pair<BinaryDataRef, BinaryDataRef>>& keyVals)
+{
+   auto dbPtr = getDbPtr(db);
+   dbPtr->reserveMapSpace(keyVals);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned LMDBBlockDatabase::getShardCount(DB_SELECT db) const
+{
+   auto dbPtr = getDbPtr(db);
+   return dbPtr->getShardCount();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned LMDBBlockDatabase::getShardId(DB_SELECT db, BinaryDataRef key) const
+{
+   auto dbPtr = getDbPtr(db);
+   return dbPtr->getShardId(key);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unique_ptr<ShardFilter> LMDBBlockDatabase::getShardFilter(DB_SELECT db)
+{
+   switch (db)
+   {
+   case SSH:
+      //prefix, scrAddr type, then the script hash
+      return make_unique<ShardFilter_KeySlice>(2, 4);
+
+   case SUBSSH:
+      //batch id, consecutive batches land on different shards
+      return make_unique<ShardFilter_KeySlice>(0, 4);
+
+   case SPENTNESS:
+      //inverted height, each batch spreads over all shards
+      return make_unique<ShardFilter_KeySlice>(0, 3);
+
+   default:
+      throw LmdbWrapperException("no shard filter for db");
+   }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t LMDBBlockDatabase::putValues(DB_SELECT db,
+   const vector<pair<BinaryDataRef, BinaryDataRef>>& keyVals)
+{
+   auto dbPtr = getDbPtr(db);
+   return dbPtr->putValues(keyVals);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Delete value based on BinaryData key.  If batch writing, pass in the batch
 void LMDBBlockDatabase::deleteValue(DB_SELECT db, 
@@ -933,12 +1418,40 @@ bool LMDBBlockDatabase::fillStoredSubHistory_Super(
       return dupid == iter->second;
    };
 
+   auto format = getSubsshFormat();
+   SubsshColumns columns;
+
+   walkSubsshBatches(ssh, start, end, [&](BinaryDataRef value,
+      unsigned height_offset, unsigned spent_offset)->void
+   {
+      if (format == SUBSSH_FORMAT_COLUMNS)
+      {
+         //decodes into the same vectors for every batch
+         columns.decode(value, height_offset, spent_offset);
+         ssh.insertSubsshColumns(columns, start, end, isValidDupId);
+      }
+      else
+      {
+         ssh.decompressManySubssh(value, 
+            height_offset, spent_offset,
+            start, end, isValidDupId);
+      }
+   });
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::walkSubsshBatches(
+   const StoredScriptHistory& ssh, unsigned start, unsigned end,
+   const function<void(BinaryDataRef, unsigned, unsigned)>& callback) const
+{
    auto meta_tx = beginTransaction(SUBSSH_META, LMDB::ReadOnly);
 
    //convert height range to batch id range
    auto start_id = getShardIdForHeight(start);
    if (start_id == UINT32_MAX)
-      return true;
+      return;
    auto end_id = getNextShardIdForHeight(end);
       
    //prepare for subssh db parsing
@@ -952,7 +1465,7 @@ bool LMDBBlockDatabase::fillStoredSubHistory_Super(
    //get subssh summary iterator positioned at <= start_id
    auto ssh_lower_bound = ssh.subsshSummary_.lower_bound(start_id);
    if (ssh_lower_bound == ssh.subsshSummary_.end())
-      return true;
+      return;
    if (ssh_lower_bound->first > start_id &&
        ssh_lower_bound != ssh.subsshSummary_.begin())
       --ssh_lower_bound;
@@ -999,27 +1512,96 @@ bool LMDBBlockDatabase::fillStoredSubHistory_Super(
          continue;
       }
 
-      ssh.decompressManySubssh(dbIter->getValueRef(), 
-         height_offset, spent_offset,
-         start, end, isValidDupId);
-
+      callback(dbIter->getValueRef(), height_offset, spent_offset);
       ++ssh_lower_bound;
    }
-
-   return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void LMDBBlockDatabase::putStoredScriptHistorySummary(StoredScriptHistory & ssh)
+bool LMDBBlockDatabase::getHistoryTxios(StoredScriptHistory& ssh,
+   BinaryDataRef scrAddrStr, map<BinaryData, TxIOPair>& txioMap,
+   uint32_t startBlock, uint32_t endBlock, bool withMultisig) const
 {
-   SCOPED_TIMER("putStoredScriptHistory");
-   if (!ssh.isInitialized())
+   if (getDbType() != ARMORY_DB_SUPER ||
+      getSubsshFormat() != SUBSSH_FORMAT_COLUMNS)
    {
-      LOGERR << "Trying to put uninitialized ssh into DB";
-      return;
-   }
+      if (!getStoredScriptHistory(ssh, scrAddrStr, startBlock, endBlock))
+         return false;
 
-   putValue(SSH, ssh.getDBKey(), serializeDBValue(ssh, getDbType()));
+      //newest subssh first, older txios don't overwrite the latest state
+      for (auto subsshIter = ssh.subHistMap_.rbegin();
+         subsshIter != ssh.subHistMap_.rend(); ++subsshIter)
+      {
+         for (auto& txioPair : subsshIter->second.txioMap_)
+         {
+            if (!withMultisig && txioPair.second.isMultisig())
+               continue;
+
+            auto& txio = txioMap[txioPair.first];
+            if (!txio.hasValue())
+               txio = txioPair.second;
+         }
+      }
+
+      return true;
+   }
+
+   if (!getStoredScriptHistorySummary(ssh, scrAddrStr))
+      return false;
+
+   auto dupIdMap = validDupByHeight_.get();
+   function<bool(unsigned, uint8_t)> isValidDupId = 
+      [dupIdMap](unsigned height, uint8_t dupid)->bool
+   {
+      auto iter = dupIdMap->find(height);
+      if (iter == dupIdMap->end())
+         return false;
+
+      return dupid == iter->second;
+   };
+
+   struct BatchRef
+   {
+      BinaryDataRef value_;
+      unsigned heightOffset_;
+      unsigned spentOffset_;
+   };
+
+   //the value refs stay valid as long as this read tx is up
+   auto subsshtx = beginTransaction(SUBSSH, LMDB::ReadOnly);
+   vector<BatchRef> batches;
+   walkSubsshBatches(ssh, startBlock, endBlock, [&batches](
+      BinaryDataRef value, unsigned height_offset, unsigned spent_offset)->void
+   {
+      batches.push_back({ value, height_offset, spent_offset });
+   });
+
+   //newest batch first, only the rows making it to the page get a TxIOPair
+   SubsshColumns columns;
+   for (auto batchIter = batches.rbegin(); 
+      batchIter != batches.rend(); ++batchIter)
+   {
+      columns.decode(batchIter->value_,
+         batchIter->heightOffset_, batchIter->spentOffset_);
+      columns.getTxios(txioMap, startBlock, endBlock, isValidDupId);
+   }
+
+   auto spentnesstx = beginTransaction(SPENTNESS, LMDB::ReadOnly);
+   getUTXOflags_Super(txioMap);
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putStoredScriptHistorySummary(StoredScriptHistory & ssh)
+{
+   SCOPED_TIMER("putStoredScriptHistory");
+   if (!ssh.isInitialized())
+   {
+      LOGERR << "Trying to put uninitialized ssh into DB";
+      return;
+   }
+
+   putValue(SSH, ssh.getDBKey(), serializeDBValue(ssh, getDbType()));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1212,6 +1794,29 @@ bool LMDBBlockDatabase::getFullUTXOMapForSSH(
    return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+static shared_ptr<BlockHeader> headerFromStored(StoredHeader& sbh)
+{
+   auto regHead = make_shared<BlockHeader>();
+
+   regHead->unserialize(sbh.dataCopy_);
+   regHead->setBlockSize((uint32_t)sbh.numBytes_);
+   regHead->setNumTx(sbh.numTx_);
+
+   regHead->setBlockFileNum(sbh.fileID_);
+   regHead->setBlockFileOffset(sbh.offset_);
+   regHead->setUniqueID(sbh.uniqueID_);
+
+   if (sbh.thisHash_ != regHead->getThisHash())
+   {
+      LOGWARN << "Corruption detected: block header hash " <<
+         sbh.thisHash_.copySwapEndian().toHexStr() << " does not match "
+         << regHead->getThisHash().copySwapEndian().toHexStr();
+   }
+
+   return regHead;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // TODO: We should also read the HeaderHgtList entries to get the blockchain
 //       sorting that is saved in the DB.  But right now, I'm not sure what
@@ -1245,26 +1850,28 @@ void LMDBBlockDatabase::readAllHeaders(
       ldbIter->getKeyReader().get_BinaryData(sbh.thisHash_, 32);
 
       sbh.unserializeDBValue(HEADERS, ldbIter->getValueRef());
+      auto regHead = headerFromStored(sbh);
+      callback(regHead, sbh.blockHeight_, sbh.duplicateID_);
 
-      auto regHead = make_shared<BlockHeader>();
-
-      regHead->unserialize(sbh.dataCopy_);
-      regHead->setBlockSize((uint32_t)sbh.numBytes_);
-      regHead->setNumTx(sbh.numTx_);
+   } while(ldbIter->advanceAndRead(DB_PREFIX_HEADHASH));
+}
 
-      regHead->setBlockFileNum(sbh.fileID_);
-      regHead->setBlockFileOffset(sbh.offset_);
-      regHead->setUniqueID(sbh.uniqueID_);
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<BlockHeader> LMDBBlockDatabase::readHeader(BinaryDataRef hash)
+{
+   auto&& tx = beginTransaction(HEADERS, LMDB::ReadOnly);
+   auto brr = getValueReader(HEADERS, DB_PREFIX_HEADHASH, hash);
+   if (brr.getSize() == 0)
+      return nullptr;
 
-      if (sbh.thisHash_ != regHead->getThisHash())
-      {
-         LOGWARN << "Corruption detected: block header hash " <<
-            sbh.thisHash_.copySwapEndian().toHexStr() << " does not match "
-            << regHead->getThisHash().copySwapEndian().toHexStr();
-      }
-      callback(regHead, sbh.blockHeight_, sbh.duplicateID_);
+   StoredHeader sbh;
+   sbh.thisHash_ = hash;
+   sbh.unserializeDBValue(HEADERS, brr);
 
-   } while(ldbIter->advanceAndRead(DB_PREFIX_HEADHASH));
+   auto regHead = headerFromStored(sbh);
+   regHead->setBlockHeight(sbh.blockHeight_);
+   regHead->setDuplicateID(sbh.duplicateID_);
+   return regHead;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -2415,6 +3022,151 @@ bool LMDBBlockDatabase::getStoredTxOut(
    return getStoredTxOut(stxo, blockHeight, dupID, txIndex, txOutIndex);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getStoredTxOuts(vector<StoredTxOut>& stxos,
+   const vector<BinaryData>& DBkeys) const
+{
+   stxos.clear();
+   stxos.resize(DBkeys.size());
+
+   for (auto& key : DBkeys)
+   {
+      if (key.getSize() != 8)
+      {
+         LOGERR << "Tried to get StoredTxOut, but the provided key is not of the "
+            "proper size. Expect size is 8, this key is: " << key.getSize();
+         return false;
+      }
+   }
+
+   if (getDbType() != ARMORY_DB_SUPER)
+   {
+      vector<BinaryData> stxoKeys;
+      stxoKeys.reserve(DBkeys.size());
+      for (auto& key : DBkeys)
+      {
+         BinaryWriter bw(9);
+         bw.put_uint8_t((uint8_t)DB_PREFIX_TXDATA);
+         bw.put_BinaryData(key);
+         stxoKeys.emplace_back(bw.getData());
+      }
+
+      vector<BinaryDataRef> keyRefs(stxoKeys.begin(), stxoKeys.end());
+      auto&& tx = beginTransaction(STXO, LMDB::ReadOnly);
+      auto&& vals = multiGet(STXO, keyRefs);
+
+      for (unsigned i = 0; i < DBkeys.size(); i++)
+      {
+         if (vals[i].getSize() == 0)
+            return false;
+
+         auto& key = DBkeys[i];
+         auto& stxo = stxos[i];
+         stxo.blockHeight_ = DBUtils::hgtxToHeight(key.getSliceRef(0, 4));
+         stxo.duplicateID_ = DBUtils::hgtxToDupID(key.getSliceRef(0, 4));
+         stxo.txIndex_ = READ_UINT16_BE(key.getSliceRef(4, 2));
+         stxo.txOutIndex_ = READ_UINT16_BE(key.getSliceRef(6, 2));
+
+         BinaryRefReader brr(vals[i]);
+         stxo.unserializeDBValue(brr);
+      }
+
+      return true;
+   }
+
+   /*
+   Supernode: keys carrying a block id (dup 0x7F) go straight to the STXO db,
+   the others need their block resolved first and take the single key path.
+   */
+   vector<unsigned> batchIds;
+   vector<BinaryDataRef> keyRefs;
+   for (unsigned i = 0; i < DBkeys.size(); i++)
+   {
+      auto& key = DBkeys[i];
+      if (DBUtils::hgtxToDupID(key.getSliceRef(0, 4)) != 0x7F)
+      {
+         if (!getStoredTxOut(stxos[i], key))
+            return false;
+         continue;
+      }
+
+      batchIds.push_back(i);
+      keyRefs.push_back(key.getRef());
+   }
+
+   if (batchIds.size() == 0)
+      return true;
+
+   {
+      auto&& stxo_tx = beginTransaction(STXO, LMDB::ReadOnly);
+      auto&& vals = multiGet(STXO, keyRefs);
+
+      for (unsigned i = 0; i < batchIds.size(); i++)
+      {
+         auto& key = DBkeys[batchIds[i]];
+         unsigned id;
+         uint8_t dup;
+         uint16_t txIdx, txoutid;
+
+         BinaryRefReader txout_key(key);
+         DBUtils::readBlkDataKeyNoPrefix(txout_key, id, dup, txIdx, txoutid);
+
+         shared_ptr<BlockHeader> header;
+         try
+         {
+            header = blockchainPtr_->getHeaderById(id);
+         }
+         catch (range_error&)
+         {
+            LOGWARN << "no header for id " << id;
+            return false;
+         }
+
+         if (vals[i].getSize() == 0)
+         {
+            LOGWARN << "no txout for key: " << header->getBlockHeight() <<
+               "|" << header->getDuplicateID() << "|" << txIdx << "|" << txoutid;
+            return false;
+         }
+
+         auto& stxo = stxos[batchIds[i]];
+         stxo.unserializeDBValue(vals[i]);
+         stxo.blockHeight_ = header->getBlockHeight();
+         stxo.duplicateID_ = header->getDuplicateID();
+         stxo.txIndex_ = txIdx;
+         stxo.txOutIndex_ = txoutid;
+         stxo.isCoinbase_ = (txIdx == 0);
+      }
+   }
+
+   //get spentness
+   vector<BinaryData> spentnessKeys;
+   spentnessKeys.reserve(batchIds.size());
+   for (auto& id : batchIds)
+      spentnessKeys.emplace_back(stxos[id].getSpentnessKey());
+
+   vector<BinaryDataRef> spentnessRefs(
+      spentnessKeys.begin(), spentnessKeys.end());
+
+   auto&& spentness_tx = beginTransaction(SPENTNESS, LMDB::ReadOnly);
+   auto&& spentnessVals = multiGet(SPENTNESS, spentnessRefs);
+   for (unsigned i = 0; i < batchIds.size(); i++)
+   {
+      auto& stxo = stxos[batchIds[i]];
+      if (spentnessVals[i].getSize() != 0)
+      {
+         stxo.spentByTxInKey_ = spentnessVals[i];
+         stxo.spentness_ = TXOUT_SPENT;
+      }
+      else
+      {
+         stxo.spentness_ = TXOUT_UNSPENT;
+      }
+   }
+
+   return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void LMDBBlockDatabase::getSpentness(StoredTxOut& stxo)
 {
@@ -2458,7 +3210,7 @@ void LMDBBlockDatabase::getUTXOflags(StoredSubHistory& subssh) const
 {
    if (getDbType() == ARMORY_DB_SUPER)
    {
-      getUTXOflags_Super(subssh);
+      getUTXOflags_Super(subssh.txioMap_);
       return;
    }
 
@@ -2482,9 +3234,10 @@ void LMDBBlockDatabase::getUTXOflags(StoredSubHistory& subssh) const
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void LMDBBlockDatabase::getUTXOflags_Super(StoredSubHistory& subSsh) const
+void LMDBBlockDatabase::getUTXOflags_Super(
+   map<BinaryData, TxIOPair>& txioMap) const
 {
-   for (auto& txioPair : subSsh.txioMap_)
+   for (auto& txioPair : txioMap)
    {
       auto& txio = txioPair.second;
 
@@ -2553,6 +3306,136 @@ bool LMDBBlockDatabase::getStoredTxHints(StoredTxHints & sths,
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putUtxoSnapshot(const StoredUtxoSnapshot& snapshot)
+{
+   if (!snapshot.isInitialized())
+      throw LmdbWrapperException("uninitialized utxo snapshot");
+
+   putValue(UTXOSNAP, snapshot.getDBKey(), snapshot.serializeDBValue());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getUtxoSnapshot(StoredUtxoSnapshot& snapshot,
+   uint32_t filterKey, uint32_t height) const
+{
+   auto&& key = StoredUtxoSnapshot::getDBKey(filterKey, height);
+   auto bdr = getValueNoCopy(UTXOSNAP, key);
+   if (bdr.getSize() == 0)
+      return false;
+
+   snapshot.filterKey_ = filterKey;
+   snapshot.height_ = height;
+   snapshot.unserializeDBValue(bdr);
+   return snapshot.version_ == UTXO_SNAPSHOT_VERSION;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<uint32_t> LMDBBlockDatabase::getUtxoSnapshotHeights(
+   uint32_t filterKey) const
+{
+   vector<uint32_t> heights;
+
+   BinaryWriter bw(5);
+   bw.put_uint8_t((uint8_t)DB_PREFIX_UTXOSNAP);
+   bw.put_uint32_t(filterKey, BE);
+
+   auto dbIter = getIterator(UTXOSNAP);
+   if (!dbIter->seekToStartsWith(bw.getDataRef()))
+      return heights;
+
+   do
+   {
+      auto keyRef = dbIter->getKeyRef();
+      if (!keyRef.startsWith(bw.getDataRef()))
+         break;
+
+      StoredUtxoSnapshot snapshot;
+      snapshot.unserializeDBKey(keyRef);
+      if (snapshot.isInitialized())
+         heights.push_back(snapshot.height_);
+   } while (dbIter->advanceAndRead());
+
+   return heights;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::deleteUtxoSnapshots(uint32_t fromHeight)
+{
+   //caller has to hold a RW tx on UTXOSNAP
+   set<BinaryData> keysToDelete;
+
+   {
+      auto dbIter = getIterator(UTXOSNAP);
+      if (!dbIter->seekToStartsWith(DB_PREFIX_UTXOSNAP))
+         return;
+
+      do
+      {
+         auto keyRef = dbIter->getKeyRef();
+         StoredUtxoSnapshot snapshot;
+         snapshot.unserializeDBKey(keyRef);
+         if (!snapshot.isInitialized())
+            break;
+
+         if (snapshot.height_ >= fromHeight)
+            keysToDelete.insert(keyRef);
+      } while (dbIter->advanceAndRead());
+   }
+
+   for (auto& key : keysToDelete)
+      deleteValue(UTXOSNAP, key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getBuildCheckpoint(StoredBuildCheckpoint& checkpoint,
+   BUILD_CHECKPOINT_TYPE type)
+{
+   auto&& tx = beginTransaction(SUBSSH_META, LMDB::ReadOnly);
+   auto bdr = getValueNoCopy(SUBSSH_META, StoredBuildCheckpoint::getDBKey(type));
+   if (bdr.getSize() == 0)
+      return false;
+
+   checkpoint.type_ = type;
+   try
+   {
+      checkpoint.unserializeDBValue(bdr);
+   }
+   catch (exception&)
+   {
+      LOGWARN << "invalid build checkpoint, ignoring it";
+      return false;
+   }
+
+   return checkpoint.isInitialized();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_future<void> LMDBBlockDatabase::pushBuildCheckpoint(
+   const StoredBuildCheckpoint& checkpoint,
+   vector<shared_future<void>> after)
+{
+   if (!checkpoint.isInitialized())
+      throw LmdbWrapperException("uninitialized build checkpoint");
+
+   map<BinaryData, BinaryData> keyVal;
+   keyVal.emplace(checkpoint.getDBKey(), checkpoint.serializeDBValue());
+
+   auto batch = DBWriteBatch::fromMap(SUBSSH_META, move(keyVal));
+   batch->after_ = move(after);
+   return commitStage_->push(move(batch));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::deleteBuildCheckpoint(BUILD_CHECKPOINT_TYPE type)
+{
+   //pending checkpoints land first
+   commitStage_->flush(SUBSSH_META);
+
+   auto&& tx = beginTransaction(SUBSSH_META, LMDB::ReadWrite);
+   deleteValue(SUBSSH_META, StoredBuildCheckpoint::getDBKey(type));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 bool LMDBBlockDatabase::putStoredHeadHgtList(StoredHeadHgtList const & hhl)
 {
@@ -2993,6 +3876,7 @@ StoredDBInfo LMDBBlockDatabase::openDB(DB_SELECT db)
 ////////////////////////////////////////////////////////////////////////////////
 void LMDBBlockDatabase::closeDB(DB_SELECT db)
 {
+   commitStage_->flush(db);
    auto dbPtr = getDbPtr(db);
    dbPtr->close();
 }
@@ -3014,6 +3898,10 @@ void LMDBBlockDatabase::loadHeightToIdMap()
 
    do
    {
+      //build checkpoints sort past the batch entries
+      if (dbIter->getKeyRef().getSize() != 8)
+         break;
+
       auto brr_value = dbIter->getValueReader();
       auto height = brr_value.get_uint32_t();
 
@@ -3091,6 +3979,9 @@ string DatabaseContainer::getDbName(DB_SELECT db)
    case SPENTNESS:
       return "spentness";
 
+   case UTXOSNAP:
+      return "utxosnap";
+
    default:
       throw LmdbWrapperException("unknown db");
    }
@@ -3100,6 +3991,22 @@ string DatabaseContainer::getDbName(DB_SELECT db)
 ////////////////////////////////////////////////////////////////////////////////
 //// DBPair
 ////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//same ordering as the default lmdb key comparison
+static int compareDbKeys(
+   const uint8_t* lhs, size_t lhsLen,
+   const uint8_t* rhs, size_t rhsLen)
+{
+   auto len = min(lhsLen, rhsLen);
+   auto cmp = len == 0 ? 0 : memcmp(lhs, rhs, len);
+   if (cmp != 0)
+      return cmp;
+
+   if (lhsLen == rhsLen)
+      return 0;
+   return lhsLen < rhsLen ? -1 : 1;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 LMDBEnv::Transaction DBPair::beginTransaction(LMDB::Mode mode)
 {
@@ -3114,9 +4021,48 @@ void DBPair::open(const string& path, const string& dbName)
    
    unsigned flags = MDB_NOSYNC | MDB_NOTLS;
 
+   if (DBSettings::isReplica())
+   {
+      //the db process owns the files, the map size comes from the env
+      env_.open(path, flags | MDB_RDONLY);
+      db_.open(&env_, dbName);
+      return;
+   }
+
    env_.open(path, flags);
-   auto map_size = LMDBBlockDatabase::mapSizes_.at(dbName);
-   env_.setMapSize(map_size);
+
+   //start at the data in use plus headroom, grow with the db
+   auto headroom = LMDBBlockDatabase::mapHeadroom_.at(dbName);
+   env_.setMapHeadroom(headroom, 
+      [](const string& filename, const LMDBResizeEvent& event)->void
+   {
+      if (!event.error_.empty())
+      {
+         LOGERR << "map resize for " << filename << " failed: " <<
+            event.error_;
+         return;
+      }
+
+      if (!event.done_)
+      {
+         LOGWARN << "map resize for " << filename << 
+            " skipped, txns still open after " << event.attempts_ << 
+            " attempts (" << event.pause_ << "s)";
+         return;
+      }
+
+      if (event.mapFull_)
+      {
+         LOGWARN << "map for " << filename << " filled up, write txn " <<
+            "rolled back";
+      }
+
+      LOGINFO << "resized map for " << filename << " from " << 
+         event.from_ / (1024 * 1024) << " MB to " << 
+         event.to_ / (1024 * 1024) << " MB (" << 
+         event.used_ / (1024 * 1024) << " MB in use, paused " << 
+         event.pause_ << "s)";
+   });
 
    auto&& tx = beginTransaction(LMDB::ReadWrite);
    db_.open(&env_, dbName);
@@ -3146,56 +4092,684 @@ BinaryDataRef DBPair::getValue(BinaryDataRef key) const
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void DBPair::putValue(BinaryDataRef key,BinaryDataRef value)
-{
-   db_.insert(
-      CharacterArrayRef(key.getSize(), key.getPtr()),
-      CharacterArrayRef(value.getSize(), value.getPtr()));
-}
-
-////////////////////////////////////////////////////////////////////////////////
-void DBPair::deleteValue(BinaryDataRef key)
+vector<BinaryDataRef> DBPair::multiGet(const vector<BinaryDataRef>& keys)
 {
-   db_.erase(CharacterArrayRef(key.getSize(), key.getPtr()));
-}
+   vector<BinaryDataRef> result(keys.size());
+   if (keys.size() == 0)
+      return result;
 
-////////////////////////////////////////////////////////////////////////////////
-unique_ptr<LDBIter_Single> DBPair::getIterator()
-{
-   return make_unique<LDBIter_Single>(move(db_.begin()));
-}
+   vector<unsigned> order(keys.size());
+   for (unsigned i = 0; i < keys.size(); i++)
+      order[i] = i;
 
-////////////////////////////////////////////////////////////////////////////////
-bool DBPair::isOpen() const
-{
-   return env_.isOpen() && db_.isOpen();
-}
+   sort(order.begin(), order.end(), 
+      [&keys](unsigned lhs, unsigned rhs)->bool
+   {
+      return compareDbKeys(
+         keys[lhs].getPtr(), keys[lhs].getSize(),
+         keys[rhs].getPtr(), keys[rhs].getSize()) < 0;
+   });
+
+   /*
+   Walk the sorted keys with a single cursor. A cursor that is already
+   positioned resolves the next seek within its current leaf page when it
+   can, rather than descending from the root, and a key that sorts before
+   the cursor position is known to be missing without a seek.
+   */
+   auto tx = beginTransaction(LMDB::ReadOnly);
+   auto iter = db_.end();
+   bool sought = false;
+
+   for (auto& id : order)
+   {
+      auto& key = keys[id];
+      if (key.getSize() == 0)
+         continue;
 
+      int cmp = -1;
+      if (iter.isValid())
+      {
+         auto& curKey = iter.key();
+         cmp = compareDbKeys(
+            (const uint8_t*)curKey.mv_data, curKey.mv_size,
+            key.getPtr(), key.getSize());
+      }
+      else if (sought)
+      {
+         //ran past the last key in the db
+         break;
+      }
+
+      if (cmp < 0)
+      {
+         iter.seek(CharacterArrayRef(
+            key.getSize(), key.getPtr()), LMDB::Iterator::Seek_GE);
+         sought = true;
+         if (!iter.isValid())
+            break;
+
+         auto& curKey = iter.key();
+         cmp = compareDbKeys(
+            (const uint8_t*)curKey.mv_data, curKey.mv_size,
+            key.getPtr(), key.getSize());
+      }
+
+      if (cmp != 0)
+         continue;
+
+      auto& val = iter.value();
+      result[id].setRef((const uint8_t*)val.mv_data, val.mv_size);
+   }
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBPair::putValue(BinaryDataRef key,BinaryDataRef value)
+{
+   db_.insert(
+      CharacterArrayRef(key.getSize(), key.getPtr()),
+      CharacterArrayRef(value.getSize(), value.getPtr()));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t DBPair::putValues(
+   const vector<pair<BinaryDataRef, BinaryDataRef>>& keyVals)
+{
+   if (keyVals.size() == 0)
+      return 0;
+
+   /*
+   The keys are sorted. Those past the last key in the db are appended,
+   which writes straight to the rightmost leaf page rather than descending
+   the tree for each key, and fills pages instead of splitting them in half.
+   */
+   BinaryData lastKey;
+   {
+      auto iter = db_.end();
+      iter.toLast();
+      if (iter.isValid())
+      {
+         auto& key = iter.key();
+         lastKey.copyFrom((const uint8_t*)key.mv_data, key.mv_size);
+      }
+   }
+
+   //find the sorted run at the tail of the batch that lands past lastKey
+   size_t appendFrom = keyVals.size();
+   while (appendFrom > 0)
+   {
+      auto& key = keyVals[appendFrom - 1].first;
+      if (key.getSize() == 0)
+         break;
+
+      if (compareDbKeys(
+         key.getPtr(), key.getSize(), 
+         lastKey.getPtr(), lastKey.getSize()) <= 0)
+         break;
+
+      if (appendFrom < keyVals.size())
+      {
+         auto& nextKey = keyVals[appendFrom].first;
+         if (compareDbKeys(
+            key.getPtr(), key.getSize(),
+            nextKey.getPtr(), nextKey.getSize()) >= 0)
+            break;
+      }
+
+      --appendFrom;
+   }
+
+   for (size_t i = 0; i < appendFrom; i++)
+      putValue(keyVals[i].first, keyVals[i].second);
+
+   //an unsorted head can move the last key past the start of the run
+   if (appendFrom > 0 && appendFrom < keyVals.size())
+   {
+      auto iter = db_.end();
+      iter.toLast();
+      auto& key = iter.key();
+
+      while (appendFrom < keyVals.size())
+      {
+         auto& nextKey = keyVals[appendFrom].first;
+         if (compareDbKeys(
+            nextKey.getPtr(), nextKey.getSize(),
+            (const uint8_t*)key.mv_data, key.mv_size) > 0)
+            break;
+
+         putValue(nextKey, keyVals[appendFrom].second);
+         ++appendFrom;
+      }
+   }
+
+   for (size_t i = appendFrom; i < keyVals.size(); i++)
+   {
+      auto& keyVal = keyVals[i];
+      db_.append(
+         CharacterArrayRef(keyVal.first.getSize(), keyVal.first.getPtr()),
+         CharacterArrayRef(keyVal.second.getSize(), keyVal.second.getPtr()));
+   }
+
+   return keyVals.size() - appendFrom;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBPair::deleteValue(BinaryDataRef key)
+{
+   db_.erase(CharacterArrayRef(key.getSize(), key.getPtr()));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unique_ptr<LDBIter_Single> DBPair::getIterator()
+{
+   return make_unique<LDBIter_Single>(move(db_.begin()));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool DBPair::isOpen() const
+{
+   return env_.isOpen() && db_.isOpen();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// DatabaseContainer_Single
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Single::close()
+{
+   db_.close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Single::eraseOnDisk()
+{
+   close();
+   auto&& dbPath = getDbPath(dbSelect_);
+   remove(dbPath.c_str());
+   
+   dbPath.append("-lock");
+   remove(dbPath.c_str());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+StoredDBInfo DatabaseContainer_Single::open()
+{
+   db_.open(getDbPath(dbSelect_), getDbName(dbSelect_));
+
+   StoredDBInfo sdbi;
+   try
+   {
+      sdbi = move(getStoredDBInfo(0));
+   }
+   catch (runtime_error&)
+   {
+      //read only envs can't be seeded, the db process writes the sdbi
+      if (db_.getEnv()->isReadOnly())
+      {
+         throw LmdbWrapperException(
+            "no sdbi in read only db " + getDbName(dbSelect_));
+      }
+
+      // If DB didn't exist yet (dbinfo key is empty), seed it
+      auto&& tx = db_.beginTransaction(LMDB::ReadWrite);
+
+      sdbi.magic_ = magicBytes_;
+      sdbi.metaHash_ = BtcUtils::EmptyHash_;
+      sdbi.topBlkHgt_ = 0;
+      sdbi.armoryType_ = DBSettings::getDbType();
+
+      //existing dbs keep the row format, new ones start columnar
+      if (dbSelect_ == SUBSSH)
+         sdbi.subsshFormat_ = SUBSSH_FORMAT_COLUMNS;
+      putStoredDBInfo(sdbi, 0);
+   }
+
+   return sdbi;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Single::putStoredDBInfo(
+   StoredDBInfo const & sdbi, uint32_t id)
+{
+   SCOPED_TIMER("putStoredDBInfo");
+   if (!sdbi.isInitialized())
+      throw LmdbWrapperException("tried to write uninitiliazed sdbi");
+
+   putValue(StoredDBInfo::getDBKey(id), serializeDBValue(sdbi));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+StoredDBInfo DatabaseContainer_Single::getStoredDBInfo(uint32_t id)
+{
+   SCOPED_TIMER("getStoredDBInfo");
+   auto&& tx = db_.beginTransaction(LMDB::ReadOnly);
+
+   auto&& key = StoredDBInfo::getDBKey(id);
+   BinaryRefReader brr(getValue(key.getRef()));
+
+   if (brr.getSize() == 0)
+      throw LmdbWrapperException("no sdbi at this key");
+
+   StoredDBInfo sdbi;
+   sdbi.unserializeDBValue(brr);
+   return sdbi;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryDataRef DatabaseContainer_Single::getValue(BinaryDataRef key) const
+{
+   return db_.getValue(key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<BinaryDataRef> DatabaseContainer_Single::multiGet(
+   const vector<BinaryDataRef>& keys) const
+{
+   return db_.multiGet(keys);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Single::putValue(
+   BinaryDataRef key,
+   BinaryDataRef value)
+{
+   db_.putValue(key, value);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+LMDBEnv::MapStats DatabaseContainer_Single::getMapStats() const
+{
+   return db_.getEnv()->getMapStats();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Single::reserveMapSpace(
+   const vector<pair<BinaryDataRef, BinaryDataRef>>& keyVals)
+{
+   size_t bytes = 0;
+   for (auto& keyVal : keyVals)
+      bytes += keyVal.first.getSize() + keyVal.second.getSize();
+
+   db_.getEnv()->reserve(bytes);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<pair<string, LMDBEnv*>> DatabaseContainer_Single::getEnvs()
+{
+   vector<pair<string, LMDBEnv*>> result;
+   result.emplace_back(getDbName(dbSelect_), db_.getEnv());
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t DatabaseContainer_Single::putValues(
+   const vector<pair<BinaryDataRef, BinaryDataRef>>& keyVals)
+{
+   return db_.putValues(keyVals);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Single::deleteValue(BinaryDataRef key)
+{
+   db_.deleteValue(key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unique_ptr<DbTransaction> DatabaseContainer_Single::beginTransaction(
+   LMDB::Mode mode) const
+{
+   return make_unique<DbTransaction_Single>(move(db_.beginTransaction(mode)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unique_ptr<LDBIter> DatabaseContainer_Single::getIterator()
+{
+   return db_.getIterator();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// LDBIter_Sharded
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+LDBIter_Sharded::LDBIter_Sharded(const DatabaseContainer_Sharded* dbPtr,
+   vector<unique_ptr<LDBIter_Single>> iters) :
+   dbPtr_(dbPtr), iters_(move(iters))
+{}
+
+////////////////////////////////////////////////////////////////////////////////
+//last key <= key. Seek_LE only lands on an exact match or past the end
+static bool seekShardBefore(LDBIter_Single& iter, BinaryDataRef key)
+{
+   if (!iter.seekTo(key))
+      return iter.seekToLast();
+
+   auto curKey = iter.getKeyRef();
+   if (compareDbKeys(
+      curKey.getPtr(), curKey.getSize(),
+      key.getPtr(), key.getSize()) <= 0)
+      return true;
+
+   iter.retreat();
+   return iter.readIterData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::isValid() const
+{
+   return current_ >= 0 && iters_[current_]->isValid();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LDBIter_Sharded::pick(bool forward)
+{
+   current_ = -1;
+   forward_ = forward;
+   aligned_ = true;
+
+   BinaryDataRef bestKey;
+   for (unsigned i = 0; i < iters_.size(); i++)
+   {
+      auto& iter = iters_[i];
+      if (!iter->readIterData())
+         continue;
+
+      auto key = iter->getKeyRef();
+      if (current_ != -1)
+      {
+         auto cmp = compareDbKeys(
+            key.getPtr(), key.getSize(),
+            bestKey.getPtr(), bestKey.getSize());
+         if (forward ? cmp >= 0 : cmp <= 0)
+            continue;
+      }
+
+      current_ = (int)i;
+      bestKey = key;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LDBIter_Sharded::align(bool forward)
+{
+   if (aligned_ && forward_ == forward)
+      return;
+
+   //keys are unique across shards, the other shards land strictly past it
+   auto& currentIter = iters_[current_];
+   currentIter->readIterData();
+   BinaryData key(currentIter->getKeyRef());
+
+   for (unsigned i = 0; i < iters_.size(); i++)
+   {
+      if ((int)i == current_)
+         continue;
+
+      if (forward)
+         iters_[i]->seekTo(key.getRef());
+      else
+         seekShardBefore(*iters_[i], key.getRef());
+   }
+
+   forward_ = forward;
+   aligned_ = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::seekTo(BinaryDataRef key)
+{
+   for (auto& iter : iters_)
+      iter->seekTo(key);
+
+   pick(true);
+   return readIterData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::seekToExact(BinaryDataRef key)
+{
+   //a hit only takes a seek on the shard the key routes to
+   auto shardId = dbPtr_->getShardId(key);
+   if (shardId < iters_.size() && iters_[shardId]->seekToExact(key))
+   {
+      current_ = (int)shardId;
+      aligned_ = false;
+      return readIterData();
+   }
+
+   if (!seekTo(key))
+      return false;
+
+   return checkKeyExact(key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::seekToBefore(BinaryDataRef key)
+{
+   for (auto& iter : iters_)
+      seekShardBefore(*iter, key);
+
+   pick(false);
+   return readIterData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::seekToFirst()
+{
+   for (auto& iter : iters_)
+      iter->seekToFirst();
+
+   pick(true);
+   return readIterData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::seekToLast()
+{
+   for (auto& iter : iters_)
+      iter->seekToLast();
+
+   pick(false);
+   return readIterData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::advance()
+{
+   isDirty_ = true;
+   if (!isValid())
+      return false;
+
+   align(true);
+   iters_[current_]->advance();
+   pick(true);
+   return isValid();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::retreat()
+{
+   isDirty_ = true;
+   if (!isValid())
+      return false;
+
+   align(false);
+   iters_[current_]->retreat();
+   pick(false);
+   return isValid();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::readIterData()
+{
+   if (!isValid() || !iters_[current_]->readIterData())
+   {
+      isDirty_ = true;
+      return false;
+   }
+
+   auto& iter = iters_[current_];
+   currKey_ = iter->getKeyRef();
+   currValue_ = iter->getValueRef();
+
+   currKeyReader_.setNewData(currKey_);
+   currValueReader_.setNewData(currValue_);
+   isDirty_ = false;
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
+//// DbTransaction_Sharded
 ////////////////////////////////////////////////////////////////////////////////
-//// DatabaseContainer_Single
 ////////////////////////////////////////////////////////////////////////////////
+thread_local vector<DbTransaction_Sharded*> DbTransaction_Sharded::txStack_;
+
 ////////////////////////////////////////////////////////////////////////////////
-void DatabaseContainer_Single::close()
+DbTransaction_Sharded::DbTransaction_Sharded(
+   const DatabaseContainer_Sharded* dbPtr, LMDB::Mode mode) :
+   dbPtr_(dbPtr), mode_(mode)
 {
-   db_.close();
+   txStack_.push_back(this);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void DatabaseContainer_Single::eraseOnDisk()
+DbTransaction_Sharded::~DbTransaction_Sharded()
 {
-   close();
-   auto&& dbPath = getDbPath(dbSelect_);
-   remove(dbPath.c_str());
-   
-   dbPath.append("-lock");
-   remove(dbPath.c_str());
+   commit();
+
+   auto iter = find(txStack_.rbegin(), txStack_.rend(), this);
+   if (iter != txStack_.rend())
+      txStack_.erase(next(iter).base());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-StoredDBInfo DatabaseContainer_Single::open()
+void DbTransaction_Sharded::commit()
 {
-   db_.open(getDbPath(dbSelect_), getDbName(dbSelect_));
+   //shard 0 carries the sdbi, it goes in after the data shards. A failed
+   //commit leaves the shards below it to the dtor
+   while (!txMap_.empty())
+   {
+      auto iter = prev(txMap_.end());
+      auto tx = move(iter->second);
+      txMap_.erase(iter);
+      tx.commit();
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DbTransaction_Sharded::beginShardTx(unsigned id)
+{
+   if (txMap_.find(id) != txMap_.end())
+      return;
+
+   auto env = dbPtr_->shards_[id]->getEnv();
+   txMap_.emplace(id, LMDBEnv::Transaction(env, mode_));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+DbTransaction_Sharded* DbTransaction_Sharded::getThreadTx(
+   const DatabaseContainer_Sharded* dbPtr)
+{
+   for (auto iter = txStack_.rbegin(); iter != txStack_.rend(); ++iter)
+   {
+      if ((*iter)->dbPtr_ == dbPtr)
+         return *iter;
+   }
+
+   return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// DatabaseContainer_Sharded
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+string DatabaseContainer_Sharded::getShardName(unsigned id) const
+{
+   auto&& dbName = getDbName(dbSelect_);
+   if (id == 0)
+      return dbName;
+
+   stringstream ss;
+   ss << dbName << "-" << id;
+   return ss.str();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+string DatabaseContainer_Sharded::getShardPath(unsigned id) const
+{
+   return getDbPath(getShardName(id));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+DBPair& DatabaseContainer_Sharded::getShard(unsigned id) const
+{
+   if (id >= shards_.size())
+      throw LmdbWrapperException("invalid shard id");
+
+   auto txPtr = DbTransaction_Sharded::getThreadTx(this);
+   if (txPtr != nullptr)
+      txPtr->beginShardTx(id);
+
+   return *shards_[id];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+StoredDBInfo DatabaseContainer_Sharded::open()
+{
+   auto&& dbName = getDbName(dbSelect_);
+   if (shards_.empty())
+   {
+      auto meta = make_unique<DBPair>(0);
+      meta->open(getShardPath(0), dbName);
+
+      unsigned shardCount = 1;
+      auto readOnly = meta->getEnv()->isReadOnly();
+      {
+         auto&& tx = meta->beginTransaction(
+            readOnly ? LMDB::ReadOnly : LMDB::ReadWrite);
+         auto&& countKey = WRITE_UINT32_BE(SHARD_COUNTER_KEY);
+         auto&& filterKey = ShardFilter::getDbKey();
+
+         auto countVal = meta->getValue(countKey.getRef());
+         if (countVal.getSize() == 4)
+         {
+            shardCount = READ_UINT32_BE(countVal);
+            filter_ = ShardFilter::deserialize(
+               meta->getValue(filterKey.getRef()));
+         }
+         else
+         {
+            //no sdbi yet: new db, otherwise a single env one
+            auto sdbiVal = meta->getValue(StoredDBInfo::getDBKey(0).getRef());
+            if (!readOnly && sdbiVal.getSize() == 0 && newShardCount_ > 1)
+            {
+               if (filter_ == nullptr)
+                  throw LmdbWrapperException("missing shard filter");
+
+               shardCount = newShardCount_;
+               meta->putValue(countKey.getRef(),
+                  WRITE_UINT32_BE(shardCount).getRef());
+               meta->putValue(filterKey.getRef(), 
+                  filter_->serialize().getRef());
+            }
+         }
+      }
+
+      if (shardCount == 0)
+         throw LmdbWrapperException("invalid shard count");
+
+      shards_.push_back(move(meta));
+      for (unsigned i = 1; i < shardCount; i++)
+      {
+         auto shard = make_unique<DBPair>(i);
+         shard->open(getShardPath(i), dbName);
+         shards_.push_back(move(shard));
+      }
+   }
 
    StoredDBInfo sdbi;
    try
@@ -3204,13 +4778,22 @@ StoredDBInfo DatabaseContainer_Single::open()
    }
    catch (runtime_error&)
    {
+      if (shards_[0]->getEnv()->isReadOnly())
+      {
+         throw LmdbWrapperException(
+            "no sdbi in read only db " + getDbName(dbSelect_));
+      }
+
       // If DB didn't exist yet (dbinfo key is empty), seed it
-      auto&& tx = db_.beginTransaction(LMDB::ReadWrite);
+      auto&& tx = beginTransaction(LMDB::ReadWrite);
 
       sdbi.magic_ = magicBytes_;
       sdbi.metaHash_ = BtcUtils::EmptyHash_;
       sdbi.topBlkHgt_ = 0;
       sdbi.armoryType_ = DBSettings::getDbType();
+
+      if (dbSelect_ == SUBSSH)
+         sdbi.subsshFormat_ = SUBSSH_FORMAT_COLUMNS;
       putStoredDBInfo(sdbi, 0);
    }
 
@@ -3218,24 +4801,54 @@ StoredDBInfo DatabaseContainer_Single::open()
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void DatabaseContainer_Single::putStoredDBInfo(
+void DatabaseContainer_Sharded::close()
+{
+   for (auto& shard : shards_)
+      shard->close();
+   shards_.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::eraseOnDisk()
+{
+   close();
+   auto&& dbPath = getShardPath(0);
+   remove(dbPath.c_str());
+   dbPath.append("-lock");
+   remove(dbPath.c_str());
+
+   //the shard count goes with shard 0, remove files until one is missing
+   for (unsigned i = 1; ; i++)
+   {
+      auto&& shardPath = getShardPath(i);
+      if (remove(shardPath.c_str()) != 0)
+         break;
+
+      shardPath.append("-lock");
+      remove(shardPath.c_str());
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::putStoredDBInfo(
    StoredDBInfo const & sdbi, uint32_t id)
 {
    SCOPED_TIMER("putStoredDBInfo");
    if (!sdbi.isInitialized())
       throw LmdbWrapperException("tried to write uninitiliazed sdbi");
 
-   putValue(StoredDBInfo::getDBKey(id), serializeDBValue(sdbi));
+   getShard(0).putValue(
+      StoredDBInfo::getDBKey(id), serializeDBValue(sdbi));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-StoredDBInfo DatabaseContainer_Single::getStoredDBInfo(uint32_t id)
+StoredDBInfo DatabaseContainer_Sharded::getStoredDBInfo(uint32_t id)
 {
    SCOPED_TIMER("getStoredDBInfo");
-   auto&& tx = db_.beginTransaction(LMDB::ReadOnly);
+   auto&& tx = beginTransaction(LMDB::ReadOnly);
 
    auto&& key = StoredDBInfo::getDBKey(id);
-   BinaryRefReader brr(getValue(key.getRef()));
+   BinaryRefReader brr(getShard(0).getValue(key.getRef()));
 
    if (brr.getSize() == 0)
       throw LmdbWrapperException("no sdbi at this key");
@@ -3246,36 +4859,159 @@ StoredDBInfo DatabaseContainer_Single::getStoredDBInfo(uint32_t id)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-BinaryDataRef DatabaseContainer_Single::getValue(BinaryDataRef key) const
+unsigned DatabaseContainer_Sharded::getShardCount() const
 {
-   return db_.getValue(key);
+   return shards_.size() == 0 ? 1 : (unsigned)shards_.size();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void DatabaseContainer_Single::putValue(
-   BinaryDataRef key,
-   BinaryDataRef value)
+unsigned DatabaseContainer_Sharded::getShardId(BinaryDataRef key) const
 {
-   db_.putValue(key, value);
+   if (shards_.size() <= 1)
+      return 0;
+
+   return filter_->keyToId(key) % shards_.size();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void DatabaseContainer_Single::deleteValue(BinaryDataRef key)
+vector<pair<string, LMDBEnv*>> DatabaseContainer_Sharded::getEnvs()
 {
-   db_.deleteValue(key);
+   vector<pair<string, LMDBEnv*>> result;
+   for (unsigned i = 0; i < shards_.size(); i++)
+      result.emplace_back(getShardName(i), shards_[i]->getEnv());
+   return result;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-unique_ptr<DbTransaction> DatabaseContainer_Single::beginTransaction(
+BinaryDataRef DatabaseContainer_Sharded::getValue(BinaryDataRef key) const
+{
+   return getShard(getShardId(key)).getValue(key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<BinaryDataRef> DatabaseContainer_Sharded::multiGet(
+   const vector<BinaryDataRef>& keys) const
+{
+   if (shards_.size() <= 1)
+      return getShard(0).multiGet(keys);
+
+   //split per shard, each resolves its keys with its own cursor walk
+   vector<vector<BinaryDataRef>> shardKeys(shards_.size());
+   vector<vector<unsigned>> shardIds(shards_.size());
+   for (unsigned i = 0; i < keys.size(); i++)
+   {
+      auto id = getShardId(keys[i]);
+      shardKeys[id].push_back(keys[i]);
+      shardIds[id].push_back(i);
+   }
+
+   vector<BinaryDataRef> result(keys.size());
+   for (unsigned id = 0; id < shards_.size(); id++)
+   {
+      if (shardKeys[id].empty())
+         continue;
+
+      auto&& vals = getShard(id).multiGet(shardKeys[id]);
+      for (unsigned i = 0; i < vals.size(); i++)
+         result[shardIds[id][i]] = vals[i];
+   }
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::putValue(
+   BinaryDataRef key, BinaryDataRef value)
+{
+   getShard(getShardId(key)).putValue(key, value);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t DatabaseContainer_Sharded::putValues(
+   const vector<pair<BinaryDataRef, BinaryDataRef>>& keyVals)
+{
+   if (shards_.size() <= 1)
+      return getShard(0).putValues(keyVals);
+
+   //the split keeps each shard's keys sorted
+   vector<vector<pair<BinaryDataRef, BinaryDataRef>>> shardKeyVals(
+      shards_.size());
+   for (auto& keyVal : keyVals)
+      shardKeyVals[getShardId(keyVal.first)].push_back(keyVal);
+
+   size_t appended = 0;
+   for (unsigned id = 0; id < shards_.size(); id++)
+   {
+      if (shardKeyVals[id].empty())
+         continue;
+
+      appended += getShard(id).putValues(shardKeyVals[id]);
+   }
+
+   return appended;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::deleteValue(BinaryDataRef key)
+{
+   getShard(getShardId(key)).deleteValue(key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+LMDBEnv::MapStats DatabaseContainer_Sharded::getMapStats() const
+{
+   LMDBEnv::MapStats stats;
+   for (auto& shard : shards_)
+   {
+      auto&& shardStats = shard->getEnv()->getMapStats();
+      stats.mapSize_ += shardStats.mapSize_;
+      stats.usedSize_ += shardStats.usedSize_;
+      stats.resizeCount_ += shardStats.resizeCount_;
+      stats.skippedResizes_ += shardStats.skippedResizes_;
+      stats.mapFullCount_ += shardStats.mapFullCount_;
+      stats.pauseTime_ += shardStats.pauseTime_;
+      stats.maxPause_ = max(stats.maxPause_, shardStats.maxPause_);
+   }
+
+   return stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::reserveMapSpace(
+   const vector<pair<BinaryDataRef, BinaryDataRef>>& keyVals)
+{
+   vector<size_t> bytes(shards_.size(), 0);
+   for (auto& keyVal : keyVals)
+   {
+      bytes[getShardId(keyVal.first)] += 
+         keyVal.first.getSize() + keyVal.second.getSize();
+   }
+
+   for (unsigned i = 0; i < shards_.size(); i++)
+   {
+      if (bytes[i] > 0)
+         shards_[i]->getEnv()->reserve(bytes[i]);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unique_ptr<DbTransaction> DatabaseContainer_Sharded::beginTransaction(
    LMDB::Mode mode) const
 {
-   return make_unique<DbTransaction_Single>(move(db_.beginTransaction(mode)));
+   return make_unique<DbTransaction_Sharded>(this, mode);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-unique_ptr<LDBIter> DatabaseContainer_Single::getIterator()
+unique_ptr<LDBIter> DatabaseContainer_Sharded::getIterator()
 {
-   return db_.getIterator();
+   if (shards_.size() == 1)
+      return getShard(0).getIterator();
+
+   vector<unique_ptr<LDBIter_Single>> iters;
+   for (unsigned id = 0; id < shards_.size(); id++)
+      iters.push_back(getShard(id).getIterator());
+
+   return make_unique<LDBIter_Sharded>(this, move(iters));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -3310,6 +5046,11 @@ unique_ptr<ShardFilter> ShardFilter::deserialize(BinaryDataRef dataRef)
       return ShardFilter_Spentness::deserialize(dataRef);
    }
 
+   case ShardFilterType_KeySlice:
+   {
+      return ShardFilter_KeySlice::deserialize(dataRef);
+   }
+
    default:
       throw FilterException("unexpected shard filter type");
    }
@@ -3438,6 +5179,55 @@ unsigned ShardFilter_Spentness::getHeightForId(unsigned id) const
       return thresholdValue_ + (id - thresholdId_) * step_;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// ShardFilter_KeySlice
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+BinaryData ShardFilter_KeySlice::serialize() const
+{
+   BinaryWriter bw;
+   bw.put_uint8_t(ShardFilterType_KeySlice);
+   bw.put_uint32_t(offset_);
+   bw.put_uint32_t(length_);
+
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unique_ptr<ShardFilter> ShardFilter_KeySlice::deserialize(BinaryDataRef dataRef)
+{
+   BinaryRefReader brr(dataRef);
+
+   auto type = brr.get_uint8_t();
+   if (type != (uint8_t)ShardFilterType_KeySlice)
+      throw FilterException("shard filter type mismatch");
+
+   auto offset = brr.get_uint32_t();
+   auto length = brr.get_uint32_t();
+   return make_unique<ShardFilter_KeySlice>(offset, length);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned ShardFilter_KeySlice::keyToId(BinaryDataRef keyRef) const
+{
+   if (keyRef.getSize() <= offset_ + length_)
+      return 0;
+
+   auto ptr = keyRef.getPtr() + offset_;
+   unsigned id = 0;
+   for (unsigned i = 0; i < length_; i++)
+      id = (id << 8) | ptr[i];
+
+   return id;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned ShardFilter_KeySlice::getHeightForId(unsigned) const
+{
+   throw FilterException("key slice ids do not map to heights");
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 //// DbTransaction
@@ -3445,3 +5235,124 @@ unsigned ShardFilter_Spentness::getHeightForId(unsigned id) const
 ////////////////////////////////////////////////////////////////////////////////
 DbTransaction::~DbTransaction()
 {}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// DbWriteGate
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+thread_local unsigned DbWriteGate::depth_ = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+void DbWriteGate::enter()
+{
+   if (depth_++ > 0)
+      return;
+
+   unique_lock<mutex> lock(mu_);
+   cv_.wait(lock, [this](void)->bool { return !frozen_; });
+   ++activeCount_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DbWriteGate::exit()
+{
+   if (--depth_ > 0)
+      return;
+
+   unique_lock<mutex> lock(mu_);
+   --activeCount_;
+   cv_.notify_all();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DbWriteGate::freeze()
+{
+   //would wait on itself
+   if (depth_ > 0)
+      throw LmdbWrapperException("cannot freeze from within a write section");
+
+   unique_lock<mutex> lock(mu_);
+   cv_.wait(lock, [this](void)->bool { return !frozen_; });
+   frozen_ = true;
+   cv_.wait(lock, [this](void)->bool { return activeCount_ == 0; });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DbWriteGate::thaw()
+{
+   unique_lock<mutex> lock(mu_);
+   frozen_ = false;
+   cv_.notify_all();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// DbSnapshot
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+BinaryData DbSnapshot::serialize() const
+{
+   BinaryWriter bw;
+   bw.put_uint8_t(DB_SNAPSHOT_VERSION);
+   bw.put_uint32_t(topHeight_);
+   bw.put_var_int(topHash_.getSize());
+   bw.put_BinaryData(topHash_);
+
+   bw.put_var_int(dbs_.size());
+   for (auto& entry : dbs_)
+   {
+      bw.put_uint8_t((uint8_t)entry.db_);
+
+      BinaryWriter bwSdbi;
+      entry.sdbi_.serializeDBValue(bwSdbi);
+      bw.put_var_int(bwSdbi.getSize());
+      bw.put_BinaryData(bwSdbi.getData());
+
+      bw.put_var_int(entry.files_.size());
+      for (auto& file : entry.files_)
+      {
+         bw.put_var_int(file.size());
+         bw.put_String(file);
+      }
+   }
+
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+DbSnapshot DbSnapshot::deserialize(BinaryDataRef data)
+{
+   BinaryRefReader brr(data);
+   if (brr.get_uint8_t() != DB_SNAPSHOT_VERSION)
+      throw LmdbWrapperException("unsupported snapshot manifest version");
+
+   DbSnapshot result;
+   result.topHeight_ = brr.get_uint32_t();
+   auto len = brr.get_var_int();
+   result.topHash_ = brr.get_BinaryData(len);
+
+   auto count = brr.get_var_int();
+   for (unsigned i = 0; i < count; i++)
+   {
+      Entry entry;
+      auto db = brr.get_uint8_t();
+      if (db >= COUNT)
+         throw LmdbWrapperException("invalid db in snapshot manifest");
+      entry.db_ = (DB_SELECT)db;
+
+      len = brr.get_var_int();
+      entry.sdbi_.unserializeDBValue(brr.get_BinaryDataRef(len));
+
+      auto fileCount = brr.get_var_int();
+      for (unsigned y = 0; y < fileCount; y++)
+      {
+         len = brr.get_var_int();
+         entry.files_.push_back(brr.get_String(len));
+      }
+
+      result.dbs_.push_back(move(entry));
+   }
+
+   return result;
+}
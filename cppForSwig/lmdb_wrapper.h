@@ -16,6 +16,8 @@
 
 #include <list>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
 #include "log.h"
 #include "BinaryData.h"
 #include "BtcUtils.h"
@@ -26,6 +28,8 @@
 #include "lmdbpp.h"
 #include "ThreadSafeClasses.h"
 #include "ReentrantLock.h"
+#include "DBCommitStage.h"
+#include "TxHintIndex.h"
 
 #define META_SHARD_ID               0xFFFFFFFF
 #define SHARD_COUNTER_KEY           0xA76B6C00
@@ -33,6 +37,9 @@
 
 #define SHARD_FILTER_DBKEY          0xAC28337D
 
+#define DB_SNAPSHOT_MANIFEST        "snapshot"
+#define DB_SNAPSHOT_VERSION         1
+
 #ifndef UNIT_TESTS
 #define SHARD_FILTER_SCRADDR_STEP   1500
 #define SHARD_FILTER_SPENTNESS_STEP 5000
@@ -120,9 +127,12 @@ class StoredScriptHistory;
 enum ShardFilterType
 {
    ShardFilterType_ScrAddr = 0,
-   ShardFilterType_Spentness
+   ShardFilterType_Spentness,
+   ShardFilterType_KeySlice
 };
 
+class DatabaseContainer_Sharded;
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 class LDBIter
@@ -214,6 +224,50 @@ public:
    bool readIterData(void) override;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+class LDBIter_Sharded : public LDBIter
+{
+   /***
+   Merges the iterators of each shard into a single walk in key order. A
+   key lives in one shard only, the iterator sits on the shard with the
+   lowest key (highest when going backwards), the others are positioned
+   past it.
+
+   seekToExact only seeks the shard the key routes to. The other shards
+   are positioned on the next advance or retreat.
+   ***/
+
+private:
+   const DatabaseContainer_Sharded* dbPtr_;
+   std::vector<std::unique_ptr<LDBIter_Single>> iters_;
+
+   int current_ = -1;
+   bool forward_ = true;
+   bool aligned_ = true;
+
+private:
+   void pick(bool forward);
+   void align(bool forward);
+
+public:
+   LDBIter_Sharded(const DatabaseContainer_Sharded*,
+      std::vector<std::unique_ptr<LDBIter_Single>>);
+
+   //virtuals
+   bool isNull(void) const override { return !isValid(); }
+   bool isValid(void) const override;
+
+   bool seekTo(BinaryDataRef key) override;
+   bool seekToExact(BinaryDataRef key) override;
+   bool seekToBefore(BinaryDataRef key) override;
+   bool seekToFirst(void) override;
+   bool seekToLast(void) override;
+
+   bool advance(void) override;
+   bool retreat(void) override;
+   bool readIterData(void) override;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 class DBPair
 {
@@ -232,7 +286,10 @@ public:
    void close(void);
 
    BinaryDataRef getValue(BinaryDataRef keyWithPrefix) const;
+   std::vector<BinaryDataRef> multiGet(const std::vector<BinaryDataRef>&);
    void putValue(BinaryDataRef key, BinaryDataRef value);
+   size_t putValues(
+      const std::vector<std::pair<BinaryDataRef, BinaryDataRef>>&);
    void deleteValue(BinaryDataRef key);
    
    std::unique_ptr<LDBIter_Single> getIterator(void);
@@ -252,6 +309,9 @@ public:
    {}
 
    virtual ~DbTransaction(void) = 0;
+
+   //commits ahead of the dtor, for callers that handle commit errors
+   virtual void commit(void) = 0;
 };
 
 ////////
@@ -264,6 +324,37 @@ public:
    DbTransaction_Single(LMDBEnv::Transaction&& dbtx) :
       dbtx_(std::move(dbtx))
    {}
+
+   void commit(void) override { dbtx_.commit(); }
+};
+
+////////
+class DbTransaction_Sharded : public DbTransaction
+{
+   /***
+   Opens its shard transactions on first use, so that writers on different
+   shards don't wait on each other's env lock. Transactions are per thread,
+   each thread keeps a stack of its open sharded transactions, the shards
+   are opened in the most recent one for the container.
+   ***/
+
+private:
+   const DatabaseContainer_Sharded* dbPtr_;
+   const LMDB::Mode mode_;
+   std::map<unsigned, LMDBEnv::Transaction> txMap_;
+
+   static thread_local std::vector<DbTransaction_Sharded*> txStack_;
+
+public:
+   DbTransaction_Sharded(const DatabaseContainer_Sharded*, LMDB::Mode);
+   ~DbTransaction_Sharded(void);
+
+   DbTransaction_Sharded(const DbTransaction_Sharded&) = delete;
+   DbTransaction_Sharded& operator=(const DbTransaction_Sharded&) = delete;
+
+   void commit(void) override;
+   void beginShardTx(unsigned);
+   static DbTransaction_Sharded* getThreadTx(const DatabaseContainer_Sharded*);
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -299,11 +390,27 @@ public:
    virtual std::unique_ptr<LDBIter> getIterator(void) = 0;
    
    virtual BinaryDataRef getValue(BinaryDataRef keyWithPrefix) const = 0;
+   virtual std::vector<BinaryDataRef> multiGet(
+      const std::vector<BinaryDataRef>&) const = 0;
    virtual void putValue(BinaryDataRef key, BinaryDataRef value) = 0;
+   virtual size_t putValues(
+      const std::vector<std::pair<BinaryDataRef, BinaryDataRef>>&) = 0;
    virtual void deleteValue(BinaryDataRef key) = 0;
 
    virtual StoredDBInfo getStoredDBInfo(uint32_t id) = 0;
    virtual void putStoredDBInfo(StoredDBInfo const & sdbi, uint32_t id) = 0;
+
+   virtual LMDBEnv::MapStats getMapStats(void) const = 0;
+
+   //grows the maps ahead of a write txn for these puts
+   virtual void reserveMapSpace(
+      const std::vector<std::pair<BinaryDataRef, BinaryDataRef>>&) = 0;
+
+   virtual unsigned getShardCount(void) const = 0;
+   virtual unsigned getShardId(BinaryDataRef key) const = 0;
+
+   //envs by file name, relative to baseDir_
+   virtual std::vector<std::pair<std::string, LMDBEnv*>> getEnvs(void) = 0;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -331,11 +438,24 @@ public:
    std::unique_ptr<LDBIter> getIterator(void);
 
    BinaryDataRef getValue(BinaryDataRef key) const;
+   std::vector<BinaryDataRef> multiGet(
+      const std::vector<BinaryDataRef>&) const;
    void putValue(BinaryDataRef key, BinaryDataRef value);
+   size_t putValues(
+      const std::vector<std::pair<BinaryDataRef, BinaryDataRef>>&);
    void deleteValue(BinaryDataRef key);
 
    StoredDBInfo getStoredDBInfo(uint32_t id);
    void putStoredDBInfo(StoredDBInfo const & sdbi, uint32_t id);
+
+   LMDBEnv::MapStats getMapStats(void) const;
+   void reserveMapSpace(
+      const std::vector<std::pair<BinaryDataRef, BinaryDataRef>>&);
+
+   unsigned getShardCount(void) const { return 1; }
+   unsigned getShardId(BinaryDataRef) const { return 0; }
+
+   std::vector<std::pair<std::string, LMDBEnv*>> getEnvs(void);
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -411,6 +531,174 @@ struct ShardFilter_Spentness : public ShardFilter
    static std::unique_ptr<ShardFilter> deserialize(BinaryDataRef);
 };
 
+////////
+struct ShardFilter_KeySlice : public ShardFilter
+{
+   /***
+   The id is the slice of the key at offset_, read big endian. Keys that
+   don't extend past the slice (the sdbi keys) get id 0.
+   ***/
+
+   const unsigned offset_;
+   const unsigned length_;
+
+   ShardFilter_KeySlice(unsigned offset, unsigned length) :
+      offset_(offset), length_(length)
+   {
+      if (length_ == 0 || length_ > 4)
+         throw FilterException("invalid key slice length");
+   }
+
+   unsigned keyToId(BinaryDataRef) const;
+   unsigned getHeightForId(unsigned) const;
+   BinaryData serialize(void) const;
+
+   static std::unique_ptr<ShardFilter> deserialize(BinaryDataRef);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class DatabaseContainer_Sharded : public DatabaseContainer
+{
+   /***
+   Spreads a db over several LMDB envs, each with its own writer lock, so
+   that batches for different shards commit in parallel.
+
+   A key goes to shard (filter id % shard count). Shard 0 is the env at
+   the regular db path, it carries the sdbi along with the shard count and
+   filter. The other shards are at <db path>-<shard id>. A db with no
+   shard count on disk is a single env db, so existing dbs open as is.
+
+   The shard count and filter passed to the ctor only apply to new dbs.
+   ***/
+
+   friend class DbTransaction_Sharded;
+
+private:
+   const unsigned newShardCount_;
+   std::unique_ptr<ShardFilter> filter_;
+   std::vector<std::unique_ptr<DBPair>> shards_;
+
+private:
+   std::string getShardName(unsigned) const;
+   std::string getShardPath(unsigned) const;
+
+   //opens the shard in the thread's current transaction
+   DBPair& getShard(unsigned) const;
+
+public:
+   DatabaseContainer_Sharded(DB_SELECT dbSelect,
+      std::unique_ptr<ShardFilter> filter, unsigned shardCount) :
+      DatabaseContainer(dbSelect), newShardCount_(shardCount),
+      filter_(std::move(filter))
+   {}
+
+   ~DatabaseContainer_Sharded(void)
+   {
+      close();
+   }
+
+   //virtuals
+   StoredDBInfo open(void);
+   void close(void);
+   void eraseOnDisk(void);
+
+   std::unique_ptr<DbTransaction> beginTransaction(LMDB::Mode) const;
+   std::unique_ptr<LDBIter> getIterator(void);
+
+   BinaryDataRef getValue(BinaryDataRef key) const;
+   std::vector<BinaryDataRef> multiGet(
+      const std::vector<BinaryDataRef>&) const;
+   void putValue(BinaryDataRef key, BinaryDataRef value);
+   size_t putValues(
+      const std::vector<std::pair<BinaryDataRef, BinaryDataRef>>&);
+   void deleteValue(BinaryDataRef key);
+
+   StoredDBInfo getStoredDBInfo(uint32_t id);
+   void putStoredDBInfo(StoredDBInfo const & sdbi, uint32_t id);
+
+   //summed over the shards, max pause is the largest of any shard
+   LMDBEnv::MapStats getMapStats(void) const;
+
+   //each shard makes room for its own part of the puts
+   void reserveMapSpace(
+      const std::vector<std::pair<BinaryDataRef, BinaryDataRef>>&);
+
+   unsigned getShardCount(void) const;
+   unsigned getShardId(BinaryDataRef key) const;
+
+   std::vector<std::pair<std::string, LMDBEnv*>> getEnvs(void);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class DbWriteGate
+{
+   /***
+   Chain updates and side scans run in a write section. freeze() waits for
+   the open sections to close and holds new ones back until thaw(), which
+   leaves every db at the same top block while a snapshot is taken.
+
+   Sections nest per thread, only the outer one is counted.
+   ***/
+
+private:
+   std::mutex mu_;
+   std::condition_variable cv_;
+   unsigned activeCount_ = 0;
+   bool frozen_ = false;
+
+   static thread_local unsigned depth_;
+
+private:
+   void enter(void);
+   void exit(void);
+
+public:
+   class Section
+   {
+   private:
+      DbWriteGate& gate_;
+
+   public:
+      Section(DbWriteGate& gate) :
+         gate_(gate)
+      {
+         gate_.enter();
+      }
+
+      ~Section(void)
+      {
+         gate_.exit();
+      }
+
+      Section(const Section&) = delete;
+      Section& operator=(const Section&) = delete;
+   };
+
+   void freeze(void);
+   void thaw(void);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct DbSnapshot
+{
+   struct Entry
+   {
+      DB_SELECT db_;
+      StoredDBInfo sdbi_;
+      std::vector<std::string> files_;
+   };
+
+   //SSH sdbi, the last db a chain update commits
+   uint32_t topHeight_ = 0;
+   BinaryData topHash_;
+
+   std::vector<Entry> dbs_;
+
+   //content of the DB_SNAPSHOT_MANIFEST file
+   BinaryData serialize(void) const;
+   static DbSnapshot deserialize(BinaryDataRef);
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 class LMDBBlockDatabase
 {
@@ -426,6 +714,18 @@ private:
 
       return iter->second;
    }
+
+   //picks the dbkey for txhash out of its TXHINTS entry
+   BinaryData getDBKeyFromHints(BinaryDataRef txhash,
+      BinaryRefReader& brrHints, uint8_t expectedDupId) const;
+
+   //resolves txhash through the static hint index, empty on a miss
+   BinaryData getDBKeyFromIndex(BinaryDataRef txhash,
+      uint8_t expectedDupId) const;
+   bool txHintKeyExists(BinaryDataRef dbKey6B) const;
+
+   //key layout driven shard filter for the sharded supernode dbs
+   static std::unique_ptr<ShardFilter> getShardFilter(DB_SELECT);
    
 public:
    LMDBBlockDatabase(std::shared_ptr<Blockchain>, const std::string&);
@@ -476,6 +776,15 @@ public:
    // BinaryData key(string(theStr));
    BinaryDataRef getValueNoCopy(DB_SELECT db, BinaryDataRef keyWithPrefix) const;
 
+   /////////////////////////////////////////////////////////////////////////////
+   // Batched getValueNoCopy. The keys are sorted and resolved by a single 
+   // cursor walking forward through one read transaction. Values come back
+   // in the order of the keys, empty refs for missing keys. Like 
+   // getValueNoCopy, the refs are only valid for as long as the caller holds
+   // a transaction on this db.
+   std::vector<BinaryDataRef> multiGet(
+      DB_SELECT db, const std::vector<BinaryDataRef>& keysWithPrefix) const;
+
    /////////////////////////////////////////////////////////////////////////////
    // Get value using BinaryDataRef object.  The data from the get* call is 
    // actually stored in a member variable, and thus the refs are valid only 
@@ -490,6 +799,8 @@ public:
 
    BinaryData getDBKeyForHash(const BinaryData& txhash,
       uint8_t dupId = UINT8_MAX) const;
+   std::vector<BinaryData> getDBKeysForHashes(
+      const std::vector<BinaryDataRef>& txhashes) const;
    BinaryData getHashForDBKey(BinaryData dbkey) const;
    BinaryData getHashForDBKey(uint32_t hgt,
       uint8_t  dup,
@@ -504,6 +815,41 @@ public:
    void putValue(DB_SELECT db, BinaryData const & key, BinaryData const & value);
    void putValue(DB_SELECT db, DB_PREFIX pref, BinaryDataRef key, BinaryDataRef value);
 
+   /////////////////////////////////////////////////////////////////////////////
+   // Puts a key sorted batch, the caller holds a write transaction on db. 
+   // Keys past the last key in db are appended. Returns the appended count.
+   size_t putValues(DB_SELECT db,
+      const std::vector<std::pair<BinaryDataRef, BinaryDataRef>>& keyVals);
+
+   //map size, usage and resize counts for db
+   LMDBEnv::MapStats getMapStats(DB_SELECT db) const;
+
+   //grows the maps of db ahead of a write txn for keyVals. Call with no
+   //transaction open on db
+   void reserveMapSpace(DB_SELECT db,
+      const std::vector<std::pair<BinaryDataRef, BinaryDataRef>>& keyVals);
+
+   //1 for single env dbs, see DatabaseContainer_Sharded
+   unsigned getShardCount(DB_SELECT db) const;
+   unsigned getShardId(DB_SELECT db, BinaryDataRef key) const;
+
+   //batched writes for the put heavy phases, see DBCommitStage
+   DBCommitStage& commitStage(void) { return *commitStage_; }
+
+   //adds the tx hints committed since the last call to the static index
+   void updateTxHintIndex(void);
+   const TxHintIndex* txHintIndex(void) const { return txHintIndex_.get(); }
+
+   //SUBSSH value layout on supernode, see SubsshColumns
+   uint8_t getSubsshFormat(void) const { return subsshFormat_; }
+
+   //writers that move the db top hold a section, see DbWriteGate
+   DbWriteGate& writeGate(void) { return writeGate_; }
+
+   //copies every db but ZERO_CONF into dir at a common top block. dir has
+   //to exist and can't already hold the db files
+   DbSnapshot snapshot(const std::string& dir);
+
    /////////////////////////////////////////////////////////////////////////////
    // Put value based on BinaryData key.  If batch writing, pass in the batch
    void deleteValue(DB_SELECT db, BinaryDataRef key);
@@ -514,6 +860,9 @@ public:
       const std::function<void(std::shared_ptr<BlockHeader>, uint32_t, uint8_t)> &callback
       );
 
+   //header by hash, with height and dup set. nullptr if not in HEADERS
+   std::shared_ptr<BlockHeader> readHeader(BinaryDataRef hash);
+
    std::map<uint32_t, uint32_t> getSSHSummary(BinaryDataRef scrAddrStr);
 
    uint32_t getStxoCountForTx(const BinaryData & dbKey6) const;
@@ -604,11 +953,15 @@ public:
    bool getStoredTxOut(
       StoredTxOut & stxo, const BinaryData& txHash, uint16_t txoutid) const;
 
+   //batched getStoredTxOut(stxo, DBkey), false if any of the keys is missing
+   bool getStoredTxOuts(std::vector<StoredTxOut>& stxos,
+      const std::vector<BinaryData>& DBkeys) const;
+
    void getSpentness(StoredTxOut& stxo);
 
    void getUTXOflags(std::map<BinaryData, StoredSubHistory>&) const;
    void getUTXOflags(StoredSubHistory&) const;
-   void getUTXOflags_Super(StoredSubHistory&) const;
+   void getUTXOflags_Super(std::map<BinaryData, TxIOPair>&) const;
 
    /////////////////////////////////////////////////////////////////////////////
    // StoredScriptHistory Accessors
@@ -635,6 +988,22 @@ public:
    bool fillStoredSubHistory(StoredScriptHistory&, unsigned, unsigned) const;
    bool fillStoredSubHistory_Super(StoredScriptHistory&, unsigned, unsigned) const;
 
+   //hands the SUBSSH value and height offsets of each batch covering
+   //[start, end] to the callback, oldest first
+   void walkSubsshBatches(const StoredScriptHistory&, unsigned, unsigned,
+      const std::function<void(BinaryDataRef, unsigned, unsigned)>&) const;
+
+   /*
+   History page: the txios of scrAddrStr in [startBlock, endBlock], the
+   latest state of each output, UTXO flags set. Columnar subssh are read
+   off the columns, without building the StoredSubHistory maps. Fills the
+   ssh summary as well.
+   */
+   bool getHistoryTxios(StoredScriptHistory& ssh, BinaryDataRef scrAddrStr,
+      std::map<BinaryData, TxIOPair>& txioMap,
+      uint32_t startBlock = 0, uint32_t endBlock = UINT32_MAX,
+      bool withMultisig = false) const;
+
    // This method breaks from the convention I've used for getting/putting 
    // stored objects, because we never really handle Sub-ssh objects directly,
    // but we do need to harness them.  This method could be renamed to
@@ -656,6 +1025,21 @@ public:
    bool getStoredTxHints(StoredTxHints & sths, BinaryDataRef hashPrefix) const;
    void updatePreferredTxHint(BinaryDataRef hashOrPrefix, BinaryData preferKey);
 
+   //utxo snapshots, keyed by ScrAddrFilter sdbi key and height
+   void putUtxoSnapshot(const StoredUtxoSnapshot&);
+   bool getUtxoSnapshot(StoredUtxoSnapshot&, 
+      uint32_t filterKey, uint32_t height) const;
+   std::vector<uint32_t> getUtxoSnapshotHeights(uint32_t filterKey) const;
+   void deleteUtxoSnapshots(uint32_t fromHeight);
+
+   //supernode build checkpoints, in SUBSSH_META. pushBuildCheckpoint
+   //commits once the futures are ready, so the checkpoint never gets ahead
+   //of the data it covers
+   bool getBuildCheckpoint(StoredBuildCheckpoint&, BUILD_CHECKPOINT_TYPE);
+   std::shared_future<void> pushBuildCheckpoint(const StoredBuildCheckpoint&,
+      std::vector<std::shared_future<void>>);
+   void deleteBuildCheckpoint(BUILD_CHECKPOINT_TYPE);
+
    bool putStoredHeadHgtList(StoredHeadHgtList const & hhl);
    bool getStoredHeadHgtList(StoredHeadHgtList & hhl, uint32_t height) const;
 
@@ -717,7 +1101,7 @@ public:
 
 public:
    std::map<DB_SELECT, std::shared_ptr<DatabaseContainer>> dbMap_;
-   const static std::map<std::string, size_t> mapSizes_;
+   const static std::map<std::string, size_t> mapHeadroom_;
 
 private:
    bool                 dbIsOpen_;
@@ -734,9 +1118,19 @@ private:
    std::map<BinaryData, StoredScriptHistory>   registeredSSHs_;
    const std::shared_ptr<Blockchain> blockchainPtr_;   
    std::string blkFolder_;
-   const static std::set<DB_SELECT> supernodeDBs_;
+   const static std::set<DB_SELECT> shardedDBs_;
 
    Armory::Threading::TransactionalMap<unsigned, unsigned> heightToBatchId_;
+
+   std::unique_ptr<DBCommitStage> commitStage_;
+   std::unique_ptr<TxHintIndex> txHintIndex_;
+
+   //hints read past the index, not enough for a segment yet. Only touched
+   //by updateTxHintIndex
+   std::vector<TxHintEntry> txHintPending_;
+   BinaryData txHintPendingTo_;
+   uint8_t subsshFormat_ = SUBSSH_FORMAT_ROWS;
+   DbWriteGate writeGate_;
 };
 
 #endif
@@ -13,6 +13,7 @@
 #include <cstring>
 #include <algorithm>
 #include <iostream>
+#include <chrono>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -26,6 +27,37 @@ static std::string errorString(int rc)
    return mdb_strerror(rc);
 }
 
+namespace
+{
+   // per thread map of env id to that thread's tx info. Envs are few, a
+   // linear scan beats hashing the thread id and locking the env
+   struct ThreadTxCache
+   {
+      struct Entry
+      {
+         uint64_t envId_;
+         LMDBThreadTxInfo* info_;
+         std::weak_ptr<LMDBThreadTxInfo> ref_;
+      };
+
+      std::vector<Entry> entries_;
+
+      ~ThreadTxCache()
+      {
+         // let the envs reclaim our idle read txns
+         for (auto& entry : entries_)
+         {
+            auto infoPtr = entry.ref_.lock();
+            if (infoPtr != nullptr)
+               infoPtr->orphaned_.store(true, std::memory_order_release);
+         }
+      }
+   };
+
+   thread_local ThreadTxCache threadTxCache_;
+   std::atomic<uint64_t> envIdCounter_{0};
+}
+
 inline void LMDB::Iterator::checkHasDb() const
 {
    if (!db_)
@@ -64,20 +96,11 @@ inline void LMDB::Iterator::checkOk() const
 
 void LMDB::Iterator::openCursor()
 {
-   auto tID = std::this_thread::get_id();
-   LMDBEnv *const _env = db_->env;
-   std::unique_lock<std::mutex> lock(_env->threadTxMutex_);
-   
-   auto txnIter = _env->txForThreads_.find(tID);
-   if (txnIter == _env->txForThreads_.end())
+   auto thTx = db_->env->getThreadTxInfo();
+   if (thTx == nullptr || thTx->transactionLevel_ == 0)
       throw std::runtime_error("Iterator must be created within Transaction");
    
-   lock.unlock();
-   
-   if (txnIter->second.transactionLevel_ == 0)
-      throw std::runtime_error("Iterator must be created within Transaction");
-   
-   txnPtr_ = &txnIter->second;
+   txnPtr_ = thTx;
   
    int rc = mdb_cursor_open(txnPtr_->txn_, db_->dbi, &csr_);
    if (rc != MDB_SUCCESS)
@@ -354,12 +377,27 @@ bool LMDBEnv::isOpen() const
    return dbenv != nullptr;
 }
 
+bool LMDBEnv::isReadOnly() const
+{
+   if (dbenv == nullptr)
+      return false;
+
+   unsigned flags = 0;
+   if (mdb_env_get_flags(dbenv, &flags) != MDB_SUCCESS)
+      return false;
+
+   return (flags & MDB_RDONLY) != 0;
+}
+
 void LMDBEnv::open(const char *filename, unsigned flags)
 {
    if (isOpen())
       throw std::logic_error("Database environment already open (close it first)");
 
-   txForThreads_.clear();
+   {
+      std::unique_lock<std::mutex> lock(threadTxMutex_);
+      txForThreads_.clear();
+   }
    
    int rc;
 
@@ -381,18 +419,97 @@ void LMDBEnv::open(const char *filename, unsigned flags)
       throw LMDBException(ss.str());
    }
 
+   MDB_stat stat;
+   rc = mdb_env_stat(dbenv, &stat);
+   if (rc != MDB_SUCCESS)
+      throw LMDBException("Failed to stat env (" + errorString(rc) + ")");
+   pageSize_ = stat.ms_psize;
+
+   {
+      std::unique_lock<std::mutex> lock(growMutex_);
+      mapHeadroom_ = 0;
+      mapStats_ = MapStats();
+      retryResizeAt_ = std::chrono::steady_clock::time_point();
+   }
+
    filename_ = std::string(filename);
+   envId_.store(++envIdCounter_, std::memory_order_release);
 }
 
 void LMDBEnv::close()
 {
    if (dbenv)
    {
+      {
+         //idle read txns have to go before the env
+         std::unique_lock<std::mutex> lock(threadTxMutex_);
+         releaseIdleReadTxns(true);
+         txForThreads_.clear();
+         envId_.store(0, std::memory_order_release);
+      }
+
       mdb_env_close(dbenv);
       dbenv = nullptr;
    }
 }
 
+LMDBThreadTxInfo* LMDBEnv::getThreadTxInfo()
+{
+   auto envId = envId_.load(std::memory_order_acquire);
+   if (envId == 0)
+      return nullptr;
+
+   auto& entries = threadTxCache_.entries_;
+   for (auto& entry : entries)
+   {
+      if (entry.envId_ == envId)
+         return entry.info_;
+   }
+
+   //first tx from this thread on this env, register it
+   auto infoPtr = std::make_shared<LMDBThreadTxInfo>();
+   {
+      std::unique_lock<std::mutex> lock(threadTxMutex_);
+      releaseIdleReadTxns(false);
+      txForThreads_.push_back(infoPtr);
+   }
+
+   //drop entries for closed envs
+   entries.erase(std::remove_if(entries.begin(), entries.end(),
+      [](const ThreadTxCache::Entry& entry)->bool
+      {
+         return entry.ref_.expired();
+      }), entries.end());
+
+   entries.push_back({ envId, infoPtr.get(), infoPtr });
+   return infoPtr.get();
+}
+
+void LMDBEnv::releaseIdleReadTxns(bool releaseAll)
+{
+   auto iter = txForThreads_.begin();
+   while (iter != txForThreads_.end())
+   {
+      auto& thTx = **iter;
+      bool orphaned = thTx.orphaned_.load(std::memory_order_acquire);
+      if (releaseAll || orphaned)
+      {
+         auto txn = thTx.idleReadTxn_.exchange(
+            nullptr, std::memory_order_acq_rel);
+         if (txn != nullptr)
+            mdb_txn_abort(txn);
+      }
+
+      if (orphaned && thTx.transactionLevel_ == 0)
+      {
+         iter = txForThreads_.erase(iter);
+         continue;
+      }
+
+      ++iter;
+   }
+}
+
 void LMDBEnv::setMapSize(size_t sz)
 {
    auto rc = mdb_env_set_mapsize(dbenv, sz);
@@ -406,6 +523,208 @@ void LMDBEnv::setMapSize(size_t sz)
    }
 }
 
+void LMDBEnv::setMapHeadroom(size_t headroom, const ResizeCallback& callback)
+{
+   if (!isOpen())
+      throw LMDBException("Cannot size map without db env");
+
+   std::unique_lock<std::mutex> lock(growMutex_);
+   mapHeadroom_ = headroom;
+   resizeCallback_ = callback;
+   if (headroom == 0)
+      return;
+
+   LMDBResizeEvent event;
+   MDB_envinfo info;
+   auto rc = mdb_env_info(dbenv, &info);
+   if (rc != MDB_SUCCESS)
+      throw LMDBException("Failed to read env info (" + errorString(rc) + ")");
+
+   event.from_ = info.me_mapsize;
+   event.used_ = getUsedSize();
+   auto newSize = event.used_ + 2 * headroom;
+   newSize = (newSize + LMDB_MAP_ROUNDING - 1) / 
+      LMDB_MAP_ROUNDING * LMDB_MAP_ROUNDING;
+   if (newSize == event.from_)
+      return;
+
+   //if txns are in the way, the next write takes care of it
+   resizeMap(newSize, event, 1);
+   if (!event.error_.empty())
+      throw LMDBException(event.error_);
+}
+
+LMDBEnv::MapStats LMDBEnv::getMapStats()
+{
+   std::unique_lock<std::mutex> lock(growMutex_);
+   auto stats = mapStats_;
+   if (isOpen())
+   {
+      MDB_envinfo info;
+      if (mdb_env_info(dbenv, &info) == MDB_SUCCESS)
+         stats.mapSize_ = info.me_mapsize;
+      stats.usedSize_ = getUsedSize();
+   }
+
+   return stats;
+}
+
+size_t LMDBEnv::getUsedSize() const
+{
+   MDB_envinfo info;
+   if (mdb_env_info(dbenv, &info) != MDB_SUCCESS)
+      return 0;
+
+   return (info.me_last_pgno + 1) * pageSize_;
+}
+
+void LMDBEnv::enterTx()
+{
+   while (true)
+   {
+      activeTxCount_.fetch_add(1);
+      if (!resizePending_.load())
+         return;
+
+      //a resize is waiting on the open txns, step aside until it's done
+      leaveTx();
+      std::unique_lock<std::mutex> lock(resizeMutex_);
+      resizeCv_.wait(lock, [this](void)->bool
+      {
+         return !resizePending_.load();
+      });
+   }
+}
+
+void LMDBEnv::leaveTx()
+{
+   if (activeTxCount_.fetch_sub(1) == 1 && resizePending_.load())
+   {
+      std::unique_lock<std::mutex> lock(resizeMutex_);
+      resizeCv_.notify_all();
+   }
+}
+
+void LMDBEnv::reserve(size_t writeSize)
+{
+   //can't resize under our own txn
+   auto thTx = getThreadTxInfo();
+   if (thTx == nullptr || thTx->transactionLevel_ != 0)
+      return;
+
+   growMap(writeSize, false);
+}
+
+void LMDBEnv::growMap(size_t writeSize, bool mapFull)
+{
+   std::unique_lock<std::mutex> lock(growMutex_);
+   if (mapFull)
+      ++mapStats_.mapFullCount_;
+
+   if (mapHeadroom_ == 0)
+      return;
+
+   MDB_envinfo info;
+   if (mdb_env_info(dbenv, &info) != MDB_SUCCESS)
+      return;
+
+   LMDBResizeEvent event;
+   event.from_ = info.me_mapsize;
+   event.used_ = getUsedSize();
+   event.mapFull_ = mapFull;
+
+   //pages are copied on write, a txn can take twice the size it writes
+   auto room = std::max(mapHeadroom_, 2 * writeSize);
+
+   /*
+   A write that won't fit has to wait on the resize. Headroom top ups take
+   a single attempt and back off if txns are in the way, so that a long
+   lived reader doesn't get every write to hold back the others.
+   */
+   auto mustGrow = mapFull || event.used_ + 2 * writeSize > event.from_;
+   auto now = std::chrono::steady_clock::now();
+   if (!mustGrow && 
+      (event.used_ + room <= event.from_ || now < retryResizeAt_))
+      return;
+
+   //geometric growth keeps the resize count logarithmic in the db size
+   auto newSize = std::max(
+      event.from_ + event.from_ / 2, event.used_ + 2 * room);
+   newSize = (newSize + LMDB_MAP_ROUNDING - 1) / 
+      LMDB_MAP_ROUNDING * LMDB_MAP_ROUNDING;
+
+   if (!resizeMap(newSize, event, mustGrow ? LMDB_RESIZE_ATTEMPTS : 1))
+   {
+      retryResizeAt_ = now + 
+         std::chrono::milliseconds(LMDB_RESIZE_BACKOFF_MS);
+   }
+}
+
+bool LMDBEnv::resizeMap(
+   size_t newSize, LMDBResizeEvent& event, unsigned attempts)
+{
+   int rc = MDB_SUCCESS;
+   for (unsigned i = 0; i < attempts && !event.done_; i++)
+   {
+      //let the txns held back by the last attempt through first
+      if (i > 0)
+      {
+         std::this_thread::sleep_for(
+            std::chrono::milliseconds(LMDB_RESIZE_DRAIN_MS));
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      {
+         std::unique_lock<std::mutex> lock(resizeMutex_);
+         resizePending_.store(true);
+         event.done_ = resizeCv_.wait_for(lock, 
+            std::chrono::milliseconds(LMDB_RESIZE_DRAIN_MS),
+            [this](void)->bool
+            {
+               return activeTxCount_.load() == 0;
+            });
+
+         if (event.done_)
+            rc = mdb_env_set_mapsize(dbenv, newSize);
+
+         resizePending_.store(false);
+      }
+      resizeCv_.notify_all();
+
+      std::chrono::duration<double> pause = 
+         std::chrono::steady_clock::now() - start;
+      event.pause_ += pause.count();
+      ++event.attempts_;
+   }
+
+   if (rc != MDB_SUCCESS)
+   {
+      event.done_ = false;
+      event.error_ = "Failed to resize map (" + errorString(rc) + ")";
+   }
+
+   MDB_envinfo info;
+   if (event.done_ && mdb_env_info(dbenv, &info) == MDB_SUCCESS)
+      event.to_ = info.me_mapsize;
+   else
+      event.to_ = event.from_;
+
+   if (event.done_)
+      resizeGen_.fetch_add(1);
+
+   mapStats_.pauseTime_ += event.pause_;
+   mapStats_.maxPause_ = std::max(mapStats_.maxPause_, event.pause_);
+   if (event.done_)
+      ++mapStats_.resizeCount_;
+   else
+      ++mapStats_.skippedResizes_;
+
+   if (resizeCallback_)
+      resizeCallback_(filename_, event);
+
+   return event.done_;
+}
+
 void LMDBEnv::compactCopy(const std::string& fname)
 {
    auto rc = mdb_env_copy2(dbenv, fname.c_str(), MDB_CP_COMPACT);
@@ -419,6 +738,18 @@ void LMDBEnv::compactCopy(const std::string& fname)
    }
 }
 
+void LMDBEnv::copy(const std::string& fname)
+{
+   auto rc = mdb_env_copy2(dbenv, fname.c_str(), 0);
+   if (rc != MDB_SUCCESS)
+   {
+      std::stringstream ss;
+      ss << "failed to copy env to " << fname << 
+         ", returned following error string: " << errorString(rc);
+      throw LMDBException(ss.str());
+   }
+}
+
 
 LMDBEnv::Transaction::Transaction(LMDBEnv *_env, LMDB::Mode mode)
    : env(_env), mode_(mode)
@@ -470,22 +801,25 @@ void LMDBEnv::Transaction::begin()
    if (began)
       return;
    
-   began = true;
-
-   auto tID = std::this_thread::get_id();
-   
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-   LMDBThreadTxInfo& thTx = env->txForThreads_[tID];
-   lock.unlock();
+   auto thTxPtr = env->getThreadTxInfo();
+   if (thTxPtr == nullptr)
+      throw LMDBException("Cannot start transaction without db env");
+   LMDBThreadTxInfo& thTx = *thTxPtr;
    
    if (thTx.transactionLevel_ != 0 && mode_ == LMDB::ReadWrite && thTx.mode_ == LMDB::ReadOnly)
       throw LMDBException("Cannot access ReadOnly Transaction in ReadWrite mode");
    
+   began = true;
    if (thTx.transactionLevel_++ != 0)
       return;
-      
-   if (!env->dbenv)
-      throw LMDBException("Cannot start transaction without db env");
+
+   //make room ahead of the write, this thread has no txn open on the env.
+   //Failures go to the resize callback, the write may still fit
+   if (mode_ == LMDB::ReadWrite)
+      env->growMap(0, false);
+
+   env->enterTx();
+   auto resizeGen = env->resizeGen_.load();
       
    int modef = MDB_RDONLY;
    thTx.mode_ = LMDB::ReadOnly;
@@ -495,13 +829,70 @@ void LMDBEnv::Transaction::begin()
       modef = 0;
       thTx.mode_ = LMDB::ReadWrite;
    }
+   else
+   {
+      //reuse the txn from our last read if it is still around
+      auto txn = thTx.idleReadTxn_.exchange(
+         nullptr, std::memory_order_acq_rel);
+      if (txn != nullptr)
+      {
+         if (mdb_txn_renew(txn) == MDB_SUCCESS)
+         {
+            thTx.txn_ = txn;
+            return;
+         }
+
+         //map was resized or the slot is gone, start a fresh one
+         mdb_txn_abort(txn);
+      }
+   }
 
    int rc = mdb_txn_begin(env->dbenv, nullptr, modef, &thTx.txn_);
+   if (rc == MDB_READERS_FULL)
+   {
+      //idle read txns sit on reader slots, free them and try again
+      {
+         std::unique_lock<std::mutex> lock(env->threadTxMutex_);
+         env->releaseIdleReadTxns(true);
+      }
+      rc = mdb_txn_begin(env->dbenv, nullptr, modef, &thTx.txn_);
+   }
+
+   /*
+   Another process grew the map past ours, adopt its size. This drains the
+   txns open in this process and holds back new ones for a few ms per
+   attempt, readers don't have to go idle. Threads that ran into it at the
+   same time find the map already adopted and just try again. A failed
+   adoption (txns held open past every attempt) is reported by the last
+   begin.
+   */
+   for (unsigned i = 0; 
+      rc == MDB_MAP_RESIZED && i < LMDB_RESIZE_ADOPT_TRIES; i++)
+   {
+      env->leaveTx();
+      {
+         std::unique_lock<std::mutex> lock(env->growMutex_);
+         if (env->resizeGen_.load() == resizeGen)
+         {
+            LMDBResizeEvent event;
+            event.used_ = env->getUsedSize();
+            MDB_envinfo info;
+            if (mdb_env_info(env->dbenv, &info) == MDB_SUCCESS)
+               event.from_ = info.me_mapsize;
+            env->resizeMap(0, event, LMDB_RESIZE_ATTEMPTS);
+         }
+
+         resizeGen = env->resizeGen_.load();
+      }
+      env->enterTx();
+      rc = mdb_txn_begin(env->dbenv, nullptr, modef, &thTx.txn_);
+   }
+
    if (rc != MDB_SUCCESS)
    {
-      lock.lock();
-      env->txForThreads_.erase(tID);
-      lock.unlock();
+      env->leaveTx();
+      thTx.txn_ = nullptr;
+      thTx.transactionLevel_ = 0;
       
       began = false;
       throw LMDBException("Failed to create transaction (" + errorString(rc) +")");
@@ -527,33 +918,65 @@ void LMDBEnv::Transaction::commit()
    began=false;
 
    //look for an existing transaction in this thread
-   auto tID = std::this_thread::get_id();
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-   auto txnIter = env->txForThreads_.find(tID);
-
-   if (txnIter == env->txForThreads_.end())
+   auto thTxPtr = env->getThreadTxInfo();
+   if (thTxPtr == nullptr)
       throw LMDBException("Transaction bound to unknown thread");
-   lock.unlock();
 
-   LMDBThreadTxInfo& thTx = txnIter->second;
+   LMDBThreadTxInfo& thTx = *thTxPtr;
 
    if (thTx.transactionLevel_-- == 1)
    {
-      int rc = mdb_txn_commit(thTx.txn_);
-      
+      //cursors do not outlive the txn, iterators reopen theirs on next use
       for (LMDB::Iterator *i : thTx.iterators_)
       {
+         if (i->csr_ != nullptr)
+            mdb_cursor_close(i->csr_);
+
          i->hasTx=false;
          i->csr_=nullptr;
       }
-      
+      thTx.iterators_.clear();
+
+      auto txn = thTx.txn_;
+      thTx.txn_ = nullptr;
+
+      if (thTx.mode_ == LMDB::ReadOnly)
+      {
+         //keep the txn handle and its reader slot for the next read
+         mdb_txn_reset(txn);
+         auto prevTxn = thTx.idleReadTxn_.exchange(
+            txn, std::memory_order_acq_rel);
+         if (prevTxn != nullptr)
+            mdb_txn_abort(prevTxn);
+         env->leaveTx();
+         return;
+      }
+
+      if (thTx.mapFull_)
+      {
+         //the write that filled the map threw already, drop the txn and
+         //make room for the retry
+         thTx.mapFull_ = false;
+         mdb_txn_abort(txn);
+         env->leaveTx();
+         env->growMap(0, true);
+         return;
+      }
+
+      int rc = mdb_txn_commit(txn);
+      env->leaveTx();
+      if (rc == MDB_MAP_FULL)
+      {
+         //commit frees the txn on failure
+         env->growMap(0, true);
+         throw LMDBMapFullException(
+            "Failed to close env tx (" + errorString(rc) +")");
+      }
+
       if (rc != MDB_SUCCESS)
       {
          throw LMDBException("Failed to close env tx (" + errorString(rc) +")");
       }
-      
-      lock.lock();
-      env->txForThreads_.erase(txnIter);
    }
 }
 
@@ -581,8 +1004,11 @@ void LMDB::close()
    {
       {
          std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-         if (!env->txForThreads_.empty())
-            throw std::runtime_error("Tried to close database with open txes");
+         for (auto& thTx : env->txForThreads_)
+         {
+            if (thTx->transactionLevel_ != 0)
+               throw std::runtime_error("Tried to close database with open txes");
+         }
       }
       mdb_dbi_close(env->dbenv, dbi);
       dbi=0;
@@ -603,17 +1029,40 @@ void LMDB::open(LMDBEnv *_env, const std::string &name)
       throw LMDBException("LMDB already open");
    }
    this->env = _env;
+
+   if (_env->isReadOnly())
+   {
+      /*
+      dbi handles opened in a read txn only outlive it if it is committed,
+      while Transaction resets read txns for reuse. Go through a txn of
+      our own. The db has to exist already.
+      */
+      MDB_txn* txn = nullptr;
+      int rc = mdb_txn_begin(_env->dbenv, nullptr, MDB_RDONLY, &txn);
+      if (rc == MDB_SUCCESS)
+      {
+         rc = mdb_open(txn, name.c_str(), 0, &dbi);
+         if (rc == MDB_SUCCESS)
+            rc = mdb_txn_commit(txn);
+         else
+            mdb_txn_abort(txn);
+      }
+
+      if (rc != MDB_SUCCESS)
+      {
+         this->env = nullptr;
+         throw LMDBException("Failed to open dbi (" + errorString(rc) +")");
+      }
+
+      return;
+   }
    
    LMDBEnv::Transaction tx(_env);
-   auto tID = std::this_thread::get_id();
-   std::unique_lock<std::mutex> lock(_env->threadTxMutex_);
-   auto txnIter = _env->txForThreads_.find(tID);
-
-   if (txnIter == _env->txForThreads_.end())
+   auto thTx = _env->getThreadTxInfo();
+   if (thTx == nullptr || thTx->transactionLevel_ == 0)
       throw LMDBException("Failed to insert: need transaction");
-   lock.unlock();
       
-   int rc = mdb_open(txnIter->second.txn_, name.c_str(), MDB_CREATE, &dbi);
+   int rc = mdb_open(thTx->txn_, name.c_str(), MDB_CREATE, &dbi);
    if (rc != MDB_SUCCESS)
    {
       // cleanup here
@@ -629,37 +1078,64 @@ void LMDB::insert(
    MDB_val mkey = { key.len, const_cast<char*>(key.data) };
    MDB_val mval = { value.len, const_cast<char*>(value.data) };
 
-   auto tID = std::this_thread::get_id();
-
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-
-   auto txnIter = env->txForThreads_.find(tID);
-
-   if (txnIter == env->txForThreads_.end())
+   auto thTx = env->getThreadTxInfo();
+   if (thTx == nullptr || thTx->transactionLevel_ == 0)
       throw LMDBException("Failed to insert: need transaction");
-   lock.unlock();
 
-   int rc = mdb_put(txnIter->second.txn_, dbi, &mkey, &mval, 0);
+   int rc = mdb_put(thTx->txn_, dbi, &mkey, &mval, 0);
    if (rc == MDB_SUCCESS)
       return;
 
+   if (rc == MDB_MAP_FULL)
+   {
+      thTx->mapFull_ = true;
+      throw LMDBMapFullException("Failed to insert (" + errorString(rc) + ")");
+   }
+
    std::cout << "failed to insert data, returned following error string: " <<
       errorString(rc) << std::endl;
    throw LMDBException("Failed to insert (" + errorString(rc) + ")");
 }
 
-void LMDB::erase(const CharacterArrayRef& key)
+void LMDB::append(
+   const CharacterArrayRef& key,
+   const CharacterArrayRef& value
+)
 {
-   auto tID = std::this_thread::get_id();
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-   auto txnIter = env->txForThreads_.find(tID);
+   MDB_val mkey = { key.len, const_cast<char*>(key.data) };
+   MDB_val mval = { value.len, const_cast<char*>(value.data) };
+
+   auto thTx = env->getThreadTxInfo();
+   if (thTx == nullptr || thTx->transactionLevel_ == 0)
+      throw LMDBException("Failed to append: need transaction");
+
+   int rc = mdb_put(thTx->txn_, dbi, &mkey, &mval, MDB_APPEND);
+   if (rc == MDB_SUCCESS)
+      return;
+
+   if (rc == MDB_MAP_FULL)
+   {
+      thTx->mapFull_ = true;
+      throw LMDBMapFullException("Failed to append (" + errorString(rc) + ")");
+   }
 
-   if (txnIter == env->txForThreads_.end())
+   throw LMDBException("Failed to append (" + errorString(rc) + ")");
+}
+
+void LMDB::erase(const CharacterArrayRef& key)
+{
+   auto thTx = env->getThreadTxInfo();
+   if (thTx == nullptr || thTx->transactionLevel_ == 0)
       throw LMDBException("Failed to insert: need transaction");
-   lock.unlock();
       
    MDB_val mkey = { key.len, const_cast<char*>(key.data) };
-   int rc = mdb_del(txnIter->second.txn_, dbi, &mkey, 0);
+   int rc = mdb_del(thTx->txn_, dbi, &mkey, 0);
+   if (rc == MDB_MAP_FULL)
+   {
+      thTx->mapFull_ = true;
+      throw LMDBMapFullException("Failed to erase (" + errorString(rc) + ")");
+   }
+
    if (rc != MDB_SUCCESS && rc != MDB_NOTFOUND)
    {
       std::cout << "failed to erase data, returned following error string: " << errorString(rc) << std::endl;
@@ -669,13 +1145,9 @@ void LMDB::erase(const CharacterArrayRef& key)
 
 void LMDB::wipe(const CharacterArrayRef& key)
 {
-   auto tID = std::this_thread::get_id();
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-   auto txnIter = env->txForThreads_.find(tID);
-
-   if (txnIter == env->txForThreads_.end())
+   auto thTx = env->getThreadTxInfo();
+   if (thTx == nullptr || thTx->transactionLevel_ == 0)
       throw LMDBException("Failed to insert: need transaction");
-   lock.unlock();
 
    try
    {
@@ -690,7 +1162,13 @@ void LMDB::wipe(const CharacterArrayRef& key)
    }   
 
    MDB_val mkey = { key.len, const_cast<char*>(key.data) };
-   int rc = mdb_del(txnIter->second.txn_, dbi, &mkey, 0); // , MDB_WIPE_DATA);
+   int rc = mdb_del(thTx->txn_, dbi, &mkey, 0); // , MDB_WIPE_DATA);
+   if (rc == MDB_MAP_FULL)
+   {
+      thTx->mapFull_ = true;
+      throw LMDBMapFullException("Failed to erase (" + errorString(rc) + ")");
+   }
+
    if (rc != MDB_SUCCESS && rc != MDB_NOTFOUND)
    {
       std::cout << "failed to erase data, returned following error string: " << errorString(rc) << std::endl;
@@ -712,23 +1190,14 @@ CharacterArrayRef LMDB::get_NoCopy(const CharacterArrayRef& key) const
 {
    //simple get without the use of iterators
 
-   auto tID = std::this_thread::get_id();
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-   
-   auto txnIter = env->txForThreads_.find(tID);
-   if (txnIter == env->txForThreads_.end())
+   auto thTx = env->getThreadTxInfo();
+   if (thTx == nullptr || thTx->transactionLevel_ == 0)
       throw std::runtime_error("Need transaction to get data");
-   
-   /*
-   TODO: this is slow, set get routines within the tx directly to avoid 
-   locking the txmap
-   */
-   lock.unlock(); 
 
    MDB_val mkey = { key.len, const_cast<char*>(key.data) };
    MDB_val mdata = { 0, 0 };
 
-   int rc = mdb_get(txnIter->second.txn_, dbi, &mkey, &mdata);
+   int rc = mdb_get(thTx->txn_, dbi, &mkey, &mdata);
    if (rc == MDB_NOTFOUND)
       return CharacterArrayRef(0, (char*)nullptr);
    
@@ -741,16 +1210,11 @@ CharacterArrayRef LMDB::get_NoCopy(const CharacterArrayRef& key) const
 
 void LMDB::drop(void)
 {
-   auto tID = std::this_thread::get_id();
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-
-   auto txnIter = env->txForThreads_.find(tID);
-   if (txnIter == env->txForThreads_.end())
+   auto thTx = env->getThreadTxInfo();
+   if (thTx == nullptr || thTx->transactionLevel_ == 0)
       throw std::runtime_error("Need transaction to get data");
 
-   lock.unlock();
-
-   if (mdb_drop(txnIter->second.txn_, dbi, 0) != MDB_SUCCESS)
+   if (mdb_drop(thTx->txn_, dbi, 0) != MDB_SUCCESS)
       throw std::runtime_error("Failed to drop DB!");
 }
 
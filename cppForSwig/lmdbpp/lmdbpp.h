@@ -8,12 +8,18 @@
 #ifndef LMDBPP_H
 #define LMDBPP_H
 
+#include <cstdint>
 #include <string>
 #include <stdexcept>
 #include <vector>
 #include <unordered_map>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include "lmdb.h"
 
 struct MDB_env;
@@ -38,6 +44,16 @@ public:
 
 };
 
+// a write ran out of map space. The txn is aborted on commit and the map
+// grown, the write can be tried again in a new txn
+class LMDBMapFullException : public LMDBException
+{
+public:
+   LMDBMapFullException(const std::string &what)
+      : LMDBException(what)
+   { }
+};
+
 // a class that stores a pointer to a memory block
 class CharacterArrayRef
 {
@@ -194,6 +210,14 @@ public:
       const CharacterArrayRef& value
    );
    
+   // insert a value with a key past the last key in the database,
+   // skipping the btree descent. Throws (MDB_KEYEXIST) if the key
+   // is not the new last key
+   void append(
+      const CharacterArrayRef& key,
+      const CharacterArrayRef& value
+   );
+
    // delete the entry with the given key, doing nothing
    // if such a key does not exist
    void erase(const CharacterArrayRef& key);
@@ -240,7 +264,6 @@ public:
 private:
 
    LMDB(const LMDB &nocopy);
-   void resize(MDB_env*);
 };
 
 struct LMDBThreadTxInfo
@@ -248,23 +271,112 @@ struct LMDBThreadTxInfo
    MDB_txn *txn_=nullptr;
 
    std::vector<LMDB::Iterator*> iterators_;
-   unsigned transactionLevel_=0;
+   std::atomic<unsigned> transactionLevel_{0};
    LMDB::Mode mode_;
+
+   // read-only txn reset at the end of the last read, renewed by the next
+   // one. Another thread may reclaim it, hence the atomic
+   std::atomic<MDB_txn*> idleReadTxn_{nullptr};
+
+   // set when the owning thread exits
+   std::atomic<bool> orphaned_{false};
+
+   // a write in the open txn hit MDB_MAP_FULL, the txn can only be aborted
+   bool mapFull_ = false;
 };
 
 
+// how long a resize attempt holds back new txns waiting on the open ones
+#define LMDB_RESIZE_DRAIN_MS 50
+
+// attempts for resizes that can't be put off (a write filled the map),
+// txns run freely for LMDB_RESIZE_DRAIN_MS between attempts
+#define LMDB_RESIZE_ATTEMPTS 20
+
+// a skipped headroom resize isn't tried again before this, so that long
+// lived txns don't have every write hold back the readers
+#define LMDB_RESIZE_BACKOFF_MS 1000
+
+// a txn begin that finds the map grown by another process adopts the new
+// size at most this many times before giving up, each adoption takes up
+// to LMDB_RESIZE_ATTEMPTS attempts
+#define LMDB_RESIZE_ADOPT_TRIES 3
+
+// sizes are rounded up to this
+#define LMDB_MAP_ROUNDING (1024 * 1024ULL)
+
+struct LMDBResizeEvent
+{
+   size_t from_ = 0;
+   size_t to_ = 0;
+   size_t used_ = 0;
+
+   // seconds new txns were held back, over all attempts
+   double pause_ = 0;
+   unsigned attempts_ = 0;
+
+   // false if the open txns did not clear in any of the attempts or the
+   // resize failed (error_ is set), the next write tries again
+   bool done_ = false;
+
+   // forced by a write that filled the map
+   bool mapFull_ = false;
+
+   std::string error_;
+};
+
 class LMDBEnv
 {
 public:
    class Transaction;
 
+   struct MapStats
+   {
+      size_t mapSize_ = 0;
+      size_t usedSize_ = 0;
+      unsigned resizeCount_ = 0;
+      unsigned skippedResizes_ = 0;
+      unsigned mapFullCount_ = 0;
+      double pauseTime_ = 0;
+      double maxPause_ = 0;
+   };
+
+   typedef std::function<void(const std::string&, const LMDBResizeEvent&)> 
+      ResizeCallback;
+
 private:
    MDB_env *dbenv=nullptr;
    unsigned dbCount_ = 1;
+   size_t pageSize_ = 0;
 
    std::string filename_;
+
+   // unique per open(), 0 while closed. Threads find their tx info through
+   // a thread local cache keyed by this id, the mutex below is only taken
+   // on a thread's first tx with this env and on close
+   std::atomic<uint64_t> envId_{0};
+
    std::mutex threadTxMutex_;
-   std::unordered_map<std::thread::id, LMDBThreadTxInfo> txForThreads_;
+   std::vector<std::shared_ptr<LMDBThreadTxInfo>> txForThreads_;
+
+   // The map can only be resized with no txn open in this process. Top
+   // level txns are counted in and out of activeTxCount_, a resize flags
+   // resizePending_ to hold back new ones and waits for the count to drop
+   std::atomic<unsigned> activeTxCount_{0};
+   std::atomic<bool> resizePending_{false};
+   std::mutex resizeMutex_;
+   std::condition_variable resizeCv_;
+
+   // bumped by every completed resize. Threads that hit MDB_MAP_RESIZED
+   // together only have the first one adopt the new size
+   std::atomic<unsigned> resizeGen_{0};
+
+   // serializes resizes, guards the members below
+   std::mutex growMutex_;
+   size_t mapHeadroom_ = 0;
+   MapStats mapStats_;
+   ResizeCallback resizeCallback_;
+   std::chrono::steady_clock::time_point retryResizeAt_;
    
    friend class LMDB;
 
@@ -318,15 +430,56 @@ public:
 
    bool isOpen(void) const;
 
+   // opened with MDB_RDONLY. Dbs open without MDB_CREATE, writes fail
+   bool isReadOnly(void) const;
+
    // close a database, doing nothing if one is presently not open
    void close();
 
    const std::string& getFilename(void) const { return filename_; }
    void setMapSize(size_t);
    void compactCopy(const std::string& fname);
+
+   // page for page copy, mdb_env_copyfd2 streams the pages from the map
+   // to the new file under a read txn of its own. fname must not exist
+   void copy(const std::string& fname);
+
+   // Grow the map online rather than reserving its final size up front.
+   // Sizes the map to the data in use plus twice the headroom. A write txn
+   // that begins with less than headroom left grows it by half, or to the
+   // data in use plus twice the headroom if that is more. A write that
+   // fills the map anyway throws LMDBMapFullException, its txn is aborted
+   // and the map grown so that the caller can retry it. 0 turns it off
+   void setMapHeadroom(size_t headroom, 
+      const ResizeCallback& callback = nullptr);
+   MapStats getMapStats(void);
+
+   // Grows the map ahead of a write txn of about writeSize bytes, if the
+   // headroom doesn't cover it. No-op if the calling thread has a txn open
+   // on the env
+   void reserve(size_t writeSize);
    
 private:
    LMDBEnv(const LMDBEnv&); // disallow copy
+
+   void enterTx(void);
+   void leaveTx(void);
+
+   size_t getUsedSize(void) const;
+
+   // mapFull forces the resize, the caller's write can't go through without
+   void growMap(size_t writeSize, bool mapFull);
+
+   // caller holds growMutex_. Returns false if the open txns did not clear
+   // in time or the resize failed, does not throw
+   bool resizeMap(size_t newSize, LMDBResizeEvent&, unsigned attempts);
+
+   // tx info for the calling thread, nullptr if the env is closed
+   LMDBThreadTxInfo* getThreadTxInfo(void);
+
+   // aborts idle read txns of exited threads (all threads if releaseAll)
+   // and drops the exited threads' tx info. Caller holds threadTxMutex_
+   void releaseIdleReadTxns(bool releaseAll);
 };
 
 
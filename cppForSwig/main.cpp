@@ -62,7 +62,11 @@ int main(int argc, char* argv[])
    DBSettings::setServiceType(SERVICE_WEBSOCKET);
    BlockDataManagerThread bdmThread;
 
-   if (!DBSettings::checkChain())
+   //chain checks and budgeted builds exit once the db is up, no service
+   bool buildOnly =
+      DBSettings::checkChain() || DBSettings::buildBudget() > 0;
+
+   if (!buildOnly)
    {
       //check we can listen on this ip:port
       if (SimpleSocket::checkSocket("127.0.0.1", NetworkSettings::listenPort()))
@@ -87,7 +91,7 @@ int main(int argc, char* argv[])
    //start up blockchain service
    bdmThread.start(DBSettings::initMode());
 
-   if (!DBSettings::checkChain())
+   if (!buildOnly)
    {
       //start websocket server
       WebSocketServer::start(&bdmThread, false);
@@ -104,5 +108,9 @@ int main(int argc, char* argv[])
    shutdownBIP151CTX();
    CryptoECDSA::shutdown();
 
+   //tell a paused build from a finished one, scripts rerun on this
+   if (bdmThread.buildPaused())
+      return BUILD_PAUSED_EXIT_CODE;
+
    return 0;
 }